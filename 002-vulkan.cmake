@@ -10,6 +10,7 @@ set(_HEADER_DIRS
         "$ENV{VULKAN_SDK_PATH}/macOS/include"
         "$ENV{GLFW_SDK_PATH}/include"
         "${_SOURCE_DIR}"
+        "${_SHADER_OUTPUT_DIR}"
 )
 
 set(_LIBRARY_DIRS
@@ -27,11 +28,12 @@ file(GLOB _SOURCE_FILES
         "${_TARGET_DIR}/${_OS_NAME}/*.cc"
 )
 
+# VK_EXT_mesh_shader (headers and glslang) needs the Vulkan SDK 1.3.226 or later.
 set(_LIBRARY_FILES
         "glfw3"
         "libvulkan.dylib"
         "libvulkan.1.dylib"
-        "libvulkan.1.2.198.dylib"
+        "libvulkan.1.3.280.dylib"
 )
 
 message("_HEADER_DIRS = ${_HEADER_DIRS}")
@@ -44,6 +46,7 @@ add_executable(${_TARGET_NAME} ${_HEADER_FILES} ${_SOURCE_FILES})
 target_include_directories(${_TARGET_NAME} PRIVATE ${_HEADER_DIRS})
 target_link_directories(${_TARGET_NAME} PRIVATE ${_LIBRARY_DIRS})
 target_link_libraries(${_TARGET_NAME} ${_LIBRARY_FILES})
+add_dependencies(${_TARGET_NAME} shaders)
 
 
 install(FILES ${_HEADER_FILES} DESTINATION include/${TARGET_NAME})
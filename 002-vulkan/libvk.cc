@@ -1,5 +1,10 @@
 
 #include "libvk.h"
+#include "libvk_capture.h"
+#include "libvk_postprocess.h"
+#include "libvk_profiler.h"
+#include "libvk_renderqueue.h"
+#include <cctype>
 #include <iostream>
 
 static VkBool32 VKAPI_PTR globalDebugCallback(
@@ -27,7 +32,7 @@ VulkanSwapchain VulkanLogicalDevice::createSwapchain(const VulkanSwapchainArgs&
     sci.imageColorSpace = args.format.colorSpace;
     sci.imageExtent = args.extent;
     sci.imageArrayLayers = 1;
-    sci.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+    sci.imageUsage = args.imageUsage;
 
     uint32_t indices[] = {
         args.queueFamilyIndices.graphicsQueueFamilyIndex,
@@ -52,10 +57,10 @@ VulkanSwapchain VulkanLogicalDevice::createSwapchain(const VulkanSwapchainArgs&
     sci.presentMode = args.presentMode;
     sci.clipped = VK_TRUE;
 
-    sci.oldSwapchain = VK_NULL_HANDLE;
+    sci.oldSwapchain = args.oldSwapchain;
 
     VulkanSwapchain swapchain = {};
-    if (VK_SUCCESS != vkCreateSwapchainKHR(device, &sci, nullptr, &swapchain.handle))
+    if (VK_SUCCESS != vkCreateSwapchainKHR(device, &sci, nullptr, swapchain.handle.put(device)))
     {
         throw std::runtime_error("create swapchain failed.");
     }
@@ -89,7 +94,7 @@ VulkanSwapchain VulkanLogicalDevice::createSwapchain(const VulkanSwapchainArgs&
         ivci.subresourceRange.baseArrayLayer = 0;
         ivci.subresourceRange.layerCount = 1;
 
-        if (VK_SUCCESS != vkCreateImageView(device, &ivci, nullptr, &swapchain.imageViews[i]))
+        if (VK_SUCCESS != vkCreateImageView(device, &ivci, nullptr, swapchain.imageViews[i].put(device)))
         {
             throw std::runtime_error("create image-view for swapchain failed.");
         }
@@ -100,31 +105,194 @@ VulkanSwapchain VulkanLogicalDevice::createSwapchain(const VulkanSwapchainArgs&
 
 void VulkanLogicalDevice::destroySwapchain(VulkanSwapchain& swapchain) const
 {
-    for (auto& imageView : swapchain.imageViews)
+    swapchain.imageViews.clear();
+    swapchain.images.clear();
+    swapchain.handle.reset();
+}
+
+uint32_t VulkanLogicalDevice::findMemoryType(
+    uint32_t typeBits,
+    VkMemoryPropertyFlags required,
+    VkMemoryPropertyFlags preferred) const
+{
+    VkMemoryPropertyFlags wanted = required | preferred;
+    for (uint32_t i = 0; i < memoryProps.memoryTypeCount; i++)
     {
-        if (imageView != nullptr)
+        if ((typeBits & (1u << i)) && (memoryProps.memoryTypes[i].propertyFlags & wanted) == wanted)
+            return i;
+    }
+    for (uint32_t i = 0; i < memoryProps.memoryTypeCount; i++)
+    {
+        if ((typeBits & (1u << i)) && (memoryProps.memoryTypes[i].propertyFlags & required) == required)
+            return i;
+    }
+    throw std::runtime_error("no suitable memory type.");
+}
+
+VulkanMemoryBudget VulkanLogicalDevice::queryMemoryBudget() const
+{
+    VulkanMemoryBudget ret;
+    if (memoryBudgetSupported)
+    {
+        VkPhysicalDeviceMemoryBudgetPropertiesEXT budget = {};
+        budget.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+        budget.pNext = nullptr;
+
+        VkPhysicalDeviceMemoryProperties2 props = {};
+        props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+        props.pNext = &budget;
+        vkGetPhysicalDeviceMemoryProperties2(physicalDevice, &props);
+
+        for (uint32_t i = 0; i < memoryProps.memoryHeapCount; i++)
         {
-            vkDestroyImageView(device, imageView, nullptr);
-            imageView = nullptr;
+            ret.budget[i] = budget.heapBudget[i];
+            ret.usage[i] = budget.heapUsage[i];
         }
+        ret.reported = true;
+        return ret;
     }
-    if (swapchain.handle != nullptr)
+
+    // the driver does not tell: leave a fifth of each heap to other processes.
+    for (uint32_t i = 0; i < memoryProps.memoryHeapCount; i++)
+        ret.budget[i] = memoryProps.memoryHeaps[i].size / 5 * 4;
+    return ret;
+}
+
+VulkanBuffer VulkanLogicalDevice::createBuffer(const VulkanBufferArgs& args) const
+{
+    VkBufferCreateInfo bci = {};
+    bci.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bci.pNext = nullptr;
+    bci.size = args.size;
+    bci.usage = args.usage;
+    bci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    VulkanBuffer buffer = {};
+    buffer.size = args.size;
+    if (VK_SUCCESS != vkCreateBuffer(device, &bci, nullptr, buffer.handle.put(device)))
+    {
+        throw std::runtime_error("Create buffer failed.");
+    }
+
+    VkMemoryRequirements requirements;
+    vkGetBufferMemoryRequirements(device, buffer.handle, &requirements);
+
+    VkMemoryAllocateInfo mai = {};
+    mai.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    mai.pNext = nullptr;
+    mai.allocationSize = requirements.size;
+    mai.memoryTypeIndex = this->findMemoryType(
+        requirements.memoryTypeBits, args.memoryProps, args.preferredMemoryProps);
+    buffer.memoryFlags = memoryProps.memoryTypes[mai.memoryTypeIndex].propertyFlags;
+
+    if (VK_SUCCESS != vkAllocateMemory(device, &mai, nullptr, buffer.memory.put(device)))
+    {
+        throw std::runtime_error("Allocate buffer memory failed.");
+    }
+    vkBindBufferMemory(device, buffer.handle, buffer.memory, 0);
+
+    if (args.mapped && VK_SUCCESS != vkMapMemory(device, buffer.memory, 0, VK_WHOLE_SIZE, 0, &buffer.mapped))
     {
-        vkDestroySwapchainKHR(device, swapchain.handle, nullptr);
-        swapchain.handle = nullptr;
+        throw std::runtime_error("Map buffer memory failed.");
     }
 
+    return buffer;
 }
 
-VkShaderModule VulkanLogicalDevice::createShaderModule(const std::vector<char>& code) const
+void VulkanLogicalDevice::destroyBuffer(VulkanBuffer& buffer) const
+{
+    if (buffer.mapped != nullptr)
+    {
+        vkUnmapMemory(device, buffer.memory);
+        buffer.mapped = nullptr;
+    }
+    buffer.handle.reset();
+    buffer.memory.reset();
+    buffer.size = 0;
+}
+
+VulkanAttachment VulkanLogicalDevice::createAttachment(const VulkanAttachmentArgs& args) const
+{
+    bool depth = (args.usage & VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT) != 0;
+
+    VkImageCreateInfo ici = {};
+    ici.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    ici.pNext = nullptr;
+    ici.imageType = VK_IMAGE_TYPE_2D;
+    ici.format = args.format;
+    ici.extent = { args.extent.width, args.extent.height, 1 };
+    ici.mipLevels = 1;
+    ici.arrayLayers = 1;
+    ici.samples = args.samples;
+    ici.tiling = VK_IMAGE_TILING_OPTIMAL;
+    ici.usage = args.usage | (args.transient ? VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT : 0);
+    ici.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    ici.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    VulkanAttachment attachment = {};
+    attachment.format = args.format;
+    attachment.samples = args.samples;
+    if (VK_SUCCESS != vkCreateImage(device, &ici, nullptr, attachment.image.put(device)))
+    {
+        throw std::runtime_error("Create attachment image failed.");
+    }
+
+    VkMemoryRequirements requirements;
+    vkGetImageMemoryRequirements(device, attachment.image, &requirements);
+
+    VkMemoryAllocateInfo mai = {};
+    mai.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    mai.pNext = nullptr;
+    mai.allocationSize = requirements.size;
+    mai.memoryTypeIndex = this->findMemoryType(requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        args.transient ? VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT : 0);
+    attachment.lazilyAllocated =
+        (memoryProps.memoryTypes[mai.memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT) != 0;
+    if (VK_SUCCESS != vkAllocateMemory(device, &mai, nullptr, attachment.memory.put(device)))
+    {
+        throw std::runtime_error("Allocate attachment memory failed.");
+    }
+    vkBindImageMemory(device, attachment.image, attachment.memory, 0);
+
+    VkImageViewCreateInfo ivci = {};
+    ivci.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    ivci.pNext = nullptr;
+    ivci.image = attachment.image;
+    ivci.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    ivci.format = args.format;
+    ivci.components = {
+        VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY,
+        VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY
+    };
+    ivci.subresourceRange.aspectMask = depth ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
+    ivci.subresourceRange.baseMipLevel = 0;
+    ivci.subresourceRange.levelCount = 1;
+    ivci.subresourceRange.baseArrayLayer = 0;
+    ivci.subresourceRange.layerCount = 1;
+    if (VK_SUCCESS != vkCreateImageView(device, &ivci, nullptr, attachment.view.put(device)))
+    {
+        throw std::runtime_error("Create attachment image-view failed.");
+    }
+
+    return attachment;
+}
+
+void VulkanLogicalDevice::destroyAttachment(VulkanAttachment& attachment) const
+{
+    attachment.view.reset();
+    attachment.image.reset();
+    attachment.memory.reset();
+}
+
+VulkanShaderModuleHandle VulkanLogicalDevice::createShaderModule(const VulkanShaderCode& code) const
 {
     VkShaderModuleCreateInfo smci = {};
     smci.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
     smci.pNext = nullptr;
-    smci.codeSize = code.size();
-    smci.pCode = reinterpret_cast<const uint32_t*>(code.data());
-    VkShaderModule shader;
-    if (VK_SUCCESS != vkCreateShaderModule(device, &smci, nullptr, &shader))
+    smci.codeSize = code.size;
+    smci.pCode = code.code;
+    VulkanShaderModuleHandle shader;
+    if (VK_SUCCESS != vkCreateShaderModule(device, &smci, nullptr, shader.put(device)))
     {
         throw std::runtime_error("create shader module failed.");
     }
@@ -132,44 +300,81 @@ VkShaderModule VulkanLogicalDevice::createShaderModule(const std::vector<char>&
     return shader;
 }
 
-void VulkanLogicalDevice::destroyShaderModule(VkShaderModule shader) const
+void VulkanLogicalDevice::destroyShaderModule(VulkanShaderModuleHandle& shader) const
 {
-    if (shader != nullptr)
-    {
-        vkDestroyShaderModule(device, shader, nullptr);
-    }
+    shader.reset();
 }
 
 VulkanGraphicsPipeline VulkanLogicalDevice::createGraphicsPipeline(const VulkanGraphicsPipelineArgs& args) const
 {
-    VkShaderModule vert = this->createShaderModule(args.vert);
-    VkShaderModule frag = this->createShaderModule(args.frag);
+    VULKAN_PROFILE_ZONE("create graphics pipeline");
+    // on any failure below, the partially built pipeline destroys what it holds.
+    VulkanGraphicsPipeline pipeline = {};
+    bool meshShading = args.mesh.size > 0;
+    if (meshShading && vkCmdDrawMeshTasksEXT == nullptr)
+    {
+        throw std::runtime_error("mesh shaders are not enabled on this device.");
+    }
+    if (meshShading)
+    {
+        if (args.task.size > 0)
+            pipeline.task = this->createShaderModule(args.task);
+        pipeline.mesh = this->createShaderModule(args.mesh);
+    }
+    else
+    {
+        pipeline.vert = this->createShaderModule(args.vert);
+    }
+    pipeline.frag = this->createShaderModule(args.frag);
+    pipeline.viewport = args.viewport;
+    pipeline.scissor = args.scissor;
+    pipeline.samples = args.samples;
+    pipeline.depthFormat = args.depthFormat;
+    bool multisampled = args.samples != VK_SAMPLE_COUNT_1_BIT;
+    bool depth = args.depthFormat != VK_FORMAT_UNDEFINED;
 
     VkPipelineShaderStageCreateInfo vsci = {};
     vsci.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
     vsci.pNext = nullptr;
     vsci.stage = VK_SHADER_STAGE_VERTEX_BIT;
-    vsci.module = vert;
+    vsci.module = pipeline.vert;
     vsci.pName = "main";
 
     VkPipelineShaderStageCreateInfo fsci = {};
     fsci.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
     fsci.pNext = nullptr;
     fsci.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-    fsci.module = frag;
+    fsci.module = pipeline.frag;
     fsci.pName = "main";
 
-    VkPipelineShaderStageCreateInfo shaderStages[] = {
-        vsci, fsci
-    };
+    // mesh shading replaces the vertex stage, optionally behind a task stage.
+    VkPipelineShaderStageCreateInfo shaderStages[3];
+    uint32_t stageCount = 0;
+    if (meshShading)
+    {
+        if (pipeline.task.get() != VK_NULL_HANDLE)
+        {
+            shaderStages[stageCount] = vsci;
+            shaderStages[stageCount].stage = VK_SHADER_STAGE_TASK_BIT_EXT;
+            shaderStages[stageCount++].module = pipeline.task;
+        }
+        shaderStages[stageCount] = vsci;
+        shaderStages[stageCount].stage = VK_SHADER_STAGE_MESH_BIT_EXT;
+        shaderStages[stageCount++].module = pipeline.mesh;
+    }
+    else
+    {
+        shaderStages[stageCount++] = vsci;
+    }
+    shaderStages[stageCount++] = fsci;
 
     VkPipelineVertexInputStateCreateInfo visci = {};
     visci.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
     visci.pNext = nullptr;
-    visci.vertexBindingDescriptionCount = 0;
-    visci.pVertexBindingDescriptions = nullptr;
-    visci.vertexAttributeDescriptionCount = 0;
-    visci.pVertexAttributeDescriptions = nullptr;
+    visci.vertexBindingDescriptionCount = (uint32_t)args.vertexBindings.size();
+    visci.pVertexBindingDescriptions = args.vertexBindings.data();
+    visci.vertexAttributeDescriptionCount = (uint32_t)args.vertexAttributes.size();
+    visci.pVertexAttributeDescriptions = args.vertexAttributes.data();
 
     VkPipelineInputAssemblyStateCreateInfo iasci = {};
     iasci.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
@@ -192,7 +397,7 @@ VulkanGraphicsPipeline VulkanLogicalDevice::createGraphicsPipeline(const VulkanG
     rssci.rasterizerDiscardEnable = VK_FALSE;
     rssci.polygonMode = VK_POLYGON_MODE_FILL;
     rssci.lineWidth = 1.0f;
-    rssci.cullMode = VK_CULL_MODE_BACK_BIT;
+    rssci.cullMode = args.cullMode;
     rssci.frontFace = VK_FRONT_FACE_CLOCKWISE;
     rssci.depthBiasEnable = VK_FALSE;
     rssci.depthBiasConstantFactor = 0.0f;
@@ -203,22 +408,33 @@ VulkanGraphicsPipeline VulkanLogicalDevice::createGraphicsPipeline(const VulkanG
     mssci.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
     mssci.pNext = nullptr;
     mssci.sampleShadingEnable = VK_FALSE;
-    mssci.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+    mssci.rasterizationSamples = args.samples;
     mssci.minSampleShading = 1.0f;
     mssci.pSampleMask = nullptr;
     mssci.alphaToCoverageEnable = VK_FALSE;
     mssci.alphaToOneEnable = VK_FALSE;
 
+    VkPipelineDepthStencilStateCreateInfo dssci = {};
+    dssci.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    dssci.pNext = nullptr;
+    dssci.depthTestEnable = args.depthTest ? VK_TRUE : VK_FALSE;
+    dssci.depthWriteEnable = args.depthTest && args.depthWrite ? VK_TRUE : VK_FALSE;
+    dssci.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+    dssci.depthBoundsTestEnable = VK_FALSE;
+    dssci.stencilTestEnable = VK_FALSE;
+    dssci.minDepthBounds = 0.0f;
+    dssci.maxDepthBounds = 1.0f;
+
     VkPipelineColorBlendAttachmentState cbas = {};
     cbas.colorWriteMask =
         VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
         VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-    cbas.blendEnable = VK_FALSE;
-    cbas.srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
-    cbas.dstColorBlendFactor = VK_BLEND_FACTOR_ZERO;
+    cbas.blendEnable = args.blend ? VK_TRUE : VK_FALSE;
+    cbas.srcColorBlendFactor = args.blend ? VK_BLEND_FACTOR_SRC_ALPHA : VK_BLEND_FACTOR_ONE;
+    cbas.dstColorBlendFactor = args.blend ? VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA : VK_BLEND_FACTOR_ZERO;
     cbas.colorBlendOp = VK_BLEND_OP_ADD;
     cbas.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
-    cbas.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+    cbas.dstAlphaBlendFactor = args.blend ? VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA : VK_BLEND_FACTOR_ZERO;
     cbas.alphaBlendOp = VK_BLEND_OP_ADD;
 
     VkPipelineColorBlendStateCreateInfo cbsci = {};
@@ -243,68 +459,154 @@ VulkanGraphicsPipeline VulkanLogicalDevice::createGraphicsPipeline(const VulkanG
     dsci.dynamicStateCount = 2;
     dsci.pDynamicStates = dynamicStates;
 
-    VulkanGraphicsPipeline pipeline = {};
-    pipeline.vert = vert;
-    pipeline.frag = frag;
-    pipeline.viewport = args.viewport;
-    pipeline.scissor = args.scissor;
+    if (!args.bindings.empty())
+    {
+        VkDescriptorSetLayoutCreateInfo dslci = {};
+        dslci.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        dslci.pNext = nullptr;
+        dslci.bindingCount = (uint32_t)args.bindings.size();
+        dslci.pBindings = args.bindings.data();
+        if (VK_SUCCESS != vkCreateDescriptorSetLayout(device, &dslci, nullptr, pipeline.setLayout.put(device)))
+        {
+            throw std::runtime_error("Create descriptor-set layout failed.");
+        }
+    }
+
+    VkPushConstantRange pcr = {};
+    pcr.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+    if (meshShading)
+        pcr.stageFlags = VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT | VK_SHADER_STAGE_FRAGMENT_BIT;
+    pcr.offset = 0;
+    pcr.size = args.pushConstantSize;
 
     VkPipelineLayoutCreateInfo lci = {};
     lci.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
     lci.pNext = nullptr;
-    lci.setLayoutCount = 0;
-    lci.pSetLayouts = nullptr;
-    lci.pushConstantRangeCount = 0;
-    lci.pPushConstantRanges = 0;
-    if (VK_SUCCESS != vkCreatePipelineLayout(device, &lci, nullptr, &pipeline.layout))
+    lci.setLayoutCount = args.bindings.empty() ? 0 : 1;
+    lci.pSetLayouts = pipeline.setLayout.address();
+    lci.pushConstantRangeCount = args.pushConstantSize > 0 ? 1 : 0;
+    lci.pPushConstantRanges = &pcr;
+    if (VK_SUCCESS != vkCreatePipelineLayout(device, &lci, nullptr, pipeline.layout.put(device)))
     {
-        this->destroyGraphicsPipeline(pipeline);
         throw std::runtime_error("Create pipeline layout failed.");
     }
 
-    VkAttachmentDescription attachment = {};
-    attachment.format = args.colorFormat;
-    attachment.samples = VK_SAMPLE_COUNT_1_BIT;
-    attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-    attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    attachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    VkGraphicsPipelineCreateInfo gpci = {};
+    gpci.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    gpci.pNext = nullptr;
+
+    // with dynamic rendering the pipeline only declares its attachment formats.
+    VkPipelineRenderingCreateInfoKHR prci = {};
+    prci.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO_KHR;
+    prci.pNext = nullptr;
+    prci.viewMask = 0;
+    prci.colorAttachmentCount = 1;
+    prci.pColorAttachmentFormats = &args.colorFormat;
+    prci.depthAttachmentFormat = args.depthFormat;
+    prci.stencilAttachmentFormat = VK_FORMAT_UNDEFINED;
+    if (args.dynamicRendering)
+    {
+        if (vkCmdBeginRenderingKHR == nullptr)
+        {
+            throw std::runtime_error("dynamic rendering is not enabled on this device.");
+        }
+        gpci.pNext = &prci;
+    }
+
+    // attachment 0 is the presented image, then the multisampled color and depth
+    // attachments when enabled (see VulkanFrameBufferArgs). Only the presented
+    // image is stored: the others live and die inside the render pass.
+    VkAttachmentDescription attachments[3] = {};
+    uint32_t attachmentCount = 0;
+
+    VkAttachmentDescription& present = attachments[attachmentCount++];
+    present.format = args.colorFormat;
+    present.samples = VK_SAMPLE_COUNT_1_BIT;
+    present.loadOp = multisampled ? VK_ATTACHMENT_LOAD_OP_DONT_CARE : VK_ATTACHMENT_LOAD_OP_CLEAR;
+    present.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    present.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    present.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    present.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    present.finalLayout = args.present ? VK_IMAGE_LAYOUT_PRESENT_SRC_KHR : VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+    VkAttachmentReference presentRef = {};
+    presentRef.attachment = 0;
+    presentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+    VkAttachmentReference colorRef = presentRef;
+    if (multisampled)
+    {
+        VkAttachmentDescription& color = attachments[attachmentCount];
+        color.format = args.colorFormat;
+        color.samples = args.samples;
+        color.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+        color.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        color.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        color.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        color.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        color.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        colorRef.attachment = attachmentCount++;
+    }
 
-    VkAttachmentReference colorAttachmentRef = {};
-    colorAttachmentRef.attachment = 0;
-    colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    VkAttachmentReference depthRef = {};
+    if (depth)
+    {
+        VkAttachmentDescription& depthAttachment = attachments[attachmentCount];
+        depthAttachment.format = args.depthFormat;
+        depthAttachment.samples = args.samples;
+        depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+        depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+        depthRef.attachment = attachmentCount++;
+        depthRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+    }
 
     VkSubpassDescription subpass = {};
     subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
     subpass.colorAttachmentCount = 1;
-    subpass.pColorAttachments = &colorAttachmentRef;
+    subpass.pColorAttachments = &colorRef;
+    subpass.pResolveAttachments = multisampled ? &presentRef : nullptr;
+    subpass.pDepthStencilAttachment = depth ? &depthRef : nullptr;
+
+    // the color and depth attachments are shared by all frames in flight: the
+    // previous frame has to be done writing them before this one clears them,
+    // and done post-processing an offscreen color image.
+    VkSubpassDependency dependency = {};
+    dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+    dependency.dstSubpass = 0;
+    dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    if (!args.present)
+        dependency.srcStageMask |= VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+    dependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
 
     VkRenderPassCreateInfo rpci = {};
     rpci.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
     rpci.pNext = nullptr;
-    rpci.attachmentCount = 1;
-    rpci.pAttachments = &attachment;
+    rpci.attachmentCount = attachmentCount;
+    rpci.pAttachments = attachments;
     rpci.subpassCount = 1;
     rpci.pSubpasses = &subpass;
-    if (VK_SUCCESS != vkCreateRenderPass(device, &rpci, nullptr, &pipeline.renderPass))
+    rpci.dependencyCount = 1;
+    rpci.pDependencies = &dependency;
+    if (!args.dynamicRendering &&
+        VK_SUCCESS != vkCreateRenderPass(device, &rpci, nullptr, pipeline.renderPass.put(device)))
     {
-        this->destroyGraphicsPipeline(pipeline);
         throw std::runtime_error("Create render-pass failed.");
     }
 
-    VkGraphicsPipelineCreateInfo gpci = {};
-    gpci.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-    gpci.pNext = nullptr;
-    gpci.stageCount = 2;
+    gpci.stageCount = stageCount;
     gpci.pStages = shaderStages;
-    gpci.pVertexInputState = &visci;
-    gpci.pInputAssemblyState = &iasci;
+    gpci.pVertexInputState = meshShading ? nullptr : &visci;
+    gpci.pInputAssemblyState = meshShading ? nullptr : &iasci;
     gpci.pViewportState = &vpsci;
     gpci.pRasterizationState = &rssci;
     gpci.pMultisampleState = &mssci;
-    gpci.pDepthStencilState = nullptr;
+    gpci.pDepthStencilState = depth ? &dssci : nullptr;
     gpci.pColorBlendState = &cbsci;
     gpci.pDynamicState = &dsci;
     gpci.layout = pipeline.layout;
@@ -312,43 +614,104 @@ VulkanGraphicsPipeline VulkanLogicalDevice::createGraphicsPipeline(const VulkanG
     gpci.subpass = 0;
     gpci.basePipelineHandle = VK_NULL_HANDLE;
     gpci.basePipelineIndex = -1;
-    if (VK_SUCCESS != vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &gpci, nullptr, &pipeline.handle))
+    if (VK_SUCCESS != vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &gpci, nullptr, pipeline.handle.put(device)))
     {
-        this->destroyGraphicsPipeline(pipeline);
         throw std::runtime_error("Create graphics pipeline failed.");
     }
+    if (capture != nullptr)
+        capture->pipeline(pipeline.handle, args);
 
     return pipeline;
 }
 
+VulkanComputePipeline VulkanLogicalDevice::createComputePipeline(const VulkanComputePipelineArgs& args) const
+{
+    VULKAN_PROFILE_ZONE("create compute pipeline");
+    VulkanComputePipeline pipeline = {};
+    pipeline.comp = this->createShaderModule(args.comp);
+
+    VkDescriptorSetLayoutCreateInfo dslci = {};
+    dslci.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    dslci.pNext = nullptr;
+    dslci.bindingCount = (uint32_t)args.bindings.size();
+    dslci.pBindings = args.bindings.data();
+    if (VK_SUCCESS != vkCreateDescriptorSetLayout(device, &dslci, nullptr, pipeline.setLayout.put(device)))
+    {
+        throw std::runtime_error("Create descriptor-set layout failed.");
+    }
+
+    VkPushConstantRange pcr = {};
+    pcr.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pcr.offset = 0;
+    pcr.size = args.pushConstantSize;
+
+    VkPipelineLayoutCreateInfo lci = {};
+    lci.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    lci.pNext = nullptr;
+    lci.setLayoutCount = 1;
+    lci.pSetLayouts = pipeline.setLayout.address();
+    lci.pushConstantRangeCount = args.pushConstantSize > 0 ? 1 : 0;
+    lci.pPushConstantRanges = &pcr;
+    if (VK_SUCCESS != vkCreatePipelineLayout(device, &lci, nullptr, pipeline.layout.put(device)))
+    {
+        throw std::runtime_error("Create pipeline layout failed.");
+    }
+
+    VkComputePipelineCreateInfo cpci = {};
+    cpci.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    cpci.pNext = nullptr;
+    cpci.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    cpci.stage.pNext = nullptr;
+    cpci.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    cpci.stage.module = pipeline.comp;
+    cpci.stage.pName = "main";
+    cpci.layout = pipeline.layout;
+    cpci.basePipelineHandle = VK_NULL_HANDLE;
+    cpci.basePipelineIndex = -1;
+    if (VK_SUCCESS != vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &cpci, nullptr, pipeline.handle.put(device)))
+    {
+        throw std::runtime_error("Create compute pipeline failed.");
+    }
+
+    return pipeline;
+}
+
+void VulkanLogicalDevice::destroyComputePipeline(VulkanComputePipeline& pipeline) const
+{
+    pipeline.handle.reset();
+    pipeline.layout.reset();
+    pipeline.setLayout.reset();
+    pipeline.comp.reset();
+}
+
 VulkanFrameBufferObject VulkanLogicalDevice::createFrameBufferObject(const VulkanFrameBufferArgs& args) const
 {
     VulkanFrameBufferObject fbo;
-    fbo.handles.resize(args.imageViews.size());
+    fbo.handles.resize(args.imageViewCount);
 
-    for (size_t i = 0; i < args.imageViews.size(); i++)
+    for (uint32_t i = 0; i < args.imageViewCount; i++)
     {
-        auto& imageView = args.imageViews.at(i);
-        VkImageView attachments[] = { imageView };
+        VkImageView attachments[3] = { args.imageViews[i] };
+        uint32_t attachmentCount = 1;
+        if (args.colorView != VK_NULL_HANDLE)
+            attachments[attachmentCount++] = args.colorView;
+        if (args.depthView != VK_NULL_HANDLE)
+            attachments[attachmentCount++] = args.depthView;
 
         VkFramebufferCreateInfo fbci = {};
         fbci.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
         fbci.pNext = nullptr;
         fbci.renderPass = args.renderPass;
-        fbci.attachmentCount = 1;
+        fbci.attachmentCount = attachmentCount;
         fbci.pAttachments = attachments;
         fbci.width = args.width;
         fbci.height = args.height;
         fbci.layers = 1;
 
-        VkFramebuffer handle;
-        if (VK_SUCCESS != vkCreateFramebuffer(device, &fbci, nullptr, &handle))
+        if (VK_SUCCESS != vkCreateFramebuffer(device, &fbci, nullptr, fbo.handles[i].put(device)))
         {
-            this->destroyFrameBufferObject(fbo);
             throw std::runtime_error("Create framebuffer failed.");
         }
-
-        fbo.handles[i] = handle;
     }
 
     return fbo;
@@ -356,24 +719,17 @@ VulkanFrameBufferObject VulkanLogicalDevice::createFrameBufferObject(const Vulka
 
 void VulkanLogicalDevice::destroyFrameBufferObject(VulkanFrameBufferObject& fbo) const
 {
-    for (size_t i = 0; i < fbo.handles.size(); i++)
-    {
-        VkFramebuffer handle = fbo.handles.at(i);
-        if (handle == VK_NULL_HANDLE)
-            continue;
-        vkDestroyFramebuffer(device, handle, nullptr);
-        fbo.handles[i] = VK_NULL_HANDLE;
-    }
+    fbo.handles.clear();
 }
 
-VkSemaphore VulkanLogicalDevice::createSemaphore() const
+VulkanSemaphoreHandle VulkanLogicalDevice::createSemaphore() const
 {
     VkSemaphoreCreateInfo sci = {};
     sci.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
     sci.pNext = nullptr;
 
-    VkSemaphore semaphore;
-    if (vkCreateSemaphore(device, &sci, nullptr, &semaphore) != VK_SUCCESS)
+    VulkanSemaphoreHandle semaphore;
+    if (vkCreateSemaphore(device, &sci, nullptr, semaphore.put(device)) != VK_SUCCESS)
     {
         throw std::runtime_error("Create semaphore failed.");
     }
@@ -381,143 +737,728 @@ VkSemaphore VulkanLogicalDevice::createSemaphore() const
     return semaphore;
 }
 
-void VulkanLogicalDevice::destroySemaphore(VkSemaphore& semaphore) const
+void VulkanLogicalDevice::destroySemaphore(VulkanSemaphoreHandle& semaphore) const
+{
+    semaphore.reset();
+}
+
+VulkanFenceHandle VulkanLogicalDevice::createFence(bool signaled) const
 {
-    if (semaphore != VK_NULL_HANDLE)
+    VkFenceCreateInfo fci = {};
+    fci.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    fci.pNext = nullptr;
+    fci.flags = signaled ? VK_FENCE_CREATE_SIGNALED_BIT : 0;
+
+    VulkanFenceHandle fence;
+    if (vkCreateFence(device, &fci, nullptr, fence.put(device)) != VK_SUCCESS)
     {
-        vkDestroySemaphore(device, semaphore, nullptr);
+        throw std::runtime_error("Create fence failed.");
     }
+
+    return fence;
 }
 
-std::vector<VkCommandBuffer> VulkanLogicalDevice::beginCommandBuffers(
-    VulkanGraphicsPipeline& pipeline,
-    VulkanFrameBufferObject& fbo) const
+void VulkanLogicalDevice::destroyFence(VulkanFenceHandle& fence) const
 {
-    std::vector<VkCommandBuffer> commandBuffers(fbo.handles.size());
+    fence.reset();
+}
 
+// the pool is created without RESET_COMMAND_BUFFER: these live until freed.
+static std::vector<VkCommandBuffer> allocateCommandBuffers(VkDevice device, VkCommandPool commandPool, uint32_t count)
+{
+    std::vector<VkCommandBuffer> commandBuffers(count);
     VkCommandBufferAllocateInfo cbai = {};
     cbai.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
     cbai.pNext = nullptr;
-    cbai.commandPool = this->commandPool;
+    cbai.commandPool = commandPool;
     cbai.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    cbai.commandBufferCount = (uint32_t)commandBuffers.size();
+    cbai.commandBufferCount = count;
     if (VK_SUCCESS != vkAllocateCommandBuffers(device, &cbai, commandBuffers.data()))
     {
         throw std::runtime_error("Allocate command-buffers failed.");
     }
+    return commandBuffers;
+}
 
+std::vector<VkCommandBuffer> VulkanLogicalDevice::beginCommandBuffers(
+    const VulkanGraphicsPipeline& pipeline,
+    const VulkanFrameBufferObject& fbo,
+    const VulkanRecordArgs& args) const
+{
+    VULKAN_PROFILE_ZONE("record command buffers");
+    std::vector<VkCommandBuffer> commandBuffers = allocateCommandBuffers(device, commandPool, (uint32_t)fbo.handles.size());
+    VulkanRecordArgs imageArgs = args;
     for (uint32_t i = 0; i < commandBuffers.size(); i++)
     {
-        VkCommandBufferBeginInfo cbbi = {};
-        cbbi.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-        cbbi.pNext = nullptr;
-        cbbi.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
-        cbbi.pInheritanceInfo = nullptr;
-        if (VK_SUCCESS != vkBeginCommandBuffer(commandBuffers[i], &cbbi))
-        {
-            throw std::runtime_error("Begin command-buffer failed.");
-        }
+        imageArgs.slot = i;
+        this->beginCommandBuffer(commandBuffers[i], i, pipeline, fbo, imageArgs);
+    }
+    return commandBuffers;
+}
 
-        VkClearValue clearValue;
-        clearValue.color = { {0.0f, 0.0f, 0.0f, 1.0f} };
-
-        VkRenderPassBeginInfo rpbi = {};
-        rpbi.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-        rpbi.renderPass = pipeline.renderPass;
-        rpbi.framebuffer = fbo.handles[i];
-        rpbi.renderArea.offset = { 0, 0 };
-        rpbi.renderArea.extent = {
-            (uint32_t)pipeline.viewport.width,
-            (uint32_t)pipeline.viewport.height
-        };
-        rpbi.clearValueCount = 1;
-        rpbi.pClearValues = &clearValue;
-        vkCmdBeginRenderPass(commandBuffers[i], &rpbi, VK_SUBPASS_CONTENTS_INLINE);
+void VulkanLogicalDevice::endCommandBuffers(std::vector<VkCommandBuffer>& commandBuffers,
+    const VulkanRecordArgs& args) const
+{
+    VULKAN_PROFILE_ZONE("record command buffers");
+    VulkanRecordArgs imageArgs = args;
+    for (uint32_t i = 0; i < commandBuffers.size(); i++)
+    {
+        imageArgs.slot = i;
+        this->endCommandBuffer(commandBuffers[i], i, imageArgs);
+    }
+}
+
+void VulkanLogicalDevice::beginCommandBuffer(
+    VkCommandBuffer commandBuffer,
+    uint32_t imageIndex,
+    const VulkanGraphicsPipeline& pipeline,
+    const VulkanFrameBufferObject& fbo,
+    const VulkanRecordArgs& args) const
+{
+    VkCommandBufferBeginInfo cbbi = {};
+    cbbi.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    cbbi.pNext = nullptr;
+    cbbi.flags = args.usage;
+    cbbi.pInheritanceInfo = nullptr;
+    if (VK_SUCCESS != vkBeginCommandBuffer(commandBuffer, &cbbi))
+    {
+        throw std::runtime_error("Begin command-buffer failed.");
+    }
+    if (args.profiler != nullptr)
+    {
+        args.profiler->reset(commandBuffer, args.slot);
+        args.profiler->begin(commandBuffer, args.slot, VULKAN_GPU_ZONE_COMMAND_BUFFER);
+    }
+    if (args.prepare)
+        args.prepare(commandBuffer);
+
+    // one per attachment, in render pass order.
+    VkClearValue clearValues[3];
+    uint32_t clearValueCount = 1;
+    clearValues[0].color = { {0.0f, 0.0f, 0.0f, 1.0f} };
+    if (pipeline.samples != VK_SAMPLE_COUNT_1_BIT)
+        clearValues[clearValueCount++].color = { {0.0f, 0.0f, 0.0f, 1.0f} };
+    if (pipeline.depthFormat != VK_FORMAT_UNDEFINED)
+        clearValues[clearValueCount++].depthStencil = { 1.0f, 0 };
+
+    VkRenderPassBeginInfo rpbi = {};
+    rpbi.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    rpbi.renderPass = pipeline.renderPass;
+    rpbi.framebuffer = fbo.handles.size() == 1 ? fbo.handles[0] : fbo.handles[imageIndex];
+    rpbi.renderArea.offset = { 0, 0 };
+    rpbi.renderArea.extent = {
+        (uint32_t)pipeline.viewport.width,
+        (uint32_t)pipeline.viewport.height
+    };
+    rpbi.clearValueCount = clearValueCount;
+    rpbi.pClearValues = clearValues;
+    vkCmdBeginRenderPass(commandBuffer, &rpbi, VK_SUBPASS_CONTENTS_INLINE);
 
-        vkCmdBindPipeline(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.handle);
+    if (args.profiler != nullptr)
+        args.profiler->begin(commandBuffer, args.slot, VULKAN_GPU_ZONE_RENDERING);
 
-        vkCmdDraw(commandBuffers[i], 6, 1, 0, 0);
+    // dynamic in every pipeline, the scissor is not.
+    vkCmdSetViewport(commandBuffer, 0, 1, &pipeline.viewport);
+    if (args.queue != nullptr)
+    {
+        args.queue->record(commandBuffer);
     }
+    else
+    {
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.handle);
+        vkCmdDraw(commandBuffer, 6, 1, 0, 0);
+    }
+    if (capture != nullptr)
+        this->captureDraws(pipeline, args);
+}
+
+// The pass and the draws beginCommandBuffer made in it; what the caller records
+// before endCommandBuffer is captured by the helpers that record it.
+void VulkanLogicalDevice::captureDraws(const VulkanGraphicsPipeline& pipeline, const VulkanRecordArgs& args) const
+{
+    capture->pass(pipeline.handle);
+    if (args.queue != nullptr)
+    {
+        args.queue->capture(*capture);
+    }
+    else
+    {
+        VulkanDrawGeometry quad;
+        quad.count = 6;
+        capture->draw(pipeline.handle, quad, 0, 1, false);
+    }
+}
 
+void VulkanLogicalDevice::endCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex,
+    const VulkanRecordArgs& args) const
+{
+    if (args.profiler != nullptr)
+        args.profiler->end(commandBuffer, args.slot, VULKAN_GPU_ZONE_RENDERING);
+    vkCmdEndRenderPass(commandBuffer);
+    if (args.post != nullptr)
+    {
+        if (args.profiler != nullptr)
+            args.profiler->begin(commandBuffer, args.slot, VULKAN_GPU_ZONE_POST_PROCESS);
+        args.post->record(commandBuffer, imageIndex);
+        if (args.profiler != nullptr)
+            args.profiler->end(commandBuffer, args.slot, VULKAN_GPU_ZONE_POST_PROCESS);
+    }
+    if (args.profiler != nullptr)
+        args.profiler->end(commandBuffer, args.slot, VULKAN_GPU_ZONE_COMMAND_BUFFER);
+    if (VK_SUCCESS != vkEndCommandBuffer(commandBuffer)) {
+        throw std::runtime_error("End command-buffer failed.");
+    }
+}
+
+static VkImageMemoryBarrier attachmentBarrier(VkImage image, VkImageAspectFlags aspect,
+    VkImageLayout oldLayout, VkImageLayout newLayout, VkAccessFlags srcAccess, VkAccessFlags dstAccess)
+{
+    VkImageMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.pNext = nullptr;
+    barrier.srcAccessMask = srcAccess;
+    barrier.dstAccessMask = dstAccess;
+    barrier.oldLayout = oldLayout;
+    barrier.newLayout = newLayout;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange = { aspect, 0, 1, 0, 1 };
+    return barrier;
+}
+
+std::vector<VkCommandBuffer> VulkanLogicalDevice::beginCommandBuffers(
+    const VulkanGraphicsPipeline& pipeline,
+    const VulkanRenderTargets& targets,
+    const VulkanRecordArgs& args) const
+{
+    VULKAN_PROFILE_ZONE("record command buffers");
+    std::vector<VkCommandBuffer> commandBuffers =
+        allocateCommandBuffers(device, commandPool, (uint32_t)targets.swapchain->imageViews.size());
+    VulkanRecordArgs imageArgs = args;
+    for (uint32_t i = 0; i < commandBuffers.size(); i++)
+    {
+        imageArgs.slot = i;
+        this->beginCommandBuffer(commandBuffers[i], i, pipeline, targets, imageArgs);
+    }
     return commandBuffers;
 }
 
-void VulkanLogicalDevice::endCommandBuffers(std::vector<VkCommandBuffer>& commandBuffers) const
+void VulkanLogicalDevice::endCommandBuffers(
+    std::vector<VkCommandBuffer>& commandBuffers,
+    const VulkanRenderTargets& targets,
+    const VulkanRecordArgs& args) const
 {
-    for (size_t i = 0; i < commandBuffers.size(); i++)
+    VULKAN_PROFILE_ZONE("record command buffers");
+    VulkanRecordArgs imageArgs = args;
+    for (uint32_t i = 0; i < commandBuffers.size(); i++)
     {
-        vkCmdEndRenderPass(commandBuffers[i]);
-        if (VK_SUCCESS != vkEndCommandBuffer(commandBuffers[i])) {
-            throw std::runtime_error("End command-buffer failed.");
-        }
+        imageArgs.slot = i;
+        this->endCommandBuffer(commandBuffers[i], i, targets, imageArgs);
+    }
+}
+
+void VulkanLogicalDevice::beginCommandBuffer(
+    VkCommandBuffer commandBuffer,
+    uint32_t imageIndex,
+    const VulkanGraphicsPipeline& pipeline,
+    const VulkanRenderTargets& targets,
+    const VulkanRecordArgs& args) const
+{
+    if (vkCmdBeginRenderingKHR == nullptr)
+    {
+        throw std::runtime_error("dynamic rendering is not enabled on this device.");
+    }
+    const VulkanSwapchain& swapchain = *targets.swapchain;
+
+    VkCommandBufferBeginInfo cbbi = {};
+    cbbi.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    cbbi.pNext = nullptr;
+    cbbi.flags = args.usage;
+    cbbi.pInheritanceInfo = nullptr;
+    if (VK_SUCCESS != vkBeginCommandBuffer(commandBuffer, &cbbi))
+    {
+        throw std::runtime_error("Begin command-buffer failed.");
+    }
+    if (args.profiler != nullptr)
+    {
+        args.profiler->reset(commandBuffer, args.slot);
+        args.profiler->begin(commandBuffer, args.slot, VULKAN_GPU_ZONE_COMMAND_BUFFER);
+    }
+    if (args.prepare)
+        args.prepare(commandBuffer);
+
+    // what a render pass does through its layouts and external dependency:
+    // all contents are discarded, the previous frame must be done with the
+    // shared attachments.
+    // an offscreen output was last read by the previous frame's post-processing.
+    VkImage outputImage = targets.output != nullptr ? targets.output->image.get() : swapchain.images[imageIndex];
+    VkImageView outputView = targets.output != nullptr ? targets.output->view.get() : swapchain.imageViews[imageIndex].get();
+    VkPipelineStageFlags srcStages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    if (targets.output != nullptr)
+        srcStages |= VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    VkImageMemoryBarrier barriers[3];
+    uint32_t barrierCount = 0;
+    barriers[barrierCount++] = attachmentBarrier(outputImage, VK_IMAGE_ASPECT_COLOR_BIT,
+        VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+        0, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT);
+    if (targets.color != nullptr)
+    {
+        barriers[barrierCount++] = attachmentBarrier(targets.color->image, VK_IMAGE_ASPECT_COLOR_BIT,
+            VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+            VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT);
+    }
+    if (targets.depth != nullptr)
+    {
+        VkImageAspectFlags aspect = VK_IMAGE_ASPECT_DEPTH_BIT;
+        if (targets.depth->format == VK_FORMAT_D24_UNORM_S8_UINT)
+            aspect |= VK_IMAGE_ASPECT_STENCIL_BIT;
+        barriers[barrierCount++] = attachmentBarrier(targets.depth->image, aspect,
+            VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+            VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT);
+    }
+    vkCmdPipelineBarrier(commandBuffer,
+        srcStages,
+        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
+        0, 0, nullptr, 0, nullptr, barrierCount, barriers);
+
+    VkRenderingAttachmentInfoKHR colorAttachment = {};
+    colorAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR;
+    colorAttachment.pNext = nullptr;
+    colorAttachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    colorAttachment.clearValue.color = { {0.0f, 0.0f, 0.0f, 1.0f} };
+    if (targets.color != nullptr)
+    {
+        colorAttachment.imageView = targets.color->view;
+        colorAttachment.resolveMode = VK_RESOLVE_MODE_AVERAGE_BIT;
+        colorAttachment.resolveImageView = outputView;
+        colorAttachment.resolveImageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    }
+    else
+    {
+        colorAttachment.imageView = outputView;
+        colorAttachment.resolveMode = VK_RESOLVE_MODE_NONE;
+        colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    }
+
+    VkRenderingAttachmentInfoKHR depthAttachment = {};
+    depthAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR;
+    depthAttachment.pNext = nullptr;
+    depthAttachment.imageView = targets.depth != nullptr ? targets.depth->view.get() : VK_NULL_HANDLE;
+    depthAttachment.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+    depthAttachment.resolveMode = VK_RESOLVE_MODE_NONE;
+    depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    depthAttachment.clearValue.depthStencil = { 1.0f, 0 };
+
+    VkRenderingInfoKHR ri = {};
+    ri.sType = VK_STRUCTURE_TYPE_RENDERING_INFO_KHR;
+    ri.pNext = nullptr;
+    ri.flags = 0;
+    ri.renderArea.offset = { 0, 0 };
+    ri.renderArea.extent = swapchain.extent;
+    ri.layerCount = 1;
+    ri.viewMask = 0;
+    ri.colorAttachmentCount = 1;
+    ri.pColorAttachments = &colorAttachment;
+    ri.pDepthAttachment = targets.depth != nullptr ? &depthAttachment : nullptr;
+    ri.pStencilAttachment = nullptr;
+    vkCmdBeginRenderingKHR(commandBuffer, &ri);
+
+    if (args.profiler != nullptr)
+        args.profiler->begin(commandBuffer, args.slot, VULKAN_GPU_ZONE_RENDERING);
+
+    // dynamic in every pipeline, the scissor is not.
+    vkCmdSetViewport(commandBuffer, 0, 1, &pipeline.viewport);
+    if (args.queue != nullptr)
+    {
+        args.queue->record(commandBuffer);
+    }
+    else
+    {
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.handle);
+        vkCmdDraw(commandBuffer, 6, 1, 0, 0);
+    }
+    if (capture != nullptr)
+        this->captureDraws(pipeline, args);
+}
+
+void VulkanLogicalDevice::endCommandBuffer(
+    VkCommandBuffer commandBuffer,
+    uint32_t imageIndex,
+    const VulkanRenderTargets& targets,
+    const VulkanRecordArgs& args) const
+{
+    if (args.profiler != nullptr)
+        args.profiler->end(commandBuffer, args.slot, VULKAN_GPU_ZONE_RENDERING);
+    vkCmdEndRenderingKHR(commandBuffer);
+
+    if (targets.output == nullptr)
+    {
+        VkImageMemoryBarrier barrier = attachmentBarrier(targets.swapchain->images[imageIndex], VK_IMAGE_ASPECT_COLOR_BIT,
+            VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+            VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, 0);
+        vkCmdPipelineBarrier(commandBuffer,
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+            0, 0, nullptr, 0, nullptr, 1, &barrier);
+    }
+    if (args.post != nullptr)
+    {
+        if (args.profiler != nullptr)
+            args.profiler->begin(commandBuffer, args.slot, VULKAN_GPU_ZONE_POST_PROCESS);
+        args.post->record(commandBuffer, imageIndex);
+        if (args.profiler != nullptr)
+            args.profiler->end(commandBuffer, args.slot, VULKAN_GPU_ZONE_POST_PROCESS);
+    }
+    if (args.profiler != nullptr)
+        args.profiler->end(commandBuffer, args.slot, VULKAN_GPU_ZONE_COMMAND_BUFFER);
+
+    if (VK_SUCCESS != vkEndCommandBuffer(commandBuffer)) {
+        throw std::runtime_error("End command-buffer failed.");
     }
 }
 
 void VulkanLogicalDevice::present(const VulkanPresentArgs& args) const
 {
+    uint32_t imageIndex = this->acquireNextImage(args.swapchain, args.onImageAvailable);
+    this->submit(args.commandBuffers[imageIndex],
+        args.onImageAvailable, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+        args.onRenderFinished, args.fence);
+    this->presentImage(args.swapchain, imageIndex, args.onRenderFinished, args.presentId);
+}
+
+uint32_t VulkanLogicalDevice::acquireNextImage(VkSwapchainKHR swapchain, VkSemaphore onImageAvailable) const
+{
+    VULKAN_PROFILE_ZONE("vkAcquireNextImageKHR");
     uint32_t imageIndex = -1;
     vkAcquireNextImageKHR(
-        device, args.swapchain,
+        device, swapchain,
         std::numeric_limits<uint64_t>::max(),
-        args.onImageAvailable, VK_NULL_HANDLE,
+        onImageAvailable, VK_NULL_HANDLE,
         &imageIndex
     );
+    return imageIndex;
+}
 
-    VkPipelineStageFlags waitStageFlags =
-        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-
+void VulkanLogicalDevice::submit(
+    VkCommandBuffer commandBuffer,
+    VkSemaphore waitSemaphore, VkPipelineStageFlags waitStage,
+    VkSemaphore signalSemaphore, VkFence fence) const
+{
+    VULKAN_PROFILE_ZONE("vkQueueSubmit");
     VkSubmitInfo submitInfo = {};
     submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
     submitInfo.pNext = nullptr;
-    submitInfo.waitSemaphoreCount = 1;
-    submitInfo.pWaitSemaphores = &args.onImageAvailable;
-    submitInfo.pWaitDstStageMask = &waitStageFlags;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &args.commandBuffers[imageIndex];
-    submitInfo.signalSemaphoreCount = 1;
-    submitInfo.pSignalSemaphores = &args.onRenderFinished;
-    if (vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+    submitInfo.waitSemaphoreCount = waitSemaphore != VK_NULL_HANDLE ? 1 : 0;
+    submitInfo.pWaitSemaphores = &waitSemaphore;
+    submitInfo.pWaitDstStageMask = &waitStage;
+    submitInfo.commandBufferCount = commandBuffer != VK_NULL_HANDLE ? 1 : 0;
+    submitInfo.pCommandBuffers = &commandBuffer;
+    submitInfo.signalSemaphoreCount = signalSemaphore != VK_NULL_HANDLE ? 1 : 0;
+    submitInfo.pSignalSemaphores = &signalSemaphore;
+    if (vkQueueSubmit(queue, 1, &submitInfo, fence) != VK_SUCCESS)
     {
         throw std::runtime_error("Submit failed.");
     }
+}
+
+void VulkanLogicalDevice::presentImage(
+    VkSwapchainKHR swapchain, uint32_t imageIndex, VkSemaphore waitSemaphore,
+    uint64_t presentId) const
+{
+    VULKAN_PROFILE_ZONE("vkQueuePresentKHR");
+    VkPresentIdKHR pid = {};
+    pid.sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR;
+    pid.pNext = nullptr;
+    pid.swapchainCount = 1;
+    pid.pPresentIds = &presentId;
 
     VkPresentInfoKHR presentInfo = {};
     presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-    presentInfo.pNext = nullptr;
+    presentInfo.pNext = presentId != 0 && vkWaitForPresentKHR != nullptr ? &pid : nullptr;
     presentInfo.waitSemaphoreCount = 1;
-    presentInfo.pWaitSemaphores = &args.onRenderFinished;
+    presentInfo.pWaitSemaphores = &waitSemaphore;
     presentInfo.swapchainCount = 1;
-    presentInfo.pSwapchains = &args.swapchain;
+    presentInfo.pSwapchains = &swapchain;
     presentInfo.pImageIndices = &imageIndex;
     presentInfo.pResults = nullptr;
     if (vkQueuePresentKHR(queue, &presentInfo) != VK_SUCCESS)
     {
         throw std::runtime_error("Present failed.");
     }
+    if (capture != nullptr)
+        capture->present();
 }
 
-void VulkanLogicalDevice::destroyGraphicsPipeline(VulkanGraphicsPipeline& pipeline) const
+bool VulkanLogicalDevice::waitForPresent(VkSwapchainKHR swapchain, uint64_t presentId, uint64_t timeout) const
+{
+    if (vkWaitForPresentKHR == nullptr)
+        return false;
+
+    VkResult result = vkWaitForPresentKHR(device, swapchain, presentId, timeout);
+    if (result == VK_ERROR_DEVICE_LOST)
+    {
+        throw std::runtime_error("Wait for present failed: device lost.");
+    }
+    // VK_TIMEOUT or an out-of-date swapchain: the caller just goes on.
+    return result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR;
+}
+
+uint32_t VulkanLogicalDevice::acquireNextImages(VulkanPresentBatch& batch) const
+{
+    VULKAN_PROFILE_ZONE("vkAcquireNextImageKHR");
+    batch.imageIndices.resize(batch.swapchains.size());
+    batch.results.assign(batch.swapchains.size(), VK_SUCCESS);
+    uint32_t acquired = 0;
+    for (size_t i = 0; i < batch.swapchains.size(); i++)
+    {
+        VkResult result = vkAcquireNextImageKHR(
+            device, batch.swapchains[i],
+            std::numeric_limits<uint64_t>::max(),
+            batch.onImageAvailable[i], VK_NULL_HANDLE,
+            &batch.imageIndices[i]
+        );
+        if (result == VK_ERROR_DEVICE_LOST)
+        {
+            throw std::runtime_error("Acquire next image failed: device lost.");
+        }
+        if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
+        {
+            // nothing signals the semaphore, the index is not an image.
+            batch.imageIndices[i] = UINT32_MAX;
+            batch.results[i] = result;
+            continue;
+        }
+        acquired++;
+    }
+    return acquired;
+}
+
+void VulkanLogicalDevice::submit(
+    const VkCommandBuffer* commandBuffers, uint32_t commandBufferCount, const VulkanPresentBatch& batch,
+    VkPipelineStageFlags waitStage, VkSemaphore signalSemaphore, VkFence fence) const
+{
+    VULKAN_PROFILE_ZONE("vkQueueSubmit");
+    if (batch.onImageAvailable.size() > VULKAN_PRESENT_BATCH_MAX)
+    {
+        throw std::runtime_error("Too many swapchains in a present batch.");
+    }
+    VkSemaphore waitSemaphores[VULKAN_PRESENT_BATCH_MAX];
+    VkPipelineStageFlags waitStages[VULKAN_PRESENT_BATCH_MAX];
+    uint32_t waitCount = 0;
+    for (size_t i = 0; i < batch.onImageAvailable.size(); i++)
+    {
+        if (batch.imageIndices[i] == UINT32_MAX)
+            continue;
+        waitSemaphores[waitCount] = batch.onImageAvailable[i];
+        waitStages[waitCount] = waitStage;
+        waitCount++;
+    }
+
+    VkSubmitInfo submitInfo = {};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.pNext = nullptr;
+    submitInfo.waitSemaphoreCount = waitCount;
+    submitInfo.pWaitSemaphores = waitSemaphores;
+    submitInfo.pWaitDstStageMask = waitStages;
+    submitInfo.commandBufferCount = commandBufferCount;
+    submitInfo.pCommandBuffers = commandBuffers;
+    submitInfo.signalSemaphoreCount = signalSemaphore != VK_NULL_HANDLE ? 1 : 0;
+    submitInfo.pSignalSemaphores = &signalSemaphore;
+    if (vkQueueSubmit(queue, 1, &submitInfo, fence) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Submit failed.");
+    }
+}
+
+void VulkanLogicalDevice::presentImages(VulkanPresentBatch& batch, VkSemaphore waitSemaphore) const
 {
-    if (pipeline.layout != nullptr)
+    VULKAN_PROFILE_ZONE("vkQueuePresentKHR");
+    if (batch.swapchains.size() > VULKAN_PRESENT_BATCH_MAX)
     {
-        vkDestroyPipelineLayout(device, pipeline.layout, nullptr);
-        pipeline.layout = nullptr;
+        throw std::runtime_error("Too many swapchains in a present batch.");
     }
-    if (pipeline.vert != nullptr)
+    // the acquired swapchains only, packed.
+    VkSwapchainKHR swapchains[VULKAN_PRESENT_BATCH_MAX];
+    uint32_t imageIndices[VULKAN_PRESENT_BATCH_MAX];
+    uint64_t ids[VULKAN_PRESENT_BATCH_MAX];
+    VkResult results[VULKAN_PRESENT_BATCH_MAX];
+    uint32_t count = 0;
+    // the ids cover every swapchain of the present or none.
+    bool presentIds = false;
+    bool hasIds = vkWaitForPresentKHR != nullptr && batch.presentIds.size() == batch.swapchains.size();
+    for (size_t i = 0; i < batch.swapchains.size(); i++)
     {
-        this->destroyShaderModule(pipeline.vert);
-        pipeline.vert = nullptr;
+        if (batch.imageIndices[i] == UINT32_MAX)
+            continue;
+        swapchains[count] = batch.swapchains[i];
+        imageIndices[count] = batch.imageIndices[i];
+        ids[count] = hasIds ? batch.presentIds[i] : 0;
+        presentIds |= ids[count] != 0;
+        results[count] = VK_SUCCESS;
+        count++;
     }
-    if (pipeline.frag != nullptr)
+    if (count == 0)
+        return;
+
+    VkPresentIdKHR pid = {};
+    pid.sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR;
+    pid.pNext = nullptr;
+    pid.swapchainCount = count;
+    pid.pPresentIds = ids;
+
+    VkPresentInfoKHR presentInfo = {};
+    presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+    presentInfo.pNext = presentIds ? &pid : nullptr;
+    presentInfo.waitSemaphoreCount = waitSemaphore != VK_NULL_HANDLE ? 1 : 0;
+    presentInfo.pWaitSemaphores = &waitSemaphore;
+    presentInfo.swapchainCount = count;
+    presentInfo.pSwapchains = swapchains;
+    presentInfo.pImageIndices = imageIndices;
+    presentInfo.pResults = results;
+    // out of date, suboptimal and surface lost are per swapchain and only show
+    // in the results; the caller recreates those.
+    VkResult result = vkQueuePresentKHR(queue, &presentInfo);
+    if (result < VK_SUCCESS && result != VK_ERROR_OUT_OF_DATE_KHR && result != VK_ERROR_SURFACE_LOST_KHR)
     {
-        this->destroyShaderModule(pipeline.frag);
-        pipeline.frag = nullptr;
+        throw std::runtime_error(result == VK_ERROR_DEVICE_LOST ? "Present failed: device lost." : "Present failed.");
     }
-    if (pipeline.handle != nullptr)
+    batch.results.resize(batch.swapchains.size(), VK_SUCCESS);
+    for (size_t i = 0, k = 0; i < batch.swapchains.size(); i++)
     {
-        vkDestroyPipeline(device, pipeline.handle, nullptr);
-        pipeline.handle = nullptr;
+        if (batch.imageIndices[i] != UINT32_MAX)
+            batch.results[i] = results[k++];
     }
+    if (capture != nullptr)
+        capture->present();
+}
+
+void VulkanPresentPacer::init(const VulkanLogicalDevice& logicalDevice, VkSwapchainKHR swapchain, uint32_t maxQueuedFrames)
+{
+    this->logicalDevice = &logicalDevice;
+    this->swapchain = swapchain;
+    this->maxQueuedFrames = maxQueuedFrames;
+    this->presentId = 0;
+}
+
+void VulkanPresentPacer::pace()
+{
+    if (logicalDevice == nullptr || maxQueuedFrames == 0 || presentId <= maxQueuedFrames)
+        return;
+    // bounded, so a hidden window that never presents cannot hang the loop.
+    logicalDevice->waitForPresent(swapchain, presentId - maxQueuedFrames, 100000000ull);
+}
+
+uint64_t VulkanPresentPacer::nextPresentId()
+{
+    if (logicalDevice == nullptr || logicalDevice->vkWaitForPresentKHR == nullptr)
+        return 0;
+    return ++presentId;
+}
+
+VulkanPresentConfig choosePresentConfig(const VulkanSwapchainSupport& support, VulkanLatencyPolicy policy)
+{
+    bool mailbox = false;
+    for (auto mode : support.presentModes)
+    {
+        if (mode == VK_PRESENT_MODE_MAILBOX_KHR)
+            mailbox = true;
+    }
+
+    VulkanPresentConfig config;
+    uint32_t minImageCount = std::max(support.capabilities.minImageCount, 2u);
+    switch (policy)
+    {
+    case VulkanLatencyPolicy::Throughput:
+        config.presentMode = mailbox ? VK_PRESENT_MODE_MAILBOX_KHR : VK_PRESENT_MODE_FIFO_KHR;
+        config.imageCount = minImageCount + 1;
+        config.maxQueuedFrames = 0;
+        break;
+    case VulkanLatencyPolicy::LowLatency:
+        // mailbox needs a spare image to render into while one is queued.
+        config.presentMode = mailbox ? VK_PRESENT_MODE_MAILBOX_KHR : VK_PRESENT_MODE_FIFO_KHR;
+        config.imageCount = mailbox ? minImageCount + 1 : minImageCount;
+        config.maxQueuedFrames = 1;
+        break;
+    case VulkanLatencyPolicy::PowerSave:
+        config.presentMode = VK_PRESENT_MODE_FIFO_KHR;
+        config.imageCount = minImageCount;
+        config.maxQueuedFrames = 1;
+        break;
+    }
+    if (support.capabilities.maxImageCount > 0)
+        config.imageCount = std::min(config.imageCount, support.capabilities.maxImageCount);
+    return config;
+}
+
+void VulkanLogicalDevice::destroyGraphicsPipeline(VulkanGraphicsPipeline& pipeline) const
+{
+    pipeline.handle.reset();
+    pipeline.renderPass.reset();
+    pipeline.layout.reset();
+    pipeline.setLayout.reset();
+    pipeline.vert.reset();
+    pipeline.task.reset();
+    pipeline.mesh.reset();
+    pipeline.frag.reset();
+}
+
+VulkanFormatInfo getFormatInfo(VkFormat format)
+{
+    switch (format)
+    {
+    case VK_FORMAT_R8_UNORM:
+    case VK_FORMAT_R8_SRGB:
+        return { 1, 1, 1 };
+    case VK_FORMAT_R8G8_UNORM:
+    case VK_FORMAT_R8G8_SRGB:
+    case VK_FORMAT_R16_SFLOAT:
+        return { 1, 1, 2 };
+    case VK_FORMAT_R8G8B8A8_UNORM:
+    case VK_FORMAT_R8G8B8A8_SRGB:
+    case VK_FORMAT_B8G8R8A8_UNORM:
+    case VK_FORMAT_B8G8R8A8_SRGB:
+    case VK_FORMAT_A2B10G10R10_UNORM_PACK32:
+    case VK_FORMAT_B10G11R11_UFLOAT_PACK32:
+    case VK_FORMAT_R16G16_SFLOAT:
+    case VK_FORMAT_R32_SFLOAT:
+        return { 1, 1, 4 };
+    case VK_FORMAT_R16G16B16A16_SFLOAT:
+    case VK_FORMAT_R32G32_SFLOAT:
+        return { 1, 1, 8 };
+    case VK_FORMAT_R32G32B32A32_SFLOAT:
+        return { 1, 1, 16 };
+    case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+    case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+    case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+    case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+    case VK_FORMAT_BC4_UNORM_BLOCK:
+    case VK_FORMAT_BC4_SNORM_BLOCK:
+        return { 4, 4, 8 };
+    case VK_FORMAT_BC2_UNORM_BLOCK:
+    case VK_FORMAT_BC2_SRGB_BLOCK:
+    case VK_FORMAT_BC3_UNORM_BLOCK:
+    case VK_FORMAT_BC3_SRGB_BLOCK:
+    case VK_FORMAT_BC5_UNORM_BLOCK:
+    case VK_FORMAT_BC5_SNORM_BLOCK:
+    case VK_FORMAT_BC6H_UFLOAT_BLOCK:
+    case VK_FORMAT_BC6H_SFLOAT_BLOCK:
+    case VK_FORMAT_BC7_UNORM_BLOCK:
+    case VK_FORMAT_BC7_SRGB_BLOCK:
+        return { 4, 4, 16 };
+    default:
+        throw std::runtime_error("unsupported texture format.");
+    }
+}
+
+VkDeviceSize getImageLevelSize(VkFormat format, uint32_t width, uint32_t height)
+{
+    VulkanFormatInfo info = getFormatInfo(format);
+    VkDeviceSize blocksX = (width + info.blockWidth - 1) / info.blockWidth;
+    VkDeviceSize blocksY = (height + info.blockHeight - 1) / info.blockHeight;
+    return blocksX * blocksY * info.blockSize;
 }
 
 std::vector<VkExtensionProperties> VulkanPhysicalDevice::enumerateExtensions() const
@@ -542,8 +1483,6 @@ VulkanLogicalDevice VulkanPhysicalDevice::createLogicalDevice(const VulkanLogica
 {
     float queuePriority = 1.0f;
 
-    VkPhysicalDeviceFeatures features = {};
-
     VkDeviceQueueCreateInfo qci = {};
     qci.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
     qci.pNext = nullptr;
@@ -556,7 +1495,33 @@ VulkanLogicalDevice VulkanPhysicalDevice::createLogicalDevice(const VulkanLogica
     dci.pNext = nullptr;
     dci.queueCreateInfoCount = 1;
     dci.pQueueCreateInfos = &qci;
-    dci.pEnabledFeatures = &features;
+    dci.pEnabledFeatures = &args.features;
+
+    VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures = {};
+    presentWaitFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+    presentWaitFeatures.pNext = nullptr;
+    presentWaitFeatures.presentWait = VK_TRUE;
+    VkPhysicalDevicePresentIdFeaturesKHR presentIdFeatures = {};
+    presentIdFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+    presentIdFeatures.pNext = &presentWaitFeatures;
+    presentIdFeatures.presentId = VK_TRUE;
+    if (args.presentWait)
+        dci.pNext = &presentIdFeatures;
+
+    VkPhysicalDeviceDynamicRenderingFeaturesKHR dynamicRenderingFeatures = {};
+    dynamicRenderingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR;
+    dynamicRenderingFeatures.pNext = (void*)dci.pNext;
+    dynamicRenderingFeatures.dynamicRendering = VK_TRUE;
+    if (args.dynamicRendering)
+        dci.pNext = &dynamicRenderingFeatures;
+
+    VkPhysicalDeviceMeshShaderFeaturesEXT meshShaderFeatures = {};
+    meshShaderFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT;
+    meshShaderFeatures.pNext = (void*)dci.pNext;
+    meshShaderFeatures.taskShader = VK_TRUE;
+    meshShaderFeatures.meshShader = VK_TRUE;
+    if (args.meshShader)
+        dci.pNext = &meshShaderFeatures;
 
     dci.enabledExtensionCount = args.extensions.size();
     dci.ppEnabledExtensionNames = args.extensions.data();
@@ -569,6 +1534,8 @@ VulkanLogicalDevice VulkanPhysicalDevice::createLogicalDevice(const VulkanLogica
     {
         throw std::runtime_error("create logical device failed.");
     }
+    VulkanLogicalDevice ret = {};
+    ret.device = VulkanDeviceHandle(logicalDevice);
 
     VkQueue queue = nullptr;
     vkGetDeviceQueue(logicalDevice, args.queueFamilyIndex, 0, &queue);
@@ -579,32 +1546,43 @@ VulkanLogicalDevice VulkanPhysicalDevice::createLogicalDevice(const VulkanLogica
     cpci.queueFamilyIndex = args.queueFamilyIndex;
     cpci.flags = 0;
 
-    VkCommandPool commandPool;
-    if (VK_SUCCESS != vkCreateCommandPool(logicalDevice, &cpci, nullptr, &commandPool))
+    if (VK_SUCCESS != vkCreateCommandPool(logicalDevice, &cpci, nullptr, ret.commandPool.put(logicalDevice)))
     {
         throw std::runtime_error("Create command-pool failed.");
     }
 
-    VulkanLogicalDevice ret = {};
-    ret.device = logicalDevice;
+    ret.physicalDevice = device;
     ret.queue = queue;
-    ret.commandPool = commandPool;
+    ret.queueFamilyIndex = args.queueFamilyIndex;
+    ret.features = args.features;
+    vkGetPhysicalDeviceMemoryProperties(device, &ret.memoryProps);
+    for (auto extension : args.extensions)
+    {
+        if (strcmp(extension, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) == 0)
+            ret.memoryBudgetSupported = true;
+    }
+    if (args.presentWait)
+        ret.vkWaitForPresentKHR = (PFN_vkWaitForPresentKHR)vkGetDeviceProcAddr(logicalDevice, "vkWaitForPresentKHR");
+    if (args.dynamicRendering)
+    {
+        ret.vkCmdBeginRenderingKHR = (PFN_vkCmdBeginRenderingKHR)vkGetDeviceProcAddr(logicalDevice, "vkCmdBeginRenderingKHR");
+        ret.vkCmdEndRenderingKHR = (PFN_vkCmdEndRenderingKHR)vkGetDeviceProcAddr(logicalDevice, "vkCmdEndRenderingKHR");
+    }
+    if (args.meshShader)
+        ret.vkCmdDrawMeshTasksEXT = (PFN_vkCmdDrawMeshTasksEXT)vkGetDeviceProcAddr(logicalDevice, "vkCmdDrawMeshTasksEXT");
+    if (args.drawIndirectCount)
+    {
+        ret.vkCmdDrawIndexedIndirectCountKHR = (PFN_vkCmdDrawIndexedIndirectCountKHR)vkGetDeviceProcAddr(
+            logicalDevice, "vkCmdDrawIndexedIndirectCountKHR");
+    }
 
     return ret;
 }
 
 void VulkanPhysicalDevice::destroyLogicalDevice(VulkanLogicalDevice& logicalDevice) const
 {
-    if (logicalDevice.commandPool != nullptr)
-    {
-        vkDestroyCommandPool(logicalDevice.device, logicalDevice.commandPool, nullptr);
-        logicalDevice.commandPool = nullptr;
-    }
-    if (logicalDevice.device != nullptr)
-    {
-        vkDestroyDevice(logicalDevice.device, nullptr);
-        logicalDevice.device = nullptr;
-    }
+    logicalDevice.commandPool.reset();
+    logicalDevice.device.reset();
 }
 
 
@@ -615,6 +1593,234 @@ bool VulkanPhysicalDevice::checkSurfaceSupport(VkSurfaceKHR surface, uint32_t qu
     return support == VK_TRUE;
 }
 
+VkDeviceSize VulkanPhysicalDevice::deviceLocalMemorySize() const
+{
+    VkDeviceSize size = 0;
+    for (uint32_t i = 0; i < memoryProps.memoryHeapCount; i++)
+    {
+        if (memoryProps.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+            size += memoryProps.memoryHeaps[i].size;
+    }
+    return size;
+}
+
+bool VulkanPhysicalDevice::checkPresentWaitSupport() const
+{
+    if (!capabilities.hasExtension(VK_KHR_PRESENT_ID_EXTENSION_NAME) ||
+        !capabilities.hasExtension(VK_KHR_PRESENT_WAIT_EXTENSION_NAME))
+        return false;
+
+    VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures = {};
+    presentWaitFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+    presentWaitFeatures.pNext = nullptr;
+    VkPhysicalDevicePresentIdFeaturesKHR presentIdFeatures = {};
+    presentIdFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+    presentIdFeatures.pNext = &presentWaitFeatures;
+    VkPhysicalDeviceFeatures2 features2 = {};
+    features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features2.pNext = &presentIdFeatures;
+    vkGetPhysicalDeviceFeatures2(device, &features2);
+    return presentIdFeatures.presentId && presentWaitFeatures.presentWait;
+}
+
+bool VulkanPhysicalDevice::checkSubgroupSupport(VkShaderStageFlags stages, VkSubgroupFeatureFlags operations) const
+{
+    if (props.apiVersion < VK_API_VERSION_1_1)
+        return false;
+
+    VkPhysicalDeviceSubgroupProperties subgroupProps = {};
+    subgroupProps.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES;
+    subgroupProps.pNext = nullptr;
+    VkPhysicalDeviceProperties2 props2 = {};
+    props2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    props2.pNext = &subgroupProps;
+    vkGetPhysicalDeviceProperties2(device, &props2);
+    return (subgroupProps.supportedStages & stages) == stages &&
+        (subgroupProps.supportedOperations & operations) == operations;
+}
+
+VkFormat VulkanPhysicalDevice::findDepthFormat() const
+{
+    const VkFormat candidates[] = {
+        VK_FORMAT_D32_SFLOAT,
+        VK_FORMAT_D24_UNORM_S8_UINT,
+        VK_FORMAT_D16_UNORM
+    };
+    for (auto format : candidates)
+    {
+        VkFormatProperties props;
+        vkGetPhysicalDeviceFormatProperties(device, format, &props);
+        if (props.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT)
+            return format;
+    }
+    return VK_FORMAT_UNDEFINED;
+}
+
+VkSampleCountFlagBits VulkanPhysicalDevice::maxSampleCount(VkSampleCountFlagBits limit) const
+{
+    VkSampleCountFlags counts = limits.framebufferColorSampleCounts & limits.framebufferDepthSampleCounts;
+    uint32_t count = VK_SAMPLE_COUNT_64_BIT;
+    while (count > (uint32_t)limit)
+        count >>= 1;
+    for (; count > 1; count >>= 1)
+    {
+        if (counts & count)
+            return (VkSampleCountFlagBits)count;
+    }
+    return VK_SAMPLE_COUNT_1_BIT;
+}
+
+bool VulkanPhysicalDevice::checkDynamicRenderingSupport() const
+{
+    // its dependencies (depth_stencil_resolve, create_renderpass2) are core in 1.2.
+    if (props.apiVersion < VK_API_VERSION_1_2 ||
+        !capabilities.hasExtension(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME))
+        return false;
+
+    VkPhysicalDeviceDynamicRenderingFeaturesKHR dynamicRenderingFeatures = {};
+    dynamicRenderingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR;
+    dynamicRenderingFeatures.pNext = nullptr;
+    VkPhysicalDeviceFeatures2 features2 = {};
+    features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features2.pNext = &dynamicRenderingFeatures;
+    vkGetPhysicalDeviceFeatures2(device, &features2);
+    return dynamicRenderingFeatures.dynamicRendering;
+}
+
+bool VulkanPhysicalDevice::checkMeshShaderSupport() const
+{
+    // GL_EXT_mesh_shader compiles to SPIR-V 1.4, which is core in 1.2.
+    if (props.apiVersion < VK_API_VERSION_1_2 ||
+        !capabilities.hasExtension(VK_EXT_MESH_SHADER_EXTENSION_NAME))
+        return false;
+
+    VkPhysicalDeviceMeshShaderFeaturesEXT meshShaderFeatures = {};
+    meshShaderFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT;
+    meshShaderFeatures.pNext = nullptr;
+    VkPhysicalDeviceFeatures2 features2 = {};
+    features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features2.pNext = &meshShaderFeatures;
+    vkGetPhysicalDeviceFeatures2(device, &features2);
+    return meshShaderFeatures.taskShader && meshShaderFeatures.meshShader;
+}
+
+bool VulkanPhysicalDevice::checkDrawIndirectCountSupport() const
+{
+    return capabilities.hasExtension(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+}
+
+static uint32_t countMissingFeatures(const VkPhysicalDeviceFeatures& wanted, const VkPhysicalDeviceFeatures& supported)
+{
+    // VkPhysicalDeviceFeatures is nothing but VkBool32 members.
+    const VkBool32* w = (const VkBool32*)&wanted;
+    const VkBool32* s = (const VkBool32*)&supported;
+    uint32_t missing = 0;
+    for (size_t i = 0; i < sizeof(VkPhysicalDeviceFeatures) / sizeof(VkBool32); i++)
+    {
+        if (w[i] && !s[i])
+            missing++;
+    }
+    return missing;
+}
+
+VulkanDeviceRating VulkanPhysicalDevice::rate(const VulkanDeviceRequirements& requirements) const
+{
+    VulkanDeviceRating rating;
+
+    for (auto name : requirements.extensions)
+    {
+        if (!capabilities.hasExtension(name))
+        {
+            rating.reason = std::string("missing extension ") + name;
+            return rating;
+        }
+    }
+    if (countMissingFeatures(requirements.features, features) > 0)
+    {
+        rating.reason = "missing required features";
+        return rating;
+    }
+
+    bool queue = false;
+    bool presentFromQueue = false;
+    bool present = requirements.surface == nullptr;
+    bool transferQueue = false;
+    bool computeQueue = false;
+    for (uint32_t i = 0; i < queueFamilies.size(); i++)
+    {
+        VkQueueFlags flags = queueFamilies[i].queueFlags;
+        bool canPresent = requirements.surface != nullptr && this->checkSurfaceSupport(requirements.surface, i);
+        if ((flags & requirements.queueFlags) == requirements.queueFlags)
+        {
+            queue = true;
+            presentFromQueue |= canPresent;
+        }
+        present |= canPresent;
+        if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)))
+            transferQueue = true;
+        if ((flags & VK_QUEUE_COMPUTE_BIT) && !(flags & VK_QUEUE_GRAPHICS_BIT))
+            computeQueue = true;
+    }
+    if (!queue || !present)
+    {
+        rating.reason = !queue ? "no queue family with the required flags" : "cannot present to the surface";
+        return rating;
+    }
+
+    // the device type dominates: a big CPU heap must not beat a small discrete GPU.
+    int64_t score = 0;
+    switch (props.deviceType)
+    {
+    case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU: score += 100000; rating.reason = "discrete"; break;
+    case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: score += 50000; rating.reason = "integrated"; break;
+    case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU: score += 20000; rating.reason = "virtual"; break;
+    case VK_PHYSICAL_DEVICE_TYPE_CPU: rating.reason = "cpu"; break;
+    default: score += 10000; rating.reason = "other"; break;
+    }
+
+    int64_t deviceLocalMiB = (int64_t)(this->deviceLocalMemorySize() >> 20);
+    score += std::min<int64_t>(deviceLocalMiB / 8, 40000);
+    rating.reason += ", " + std::to_string(deviceLocalMiB) + " MiB device-local";
+
+    uint32_t preferredExtensions = 0;
+    for (auto name : requirements.preferredExtensions)
+    {
+        if (capabilities.hasExtension(name))
+            preferredExtensions++;
+    }
+    uint32_t preferredFeatures = 0;
+    const VkBool32* wanted = (const VkBool32*)&requirements.preferredFeatures;
+    for (size_t i = 0; i < sizeof(VkPhysicalDeviceFeatures) / sizeof(VkBool32); i++)
+    {
+        if (wanted[i])
+            preferredFeatures++;
+    }
+    preferredFeatures -= countMissingFeatures(requirements.preferredFeatures, features);
+    score += 500 * preferredExtensions + 250 * preferredFeatures;
+    rating.reason += ", " + std::to_string(preferredExtensions) + "/" +
+        std::to_string(requirements.preferredExtensions.size()) + " preferred extensions";
+    rating.reason += ", " + std::to_string(preferredFeatures) + " preferred features";
+
+    if (presentFromQueue)
+    {
+        score += 1000;
+        rating.reason += ", presents from the graphics queue";
+    }
+    if (transferQueue)
+    {
+        score += 500;
+        rating.reason += ", transfer queue";
+    }
+    if (computeQueue)
+    {
+        score += 500;
+        rating.reason += ", async compute queue";
+    }
+
+    rating.score = score;
+    return rating;
+}
+
 VulkanSwapchainSupport VulkanPhysicalDevice::checkSwapchainSupport(VkSurfaceKHR surface) const
 {
     VulkanSwapchainSupport support;
@@ -684,14 +1890,12 @@ VulkanInstance VulkanInstance::createInstance(const VulkanInstanceArgs& args)
 
     instance.extensionFactory.init(instance.handle);
 
+    // the callback reports through VK_EXT_debug_report, so it has to be enabled.
     bool enabledDebug = false;
-    for (auto& layer : args.layers)
+    for (auto& extension : args.extensions)
     {
-        if (strstr(layer, "validation"))
-        {
+        if (strcmp(extension, VK_EXT_DEBUG_REPORT_EXTENSION_NAME) == 0)
             enabledDebug = true;
-            break;
-        }
     }
     if (enabledDebug)
     {
@@ -742,12 +1946,78 @@ std::vector<VulkanPhysicalDevice> VulkanInstance::enumeratePhysicalDevices()
         p.device = devices.at(i);
         vkGetPhysicalDeviceProperties(p.device, &p.props);
         vkGetPhysicalDeviceFeatures(p.device, &p.features);
+        vkGetPhysicalDeviceMemoryProperties(p.device, &p.memoryProps);
+        p.limits = p.props.limits;
 
         uint32_t qfCount = 0;
         vkGetPhysicalDeviceQueueFamilyProperties(p.device, &qfCount, nullptr);
         p.queueFamilies.resize(qfCount);
         vkGetPhysicalDeviceQueueFamilyProperties(p.device, &qfCount, p.queueFamilies.data());
+
+        p.capabilities = VulkanCapabilities::query(p.device);
     }
 
     return list;
 }
+
+size_t VulkanInstance::selectPhysicalDevice(
+    const std::vector<VulkanPhysicalDevice>& devices,
+    const VulkanDeviceRequirements& requirements,
+    const std::string& override)
+{
+    if (!override.empty())
+    {
+        auto lower = [](std::string str) {
+            for (auto& c : str)
+                c = (char)tolower((unsigned char)c);
+            return str;
+        };
+        bool isIndex = override.find_first_not_of("0123456789") == std::string::npos;
+        unsigned long index = 0;
+        if (isIndex)
+        {
+            try
+            {
+                index = std::stoul(override);
+            }
+            catch (const std::out_of_range&)
+            {
+                throw std::runtime_error("no physical device matches: " + override);
+            }
+        }
+        for (size_t i = 0; i < devices.size(); i++)
+        {
+            bool match = isIndex
+                ? index == i
+                : lower(devices[i].props.deviceName).find(lower(override)) != std::string::npos;
+            if (!match)
+                continue;
+
+            auto rating = devices[i].rate(requirements);
+            if (rating.score < 0)
+            {
+                throw std::runtime_error(std::string("requested physical device is unsuitable: ") +
+                    devices[i].props.deviceName + " (" + rating.reason + ")");
+            }
+            return i;
+        }
+        throw std::runtime_error("no physical device matches: " + override);
+    }
+
+    size_t best = devices.size();
+    int64_t bestScore = -1;
+    for (size_t i = 0; i < devices.size(); i++)
+    {
+        auto rating = devices[i].rate(requirements);
+        if (rating.score > bestScore)
+        {
+            best = i;
+            bestScore = rating.score;
+        }
+    }
+    if (best == devices.size())
+    {
+        throw std::runtime_error("no suitable physical device.");
+    }
+    return best;
+}
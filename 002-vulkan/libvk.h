@@ -2,10 +2,18 @@
 #define _LIBVK_H_
 
 #include <vulkan/vulkan.hpp>
+#include "libvk_caps.h"
+#include "libvk_handle.h"
+#include <functional>
 #include <vector>
 #include <map>
 #include <string>
 
+// the meshlet renderer's mesh shading path.
+#ifndef VK_EXT_mesh_shader
+#error "VK_EXT_mesh_shader is missing: the Vulkan headers must be 1.3.226 or later."
+#endif
+
 template<typename Func>
 Func resolveVulkanEXT(VkInstance instance, const char* name, Func& ptr)
 {
@@ -38,6 +46,20 @@ struct VulkanSwapchainSupport
     std::vector<VkPresentModeKHR> presentModes;
 };
 
+enum class VulkanLatencyPolicy
+{
+    Throughput,     // newest frame wins, the GPU never waits for the display
+    LowLatency,     // as Throughput, but the CPU stays one frame ahead of the display
+    PowerSave       // vsync, minimal queue, no frame rendered only to be discarded
+};
+
+struct VulkanPresentConfig
+{
+    VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR;
+    uint32_t imageCount = 2;
+    uint32_t maxQueuedFrames = 0;   // presents the CPU may run ahead of the display, 0: unpaced
+};
+
 struct QueueFamilyIndices
 {
     uint32_t graphicsQueueFamilyIndex;
@@ -50,51 +72,178 @@ struct VulkanSwapchainArgs
     VkExtent2D extent;
     int minImageCount;
     VkSurfaceFormatKHR format;
+    VkImageUsageFlags imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
     VkPresentModeKHR presentMode;
     QueueFamilyIndices queueFamilyIndices;
     VkSurfaceTransformFlagBitsKHR preTransform;
+    VkSwapchainKHR oldSwapchain = VK_NULL_HANDLE;   // being replaced, retired by the caller
 };
 
+// The structs below own their Vulkan objects and are move-only: they are
+// destroyed with the struct, or earlier through the matching destroy call.
 struct VulkanSwapchain
 {
-    VkSwapchainKHR handle = nullptr;
+    VulkanSwapchainHandle handle;
     VkFormat format;
     VkExtent2D extent;
-    std::vector<VkImage> images;
-    std::vector<VkImageView> imageViews;
+    std::vector<VkImage> images;    // owned by the swapchain
+    std::vector<VulkanImageViewHandle> imageViews;
+};
+
+struct VulkanShaderCode
+{
+    const uint32_t* code = nullptr;
+    size_t size = 0;
+
+    VulkanShaderCode() = default;
+    VulkanShaderCode(const uint32_t* code, size_t size) : code(code), size(size) {}
+
+    template<size_t N>
+    VulkanShaderCode(const uint32_t (&words)[N]) : code(words), size(sizeof(words)) {}
 };
 
 struct VulkanGraphicsPipelineArgs
 {
-    std::vector<char> vert;
-    std::vector<char> frag;
+    VulkanShaderCode vert;
+    VulkanShaderCode frag;
+    VulkanShaderCode task;          // optional, with `mesh`
+    VulkanShaderCode mesh;          // mesh shading instead of `vert` and vertex input, VK_EXT_mesh_shader
     VkViewport viewport;
     VkRect2D scissor;
     VkFormat colorFormat;
+    VkFormat depthFormat = VK_FORMAT_UNDEFINED;             // UNDEFINED: no depth attachment
+    VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;  // > 1: resolved into the color image
+    bool dynamicRendering = false;  // no render pass: record with VulkanRenderTargets instead of a framebuffer
+    std::vector<VkVertexInputBindingDescription> vertexBindings;    // none: vertices come from gl_VertexIndex
+    std::vector<VkVertexInputAttributeDescription> vertexAttributes;
+    std::vector<VkDescriptorSetLayoutBinding> bindings;             // set 0, none: no descriptor set
+    uint32_t pushConstantSize = 0;  // visible to the vertex (or task and mesh) and fragment stages
+    VkCullModeFlags cullMode = VK_CULL_MODE_BACK_BIT;
+    bool depthTest = true;          // with a depth format only
+    bool depthWrite = true;         // with depthTest; off: tested against opaque geometry, never occludes
+    bool blend = false;             // straight alpha blending
+    bool present = true;            // false: the color image is left in COLOR_ATTACHMENT_OPTIMAL for post-processing
 };
 
 struct VulkanGraphicsPipeline
 {
-    VkPipeline handle = nullptr;
-    VkShaderModule vert = nullptr;
-    VkShaderModule frag = nullptr;
+    VulkanPipelineHandle handle;
+    VulkanShaderModuleHandle vert;
+    VulkanShaderModuleHandle frag;
+    VulkanShaderModuleHandle task;
+    VulkanShaderModuleHandle mesh;
     VkViewport viewport;
     VkRect2D scissor;
-    VkPipelineLayout layout;
-    VkRenderPass renderPass;
+    VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+    VkFormat depthFormat = VK_FORMAT_UNDEFINED;
+    VulkanDescriptorSetLayoutHandle setLayout;     // null without bindings
+    VulkanPipelineLayoutHandle layout;
+    VulkanRenderPassHandle renderPass;
+};
+
+struct VulkanComputePipelineArgs
+{
+    VulkanShaderCode comp;
+    std::vector<VkDescriptorSetLayoutBinding> bindings;
+    uint32_t pushConstantSize = 0;
+};
+
+struct VulkanComputePipeline
+{
+    VulkanPipelineHandle handle;
+    VulkanShaderModuleHandle comp;
+    VulkanDescriptorSetLayoutHandle setLayout;
+    VulkanPipelineLayoutHandle layout;
 };
 
 struct VulkanFrameBufferArgs
 {
     VkRenderPass renderPass;
-    std::vector<VkImageView> imageViews;
+    const VulkanImageViewHandle* imageViews;    // one framebuffer per view; a single one serves every image
+    uint32_t imageViewCount;
     uint32_t width;
     uint32_t height;
+    VkImageView colorView = VK_NULL_HANDLE;     // multisampled color, shared by all framebuffers
+    VkImageView depthView = VK_NULL_HANDLE;     // shared by all framebuffers
 };
 
 struct VulkanFrameBufferObject
 {
-    std::vector<VkFramebuffer> handles;
+    std::vector<VulkanFramebufferHandle> handles;
+};
+
+// Color or depth image that only exists inside a render pass. Transient
+// attachments get lazily allocated memory where the device has it, so tilers
+// can keep them in tile memory and never back them with real pages.
+struct VulkanAttachmentArgs
+{
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    VkExtent2D extent = {};
+    VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+    VkImageUsageFlags usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+    bool transient = true;      // contents are never loaded or stored
+};
+
+struct VulkanAttachment
+{
+    VulkanDeviceMemoryHandle memory;
+    VulkanImageHandle image;
+    VulkanImageViewHandle view;
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+    bool lazilyAllocated = false;
+};
+
+// What a dynamic-rendering pass draws into: the swapchain image directly, or
+// `color` resolved into it when the pipeline is multisampled. No render pass or
+// framebuffer objects, so nothing besides the views is rebuilt on resize.
+struct VulkanRenderTargets
+{
+    const VulkanSwapchain* swapchain = nullptr;
+    const VulkanAttachment* color = nullptr;    // optional, multisampled
+    const VulkanAttachment* depth = nullptr;    // optional
+    const VulkanAttachment* output = nullptr;   // optional, drawn or resolved into instead of the swapchain
+                                                // image and left in COLOR_ATTACHMENT_OPTIMAL
+};
+
+struct VulkanBufferArgs
+{
+    VkDeviceSize size = 0;
+    VkBufferUsageFlags usage = 0;
+    VkMemoryPropertyFlags memoryProps = 0;
+    VkMemoryPropertyFlags preferredMemoryProps = 0;
+    bool mapped = false;
+};
+
+struct VulkanBuffer
+{
+    VulkanDeviceMemoryHandle memory;    // declared first: freed after the buffer
+    VulkanBufferHandle handle;
+    VkDeviceSize size = 0;
+    VkMemoryPropertyFlags memoryFlags = 0;
+    void* mapped = nullptr;
+};
+
+struct VulkanFormatInfo
+{
+    uint32_t blockWidth = 1;
+    uint32_t blockHeight = 1;
+    uint32_t blockSize = 0;
+};
+
+VulkanPresentConfig choosePresentConfig(const VulkanSwapchainSupport& support, VulkanLatencyPolicy policy);
+
+VulkanFormatInfo getFormatInfo(VkFormat format);
+VkDeviceSize getImageLevelSize(VkFormat format, uint32_t width, uint32_t height);
+
+// Per-heap budget and usage in bytes. Without VK_EXT_memory_budget the budget is
+// estimated from the heap sizes and `reported` stays false: usage is then unknown
+// and has to come from the caller's own accounting.
+struct VulkanMemoryBudget
+{
+    VkDeviceSize budget[VK_MAX_MEMORY_HEAPS] = {};
+    VkDeviceSize usage[VK_MAX_MEMORY_HEAPS] = {};
+    bool reported = false;
 };
 
 struct VulkanLogicalDeviceArgs
@@ -102,40 +251,182 @@ struct VulkanLogicalDeviceArgs
     uint32_t queueFamilyIndex;
     std::vector<const char*> extensions;
     std::vector<const char*> layers;
+    VkPhysicalDeviceFeatures features = {};
+    bool presentWait = false;       // VK_KHR_present_id and VK_KHR_present_wait must be in `extensions`
+    bool dynamicRendering = false;  // VK_KHR_dynamic_rendering must be in `extensions`
+    bool meshShader = false;        // task and mesh shaders, VK_EXT_mesh_shader must be in `extensions`
+    bool drawIndirectCount = false; // VK_KHR_draw_indirect_count must be in `extensions`
 };
 
 struct VulkanPresentArgs
 {
     VkSwapchainKHR swapchain;
-    std::vector<VkCommandBuffer> commandBuffers;
+    const VkCommandBuffer* commandBuffers = nullptr;   // one per swapchain image, not copied
     VkSemaphore onImageAvailable;
     VkSemaphore onRenderFinished;
+    uint64_t presentId = 0;
+    VkFence fence = VK_NULL_HANDLE;     // signaled with the rendering submission
+};
+
+#define VULKAN_PRESENT_BATCH_MAX 16u    // swapchains, so submitting needs no allocation
+
+// One frame over several swapchains of the device's queue: every image is
+// acquired first, then the rendering for all of them goes in one submission
+// and all of them in one present. Entries are parallel, one per swapchain.
+struct VulkanPresentBatch
+{
+    std::vector<VkSwapchainKHR> swapchains;
+    std::vector<VkSemaphore> onImageAvailable;  // one per swapchain, signaled by its acquire
+    std::vector<uint32_t> imageIndices;         // written by acquireNextImages; UINT32_MAX: not acquired
+    std::vector<uint64_t> presentIds;           // empty, or one per swapchain; 0: none
+    std::vector<VkResult> results;              // of the acquire where it failed, else of the present
+};
+
+class VulkanRenderQueue;
+class VulkanGpuProfiler;
+class VulkanPostProcess;
+class VulkanCapture;
+
+// Optional extras for beginCommandBuffers/endCommandBuffers. Pass the same
+// args to both calls.
+struct VulkanRecordArgs
+{
+    VulkanRenderQueue* queue = nullptr;         // records its draws instead of the demo quad
+    VulkanGpuProfiler* profiler = nullptr;      // timestamps
+    const VulkanPostProcess* post = nullptr;    // recorded after the rendering, writes and presents the image
+    std::function<void(VkCommandBuffer)> prepare;   // recorded before the render pass (or rendering scope)
+                                                    // begins: compute whose results the pass draws
+    uint32_t slot = 0;      // profiler slot of a single command buffer; the vector overloads use the image index
+    VkCommandBufferUsageFlags usage = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
 };
 
 struct VulkanLogicalDevice
 {
-    VkDevice device = nullptr;
+    VkPhysicalDevice physicalDevice = nullptr;
+    VulkanDeviceHandle device;
     VkQueue queue = nullptr;
-    VkCommandPool commandPool = nullptr;
+    uint32_t queueFamilyIndex = 0;
+    VulkanCommandPoolHandle commandPool;
+    VkPhysicalDeviceMemoryProperties memoryProps = {};
+    VkPhysicalDeviceFeatures features = {};
+    bool memoryBudgetSupported = false;
+    PFN_vkWaitForPresentKHR vkWaitForPresentKHR = nullptr;     // null without present-wait
+    PFN_vkCmdBeginRenderingKHR vkCmdBeginRenderingKHR = nullptr;   // null without dynamic rendering
+    PFN_vkCmdEndRenderingKHR vkCmdEndRenderingKHR = nullptr;
+    PFN_vkCmdDrawMeshTasksEXT vkCmdDrawMeshTasksEXT = nullptr;     // null without mesh shaders
+    PFN_vkCmdDrawIndexedIndirectCountKHR vkCmdDrawIndexedIndirectCountKHR = nullptr;   // null without draw-indirect-count
+    VulkanCapture* capture = nullptr;   // records the calls made through the device and its helpers while set
+
+    uint32_t findMemoryType(uint32_t typeBits, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred = 0) const;
+
+    VulkanMemoryBudget queryMemoryBudget() const;
+
+    VulkanBuffer createBuffer(const VulkanBufferArgs& args) const;
+    void destroyBuffer(VulkanBuffer& buffer) const;
+
+    VulkanAttachment createAttachment(const VulkanAttachmentArgs& args) const;
+    void destroyAttachment(VulkanAttachment& attachment) const;
 
     VulkanSwapchain createSwapchain(const VulkanSwapchainArgs& args) const;
     void destroySwapchain(VulkanSwapchain& swapchain) const;
 
-    VkShaderModule createShaderModule(const std::vector<char>& code) const;
-    void destroyShaderModule(VkShaderModule shader) const;
+    VulkanShaderModuleHandle createShaderModule(const VulkanShaderCode& code) const;
+    void destroyShaderModule(VulkanShaderModuleHandle& shader) const;
 
     VulkanGraphicsPipeline createGraphicsPipeline(const VulkanGraphicsPipelineArgs& args) const;
     void destroyGraphicsPipeline(VulkanGraphicsPipeline& pipeline) const;
 
+    VulkanComputePipeline createComputePipeline(const VulkanComputePipelineArgs& args) const;
+    void destroyComputePipeline(VulkanComputePipeline& pipeline) const;
+
     VulkanFrameBufferObject createFrameBufferObject(const VulkanFrameBufferArgs& args) const;
     void destroyFrameBufferObject(VulkanFrameBufferObject& fbo) const;
 
-    VkSemaphore createSemaphore() const;
-    void destroySemaphore(VkSemaphore& semaphore) const;
+    VulkanSemaphoreHandle createSemaphore() const;
+    void destroySemaphore(VulkanSemaphoreHandle& semaphore) const;
 
-    std::vector<VkCommandBuffer> beginCommandBuffers(VulkanGraphicsPipeline& pipeline, VulkanFrameBufferObject& fbo) const;
-    void endCommandBuffers(std::vector<VkCommandBuffer>& commandBuffers) const;
+    VulkanFenceHandle createFence(bool signaled = false) const;
+    void destroyFence(VulkanFenceHandle& fence) const;
+
+    // Without a queue the pipeline is bound and the demo quad drawn; with one, the
+    // queue records its draws instead (see VulkanRenderQueue::record).
+    std::vector<VkCommandBuffer> beginCommandBuffers(const VulkanGraphicsPipeline& pipeline, const VulkanFrameBufferObject& fbo,
+        const VulkanRecordArgs& args = VulkanRecordArgs()) const;
+    void endCommandBuffers(std::vector<VkCommandBuffer>& commandBuffers,
+        const VulkanRecordArgs& args = VulkanRecordArgs()) const;
+    // Dynamic-rendering variants, one command buffer per swapchain image. They
+    // also move the images to and from the attachment layouts.
+    std::vector<VkCommandBuffer> beginCommandBuffers(const VulkanGraphicsPipeline& pipeline, const VulkanRenderTargets& targets,
+        const VulkanRecordArgs& args = VulkanRecordArgs()) const;
+    void endCommandBuffers(std::vector<VkCommandBuffer>& commandBuffers, const VulkanRenderTargets& targets,
+        const VulkanRecordArgs& args = VulkanRecordArgs()) const;
+    // Single command buffer variants, for work recorded every frame: the render
+    // pass (or rendering scope) for `imageIndex` is open between the two calls.
+    void beginCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex, const VulkanGraphicsPipeline& pipeline,
+        const VulkanFrameBufferObject& fbo, const VulkanRecordArgs& args = VulkanRecordArgs()) const;
+    void endCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex,
+        const VulkanRecordArgs& args = VulkanRecordArgs()) const;
+    void beginCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex, const VulkanGraphicsPipeline& pipeline,
+        const VulkanRenderTargets& targets, const VulkanRecordArgs& args = VulkanRecordArgs()) const;
+    void endCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex, const VulkanRenderTargets& targets,
+        const VulkanRecordArgs& args = VulkanRecordArgs()) const;
+    // Called by beginCommandBuffer while `capture` is set.
+    void captureDraws(const VulkanGraphicsPipeline& pipeline, const VulkanRecordArgs& args) const;
     void present(const VulkanPresentArgs& args) const;
+
+    uint32_t acquireNextImage(VkSwapchainKHR swapchain, VkSemaphore onImageAvailable) const;
+    void submit(VkCommandBuffer commandBuffer,
+        VkSemaphore waitSemaphore, VkPipelineStageFlags waitStage,
+        VkSemaphore signalSemaphore, VkFence fence = VK_NULL_HANDLE) const;
+    void presentImage(VkSwapchainKHR swapchain, uint32_t imageIndex, VkSemaphore waitSemaphore,
+        uint64_t presentId = 0) const;
+    bool waitForPresent(VkSwapchainKHR swapchain, uint64_t presentId, uint64_t timeout) const;
+    // Batched variants, see VulkanPresentBatch. A swapchain whose acquire fails
+    // (out of date, surface lost) sits the frame out: the submission waits for
+    // the acquired ones at `waitStage` and only those are presented. Returns the
+    // number acquired; throws only when the device is lost. The present throws
+    // on fatal errors only: out of date, suboptimal and surface lost show in the
+    // swapchain's result, for the caller to recreate it.
+    uint32_t acquireNextImages(VulkanPresentBatch& batch) const;
+    void submit(const VkCommandBuffer* commandBuffers, uint32_t commandBufferCount, const VulkanPresentBatch& batch,
+        VkPipelineStageFlags waitStage, VkSemaphore signalSemaphore, VkFence fence = VK_NULL_HANDLE) const;
+    void presentImages(VulkanPresentBatch& batch, VkSemaphore waitSemaphore) const;
+};
+
+// Keeps the CPU at most `maxQueuedFrames` presents ahead of the display: pace()
+// blocks until the present that many frames back is on screen, so input sampled
+// right after it is shown at the next refresh or so instead of behind a queue of
+// finished frames. Without present-wait it does nothing and the swapchain's own
+// back-pressure applies.
+struct VulkanPresentPacer
+{
+    const VulkanLogicalDevice* logicalDevice = nullptr;
+    VkSwapchainKHR swapchain = nullptr;
+    uint32_t maxQueuedFrames = 0;
+    uint64_t presentId = 0;
+
+    void init(const VulkanLogicalDevice& logicalDevice, VkSwapchainKHR swapchain, uint32_t maxQueuedFrames);
+    void pace();
+    // id to pass with the next present; 0 when ids are not in use.
+    uint64_t nextPresentId();
+};
+
+struct VulkanDeviceRequirements
+{
+    std::vector<const char*> extensions;
+    std::vector<const char*> preferredExtensions;
+    VkPhysicalDeviceFeatures features = {};
+    VkPhysicalDeviceFeatures preferredFeatures = {};
+    VkQueueFlags queueFlags = VK_QUEUE_GRAPHICS_BIT;
+    VkSurfaceKHR surface = nullptr;     // a queue family must also present to it
+};
+
+// score < 0: unsuitable, `reason` says why. Otherwise higher is better, and
+// `reason` lists what the score was made of.
+struct VulkanDeviceRating
+{
+    int64_t score = -1;
+    std::string reason;
 };
 
 struct VulkanPhysicalDevice
@@ -146,6 +437,7 @@ struct VulkanPhysicalDevice
     VkPhysicalDeviceLimits limits;
     VkPhysicalDeviceMemoryProperties memoryProps;
     std::vector<VkQueueFamilyProperties> queueFamilies;
+    VulkanCapabilities capabilities;    // queried once by enumeratePhysicalDevices
 
     std::vector<VkExtensionProperties> enumerateExtensions() const;
     std::vector<VkLayerProperties> enumerateLayers() const;
@@ -153,6 +445,19 @@ struct VulkanPhysicalDevice
     void destroyLogicalDevice(VulkanLogicalDevice& logicalDevice) const;
     bool checkSurfaceSupport(VkSurfaceKHR surface, uint32_t queueFamilyIndex) const;
     VulkanSwapchainSupport checkSwapchainSupport(VkSurfaceKHR surface) const;
+    VkDeviceSize deviceLocalMemorySize() const;
+    bool checkPresentWaitSupport() const;
+    bool checkDynamicRenderingSupport() const;
+    // Task and mesh shaders through VK_EXT_mesh_shader, on a 1.2 device (SPIR-V 1.4).
+    bool checkMeshShaderSupport() const;
+    bool checkDrawIndirectCountSupport() const;
+    // All `operations` in all `stages`; subgroups are core since 1.1.
+    bool checkSubgroupSupport(VkShaderStageFlags stages, VkSubgroupFeatureFlags operations) const;
+    // First of D32/D24S8/D16 usable as an optimal-tiling depth attachment.
+    VkFormat findDepthFormat() const;
+    // Highest count up to `limit` supported for both color and depth attachments.
+    VkSampleCountFlagBits maxSampleCount(VkSampleCountFlagBits limit) const;
+    VulkanDeviceRating rate(const VulkanDeviceRequirements& requirements) const;
 };
 
 struct VulkanInstanceArgs
@@ -176,6 +481,11 @@ struct VulkanInstance
     VkDebugReportCallbackEXT debugCallback = nullptr;
 
     std::vector<VulkanPhysicalDevice> enumeratePhysicalDevices();
+
+    // Index of the best-rated suitable device. `override` is a device index or a
+    // case-insensitive part of its name and wins over the score; empty: no override.
+    static size_t selectPhysicalDevice(const std::vector<VulkanPhysicalDevice>& devices,
+        const VulkanDeviceRequirements& requirements, const std::string& override = "");
 };
 
 #endif//_LIBVK_H_
@@ -0,0 +1,237 @@
+
+#include "libvk_allocator.h"
+
+static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+{
+    return alignment > 1 ? (value + alignment - 1) / alignment * alignment : value;
+}
+
+void VulkanAllocator::init(const VulkanLogicalDevice& logicalDevice, VkDeviceSize blockSize)
+{
+    this->logicalDevice = &logicalDevice;
+    this->blockSize = blockSize;
+}
+
+void VulkanAllocator::quit()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto& pool : pools)
+    {
+        for (auto& block : pool.blocks)
+        {
+            if (block.memory == nullptr)
+                continue;
+            if (block.mapped != nullptr)
+                vkUnmapMemory(logicalDevice->device, block.memory);
+            vkFreeMemory(logicalDevice->device, block.memory, nullptr);
+        }
+    }
+    pools.clear();
+    for (auto& usage : heapUsage)
+        usage = 0;
+    for (auto& used : heapUsed)
+        used = 0;
+}
+
+VulkanAllocator::Pool& VulkanAllocator::getPool(uint32_t memoryType, VulkanAllocationKind kind)
+{
+    for (auto& pool : pools)
+    {
+        if (pool.memoryType == memoryType && pool.kind == kind)
+            return pool;
+    }
+    pools.push_back({ memoryType, kind, {} });
+    return pools.back();
+}
+
+VulkanAllocator::Block VulkanAllocator::createBlock(uint32_t memoryType, VkDeviceSize size, bool dedicated)
+{
+    VkMemoryAllocateInfo mai = {};
+    mai.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    mai.pNext = nullptr;
+    mai.allocationSize = size;
+    mai.memoryTypeIndex = memoryType;
+
+    Block block;
+    block.size = size;
+    block.dedicated = dedicated;
+    if (VK_SUCCESS != vkAllocateMemory(logicalDevice->device, &mai, nullptr, &block.memory))
+    {
+        throw std::runtime_error("Allocate device memory block failed.");
+    }
+
+    const auto& type = logicalDevice->memoryProps.memoryTypes[memoryType];
+    if (type.propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+    {
+        if (VK_SUCCESS != vkMapMemory(logicalDevice->device, block.memory, 0, VK_WHOLE_SIZE, 0, &block.mapped))
+        {
+            vkFreeMemory(logicalDevice->device, block.memory, nullptr);
+            throw std::runtime_error("Map device memory block failed.");
+        }
+    }
+    heapUsage[type.heapIndex] += size;
+
+    if (!dedicated)
+        block.freeRanges.push_back({ 0, size });
+    return block;
+}
+
+VulkanAllocation VulkanAllocator::allocate(
+    const VkMemoryRequirements& requirements,
+    VkMemoryPropertyFlags required,
+    VkMemoryPropertyFlags preferred,
+    VulkanAllocationKind kind)
+{
+    uint32_t memoryType = logicalDevice->findMemoryType(requirements.memoryTypeBits, required, preferred);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    Pool& pool = this->getPool(memoryType, kind);
+
+    VulkanAllocation allocation;
+    allocation.memoryType = memoryType;
+    allocation.memoryFlags = logicalDevice->memoryProps.memoryTypes[memoryType].propertyFlags;
+    allocation.size = requirements.size;
+    allocation.pool = (uint32_t)(&pool - pools.data());
+    uint32_t heapIndex = logicalDevice->memoryProps.memoryTypes[memoryType].heapIndex;
+
+    // large resources get their own VkDeviceMemory instead of fragmenting blocks.
+    if (requirements.size > blockSize / 2)
+    {
+        Block block = this->createBlock(memoryType, requirements.size, true);
+        allocation.memory = block.memory;
+        allocation.offset = 0;
+        allocation.mapped = block.mapped;
+
+        uint32_t index = 0;
+        while (index < pool.blocks.size() && pool.blocks[index].memory != nullptr)
+            index++;
+        if (index == pool.blocks.size())
+            pool.blocks.push_back(std::move(block));
+        else
+            pool.blocks[index] = std::move(block);
+        allocation.block = index;
+        heapUsed[heapIndex] += allocation.size;
+        return allocation;
+    }
+
+    for (int pass = 0; pass < 2; pass++)
+    {
+        for (uint32_t b = 0; b < pool.blocks.size(); b++)
+        {
+            auto& block = pool.blocks[b];
+            if (block.memory == nullptr || block.dedicated)
+                continue;
+
+            for (size_t r = 0; r < block.freeRanges.size(); r++)
+            {
+                Range range = block.freeRanges[r];
+                VkDeviceSize offset = alignUp(range.offset, requirements.alignment);
+                if (offset + requirements.size > range.offset + range.size)
+                    continue;
+
+                VkDeviceSize tail = range.offset + range.size - (offset + requirements.size);
+                block.freeRanges.erase(block.freeRanges.begin() + r);
+                if (tail > 0)
+                    block.freeRanges.insert(block.freeRanges.begin() + r, { offset + requirements.size, tail });
+                if (offset > range.offset)
+                    block.freeRanges.insert(block.freeRanges.begin() + r, { range.offset, offset - range.offset });
+
+                allocation.memory = block.memory;
+                allocation.offset = offset;
+                allocation.mapped = block.mapped != nullptr ? (uint8_t*)block.mapped + offset : nullptr;
+                allocation.block = b;
+                heapUsed[heapIndex] += allocation.size;
+                return allocation;
+            }
+        }
+
+        if (pass == 0)
+        {
+            Block block = this->createBlock(memoryType, blockSize, false);
+            uint32_t index = 0;
+            while (index < pool.blocks.size() && pool.blocks[index].memory != nullptr)
+                index++;
+            if (index == pool.blocks.size())
+                pool.blocks.push_back(std::move(block));
+            else
+                pool.blocks[index] = std::move(block);
+        }
+    }
+
+    throw std::runtime_error("device memory allocation failed.");
+}
+
+void VulkanAllocator::free(VulkanAllocation& allocation)
+{
+    if (allocation.memory == nullptr)
+        return;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    Pool& pool = pools.at(allocation.pool);
+    Block& block = pool.blocks.at(allocation.block);
+    uint32_t heapIndex = logicalDevice->memoryProps.memoryTypes[pool.memoryType].heapIndex;
+
+    heapUsed[heapIndex] -= allocation.size;
+
+    bool release = block.dedicated;
+    if (!block.dedicated)
+    {
+        auto& ranges = block.freeRanges;
+        auto it = std::lower_bound(ranges.begin(), ranges.end(), allocation.offset,
+            [](const Range& range, VkDeviceSize offset) { return range.offset < offset; });
+        it = ranges.insert(it, { allocation.offset, allocation.size });
+
+        auto next = it + 1;
+        if (next != ranges.end() && it->offset + it->size == next->offset)
+        {
+            it->size += next->size;
+            ranges.erase(next);
+        }
+        if (it != ranges.begin())
+        {
+            auto prev = it - 1;
+            if (prev->offset + prev->size == it->offset)
+            {
+                prev->size += it->size;
+                ranges.erase(it);
+            }
+        }
+
+        // an empty block is released unless it is the last one of its pool.
+        if (ranges.size() == 1 && ranges[0].size == block.size)
+        {
+            for (uint32_t b = 0; b < pool.blocks.size(); b++)
+            {
+                const auto& other = pool.blocks[b];
+                if (b != allocation.block && other.memory != nullptr && !other.dedicated)
+                {
+                    release = true;
+                    break;
+                }
+            }
+        }
+    }
+
+    if (release)
+    {
+        if (block.mapped != nullptr)
+            vkUnmapMemory(logicalDevice->device, block.memory);
+        vkFreeMemory(logicalDevice->device, block.memory, nullptr);
+        heapUsage[heapIndex] -= block.size;
+        block = Block();
+    }
+
+    allocation = VulkanAllocation();
+}
+
+VkDeviceSize VulkanAllocator::allocatedBytes(uint32_t heapIndex) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return heapIndex < VK_MAX_MEMORY_HEAPS ? heapUsage[heapIndex] : 0;
+}
+
+VkDeviceSize VulkanAllocator::usedBytes(uint32_t heapIndex) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return heapIndex < VK_MAX_MEMORY_HEAPS ? heapUsed[heapIndex] : 0;
+}
@@ -0,0 +1,79 @@
+#ifndef _LIBVK_ALLOCATOR_H_
+#define _LIBVK_ALLOCATOR_H_
+
+#include "libvk.h"
+#include <mutex>
+
+struct VulkanAllocation
+{
+    VkDeviceMemory memory = nullptr;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+    uint32_t memoryType = 0;
+    VkMemoryPropertyFlags memoryFlags = 0;
+    void* mapped = nullptr;
+    uint32_t pool = ~0u;
+    uint32_t block = ~0u;
+};
+
+enum class VulkanAllocationKind
+{
+    Linear,     // buffers, linear images
+    Optimal     // optimal-tiling images
+};
+
+// Sub-allocates resources from large VkDeviceMemory blocks, one free list per
+// (memory type, resource kind) pair. Keeping linear and optimal resources in
+// separate blocks side-steps bufferImageGranularity, and the block count stays far
+// below maxMemoryAllocationCount even with thousands of textures.
+class VulkanAllocator
+{
+    struct Range
+    {
+        VkDeviceSize offset;
+        VkDeviceSize size;
+    };
+
+    struct Block
+    {
+        VkDeviceMemory memory = nullptr;
+        VkDeviceSize size = 0;
+        void* mapped = nullptr;
+        std::vector<Range> freeRanges;
+        bool dedicated = false;
+    };
+
+    struct Pool
+    {
+        uint32_t memoryType;
+        VulkanAllocationKind kind;
+        std::vector<Block> blocks;
+    };
+
+    const VulkanLogicalDevice* logicalDevice = nullptr;
+    VkDeviceSize blockSize = 0;
+    std::vector<Pool> pools;
+    VkDeviceSize heapUsage[VK_MAX_MEMORY_HEAPS] = {};
+    VkDeviceSize heapUsed[VK_MAX_MEMORY_HEAPS] = {};
+    mutable std::mutex mutex;
+
+public:
+    void init(const VulkanLogicalDevice& logicalDevice, VkDeviceSize blockSize = 64ull << 20);
+    void quit();
+
+    VulkanAllocation allocate(const VkMemoryRequirements& requirements,
+        VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred = 0,
+        VulkanAllocationKind kind = VulkanAllocationKind::Linear);
+    void free(VulkanAllocation& allocation);
+
+    // Bytes of VkDeviceMemory this allocator holds in the given heap.
+    VkDeviceSize allocatedBytes(uint32_t heapIndex) const;
+    // Bytes of those handed out as allocations; the difference is free block space.
+    VkDeviceSize usedBytes(uint32_t heapIndex) const;
+
+private:
+    Pool& getPool(uint32_t memoryType, VulkanAllocationKind kind);
+    Block createBlock(uint32_t memoryType, VkDeviceSize size, bool dedicated);
+};
+
+#endif//_LIBVK_ALLOCATOR_H_
@@ -0,0 +1,105 @@
+
+#include "libvk_arena.h"
+#include <algorithm>
+
+static uint8_t* alignUp(uint8_t* pointer, size_t alignment)
+{
+    uintptr_t address = (uintptr_t)pointer;
+    return (uint8_t*)((address + alignment - 1) & ~(uintptr_t)(alignment - 1));
+}
+
+void VulkanArena::init(size_t capacity)
+{
+    blocks.clear();
+    Block block;
+    block.size = std::max(capacity, (size_t)256);
+    block.data.reset(new uint8_t[block.size]);
+    blocks.push_back(std::move(block));
+    cursor = blocks[0].data.get();
+    limit = cursor + blocks[0].size;
+    retired = 0;
+    peak = 0;
+}
+
+void VulkanArena::quit()
+{
+    blocks.clear();
+    cursor = nullptr;
+    limit = nullptr;
+    retired = 0;
+    peak = 0;
+}
+
+void* VulkanArena::allocate(size_t size, size_t alignment)
+{
+    uint8_t* begin = alignUp(cursor, alignment);
+    if (cursor == nullptr || begin + size > limit)
+    {
+        this->grow(size, alignment);
+        begin = alignUp(cursor, alignment);
+    }
+    cursor = begin + size;
+    return begin;
+}
+
+// Chains a block at least as large as everything so far, so a frame that
+// outgrows the arena chains a handful of blocks, not one per allocation.
+void VulkanArena::grow(size_t size, size_t alignment)
+{
+    size_t used = this->used();
+    retired = used;
+    Block block;
+    block.size = std::max(size + alignment, std::max(used, (size_t)256));
+    block.data.reset(new uint8_t[block.size]);
+    cursor = block.data.get();
+    limit = cursor + block.size;
+    blocks.push_back(std::move(block));
+}
+
+void VulkanArena::reset()
+{
+    peak = std::max(peak, this->used());
+    if (blocks.size() > 1)
+    {
+        // the only allocation outside allocate(): after an overflow the first
+        // block is replaced by one that holds the whole frame.
+        size_t high = peak;
+        this->init(high + high / 4);
+        peak = high;
+        return;
+    }
+    if (!blocks.empty())
+    {
+        cursor = blocks[0].data.get();
+        limit = cursor + blocks[0].size;
+    }
+    retired = 0;
+}
+
+size_t VulkanArena::used() const
+{
+    if (blocks.empty())
+        return 0;
+    return retired + (size_t)(cursor - blocks.back().data.get());
+}
+
+void VulkanFrameArenas::init(uint32_t framesInFlight, size_t capacity)
+{
+    arenas.clear();
+    for (uint32_t i = 0; i < std::max(framesInFlight, 1u); i++)
+        arenas.emplace_back(capacity);
+    current = 0;
+}
+
+void VulkanFrameArenas::quit()
+{
+    arenas.clear();
+    current = 0;
+}
+
+VulkanArena& VulkanFrameArenas::begin(uint64_t frame)
+{
+    current = (size_t)(frame % arenas.size());
+    arenas[current].reset();
+    return arenas[current];
+}
@@ -0,0 +1,114 @@
+#ifndef _LIBVK_ARENA_H_
+#define _LIBVK_ARENA_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+// Bump allocator for data that dies all at once. allocate() moves a cursor,
+// nothing is freed individually and reset() rewinds in O(1). When a block runs
+// out another one is chained; the next reset() folds them into a single block
+// of the high-water size, so after a few frames the arena never calls malloc.
+// Not thread-safe: one arena per thread or per frame.
+class VulkanArena
+{
+    struct Block
+    {
+        std::unique_ptr<uint8_t[]> data;
+        size_t size = 0;
+    };
+
+    std::vector<Block> blocks;  // first one is reused, the others only live until reset()
+    uint8_t* cursor = nullptr;
+    uint8_t* limit = nullptr;
+    size_t retired = 0;         // bytes used in blocks before the current one
+    size_t peak = 0;
+
+public:
+    VulkanArena() = default;
+    explicit VulkanArena(size_t capacity) { this->init(capacity); }
+    VulkanArena(VulkanArena&&) = default;
+    VulkanArena& operator=(VulkanArena&&) = default;
+
+    void init(size_t capacity);
+    void quit();
+
+    void* allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+    template <typename T>
+    T* allocate(size_t count) { return (T*)this->allocate(count * sizeof(T), alignof(T)); }
+
+    // Everything allocated so far is gone.
+    void reset();
+
+    size_t used() const;
+    size_t capacity() const { return blocks.empty() ? 0 : blocks[0].size; }
+    size_t highWater() const { return peak; }
+
+private:
+    void grow(size_t size, size_t alignment);
+};
+
+// std allocator on top of an arena. deallocate() does nothing, so containers
+// should reserve what they need instead of growing. Without an arena it falls
+// back to the heap, which lets containers be members before any arena exists;
+// assigning a container built on an arena moves the arena along with the storage.
+template <typename T>
+class VulkanArenaAllocator
+{
+    template <typename U> friend class VulkanArenaAllocator;
+    VulkanArena* arena = nullptr;
+
+public:
+    typedef T value_type;
+    typedef std::true_type propagate_on_container_copy_assignment;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    VulkanArenaAllocator() noexcept = default;
+    VulkanArenaAllocator(VulkanArena& arena) noexcept : arena(&arena) {}
+    template <typename U>
+    VulkanArenaAllocator(const VulkanArenaAllocator<U>& other) noexcept : arena(other.arena) {}
+
+    T* allocate(size_t count)
+    {
+        if (arena != nullptr)
+            return arena->allocate<T>(count);
+        return (T*)::operator new(count * sizeof(T));
+    }
+    void deallocate(T* pointer, size_t) noexcept
+    {
+        if (arena == nullptr)
+            ::operator delete(pointer);
+    }
+
+    template <typename U>
+    bool operator==(const VulkanArenaAllocator<U>& other) const noexcept { return arena == other.arena; }
+    template <typename U>
+    bool operator!=(const VulkanArenaAllocator<U>& other) const noexcept { return arena != other.arena; }
+};
+
+template <typename T>
+using VulkanArenaVector = std::vector<T, VulkanArenaAllocator<T>>;
+
+// One arena per frame in flight. begin(frame) hands out the arena of that frame
+// slot after rewinding it, so whatever the frame put there stays valid until the
+// same slot comes round again: call it after VulkanFrameTimeline::begin() has
+// waited for the slot, and per-frame data may be read by anything that lives
+// as long as the frame.
+class VulkanFrameArenas
+{
+    std::vector<VulkanArena> arenas;
+    size_t current = 0;
+
+public:
+    void init(uint32_t framesInFlight = 2, size_t capacity = 1ull << 20);
+    void quit();
+
+    VulkanArena& begin(uint64_t frame);
+    VulkanArena& arena() { return arenas[current]; }
+};
+
+#endif//_LIBVK_ARENA_H_
@@ -0,0 +1,294 @@
+
+#include "libvk_batch.h"
+#include "libvk_profiler.h"
+
+void VulkanBatchRenderer::init(VulkanInstance& instance, const VulkanBatchArgs& args)
+{
+    if (args.tilesX == 0 || args.tilesY == 0 ||
+        args.extent.width % args.tilesX != 0 || args.extent.height % args.tilesY != 0)
+    {
+        throw std::runtime_error("batch frame extent does not split into the tiles evenly.");
+    }
+    this->args = args;
+    this->args.framesInFlight = std::max(args.framesInFlight, 1u);
+    this->tileExtent = { args.extent.width / args.tilesX, args.extent.height / args.tilesY };
+    this->itemCount = args.frameCount * args.tilesX * args.tilesY;
+
+    for (auto& physicalDevice : instance.enumeratePhysicalDevices())
+    {
+        uint32_t queueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        for (size_t i = 0; i < physicalDevice.queueFamilies.size(); i++)
+        {
+            if (physicalDevice.queueFamilies[i].queueFlags & VK_QUEUE_GRAPHICS_BIT)
+            {
+                queueFamilyIndex = (uint32_t)i;
+                break;
+            }
+        }
+        if (queueFamilyIndex == VK_QUEUE_FAMILY_IGNORED)
+            continue;
+
+        auto device = std::make_unique<Device>();
+        device->physicalDevice = physicalDevice;
+        VulkanLogicalDeviceArgs logicalDeviceArgs;
+        logicalDeviceArgs.queueFamilyIndex = queueFamilyIndex;
+        device->logicalDevice = physicalDevice.createLogicalDevice(logicalDeviceArgs);
+        const VulkanLogicalDevice& logicalDevice = device->logicalDevice;
+
+        VulkanGraphicsPipelineArgs pipelineArgs = this->args.pipeline;
+        pipelineArgs.viewport = { 0.0f, 0.0f, (float)tileExtent.width, (float)tileExtent.height, 0.0f, 1.0f };
+        pipelineArgs.scissor = { { 0, 0 }, tileExtent };
+        pipelineArgs.colorFormat = this->args.format;
+        pipelineArgs.present = false;
+        pipelineArgs.dynamicRendering = false;
+        device->pipeline = logicalDevice.createGraphicsPipeline(pipelineArgs);
+
+        if (pipelineArgs.samples != VK_SAMPLE_COUNT_1_BIT)
+        {
+            VulkanAttachmentArgs colorArgs;
+            colorArgs.format = pipelineArgs.colorFormat;
+            colorArgs.extent = tileExtent;
+            colorArgs.samples = pipelineArgs.samples;
+            colorArgs.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+            device->color = logicalDevice.createAttachment(colorArgs);
+        }
+        if (pipelineArgs.depthFormat != VK_FORMAT_UNDEFINED)
+        {
+            VulkanAttachmentArgs depthArgs;
+            depthArgs.format = pipelineArgs.depthFormat;
+            depthArgs.extent = tileExtent;
+            depthArgs.samples = pipelineArgs.samples;
+            depthArgs.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+            device->depth = logicalDevice.createAttachment(depthArgs);
+        }
+
+        VkCommandPoolCreateInfo cpci = {};
+        cpci.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        cpci.pNext = nullptr;
+        cpci.queueFamilyIndex = queueFamilyIndex;
+        cpci.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+        if (VK_SUCCESS != vkCreateCommandPool(logicalDevice.device, &cpci, nullptr, device->commandPool.put(logicalDevice.device)))
+        {
+            throw std::runtime_error("Create batch command-pool failed.");
+        }
+        device->commandBuffers.resize(this->args.framesInFlight);
+        VkCommandBufferAllocateInfo cbai = {};
+        cbai.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        cbai.pNext = nullptr;
+        cbai.commandPool = device->commandPool;
+        cbai.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        cbai.commandBufferCount = this->args.framesInFlight;
+        if (VK_SUCCESS != vkAllocateCommandBuffers(logicalDevice.device, &cbai, device->commandBuffers.data()))
+        {
+            throw std::runtime_error("Allocate batch command-buffers failed.");
+        }
+
+        // one target per slot, so the readback of an item overlaps the rendering
+        // of the next ones.
+        device->targets.resize(this->args.framesInFlight);
+        for (uint32_t i = 0; i < this->args.framesInFlight; i++)
+        {
+            VulkanAttachmentArgs targetArgs;
+            targetArgs.format = pipelineArgs.colorFormat;
+            targetArgs.extent = tileExtent;
+            targetArgs.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+            targetArgs.transient = false;
+            device->targets[i] = logicalDevice.createAttachment(targetArgs);
+
+            VulkanFrameBufferArgs frameBufferArgs;
+            frameBufferArgs.renderPass = device->pipeline.renderPass;
+            frameBufferArgs.imageViews = &device->targets[i].view;
+            frameBufferArgs.imageViewCount = 1;
+            frameBufferArgs.width = tileExtent.width;
+            frameBufferArgs.height = tileExtent.height;
+            frameBufferArgs.colorView = device->color.view;
+            frameBufferArgs.depthView = device->depth.view;
+            device->frameBuffers.push_back(logicalDevice.createFrameBufferObject(frameBufferArgs));
+
+            device->fences.push_back(logicalDevice.createFence(true));
+            device->onRendered.push_back(logicalDevice.createSemaphore());
+        }
+
+        // one more slot than items in flight, so the encoder rarely holds up the copies.
+        VulkanReadbackArgs readbackArgs;
+        readbackArgs.extent = tileExtent;
+        readbackArgs.format = this->args.format;
+        readbackArgs.slotCount = this->args.framesInFlight + 1;
+        readbackArgs.encoding = this->args.encoding;
+        readbackArgs.dropWhenBusy = false;
+        readbackArgs.callback = [this](VulkanReadbackResult& result) {
+            if (this->args.output)
+                this->args.output(item(result.frame), result);
+        };
+        device->readback.init(logicalDevice, readbackArgs);
+
+        device->context.index = (uint32_t)devices.size();
+        device->context.physicalDevice = &device->physicalDevice;
+        device->context.logicalDevice = &device->logicalDevice;
+        device->context.pipeline = &device->pipeline;
+        device->stats.name = physicalDevice.props.deviceName;
+        devices.push_back(std::move(device));
+    }
+    if (devices.empty())
+    {
+        throw std::runtime_error("No device renders the batch.");
+    }
+}
+
+void VulkanBatchRenderer::quit()
+{
+    for (auto& device : devices)
+    {
+        if (device->thread.joinable())
+            device->thread.join();
+    }
+    for (auto& device : devices)
+    {
+        VulkanLogicalDevice& logicalDevice = device->logicalDevice;
+        if (logicalDevice.device == VK_NULL_HANDLE)
+            continue;
+        vkDeviceWaitIdle(logicalDevice.device);
+        if (device->setup && args.teardown)
+            args.teardown(device->context);
+        device->readback.quit();
+        for (auto& semaphore : device->onRendered)
+            logicalDevice.destroySemaphore(semaphore);
+        for (auto& fence : device->fences)
+            logicalDevice.destroyFence(fence);
+        for (auto& frameBuffers : device->frameBuffers)
+            logicalDevice.destroyFrameBufferObject(frameBuffers);
+        for (auto& target : device->targets)
+            logicalDevice.destroyAttachment(target);
+        logicalDevice.destroyAttachment(device->depth);
+        logicalDevice.destroyAttachment(device->color);
+        device->commandPool.reset();
+        logicalDevice.destroyGraphicsPipeline(device->pipeline);
+        device->physicalDevice.destroyLogicalDevice(logicalDevice);
+    }
+    devices.clear();
+}
+
+void VulkanBatchRenderer::run()
+{
+    VULKAN_PROFILE_ZONE("batch");
+    uint64_t begin = VulkanProfiler::now();
+    next = 0;
+    for (auto& device : devices)
+        device->thread = std::thread(&VulkanBatchRenderer::work, this, std::ref(*device));
+    for (auto& device : devices)
+        device->thread.join();
+    seconds = (double)(VulkanProfiler::now() - begin) * 1e-9;
+
+    for (auto& device : devices)
+    {
+        if (device->error)
+            std::rethrow_exception(device->error);
+    }
+}
+
+VulkanBatchItem VulkanBatchRenderer::item(uint64_t index) const
+{
+    uint32_t tiles = args.tilesX * args.tilesY;
+    VulkanBatchItem item;
+    item.frame = index / tiles;
+    item.tile = (uint32_t)(index % tiles);
+    item.area.offset.x = (int32_t)(item.tile % args.tilesX * tileExtent.width);
+    item.area.offset.y = (int32_t)(item.tile / args.tilesX * tileExtent.height);
+    item.area.extent = tileExtent;
+    return item;
+}
+
+void VulkanBatchRenderer::work(Device& device)
+{
+    try
+    {
+        if (args.setup)
+            args.setup(device.context);
+        device.setup = true;
+
+        uint64_t begin = VulkanProfiler::now();
+        // items in sequence order, to whichever device asks first.
+        for (uint64_t index = next++; index < itemCount; index = next++)
+            render(device, index);
+        device.readback.flush();
+        device.stats.seconds = (double)(VulkanProfiler::now() - begin) * 1e-9;
+    }
+    catch (...)
+    {
+        device.error = std::current_exception();
+        // the other devices stop at their next item.
+        next = itemCount;
+    }
+}
+
+void VulkanBatchRenderer::render(Device& device, uint64_t index)
+{
+    VULKAN_PROFILE_ZONE("batch item");
+    const VulkanLogicalDevice& logicalDevice = device.logicalDevice;
+    uint32_t slot = (uint32_t)(device.stats.items % args.framesInFlight);
+    VulkanBatchItem item = this->item(index);
+
+    vkWaitForFences(logicalDevice.device, 1, device.fences[slot].address(), VK_TRUE, std::numeric_limits<uint64_t>::max());
+    vkResetFences(logicalDevice.device, 1, device.fences[slot].address());
+
+    VkCommandBuffer commandBuffer = device.commandBuffers[slot];
+    vkResetCommandBuffer(commandBuffer, 0);
+    VkCommandBufferBeginInfo cbbi = {};
+    cbbi.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    cbbi.pNext = nullptr;
+    cbbi.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    cbbi.pInheritanceInfo = nullptr;
+    if (VK_SUCCESS != vkBeginCommandBuffer(commandBuffer, &cbbi))
+    {
+        throw std::runtime_error("Begin batch command-buffer failed.");
+    }
+
+    // the target was last read by its readback copy, which the render pass's
+    // own dependency does not cover.
+    vkCmdPipelineBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+        0, 0, nullptr, 0, nullptr, 0, nullptr);
+
+    // one per attachment, in render pass order.
+    VkClearValue clearValues[3];
+    uint32_t clearValueCount = 1;
+    clearValues[0].color = { {0.0f, 0.0f, 0.0f, 1.0f} };
+    if (device.pipeline.samples != VK_SAMPLE_COUNT_1_BIT)
+        clearValues[clearValueCount++].color = { {0.0f, 0.0f, 0.0f, 1.0f} };
+    if (device.pipeline.depthFormat != VK_FORMAT_UNDEFINED)
+        clearValues[clearValueCount++].depthStencil = { 1.0f, 0 };
+
+    VkRenderPassBeginInfo rpbi = {};
+    rpbi.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    rpbi.renderPass = device.pipeline.renderPass;
+    rpbi.framebuffer = device.frameBuffers[slot].handles[0];
+    rpbi.renderArea.offset = { 0, 0 };
+    rpbi.renderArea.extent = tileExtent;
+    rpbi.clearValueCount = clearValueCount;
+    rpbi.pClearValues = clearValues;
+    vkCmdBeginRenderPass(commandBuffer, &rpbi, VK_SUBPASS_CONTENTS_INLINE);
+
+    // the whole frame, moved so the tile lands on the target.
+    VkViewport viewport = {
+        -(float)item.area.offset.x, -(float)item.area.offset.y,
+        (float)args.extent.width, (float)args.extent.height,
+        0.0f, 1.0f
+    };
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+    device.context.recorded = device.stats.items;
+    if (args.record)
+        args.record(device.context, commandBuffer, item);
+
+    vkCmdEndRenderPass(commandBuffer);
+    if (VK_SUCCESS != vkEndCommandBuffer(commandBuffer))
+    {
+        throw std::runtime_error("End batch command-buffer failed.");
+    }
+
+    logicalDevice.submit(commandBuffer, VK_NULL_HANDLE, 0, device.onRendered[slot], device.fences[slot]);
+    // the pass leaves the target in COLOR_ATTACHMENT_OPTIMAL.
+    device.readback.capture(device.targets[slot].image, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, index,
+        device.onRendered[slot], VK_NULL_HANDLE);
+    device.readback.poll();
+    device.stats.items++;
+}
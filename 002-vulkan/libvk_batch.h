@@ -0,0 +1,118 @@
+#ifndef _LIBVK_BATCH_H_
+#define _LIBVK_BATCH_H_
+
+#include "libvk.h"
+#include "libvk_readback.h"
+#include <atomic>
+#include <exception>
+#include <thread>
+
+// One unit of work: a tile of a frame of the sequence.
+struct VulkanBatchItem
+{
+    uint64_t frame = 0;
+    uint32_t tile = 0;          // row-major
+    VkRect2D area = {};         // the tile's pixels in the frame
+};
+
+// One device of the batch, as the callbacks see it.
+struct VulkanBatchContext
+{
+    uint32_t index = 0;         // of the device in the batch
+    const VulkanPhysicalDevice* physicalDevice = nullptr;
+    const VulkanLogicalDevice* logicalDevice = nullptr;
+    const VulkanGraphicsPipeline* pipeline = nullptr;  // made from VulkanBatchArgs::pipeline for the pass
+    uint64_t recorded = 0;      // items this device recorded before the current one: the
+                                // frame number for per-frame-in-flight state, like sprite batches
+};
+
+struct VulkanBatchArgs
+{
+    VkExtent2D extent;              // of a whole frame, a multiple of the tile counts
+    uint64_t frameCount = 1;
+    uint32_t tilesX = 1;
+    uint32_t tilesY = 1;
+    VkFormat format = VK_FORMAT_R8G8B8A8_UNORM;    // 8-bit RGBA or BGRA, for the readback
+    uint32_t framesInFlight = 2;    // per device
+    VulkanReadbackEncoding encoding = VulkanReadbackEncoding::PNG;
+    // shaders and state of the pass's base pipeline. Formats, extent and
+    // dynamicRendering are filled in; depth and samples are kept.
+    VulkanGraphicsPipelineArgs pipeline;
+
+    // On the device's thread before its first item: per-device resources for
+    // the pass (the pipeline's formats, the tile extent).
+    std::function<void(VulkanBatchContext& context)> setup;
+    // Inside the pass, for every item the device takes. The viewport is set to
+    // the whole frame shifted to the item's tile; state that sets its own must
+    // shift by `item.area.offset` itself.
+    std::function<void(VulkanBatchContext& context, VkCommandBuffer commandBuffer, const VulkanBatchItem& item)> record;
+    // In quit(), once the device is idle, if setup() ran.
+    std::function<void(VulkanBatchContext& context)> teardown;
+    // On the device's readback thread, in any order across items.
+    std::function<void(const VulkanBatchItem& item, VulkanReadbackResult& result)> output;
+};
+
+struct VulkanBatchDeviceStats
+{
+    std::string name;
+    uint64_t items = 0;
+    double seconds = 0.0;       // from its first item until its last output returned
+};
+
+// Renders a scripted sequence offscreen on every physical device at once,
+// lavapipe and other CPU implementations included, each with a logical device
+// and a thread of its own. The frames' tiles are handed out from one shared
+// counter, so a device that is twice as fast takes twice the items and the
+// throughput adds up across devices. Every device keeps `framesInFlight`
+// items on the GPU and reads them back through a VulkanReadback that encodes
+// on its own thread: recording, rendering, copying and encoding overlap.
+class VulkanBatchRenderer
+{
+    struct Device
+    {
+        VulkanPhysicalDevice physicalDevice;
+        VulkanLogicalDevice logicalDevice;
+        VulkanGraphicsPipeline pipeline;
+        VulkanAttachment color;     // multisampled, shared by the slots
+        VulkanAttachment depth;
+        std::vector<VulkanAttachment> targets;      // one per slot, read back
+        std::vector<VulkanFrameBufferObject> frameBuffers;     // one per target
+        VulkanCommandPoolHandle commandPool;
+        std::vector<VkCommandBuffer> commandBuffers;
+        std::vector<VulkanFenceHandle> fences;
+        std::vector<VulkanSemaphoreHandle> onRendered;
+        VulkanReadback readback;
+        VulkanBatchContext context;
+        VulkanBatchDeviceStats stats;
+        bool setup = false;
+        std::thread thread;
+        std::exception_ptr error;
+    };
+
+    VulkanBatchArgs args;
+    VkExtent2D tileExtent = {};
+    uint64_t itemCount = 0;
+    std::vector<std::unique_ptr<Device>> devices;
+    std::atomic<uint64_t> next{ 0 };
+    double seconds = 0.0;
+
+public:
+    // One logical device per physical device with a graphics queue.
+    void init(VulkanInstance& instance, const VulkanBatchArgs& args);
+    void quit();
+
+    // Renders the whole sequence; returns once every item went through
+    // `output`. Rethrows the first error of a device thread.
+    void run();
+
+    uint32_t deviceCount() const { return (uint32_t)devices.size(); }
+    VulkanBatchDeviceStats statistics(uint32_t device) const { return devices[device]->stats; }
+    double totalSeconds() const { return seconds; }
+
+private:
+    VulkanBatchItem item(uint64_t index) const;
+    void work(Device& device);
+    void render(Device& device, uint64_t index);
+};
+
+#endif//_LIBVK_BATCH_H_
@@ -0,0 +1,134 @@
+
+#include "libvk_caps.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+template<typename T, size_t N>
+static const T* findByName(const std::vector<T>& list, char const (T::*name)[N], const char* key)
+{
+    auto it = std::lower_bound(list.begin(), list.end(), key,
+        [name](const T& item, const char* key) { return strcmp(item.*name, key) < 0; });
+    return it != list.end() && strcmp((*it).*name, key) == 0 ? &*it : nullptr;
+}
+
+static bool contains(const std::vector<const char*>& names, const char* name)
+{
+    for (auto n : names)
+    {
+        if (strcmp(n, name) == 0)
+            return true;
+    }
+    return false;
+}
+
+const VulkanCapabilities& VulkanCapabilities::instance()
+{
+    static const VulkanCapabilities caps = []() {
+        VulkanCapabilities ret;
+        uint32_t count = 0;
+        vkEnumerateInstanceExtensionProperties(nullptr, &count, nullptr);
+        ret.extensions.resize(count);
+        vkEnumerateInstanceExtensionProperties(nullptr, &count, ret.extensions.data());
+        ret.extensions.resize(count);
+
+        count = 0;
+        vkEnumerateInstanceLayerProperties(&count, nullptr);
+        ret.layers.resize(count);
+        vkEnumerateInstanceLayerProperties(&count, ret.layers.data());
+        ret.layers.resize(count);
+
+        ret.sort();
+        return ret;
+    }();
+    return caps;
+}
+
+VulkanCapabilities VulkanCapabilities::query(VkPhysicalDevice device)
+{
+    VulkanCapabilities ret;
+    uint32_t count = 0;
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &count, nullptr);
+    ret.extensions.resize(count);
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &count, ret.extensions.data());
+    ret.extensions.resize(count);
+
+    // device layers are deprecated, but older loaders still report them.
+    count = 0;
+    vkEnumerateDeviceLayerProperties(device, &count, nullptr);
+    ret.layers.resize(count);
+    vkEnumerateDeviceLayerProperties(device, &count, ret.layers.data());
+    ret.layers.resize(count);
+
+    ret.sort();
+    return ret;
+}
+
+void VulkanCapabilities::sort()
+{
+    std::sort(extensions.begin(), extensions.end(), [](const VkExtensionProperties& a, const VkExtensionProperties& b) {
+        return strcmp(a.extensionName, b.extensionName) < 0;
+    });
+    std::sort(layers.begin(), layers.end(), [](const VkLayerProperties& a, const VkLayerProperties& b) {
+        return strcmp(a.layerName, b.layerName) < 0;
+    });
+}
+
+const VkExtensionProperties* VulkanCapabilities::findExtension(const char* name) const
+{
+    return findByName(extensions, &VkExtensionProperties::extensionName, name);
+}
+
+const VkLayerProperties* VulkanCapabilities::findLayer(const char* name) const
+{
+    return findByName(layers, &VkLayerProperties::layerName, name);
+}
+
+bool VulkanCapabilities::enableExtension(const char* name, std::vector<const char*>& enabled) const
+{
+    if (!this->hasExtension(name))
+        return false;
+    if (!contains(enabled, name))
+        enabled.push_back(name);
+    return true;
+}
+
+bool VulkanCapabilities::enableLayer(const char* name, std::vector<const char*>& enabled) const
+{
+    if (!this->hasLayer(name))
+        return false;
+    if (!contains(enabled, name))
+        enabled.push_back(name);
+    return true;
+}
+
+void VulkanCapabilities::requireExtension(const char* name, std::vector<const char*>& enabled) const
+{
+    if (!this->enableExtension(name, enabled))
+    {
+        throw std::runtime_error(std::string("required extension not supported: ") + name);
+    }
+}
+
+void VulkanCapabilities::dump(std::ostream& out, const char* title,
+    const std::vector<const char*>& enabledExtensions,
+    const std::vector<const char*>& enabledLayers) const
+{
+    out << '\n' << title << " extensions count: " << extensions.size() << '\n';
+    for (auto& e : extensions)
+    {
+        out << "  " << e.extensionName;
+        if (contains(enabledExtensions, e.extensionName))
+            out << "  USED";
+        out << '\n';
+    }
+    out << '\n' << title << " layers count: " << layers.size() << '\n';
+    for (auto& l : layers)
+    {
+        out << "  " << l.layerName;
+        if (contains(enabledLayers, l.layerName))
+            out << "  USED";
+        out << '\n';
+    }
+}
@@ -0,0 +1,46 @@
+#ifndef _LIBVK_CAPS_H_
+#define _LIBVK_CAPS_H_
+
+#include <vulkan/vulkan.hpp>
+#include <ostream>
+#include <vector>
+
+#define VULKAN_VALIDATION_LAYER_NAME "VK_LAYER_KHRONOS_validation"
+
+// Extensions and layers of the instance or of one physical device. Queried once
+// and kept sorted by name: every lookup is a binary search, never another
+// vkEnumerate* call. Nothing is enabled implicitly, callers ask by exact name.
+class VulkanCapabilities
+{
+    std::vector<VkExtensionProperties> extensions;  // sorted by extensionName
+    std::vector<VkLayerProperties> layers;          // sorted by layerName
+
+public:
+    // Instance-level set, queried on first use and cached for the process.
+    static const VulkanCapabilities& instance();
+    static VulkanCapabilities query(VkPhysicalDevice device);
+
+    const VkExtensionProperties* findExtension(const char* name) const;
+    const VkLayerProperties* findLayer(const char* name) const;
+    bool hasExtension(const char* name) const { return this->findExtension(name) != nullptr; }
+    bool hasLayer(const char* name) const { return this->findLayer(name) != nullptr; }
+
+    // Append `name` to `enabled` once if it is supported; return whether it is.
+    bool enableExtension(const char* name, std::vector<const char*>& enabled) const;
+    bool enableLayer(const char* name, std::vector<const char*>& enabled) const;
+    // Same, but throw when it is not supported.
+    void requireExtension(const char* name, std::vector<const char*>& enabled) const;
+
+    const std::vector<VkExtensionProperties>& extensionList() const { return extensions; }
+    const std::vector<VkLayerProperties>& layerList() const { return layers; }
+
+    // Lists everything, marking what is in `enabledExtensions` / `enabledLayers`.
+    void dump(std::ostream& out, const char* title,
+        const std::vector<const char*>& enabledExtensions,
+        const std::vector<const char*>& enabledLayers) const;
+
+private:
+    void sort();
+};
+
+#endif//_LIBVK_CAPS_H_
@@ -0,0 +1,910 @@
+
+#include "libvk_capture.h"
+#include "libvk_profiler.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <thread>
+
+// Bounds-checked reads from a record's payload. Values are in host byte
+// order, which is little-endian everywhere this runs.
+struct VulkanCaptureReader
+{
+    const uint8_t* data;
+    size_t size;
+    size_t offset = 0;
+
+    const uint8_t* bytes(size_t count)
+    {
+        if (count > size - offset)
+        {
+            throw std::runtime_error("capture record is cut short.");
+        }
+        const uint8_t* p = data + offset;
+        offset += count;
+        return p;
+    }
+
+    template<class T> T get()
+    {
+        T value;
+        memcpy(&value, this->bytes(sizeof(T)), sizeof(T));
+        return value;
+    }
+};
+
+// where this thread's hooks go instead of the file, see beginDeferred().
+static thread_local std::vector<uint8_t>* deferredRecords = nullptr;
+
+template<class T> void VulkanCapture::put(const T& value)
+{
+    this->put(&value, sizeof(T));
+}
+
+void VulkanCapture::put(const void* data, size_t size)
+{
+    if (size == 0)
+        return;
+    const uint8_t* p = (const uint8_t*)data;
+    record.insert(record.end(), p, p + size);
+}
+
+void VulkanCapture::open(const std::string& path, uint32_t frameCount)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    file.open(path, std::ios::binary | std::ios::trunc);
+    if (!file)
+    {
+        throw std::runtime_error("Open capture file failed.");
+    }
+    uint32_t header[2] = { VULKAN_CAPTURE_MAGIC, VULKAN_CAPTURE_VERSION };
+    file.write((const char*)header, sizeof(header));
+    bytes = sizeof(header);
+    for (uint32_t kind = 0; kind < ID_KIND_COUNT; kind++)
+    {
+        ids[kind].clear();
+        nextIds[kind] = 0;
+    }
+    start = VulkanProfiler::now();
+    framesLeft = frameCount;
+}
+
+void VulkanCapture::close()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    framesLeft = 0;
+    if (file.is_open())
+        file.close();
+}
+
+void VulkanCapture::pipeline(VkPipeline handle, const VulkanGraphicsPipelineArgs& args)
+{
+    if (!this->recording())
+        return;
+    std::lock_guard<std::mutex> lock(mutex);
+    this->begin(VULKAN_CAPTURE_PIPELINE);
+    this->put(this->create(ID_PIPELINE, (uint64_t)handle));
+    for (const VulkanShaderCode* code : { &args.vert, &args.frag, &args.task, &args.mesh })
+    {
+        this->put((uint32_t)code->size);
+        this->put(code->code, code->size);
+    }
+    this->put(args.viewport);
+    this->put(args.scissor);
+    this->put((uint32_t)args.colorFormat);
+    this->put((uint32_t)args.depthFormat);
+    this->put((uint32_t)args.samples);
+    this->put((uint8_t)args.dynamicRendering);
+    this->put((uint32_t)args.vertexBindings.size());
+    for (const auto& binding : args.vertexBindings)
+        this->put(binding);
+    this->put((uint32_t)args.vertexAttributes.size());
+    for (const auto& attribute : args.vertexAttributes)
+        this->put(attribute);
+    // immutable samplers are device objects, replays go without them.
+    this->put((uint32_t)args.bindings.size());
+    for (const auto& binding : args.bindings)
+    {
+        this->put(binding.binding);
+        this->put((uint32_t)binding.descriptorType);
+        this->put(binding.descriptorCount);
+        this->put((uint32_t)binding.stageFlags);
+    }
+    this->put(args.pushConstantSize);
+    this->put((uint32_t)args.cullMode);
+    this->put((uint8_t)args.depthTest);
+    this->put((uint8_t)args.depthWrite);
+    this->put((uint8_t)args.blend);
+    this->put((uint8_t)args.present);
+    this->end();
+}
+
+void VulkanCapture::texture(VkImageView view, const VulkanTextureArgs& args)
+{
+    if (!this->recording())
+        return;
+    std::lock_guard<std::mutex> lock(mutex);
+    VkDeviceSize size = args.data != nullptr ? args.size : 0;
+    this->begin(VULKAN_CAPTURE_TEXTURE);
+    this->put(this->create(ID_TEXTURE, (uint64_t)view));
+    this->put((uint32_t)args.format);
+    this->put(args.extent);
+    this->put(args.mipLevels);
+    this->put(args.dataMipLevels);
+    this->put((uint32_t)args.usage);
+    this->put((uint64_t)size);
+    this->put(args.data, (size_t)size);
+    this->end();
+}
+
+void VulkanCapture::upload(VkBuffer buffer, VkDeviceSize offset, const void* data, VkDeviceSize size)
+{
+    if (!this->recording())
+        return;
+    std::lock_guard<std::mutex> lock(mutex);
+    uint32_t id = this->find(ID_BUFFER, (uint64_t)buffer);
+    if (id == VULKAN_CAPTURE_UNKNOWN)
+        id = this->create(ID_BUFFER, (uint64_t)buffer);
+    this->begin(VULKAN_CAPTURE_UPLOAD);
+    this->put(id);
+    this->put((uint64_t)offset);
+    this->put((uint64_t)size);
+    this->put(data, (size_t)size);
+    this->end();
+}
+
+void VulkanCapture::spriteBatch(const VulkanSpriteBatch* batch, const VulkanSpriteBatchArgs& args)
+{
+    if (!this->recording())
+        return;
+    std::lock_guard<std::mutex> lock(mutex);
+    this->begin(VULKAN_CAPTURE_SPRITE_BATCH);
+    this->put(this->create(ID_SPRITE_BATCH, (uint64_t)(uintptr_t)batch));
+    this->put((uint32_t)args.colorFormat);
+    this->put((uint32_t)args.depthFormat);
+    this->put((uint32_t)args.samples);
+    this->put((uint8_t)args.dynamicRendering);
+    this->put(args.extent);
+    this->put(args.maxSprites);
+    this->put(args.maxTextures);
+    this->end();
+}
+
+void VulkanCapture::spriteTexture(const VulkanSpriteBatch* batch, VkImageView view)
+{
+    if (!this->recording())
+        return;
+    std::lock_guard<std::mutex> lock(mutex);
+    this->begin(VULKAN_CAPTURE_SPRITE_TEXTURE);
+    this->put(this->find(ID_SPRITE_BATCH, (uint64_t)(uintptr_t)batch));
+    this->put(this->find(ID_TEXTURE, (uint64_t)view));
+    this->end();
+}
+
+void VulkanCapture::sprites(const VulkanSpriteBatch* batch, const VulkanSprite* sprites, const uint32_t* keys, uint32_t count)
+{
+    if (!this->recording())
+        return;
+    std::lock_guard<std::mutex> lock(mutex);
+    this->begin(VULKAN_CAPTURE_SPRITES);
+    this->put(this->find(ID_SPRITE_BATCH, (uint64_t)(uintptr_t)batch));
+    this->put(count);
+    this->put(sprites, count * sizeof(VulkanSprite));
+    this->put(keys, count * sizeof(uint32_t));
+    this->end();
+}
+
+void VulkanCapture::pass(VkPipeline pipeline)
+{
+    if (!this->recording())
+        return;
+    std::lock_guard<std::mutex> lock(mutex);
+    this->begin(VULKAN_CAPTURE_PASS);
+    this->put(this->find(ID_PIPELINE, (uint64_t)pipeline));
+    this->end();
+}
+
+void VulkanCapture::draw(VkPipeline pipeline, const VulkanDrawGeometry& geometry, uint32_t firstInstance, uint32_t instanceCount,
+    bool descriptorSets)
+{
+    if (!this->recording())
+        return;
+    std::lock_guard<std::mutex> lock(mutex);
+    this->begin(VULKAN_CAPTURE_DRAW);
+    this->put(this->find(ID_PIPELINE, (uint64_t)pipeline));
+    this->put(this->find(ID_BUFFER, (uint64_t)geometry.vertexBuffer));
+    this->put((uint64_t)geometry.vertexOffset);
+    this->put(this->find(ID_BUFFER, (uint64_t)geometry.indexBuffer));
+    this->put((uint64_t)geometry.indexOffset);
+    this->put((uint32_t)geometry.indexType);
+    this->put(geometry.count);
+    this->put(firstInstance);
+    this->put(instanceCount);
+    this->put((uint8_t)descriptorSets);
+    this->end();
+}
+
+void VulkanCapture::spriteDraw(const VulkanSpriteBatch* batch)
+{
+    if (!this->recording())
+        return;
+    std::lock_guard<std::mutex> lock(mutex);
+    this->begin(VULKAN_CAPTURE_SPRITE_DRAW);
+    this->put(this->find(ID_SPRITE_BATCH, (uint64_t)(uintptr_t)batch));
+    this->end();
+}
+
+void VulkanCapture::present()
+{
+    if (!this->recording())
+        return;
+    std::lock_guard<std::mutex> lock(mutex);
+    this->begin(VULKAN_CAPTURE_PRESENT);
+    this->put((uint64_t)(VulkanProfiler::now() - start));
+    this->end();
+    if (framesLeft > 0 && --framesLeft == 0)
+        file.close();
+}
+
+void VulkanCapture::beginDeferred(std::vector<uint8_t>& records)
+{
+    deferredRecords = &records;
+}
+
+void VulkanCapture::endDeferred()
+{
+    deferredRecords = nullptr;
+}
+
+void VulkanCapture::flush(std::vector<uint8_t>& records)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!records.empty() && file.is_open())
+    {
+        file.write((const char*)records.data(), records.size());
+        bytes += records.size();
+    }
+    records.clear();
+}
+
+uint32_t VulkanCapture::create(IdKind kind, uint64_t handle)
+{
+    // a handle may be reused once its object is gone: the newest object wins.
+    uint32_t id = nextIds[kind]++;
+    ids[kind][handle] = id;
+    return id;
+}
+
+uint32_t VulkanCapture::find(IdKind kind, uint64_t handle)
+{
+    if (handle == 0)
+        return VULKAN_CAPTURE_NONE;
+    auto it = ids[kind].find(handle);
+    return it != ids[kind].end() ? it->second : VULKAN_CAPTURE_UNKNOWN;
+}
+
+void VulkanCapture::begin(VulkanCaptureOp op)
+{
+    record.clear();
+    this->put((uint8_t)op);
+    this->put((uint32_t)0);
+}
+
+void VulkanCapture::end()
+{
+    // the last present may have closed the file under another thread's hook.
+    if (!file.is_open())
+        return;
+    uint32_t size = (uint32_t)(record.size() - 5);
+    memcpy(record.data() + 1, &size, sizeof(size));
+    if (deferredRecords != nullptr)
+    {
+        deferredRecords->insert(deferredRecords->end(), record.begin(), record.end());
+        return;
+    }
+    file.write((const char*)record.data(), record.size());
+    bytes += record.size();
+}
+
+void VulkanReplay::init(const VulkanLogicalDevice& logicalDevice, VulkanUploader& uploader, VulkanTextureManager& textures,
+    const VulkanReplayArgs& args)
+{
+    this->logicalDevice = &logicalDevice;
+    this->uploader = &uploader;
+    this->textures = &textures;
+    this->args = args;
+    this->args.framesInFlight = std::max(args.framesInFlight, 1u);
+
+    VkCommandPoolCreateInfo cpci = {};
+    cpci.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    cpci.pNext = nullptr;
+    cpci.queueFamilyIndex = logicalDevice.queueFamilyIndex;
+    cpci.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    if (VK_SUCCESS != vkCreateCommandPool(logicalDevice.device, &cpci, nullptr, commandPool.put(logicalDevice.device)))
+    {
+        throw std::runtime_error("Create replay command-pool failed.");
+    }
+    commandBuffers.resize(this->args.framesInFlight);
+    VkCommandBufferAllocateInfo cbai = {};
+    cbai.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    cbai.pNext = nullptr;
+    cbai.commandPool = commandPool;
+    cbai.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    cbai.commandBufferCount = this->args.framesInFlight;
+    if (VK_SUCCESS != vkAllocateCommandBuffers(logicalDevice.device, &cbai, commandBuffers.data()))
+    {
+        throw std::runtime_error("Allocate replay command-buffers failed.");
+    }
+    for (uint32_t i = 0; i < this->args.framesInFlight; i++)
+        fences.push_back(logicalDevice.createFence(true));
+
+    uint32_t white = 0xffffffffu;
+    VulkanTextureArgs fallbackArgs;
+    fallbackArgs.format = VK_FORMAT_R8G8B8A8_UNORM;
+    fallbackArgs.extent = { 1, 1 };
+    fallbackArgs.mipLevels = 1;
+    fallbackArgs.data = &white;
+    fallbackArgs.size = sizeof(white);
+    fallback = textures.createTexture(fallbackArgs);
+    uploader.flush();
+}
+
+void VulkanReplay::quit()
+{
+    if (logicalDevice == nullptr)
+        return;
+    vkDeviceWaitIdle(logicalDevice->device);
+    for (auto& spriteBatch : spriteBatches)
+        spriteBatch->batch.quit();
+    spriteBatches.clear();
+    for (auto& pipeline : pipelines)
+    {
+        if (pipeline->created)
+            logicalDevice->destroyGraphicsPipeline(pipeline->pipeline);
+    }
+    pipelines.clear();
+    for (auto& texture : textureList)
+    {
+        if (texture.image != nullptr)
+            textures->destroyTexture(texture);
+    }
+    textureList.clear();
+    textures->destroyTexture(fallback);
+    for (auto& buffer : buffers)
+        logicalDevice->destroyBuffer(buffer);
+    buffers.clear();
+    logicalDevice->destroyFrameBufferObject(frameBuffer);
+    logicalDevice->destroyAttachment(target);
+    logicalDevice->destroyAttachment(color);
+    logicalDevice->destroyAttachment(depth);
+    for (auto& fence : fences)
+        logicalDevice->destroyFence(fence);
+    fences.clear();
+    commandBuffers.clear();
+    commandPool.reset();
+    records.clear();
+    presentTimes.clear();
+    data.clear();
+    logicalDevice = nullptr;
+}
+
+void VulkanReplay::load(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file)
+    {
+        throw std::runtime_error("Open capture file failed.");
+    }
+    data.resize((size_t)file.tellg());
+    file.seekg(0);
+    file.read((char*)data.data(), data.size());
+
+    VulkanCaptureReader header = { data.data(), data.size() };
+    if (header.get<uint32_t>() != VULKAN_CAPTURE_MAGIC || header.get<uint32_t>() != VULKAN_CAPTURE_VERSION)
+    {
+        throw std::runtime_error("not a capture file, or one of another version.");
+    }
+
+    // the records, then what has to exist before the first frame: the
+    // pipelines' state, the target and the buffers' sizes.
+    VulkanCaptureReader reader = { data.data(), data.size(), header.offset };
+    while (reader.offset < reader.size)
+    {
+        Record record;
+        record.op = reader.get<uint8_t>();
+        record.size = reader.get<uint32_t>();
+        record.offset = reader.offset;
+        reader.bytes(record.size);
+        if (record.op < VULKAN_CAPTURE_PIPELINE || record.op > VULKAN_CAPTURE_PRESENT)
+        {
+            throw std::runtime_error("capture has a record of unknown type.");
+        }
+        records.push_back(record);
+
+        VulkanCaptureReader payload = { data.data() + record.offset, record.size };
+        if (record.op == VULKAN_CAPTURE_PIPELINE)
+        {
+            this->parsePipeline(record);
+        }
+        else if (record.op == VULKAN_CAPTURE_PASS && targetPipeline == VULKAN_CAPTURE_NONE)
+        {
+            targetPipeline = payload.get<uint32_t>();
+        }
+        else if (record.op == VULKAN_CAPTURE_PRESENT)
+        {
+            presentTimes.push_back(payload.get<uint64_t>());
+        }
+    }
+    if (presentTimes.empty() || targetPipeline >= pipelines.size())
+    {
+        throw std::runtime_error("capture has no frame to replay.");
+    }
+    this->createTarget();
+    this->createBuffers();
+}
+
+void VulkanReplay::parsePipeline(const Record& record)
+{
+    VulkanCaptureReader reader = { data.data() + record.offset, record.size };
+    if (reader.get<uint32_t>() != pipelines.size())
+    {
+        throw std::runtime_error("capture pipeline ids are out of order.");
+    }
+    auto pipeline = std::make_unique<Pipeline>();
+    VulkanGraphicsPipelineArgs& args = pipeline->args;
+    VulkanShaderCode* shaders[4] = { &args.vert, &args.frag, &args.task, &args.mesh };
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        // copied, the words have to be aligned.
+        uint32_t size = reader.get<uint32_t>();
+        pipeline->code[i].resize(size / sizeof(uint32_t));
+        memcpy(pipeline->code[i].data(), reader.bytes(size), pipeline->code[i].size() * sizeof(uint32_t));
+        if (size != 0)
+            *shaders[i] = VulkanShaderCode(pipeline->code[i].data(), pipeline->code[i].size() * sizeof(uint32_t));
+    }
+    args.viewport = reader.get<VkViewport>();
+    args.scissor = reader.get<VkRect2D>();
+    args.colorFormat = (VkFormat)reader.get<uint32_t>();
+    args.depthFormat = (VkFormat)reader.get<uint32_t>();
+    args.samples = (VkSampleCountFlagBits)reader.get<uint32_t>();
+    reader.get<uint8_t>();
+    // every pass of the replay is a render pass into the one target.
+    args.dynamicRendering = false;
+    args.vertexBindings.resize(reader.get<uint32_t>());
+    for (auto& binding : args.vertexBindings)
+        binding = reader.get<VkVertexInputBindingDescription>();
+    args.vertexAttributes.resize(reader.get<uint32_t>());
+    for (auto& attribute : args.vertexAttributes)
+        attribute = reader.get<VkVertexInputAttributeDescription>();
+    args.bindings.resize(reader.get<uint32_t>());
+    for (auto& binding : args.bindings)
+    {
+        binding.binding = reader.get<uint32_t>();
+        binding.descriptorType = (VkDescriptorType)reader.get<uint32_t>();
+        binding.descriptorCount = reader.get<uint32_t>();
+        binding.stageFlags = (VkShaderStageFlags)reader.get<uint32_t>();
+        binding.pImmutableSamplers = nullptr;
+    }
+    args.pushConstantSize = reader.get<uint32_t>();
+    args.cullMode = (VkCullModeFlags)reader.get<uint32_t>();
+    args.depthTest = reader.get<uint8_t>() != 0;
+    args.depthWrite = reader.get<uint8_t>() != 0;
+    args.blend = reader.get<uint8_t>() != 0;
+    reader.get<uint8_t>();
+    args.present = false;
+    pipelines.push_back(std::move(pipeline));
+}
+
+void VulkanReplay::createBuffers()
+{
+    // only buffers some draw reads are worth the memory.
+    std::vector<bool> used;
+    std::vector<VkDeviceSize> sizes;
+    for (const Record& record : records)
+    {
+        VulkanCaptureReader reader = { data.data() + record.offset, record.size };
+        if (record.op == VULKAN_CAPTURE_UPLOAD)
+        {
+            uint32_t id = reader.get<uint32_t>();
+            uint64_t offset = reader.get<uint64_t>();
+            uint64_t size = reader.get<uint64_t>();
+            if (id >= VULKAN_CAPTURE_UNKNOWN)
+                continue;
+            if (id >= sizes.size())
+                sizes.resize(id + 1, 0);
+            sizes[id] = std::max<VkDeviceSize>(sizes[id], offset + size);
+        }
+        else if (record.op == VULKAN_CAPTURE_DRAW)
+        {
+            reader.get<uint32_t>();
+            uint32_t vertexBuffer = reader.get<uint32_t>();
+            reader.get<uint64_t>();
+            uint32_t indexBuffer = reader.get<uint32_t>();
+            for (uint32_t id : { vertexBuffer, indexBuffer })
+            {
+                if (id >= VULKAN_CAPTURE_UNKNOWN)
+                    continue;
+                if (id >= used.size())
+                    used.resize(id + 1, false);
+                used[id] = true;
+            }
+        }
+    }
+
+    buffers.resize(sizes.size());
+    for (uint32_t id = 0; id < sizes.size() && id < used.size(); id++)
+    {
+        if (!used[id] || sizes[id] == 0)
+            continue;
+        VulkanBufferArgs bufferArgs;
+        bufferArgs.size = sizes[id];
+        bufferArgs.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        bufferArgs.memoryProps = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+        buffers[id] = logicalDevice->createBuffer(bufferArgs);
+    }
+}
+
+void VulkanReplay::createTarget()
+{
+    const VulkanGraphicsPipeline* pipeline = this->getPipeline(targetPipeline);
+    if (pipeline == nullptr)
+    {
+        throw std::runtime_error("Create the capture's first pipeline failed.");
+    }
+    const VulkanGraphicsPipelineArgs& pipelineArgs = pipelines[targetPipeline]->args;
+    extent = { (uint32_t)std::abs(pipelineArgs.viewport.width), (uint32_t)std::abs(pipelineArgs.viewport.height) };
+
+    VulkanAttachmentArgs targetArgs;
+    targetArgs.format = pipelineArgs.colorFormat;
+    targetArgs.extent = extent;
+    targetArgs.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+    targetArgs.transient = false;
+    target = logicalDevice->createAttachment(targetArgs);
+    if (pipelineArgs.samples != VK_SAMPLE_COUNT_1_BIT)
+    {
+        VulkanAttachmentArgs colorArgs;
+        colorArgs.format = pipelineArgs.colorFormat;
+        colorArgs.extent = extent;
+        colorArgs.samples = pipelineArgs.samples;
+        colorArgs.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+        color = logicalDevice->createAttachment(colorArgs);
+    }
+    if (pipelineArgs.depthFormat != VK_FORMAT_UNDEFINED)
+    {
+        VulkanAttachmentArgs depthArgs;
+        depthArgs.format = pipelineArgs.depthFormat;
+        depthArgs.extent = extent;
+        depthArgs.samples = pipelineArgs.samples;
+        depthArgs.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+        depth = logicalDevice->createAttachment(depthArgs);
+    }
+
+    VulkanFrameBufferArgs frameBufferArgs;
+    frameBufferArgs.renderPass = pipeline->renderPass;
+    frameBufferArgs.imageViews = &target.view;
+    frameBufferArgs.imageViewCount = 1;
+    frameBufferArgs.width = extent.width;
+    frameBufferArgs.height = extent.height;
+    frameBufferArgs.colorView = color.view;
+    frameBufferArgs.depthView = depth.view;
+    frameBuffer = logicalDevice->createFrameBufferObject(frameBufferArgs);
+}
+
+const VulkanGraphicsPipeline* VulkanReplay::getPipeline(uint32_t id)
+{
+    if (id >= pipelines.size())
+        return nullptr;
+    Pipeline& pipeline = *pipelines[id];
+    if (pipeline.args.mesh.size != 0 && logicalDevice->vkCmdDrawMeshTasksEXT == nullptr)
+        pipeline.failed = true;
+    if (!pipeline.created && !pipeline.failed)
+    {
+        // e.g. mesh shaders the device lacks.
+        try
+        {
+            pipeline.pipeline = logicalDevice->createGraphicsPipeline(pipeline.args);
+            pipeline.created = true;
+        }
+        catch (const std::runtime_error&)
+        {
+            pipeline.failed = true;
+        }
+    }
+    return pipeline.created ? &pipeline.pipeline : nullptr;
+}
+
+bool VulkanReplay::compatible(VkFormat colorFormat, VkFormat depthFormat, VkSampleCountFlagBits samples) const
+{
+    return colorFormat == target.format && depthFormat == depth.format &&
+        samples == (color.view != nullptr ? color.samples : VK_SAMPLE_COUNT_1_BIT);
+}
+
+VulkanReplayStats VulkanReplay::run()
+{
+    VULKAN_PROFILE_ZONE("replay");
+    VulkanReplayStats stats;
+    stats.recordedSeconds = (double)(presentTimes.back() - presentTimes.front()) * 1e-9;
+
+    const VulkanGraphicsPipeline& targetPass = pipelines[targetPipeline]->pipeline;
+    VkSampler sampler = textures->getSampler(VulkanSamplerDesc());
+    std::vector<double> intervals;
+    uint64_t begin = 0;
+    uint64_t frameBegin = 0;
+    uint64_t lastSubmit = 0;
+    double cpuSeconds = 0.0;
+    VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+    bool inPass = false;
+
+    // waits for the slot on the first record that needs it: the sprites of the
+    // frame overwrite its region of their instance buffer.
+    auto beginFrame = [&]() {
+        if (commandBuffer != VK_NULL_HANDLE)
+            return;
+        uint32_t slot = stats.frames % args.framesInFlight;
+        vkWaitForFences(logicalDevice->device, 1, fences[slot].address(), VK_TRUE, std::numeric_limits<uint64_t>::max());
+        vkResetFences(logicalDevice->device, 1, fences[slot].address());
+        frameBegin = VulkanProfiler::now();
+        if (begin == 0)
+            begin = frameBegin;
+
+        commandBuffer = commandBuffers[slot];
+        vkResetCommandBuffer(commandBuffer, 0);
+        VkCommandBufferBeginInfo cbbi = {};
+        cbbi.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        cbbi.pNext = nullptr;
+        cbbi.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        cbbi.pInheritanceInfo = nullptr;
+        if (VK_SUCCESS != vkBeginCommandBuffer(commandBuffer, &cbbi))
+        {
+            throw std::runtime_error("Begin replay command-buffer failed.");
+        }
+    };
+
+    for (const Record& record : records)
+    {
+        VulkanCaptureReader reader = { data.data() + record.offset, record.size };
+        switch (record.op)
+        {
+        case VULKAN_CAPTURE_PIPELINE:
+            // parsed by load(), created on first use.
+            break;
+
+        case VULKAN_CAPTURE_TEXTURE:
+        {
+            if (reader.get<uint32_t>() != textureList.size())
+            {
+                throw std::runtime_error("capture texture ids are out of order.");
+            }
+            VulkanTextureArgs textureArgs;
+            textureArgs.format = (VkFormat)reader.get<uint32_t>();
+            textureArgs.extent = reader.get<VkExtent2D>();
+            textureArgs.mipLevels = reader.get<uint32_t>();
+            textureArgs.dataMipLevels = reader.get<uint32_t>();
+            textureArgs.usage = (VkImageUsageFlags)reader.get<uint32_t>();
+            textureArgs.size = (VkDeviceSize)reader.get<uint64_t>();
+            textureArgs.data = reader.bytes((size_t)textureArgs.size);
+            // filled by copies or rendering the capture does not hold.
+            if (textureArgs.size == 0)
+                textureList.push_back(VulkanTexture());
+            else
+                textureList.push_back(textures->createTexture(textureArgs));
+            break;
+        }
+
+        case VULKAN_CAPTURE_UPLOAD:
+        {
+            uint32_t id = reader.get<uint32_t>();
+            VkDeviceSize offset = (VkDeviceSize)reader.get<uint64_t>();
+            VkDeviceSize size = (VkDeviceSize)reader.get<uint64_t>();
+            const uint8_t* bytes = reader.bytes((size_t)size);
+            if (id < buffers.size() && buffers[id].handle.get() != VK_NULL_HANDLE && size != 0)
+                uploader->uploadBuffer(buffers[id].handle, offset, bytes, size);
+            break;
+        }
+
+        case VULKAN_CAPTURE_SPRITE_BATCH:
+        {
+            if (reader.get<uint32_t>() != spriteBatches.size())
+            {
+                throw std::runtime_error("capture sprite batch ids are out of order.");
+            }
+            VulkanSpriteBatchArgs spriteArgs;
+            spriteArgs.colorFormat = (VkFormat)reader.get<uint32_t>();
+            spriteArgs.depthFormat = (VkFormat)reader.get<uint32_t>();
+            spriteArgs.samples = (VkSampleCountFlagBits)reader.get<uint32_t>();
+            reader.get<uint8_t>();
+            spriteArgs.dynamicRendering = false;
+            spriteArgs.extent = reader.get<VkExtent2D>();
+            spriteArgs.maxSprites = reader.get<uint32_t>();
+            spriteArgs.maxTextures = reader.get<uint32_t>();
+            spriteArgs.framesInFlight = args.framesInFlight;
+            auto spriteBatch = std::make_unique<SpriteBatch>();
+            spriteBatch->batch.init(*logicalDevice, spriteArgs);
+            spriteBatch->compatible = this->compatible(spriteArgs.colorFormat, spriteArgs.depthFormat, spriteArgs.samples);
+            spriteBatches.push_back(std::move(spriteBatch));
+            break;
+        }
+
+        case VULKAN_CAPTURE_SPRITE_TEXTURE:
+        {
+            uint32_t batch = reader.get<uint32_t>();
+            uint32_t texture = reader.get<uint32_t>();
+            if (batch >= spriteBatches.size())
+                break;
+            bool valid = texture < textureList.size() && textureList[texture].view != nullptr;
+            spriteBatches[batch]->batch.addTexture(valid ? textureList[texture].view : fallback.view, sampler);
+            break;
+        }
+
+        case VULKAN_CAPTURE_SPRITES:
+        {
+            uint32_t batch = reader.get<uint32_t>();
+            uint32_t count = reader.get<uint32_t>();
+            const uint8_t* sprites = reader.bytes((size_t)count * sizeof(VulkanSprite));
+            const uint8_t* keys = reader.bytes((size_t)count * sizeof(uint32_t));
+            if (batch >= spriteBatches.size())
+                break;
+            beginFrame();
+            VulkanSpriteBatch& spriteBatch = spriteBatches[batch]->batch;
+            spriteBatch.begin(stats.frames);
+            for (uint32_t i = 0; i < count; i++)
+            {
+                VulkanSprite sprite;
+                uint32_t key;
+                memcpy(&sprite, sprites + i * sizeof(VulkanSprite), sizeof(VulkanSprite));
+                memcpy(&key, keys + i * sizeof(uint32_t), sizeof(uint32_t));
+                spriteBatch.push(sprite, key & 0xffff, (uint16_t)(key >> 16));
+            }
+            spriteBatch.flush();
+            break;
+        }
+
+        case VULKAN_CAPTURE_PASS:
+        {
+            beginFrame();
+            if (inPass)
+                vkCmdEndRenderPass(commandBuffer);
+
+            // one per attachment, in render pass order.
+            VkClearValue clearValues[3];
+            uint32_t clearValueCount = 1;
+            clearValues[0].color = { {0.0f, 0.0f, 0.0f, 1.0f} };
+            if (targetPass.samples != VK_SAMPLE_COUNT_1_BIT)
+                clearValues[clearValueCount++].color = { {0.0f, 0.0f, 0.0f, 1.0f} };
+            if (targetPass.depthFormat != VK_FORMAT_UNDEFINED)
+                clearValues[clearValueCount++].depthStencil = { 1.0f, 0 };
+
+            VkRenderPassBeginInfo rpbi = {};
+            rpbi.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+            rpbi.renderPass = targetPass.renderPass;
+            rpbi.framebuffer = frameBuffer.handles[0];
+            rpbi.renderArea.offset = { 0, 0 };
+            rpbi.renderArea.extent = extent;
+            rpbi.clearValueCount = clearValueCount;
+            rpbi.pClearValues = clearValues;
+            vkCmdBeginRenderPass(commandBuffer, &rpbi, VK_SUBPASS_CONTENTS_INLINE);
+            VkViewport viewport = { 0.0f, 0.0f, (float)extent.width, (float)extent.height, 0.0f, 1.0f };
+            vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+            inPass = true;
+            break;
+        }
+
+        case VULKAN_CAPTURE_DRAW:
+        {
+            uint32_t pipelineId = reader.get<uint32_t>();
+            VulkanDrawGeometry geometry;
+            uint32_t vertexBuffer = reader.get<uint32_t>();
+            geometry.vertexOffset = (VkDeviceSize)reader.get<uint64_t>();
+            uint32_t indexBuffer = reader.get<uint32_t>();
+            geometry.indexOffset = (VkDeviceSize)reader.get<uint64_t>();
+            geometry.indexType = (VkIndexType)reader.get<uint32_t>();
+            geometry.count = reader.get<uint32_t>();
+            uint32_t firstInstance = reader.get<uint32_t>();
+            uint32_t instanceCount = reader.get<uint32_t>();
+            bool descriptorSets = reader.get<uint8_t>() != 0;
+
+            // a buffer id only misses from `buffers` when nothing was uploaded into it.
+            auto buffer = [this](uint32_t id, VkBuffer& handle) {
+                if (id == VULKAN_CAPTURE_NONE)
+                    return true;
+                if (id >= buffers.size() || buffers[id].handle.get() == VK_NULL_HANDLE)
+                    return false;
+                handle = buffers[id].handle;
+                return true;
+            };
+            const VulkanGraphicsPipeline* pipeline = nullptr;
+            if (inPass && !descriptorSets && pipelineId < pipelines.size() &&
+                this->compatible(pipelines[pipelineId]->args.colorFormat, pipelines[pipelineId]->args.depthFormat,
+                    pipelines[pipelineId]->args.samples) &&
+                buffer(vertexBuffer, geometry.vertexBuffer) && buffer(indexBuffer, geometry.indexBuffer))
+            {
+                pipeline = this->getPipeline(pipelineId);
+            }
+            if (pipeline == nullptr)
+            {
+                stats.skippedDraws++;
+                break;
+            }
+
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline->handle);
+            if (geometry.vertexBuffer != VK_NULL_HANDLE)
+                vkCmdBindVertexBuffers(commandBuffer, 0, 1, &geometry.vertexBuffer, &geometry.vertexOffset);
+            if (geometry.indexBuffer != VK_NULL_HANDLE)
+            {
+                vkCmdBindIndexBuffer(commandBuffer, geometry.indexBuffer, geometry.indexOffset, geometry.indexType);
+                vkCmdDrawIndexed(commandBuffer, geometry.count, instanceCount, 0, 0, firstInstance);
+            }
+            else
+            {
+                vkCmdDraw(commandBuffer, geometry.count, instanceCount, 0, firstInstance);
+            }
+            stats.draws++;
+            break;
+        }
+
+        case VULKAN_CAPTURE_SPRITE_DRAW:
+        {
+            uint32_t batch = reader.get<uint32_t>();
+            if (!inPass || batch >= spriteBatches.size() || !spriteBatches[batch]->compatible)
+            {
+                stats.skippedDraws++;
+                break;
+            }
+            spriteBatches[batch]->batch.record(commandBuffer);
+            stats.draws += spriteBatches[batch]->batch.statistics().draws;
+            break;
+        }
+
+        case VULKAN_CAPTURE_PRESENT:
+        {
+            beginFrame();
+            if (inPass)
+                vkCmdEndRenderPass(commandBuffer);
+            inPass = false;
+            if (VK_SUCCESS != vkEndCommandBuffer(commandBuffer))
+            {
+                throw std::runtime_error("End replay command-buffer failed.");
+            }
+            // textures and buffers made for this frame go first.
+            uploader->flush();
+            cpuSeconds += (double)(VulkanProfiler::now() - frameBegin) * 1e-9;
+
+            if (args.paced)
+            {
+                uint64_t due = begin + (reader.get<uint64_t>() - presentTimes.front());
+                uint64_t now = VulkanProfiler::now();
+                if (due > now)
+                    std::this_thread::sleep_for(std::chrono::nanoseconds(due - now));
+            }
+            uint32_t slot = stats.frames % args.framesInFlight;
+            logicalDevice->submit(commandBuffer, VK_NULL_HANDLE, 0, VK_NULL_HANDLE, fences[slot]);
+            uint64_t submitted = VulkanProfiler::now();
+            if (lastSubmit != 0)
+                intervals.push_back((double)(submitted - lastSubmit) * 1e-6);
+            lastSubmit = submitted;
+            uploader->collect();
+            commandBuffer = VK_NULL_HANDLE;
+            stats.frames++;
+            break;
+        }
+        }
+    }
+
+    vkDeviceWaitIdle(logicalDevice->device);
+    stats.seconds = (double)(VulkanProfiler::now() - begin) * 1e-9;
+    stats.cpuAverage = stats.frames > 0 ? cpuSeconds * 1e3 / stats.frames : 0.0;
+    if (!intervals.empty())
+    {
+        double sum = 0.0;
+        for (double interval : intervals)
+            sum += interval;
+        std::sort(intervals.begin(), intervals.end());
+        stats.intervalMin = intervals.front();
+        stats.intervalAverage = sum / intervals.size();
+        stats.intervalP99 = intervals[std::min(intervals.size() - 1, intervals.size() * 99 / 100)];
+        stats.intervalMax = intervals.back();
+    }
+    return stats;
+}
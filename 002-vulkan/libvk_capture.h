@@ -0,0 +1,196 @@
+#ifndef _LIBVK_CAPTURE_H_
+#define _LIBVK_CAPTURE_H_
+
+#include "libvk.h"
+#include "libvk_renderqueue.h"
+#include "libvk_sprites.h"
+#include "libvk_texture.h"
+#include "libvk_upload.h"
+#include <atomic>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#define VULKAN_CAPTURE_MAGIC    0x50434b56u     // "VKCP"
+#define VULKAN_CAPTURE_VERSION  1u
+#define VULKAN_CAPTURE_NONE     0xffffffffu     // no object
+#define VULKAN_CAPTURE_UNKNOWN  0xfffffffeu     // an object made outside the capture
+
+// A capture file is the magic and version, then records of one op byte, a
+// 32-bit payload size and the payload, little-endian and unpadded. Objects
+// are referred to by ids numbered per kind in order of creation.
+enum VulkanCaptureOp
+{
+    VULKAN_CAPTURE_PIPELINE = 1,        // id, VulkanGraphicsPipelineArgs with the SPIR-V
+    VULKAN_CAPTURE_TEXTURE,             // id, VulkanTextureArgs with the data
+    VULKAN_CAPTURE_UPLOAD,              // buffer id, offset, bytes
+    VULKAN_CAPTURE_SPRITE_BATCH,        // id, VulkanSpriteBatchArgs
+    VULKAN_CAPTURE_SPRITE_TEXTURE,      // batch id, texture id
+    VULKAN_CAPTURE_SPRITES,             // batch id, count, VulkanSprite[count], keys[count]
+    VULKAN_CAPTURE_PASS,                // pipeline id the render pass (or rendering scope) began with
+    VULKAN_CAPTURE_DRAW,                // pipeline id, geometry with buffer ids, instances
+    VULKAN_CAPTURE_SPRITE_DRAW,         // batch id
+    VULKAN_CAPTURE_PRESENT,             // ns since the capture began
+};
+
+// Records the high-level calls made on a logical device for a number of
+// frames: pipeline, texture and sprite batch creation, buffer uploads, the
+// render queue's and sprite batches' draws per pass, and the presents. libvk
+// calls the hooks below where those happen while VulkanLogicalDevice::capture
+// points here; the file closes itself after the last frame's present.
+//
+// GPU-driven work (meshlets, particles, compute) is outside the capture: its
+// pipelines are recorded, its dispatches and indirect draws are not.
+// Thread-safe, the sprite batches flush on job threads; the records of work
+// recorded in parallel are deferred and flushed in order, see beginDeferred().
+class VulkanCapture
+{
+    enum IdKind
+    {
+        ID_PIPELINE,
+        ID_TEXTURE,
+        ID_BUFFER,
+        ID_SPRITE_BATCH,
+        ID_KIND_COUNT
+    };
+
+    std::ofstream file;
+    std::mutex mutex;
+    std::atomic<uint32_t> framesLeft{ 0 };
+    uint64_t start = 0;
+    uint64_t bytes = 0;
+    std::unordered_map<uint64_t, uint32_t> ids[ID_KIND_COUNT];   // handle -> id
+    uint32_t nextIds[ID_KIND_COUNT] = {};
+    std::vector<uint8_t> record;
+
+public:
+    void open(const std::string& path, uint32_t frameCount);
+    void close();
+
+    bool recording() const { return framesLeft > 0; }
+    uint64_t size() const { return bytes; }
+
+    // hooks
+    void pipeline(VkPipeline handle, const VulkanGraphicsPipelineArgs& args);
+    void texture(VkImageView view, const VulkanTextureArgs& args);
+    void upload(VkBuffer buffer, VkDeviceSize offset, const void* data, VkDeviceSize size);
+    void spriteBatch(const VulkanSpriteBatch* batch, const VulkanSpriteBatchArgs& args);
+    void spriteTexture(const VulkanSpriteBatch* batch, VkImageView view);
+    void sprites(const VulkanSpriteBatch* batch, const VulkanSprite* sprites, const uint32_t* keys, uint32_t count);
+    void pass(VkPipeline pipeline);
+    void draw(VkPipeline pipeline, const VulkanDrawGeometry& geometry, uint32_t firstInstance, uint32_t instanceCount,
+        bool descriptorSets);
+    void spriteDraw(const VulkanSpriteBatch* batch);
+    void present();
+
+    // Hooks called on this thread until endDeferred() add their records to
+    // `records` instead of the file, for flush() to write later: command
+    // buffers recorded on parallel jobs keep their passes and draws together
+    // and in submission order.
+    void beginDeferred(std::vector<uint8_t>& records);
+    void endDeferred();
+    // Writes and clears `records`.
+    void flush(std::vector<uint8_t>& records);
+
+private:
+    uint32_t create(IdKind kind, uint64_t handle);
+    uint32_t find(IdKind kind, uint64_t handle);
+    void begin(VulkanCaptureOp op);
+    void end();
+    template<class T> void put(const T& value);
+    void put(const void* data, size_t size);
+};
+
+struct VulkanReplayArgs
+{
+    bool paced = false;             // present at the recorded times instead of as fast as possible
+    uint32_t framesInFlight = 2;
+};
+
+struct VulkanReplayStats
+{
+    uint32_t frames = 0;
+    uint64_t draws = 0;
+    uint64_t skippedDraws = 0;      // with descriptor sets, buffers or a pipeline the replay lacks, or for another target
+    double seconds = 0.0;           // first frame begun until the GPU finished the last
+    double recordedSeconds = 0.0;   // first to last present of the capture
+    double intervalMin = 0.0;       // ms between submissions
+    double intervalAverage = 0.0;
+    double intervalP99 = 0.0;
+    double intervalMax = 0.0;
+    double cpuAverage = 0.0;        // ms recording and submitting a frame
+};
+
+// Replays a capture offscreen, into one color target made for the pipeline of
+// the first recorded pass; every later pass clears and draws into it again.
+// Pipelines are created on first use, so ones the device cannot make only cost
+// the draws that use them. Buffers are sized up front from the uploads into
+// the ones recorded draws use. Not thread-safe.
+class VulkanReplay
+{
+    struct Record
+    {
+        uint8_t op;
+        size_t offset;      // of the payload in `data`
+        uint32_t size;
+    };
+
+    struct Pipeline
+    {
+        VulkanGraphicsPipelineArgs args;
+        std::vector<uint32_t> code[4];      // vert, frag, task, mesh
+        VulkanGraphicsPipeline pipeline;
+        bool created = false;
+        bool failed = false;
+    };
+
+    struct SpriteBatch
+    {
+        VulkanSpriteBatch batch;
+        bool compatible = false;
+    };
+
+    const VulkanLogicalDevice* logicalDevice = nullptr;
+    VulkanUploader* uploader = nullptr;
+    VulkanTextureManager* textures = nullptr;
+    VulkanReplayArgs args;
+    std::vector<uint8_t> data;          // the whole capture
+    std::vector<Record> records;
+    std::vector<uint64_t> presentTimes; // ns, as recorded
+
+    std::vector<std::unique_ptr<Pipeline>> pipelines;
+    std::vector<VulkanTexture> textureList;     // by id, empty for textures made without data
+    VulkanTexture fallback;             // 1x1 white, sampled instead of those
+    std::vector<VulkanBuffer> buffers;  // by id, empty where no draw uses them
+    std::vector<std::unique_ptr<SpriteBatch>> spriteBatches;
+
+    uint32_t targetPipeline = VULKAN_CAPTURE_NONE;
+    VkExtent2D extent = {};
+    VulkanAttachment target;
+    VulkanAttachment color;             // multisampled
+    VulkanAttachment depth;
+    VulkanFrameBufferObject frameBuffer;
+    VulkanCommandPoolHandle commandPool;
+    std::vector<VkCommandBuffer> commandBuffers;
+    std::vector<VulkanFenceHandle> fences;
+
+public:
+    void init(const VulkanLogicalDevice& logicalDevice, VulkanUploader& uploader, VulkanTextureManager& textures,
+        const VulkanReplayArgs& args);
+    void quit();
+
+    // Reads the whole file and sets up the target; throws if it is not a
+    // capture or a record is cut short.
+    void load(const std::string& path);
+    VulkanReplayStats run();
+
+private:
+    void parsePipeline(const Record& record);
+    void createBuffers();
+    void createTarget();
+    const VulkanGraphicsPipeline* getPipeline(uint32_t id);
+    bool compatible(VkFormat colorFormat, VkFormat depthFormat, VkSampleCountFlagBits samples) const;
+};
+
+#endif//_LIBVK_CAPTURE_H_
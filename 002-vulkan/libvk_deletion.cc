@@ -0,0 +1,185 @@
+
+#include "libvk_deletion.h"
+
+static const uint64_t NOT_SUBMITTED = ~0ull;
+
+void VulkanFrameTimeline::init(const VulkanLogicalDevice& logicalDevice, uint32_t framesInFlight)
+{
+    this->logicalDevice = &logicalDevice;
+    fences.resize(std::max(framesInFlight, 1u));
+    submitted.assign(fences.size(), NOT_SUBMITTED);
+    for (auto& fence : fences)
+        fence = logicalDevice.createFence();
+    next = 0;
+}
+
+void VulkanFrameTimeline::quit()
+{
+    if (logicalDevice == nullptr)
+        return;
+    for (auto& fence : fences)
+        logicalDevice->destroyFence(fence);
+    fences.clear();
+    submitted.clear();
+    logicalDevice = nullptr;
+}
+
+VkFence VulkanFrameTimeline::begin(uint64_t frame)
+{
+    size_t slot = frame % fences.size();
+    if (submitted[slot] != NOT_SUBMITTED)
+    {
+        vkWaitForFences(logicalDevice->device, 1, fences[slot].address(), VK_TRUE, std::numeric_limits<uint64_t>::max());
+        vkResetFences(logicalDevice->device, 1, fences[slot].address());
+    }
+    submitted[slot] = frame;
+    next = std::max(next, frame + 1);
+    return fences[slot];
+}
+
+uint64_t VulkanFrameTimeline::completedFrames() const
+{
+    // the oldest frame still running bounds the answer, whatever order fences signal in.
+    uint64_t completed = next;
+    for (size_t slot = 0; slot < fences.size(); slot++)
+    {
+        if (submitted[slot] != NOT_SUBMITTED && submitted[slot] < completed &&
+            vkGetFenceStatus(logicalDevice->device, fences[slot]) != VK_SUCCESS)
+        {
+            completed = submitted[slot];
+        }
+    }
+    return completed;
+}
+
+void VulkanFrameCommands::init(const VulkanLogicalDevice& logicalDevice, uint32_t framesInFlight, uint32_t commandBuffersPerFrame)
+{
+    this->logicalDevice = &logicalDevice;
+    slots.resize(std::max(framesInFlight, 1u));
+    for (auto& slot : slots)
+    {
+        slot.pools.resize(std::max(commandBuffersPerFrame, 1u));
+        slot.commandBuffers.resize(slot.pools.size());
+        for (size_t i = 0; i < slot.pools.size(); i++)
+        {
+            VkCommandPoolCreateInfo cpci = {};
+            cpci.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+            cpci.pNext = nullptr;
+            cpci.queueFamilyIndex = logicalDevice.queueFamilyIndex;
+            cpci.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+            if (VK_SUCCESS != vkCreateCommandPool(logicalDevice.device, &cpci, nullptr, slot.pools[i].put(logicalDevice.device)))
+            {
+                throw std::runtime_error("Create frame command-pool failed.");
+            }
+
+            VkCommandBufferAllocateInfo cbai = {};
+            cbai.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            cbai.pNext = nullptr;
+            cbai.commandPool = slot.pools[i];
+            cbai.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+            cbai.commandBufferCount = 1;
+            if (VK_SUCCESS != vkAllocateCommandBuffers(logicalDevice.device, &cbai, &slot.commandBuffers[i]))
+            {
+                throw std::runtime_error("Allocate frame command-buffer failed.");
+            }
+        }
+    }
+}
+
+void VulkanFrameCommands::quit()
+{
+    // the command buffers go with their pools.
+    slots.clear();
+    logicalDevice = nullptr;
+}
+
+VkCommandBuffer VulkanFrameCommands::begin(uint64_t frame)
+{
+    Slot& slot = slots[this->slot(frame)];
+    for (auto& pool : slot.pools)
+        vkResetCommandPool(logicalDevice->device, pool, 0);
+    return slot.commandBuffers[0];
+}
+
+void VulkanDeletionQueue::init(const VulkanLogicalDevice& logicalDevice)
+{
+    this->logicalDevice = &logicalDevice;
+}
+
+void VulkanDeletionQueue::quit()
+{
+    if (logicalDevice == nullptr)
+        return;
+    while (!items.empty())
+    {
+        auto destroy = std::move(items.front().destroy);
+        items.pop_front();
+        destroy();
+    }
+    logicalDevice = nullptr;
+}
+
+void VulkanDeletionQueue::retire(uint64_t value, std::function<void()> destroy)
+{
+    // values arrive nearly sorted; keep them sorted so collect() stops early.
+    auto it = items.end();
+    while (it != items.begin() && (it - 1)->value > value)
+        --it;
+    items.insert(it, { value, std::move(destroy) });
+}
+
+template<typename T>
+void VulkanDeletionQueue::retireObject(uint64_t value, T& object)
+{
+    // std::function wants a copyable callable: share the moved-in object instead.
+    auto held = std::make_shared<T>(std::move(object));
+    object = T();
+    this->retire(value, [held]() { *held = T(); });
+}
+
+void VulkanDeletionQueue::retire(uint64_t value, VulkanGraphicsPipeline& pipeline)
+{
+    this->retireObject(value, pipeline);
+}
+
+void VulkanDeletionQueue::retire(uint64_t value, VulkanComputePipeline& pipeline)
+{
+    this->retireObject(value, pipeline);
+}
+
+void VulkanDeletionQueue::retire(uint64_t value, VulkanFrameBufferObject& fbo)
+{
+    this->retireObject(value, fbo);
+}
+
+void VulkanDeletionQueue::retire(uint64_t value, VulkanSwapchain& swapchain)
+{
+    this->retireObject(value, swapchain);
+}
+
+void VulkanDeletionQueue::retire(uint64_t value, VulkanBuffer& buffer)
+{
+    this->retireObject(value, buffer);
+}
+
+void VulkanDeletionQueue::retire(uint64_t value, std::vector<VkCommandBuffer>& commandBuffers)
+{
+    if (commandBuffers.empty())
+        return;
+    auto device = logicalDevice;
+    this->retire(value, [device, commandBuffers]() {
+        vkFreeCommandBuffers(device->device, device->commandPool, (uint32_t)commandBuffers.size(), commandBuffers.data());
+    });
+    commandBuffers.clear();
+}
+
+void VulkanDeletionQueue::collect(uint64_t completed)
+{
+    while (!items.empty() && items.front().value < completed)
+    {
+        // pop first: a destroy callback may retire more objects.
+        auto destroy = std::move(items.front().destroy);
+        items.pop_front();
+        destroy();
+    }
+}
@@ -0,0 +1,93 @@
+#ifndef _LIBVK_DELETION_H_
+#define _LIBVK_DELETION_H_
+
+#include "libvk.h"
+#include <deque>
+#include <functional>
+#include <memory>
+
+// Tells which frames the GPU has finished, through one fence per frame in flight.
+// The fence returned by begin() has to be passed to the frame's last submission.
+class VulkanFrameTimeline
+{
+    const VulkanLogicalDevice* logicalDevice = nullptr;
+    std::vector<VulkanFenceHandle> fences;
+    std::vector<uint64_t> submitted;
+    uint64_t next = 0;
+
+public:
+    void init(const VulkanLogicalDevice& logicalDevice, uint32_t framesInFlight = 2);
+    void quit();
+
+    // Blocks only while `frame - framesInFlight` is still on the GPU.
+    VkFence begin(uint64_t frame);
+
+    // Every frame below the returned one has finished. Does not block.
+    uint64_t completedFrames() const;
+    uint32_t framesInFlight() const { return (uint32_t)fences.size(); }
+};
+
+// Primary command buffers per frame in flight, for work recorded every frame,
+// each from its own transient pool so they can be recorded on different
+// threads. begin(frame) resets the pools of the frame's slot, so call it after
+// VulkanFrameTimeline::begin() has waited for that slot.
+class VulkanFrameCommands
+{
+    struct Slot
+    {
+        std::vector<VulkanCommandPoolHandle> pools;     // one per command buffer
+        std::vector<VkCommandBuffer> commandBuffers;
+    };
+
+    const VulkanLogicalDevice* logicalDevice = nullptr;
+    std::vector<Slot> slots;
+
+public:
+    void init(const VulkanLogicalDevice& logicalDevice, uint32_t framesInFlight = 2, uint32_t commandBuffersPerFrame = 1);
+    void quit();
+
+    // Reset, not yet begun: the slot's first command buffer.
+    VkCommandBuffer begin(uint64_t frame);
+    // The slot's others, reset by the same begin().
+    VkCommandBuffer get(uint64_t frame, uint32_t index) const { return slots[slot(frame)].commandBuffers[index]; }
+    uint32_t slot(uint64_t frame) const { return (uint32_t)(frame % slots.size()); }
+};
+
+// Destroys objects once the GPU is past the last frame (or timeline value) that
+// used them, instead of idling the device. Objects are moved in: the caller's
+// handles are reset by retire().
+class VulkanDeletionQueue
+{
+    struct Item
+    {
+        uint64_t value;
+        std::function<void()> destroy;
+    };
+
+    const VulkanLogicalDevice* logicalDevice = nullptr;
+    std::deque<Item> items;
+
+public:
+    void init(const VulkanLogicalDevice& logicalDevice);
+    // Destroys everything left; the device must be idle.
+    void quit();
+
+    void retire(uint64_t value, std::function<void()> destroy);
+    void retire(uint64_t value, VulkanGraphicsPipeline& pipeline);
+    void retire(uint64_t value, VulkanComputePipeline& pipeline);
+    void retire(uint64_t value, VulkanFrameBufferObject& fbo);
+    void retire(uint64_t value, VulkanSwapchain& swapchain);
+    void retire(uint64_t value, VulkanBuffer& buffer);
+    void retire(uint64_t value, std::vector<VkCommandBuffer>& commandBuffers);
+
+    // Destroys what was retired with a value below `completed`.
+    void collect(uint64_t completed);
+
+    size_t size() const { return items.size(); }
+
+private:
+    template<typename T>
+    void retireObject(uint64_t value, T& object);
+};
+
+#endif//_LIBVK_DELETION_H_
@@ -0,0 +1,137 @@
+#ifndef _LIBVK_HANDLE_H_
+#define _LIBVK_HANDLE_H_
+
+#include <vulkan/vulkan.hpp>
+
+// Move-only owner of a Vulkan object created from `Owner` (usually the VkDevice),
+// destroyed with `Destroy` when the owner goes out of scope or is reset. Structs
+// built from these are move-only as well, so a stray copy or a shadowing local no
+// longer compiles into a double destroy or a leak.
+//
+// Converts to the raw handle only as an lvalue: `VkFence f = createFence();` would
+// destroy the fence at the end of the statement and is rejected.
+template<typename Handle, typename Owner, void (VKAPI_PTR *Destroy)(Owner, Handle, const VkAllocationCallbacks*)>
+class VulkanHandle
+{
+    Owner owner = VK_NULL_HANDLE;
+    Handle handle = VK_NULL_HANDLE;
+
+public:
+    VulkanHandle() = default;
+    VulkanHandle(Owner owner, Handle handle) : owner(owner), handle(handle) {}
+    VulkanHandle(const VulkanHandle&) = delete;
+    VulkanHandle& operator=(const VulkanHandle&) = delete;
+
+    VulkanHandle(VulkanHandle&& other) noexcept : owner(other.owner), handle(other.handle)
+    {
+        other.handle = VK_NULL_HANDLE;
+    }
+
+    VulkanHandle& operator=(VulkanHandle&& other) noexcept
+    {
+        if (this != &other)
+        {
+            this->reset();
+            owner = other.owner;
+            handle = other.handle;
+            other.handle = VK_NULL_HANDLE;
+        }
+        return *this;
+    }
+
+    ~VulkanHandle() { this->reset(); }
+
+    void reset()
+    {
+        if (handle != VK_NULL_HANDLE)
+        {
+            Destroy(owner, handle, nullptr);
+            handle = VK_NULL_HANDLE;
+        }
+    }
+
+    // Destroys the current object and returns the slot for a vkCreate* call.
+    Handle* put(Owner owner)
+    {
+        this->reset();
+        this->owner = owner;
+        return &handle;
+    }
+
+    Handle release()
+    {
+        Handle ret = handle;
+        handle = VK_NULL_HANDLE;
+        return ret;
+    }
+
+    Handle get() const { return handle; }
+    const Handle* address() const { return &handle; }
+
+    operator Handle() const & { return handle; }
+    operator Handle() const && = delete;
+};
+
+// Same, for objects without a parent (VkDevice).
+template<typename Handle, void (VKAPI_PTR *Destroy)(Handle, const VkAllocationCallbacks*)>
+class VulkanRootHandle
+{
+    Handle handle = VK_NULL_HANDLE;
+
+public:
+    VulkanRootHandle() = default;
+    explicit VulkanRootHandle(Handle handle) : handle(handle) {}
+    VulkanRootHandle(const VulkanRootHandle&) = delete;
+    VulkanRootHandle& operator=(const VulkanRootHandle&) = delete;
+
+    VulkanRootHandle(VulkanRootHandle&& other) noexcept : handle(other.handle)
+    {
+        other.handle = VK_NULL_HANDLE;
+    }
+
+    VulkanRootHandle& operator=(VulkanRootHandle&& other) noexcept
+    {
+        if (this != &other)
+        {
+            this->reset();
+            handle = other.handle;
+            other.handle = VK_NULL_HANDLE;
+        }
+        return *this;
+    }
+
+    ~VulkanRootHandle() { this->reset(); }
+
+    void reset()
+    {
+        if (handle != VK_NULL_HANDLE)
+        {
+            Destroy(handle, nullptr);
+            handle = VK_NULL_HANDLE;
+        }
+    }
+
+    Handle get() const { return handle; }
+
+    operator Handle() const & { return handle; }
+    operator Handle() const && = delete;
+};
+
+typedef VulkanRootHandle<VkDevice, vkDestroyDevice> VulkanDeviceHandle;
+typedef VulkanHandle<VkCommandPool, VkDevice, vkDestroyCommandPool> VulkanCommandPoolHandle;
+typedef VulkanHandle<VkSwapchainKHR, VkDevice, vkDestroySwapchainKHR> VulkanSwapchainHandle;
+typedef VulkanHandle<VkImage, VkDevice, vkDestroyImage> VulkanImageHandle;
+typedef VulkanHandle<VkImageView, VkDevice, vkDestroyImageView> VulkanImageViewHandle;
+typedef VulkanHandle<VkShaderModule, VkDevice, vkDestroyShaderModule> VulkanShaderModuleHandle;
+typedef VulkanHandle<VkPipeline, VkDevice, vkDestroyPipeline> VulkanPipelineHandle;
+typedef VulkanHandle<VkPipelineLayout, VkDevice, vkDestroyPipelineLayout> VulkanPipelineLayoutHandle;
+typedef VulkanHandle<VkRenderPass, VkDevice, vkDestroyRenderPass> VulkanRenderPassHandle;
+typedef VulkanHandle<VkDescriptorSetLayout, VkDevice, vkDestroyDescriptorSetLayout> VulkanDescriptorSetLayoutHandle;
+typedef VulkanHandle<VkDescriptorPool, VkDevice, vkDestroyDescriptorPool> VulkanDescriptorPoolHandle;
+typedef VulkanHandle<VkFramebuffer, VkDevice, vkDestroyFramebuffer> VulkanFramebufferHandle;
+typedef VulkanHandle<VkBuffer, VkDevice, vkDestroyBuffer> VulkanBufferHandle;
+typedef VulkanHandle<VkDeviceMemory, VkDevice, vkFreeMemory> VulkanDeviceMemoryHandle;
+typedef VulkanHandle<VkSemaphore, VkDevice, vkDestroySemaphore> VulkanSemaphoreHandle;
+typedef VulkanHandle<VkFence, VkDevice, vkDestroyFence> VulkanFenceHandle;
+
+#endif//_LIBVK_HANDLE_H_
@@ -0,0 +1,227 @@
+
+#include "libvk_jobs.h"
+#include "libvk_profiler.h"
+#include <algorithm>
+
+static const uint32_t NOT_A_WORKER = ~0u;
+
+static thread_local const VulkanJobSystem* currentSystem = nullptr;
+static thread_local uint32_t currentWorker = NOT_A_WORKER;
+
+void VulkanJobSystem::init(uint32_t threadCount)
+{
+    if (threadCount == 0)
+        threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+    for (uint32_t i = 0; i < threadCount; i++)
+        workers.push_back(std::make_unique<Worker>());
+
+    currentSystem = this;
+    currentWorker = 0;
+    VulkanProfiler::instance().setThreadName("main");
+    running = true;
+    for (uint32_t i = 1; i < threadCount; i++)
+        threads.emplace_back(&VulkanJobSystem::work, this, i);
+}
+
+void VulkanJobSystem::quit()
+{
+    if (!running)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        running = false;
+    }
+    wake.notify_all();
+    for (auto& thread : threads)
+        thread.join();
+    threads.clear();
+    workers.clear();
+    mainJobs.clear();
+    queued = 0;
+    if (currentSystem == this)
+    {
+        currentSystem = nullptr;
+        currentWorker = NOT_A_WORKER;
+    }
+}
+
+void VulkanJobSystem::run(VulkanJobFunction function, VulkanJobCounter* counter)
+{
+    if (counter != nullptr)
+        counter->value.fetch_add(1, std::memory_order_relaxed);
+    this->push({ std::move(function), counter });
+}
+
+void VulkanJobSystem::runAfter(VulkanJobCounter& dependency, VulkanJobFunction function, VulkanJobCounter* counter)
+{
+    if (counter != nullptr)
+        counter->value.fetch_add(1, std::memory_order_relaxed);
+    {
+        // finish() drains under the same lock after the value reached zero.
+        std::lock_guard<std::mutex> lock(dependency.mutex);
+        if (!dependency.done())
+        {
+            dependency.parked.push_back({ std::move(function), counter });
+            return;
+        }
+    }
+    this->push({ std::move(function), counter });
+}
+
+void VulkanJobSystem::runOnMain(VulkanJobFunction function, VulkanJobCounter* counter)
+{
+    if (counter != nullptr)
+        counter->value.fetch_add(1, std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(mainMutex);
+    mainJobs.push_back({ std::move(function), counter });
+}
+
+void VulkanJobSystem::parallelFor(size_t count, size_t grain, const VulkanJobRange& function, VulkanJobCounter* counter)
+{
+    grain = std::max(grain, (size_t)1);
+    for (size_t begin = 0; begin < count; begin += grain)
+    {
+        if (counter != nullptr)
+            counter->value.fetch_add(1, std::memory_order_relaxed);
+        Job job;
+        job.counter = counter;
+        job.range = &function;
+        job.begin = begin;
+        job.end = std::min(begin + grain, count);
+        this->push(std::move(job));
+    }
+}
+
+void VulkanJobSystem::wait(VulkanJobCounter& counter)
+{
+    bool main = this->isMainThread();
+    Job job;
+    while (!counter.done())
+    {
+        if ((main && this->popMain(job)) || this->pop(job) || this->steal(job))
+            this->execute(job);
+        else
+            std::this_thread::yield();
+    }
+    std::lock_guard<std::mutex> lock(counter.mutex);
+}
+
+void VulkanJobSystem::pumpMain()
+{
+    Job job;
+    while (this->popMain(job))
+        this->execute(job);
+}
+
+bool VulkanJobSystem::isMainThread() const
+{
+    return currentSystem == this && currentWorker == 0;
+}
+
+void VulkanJobSystem::push(Job&& job)
+{
+    // threads outside the system hand their jobs to the main thread's deque,
+    // where the workers steal them.
+    uint32_t index = currentSystem == this ? currentWorker : 0;
+    {
+        Worker& worker = *workers[index];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        worker.jobs.push_back(std::move(job));
+    }
+    queued.fetch_add(1, std::memory_order_release);
+    {
+        // a worker between its check and its wait must not miss this.
+        std::lock_guard<std::mutex> lock(sleepMutex);
+    }
+    wake.notify_one();
+}
+
+bool VulkanJobSystem::pop(Job& job)
+{
+    if (currentSystem != this)
+        return false;
+    Worker& worker = *workers[currentWorker];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    if (worker.jobs.empty())
+        return false;
+    job = std::move(worker.jobs.back());
+    worker.jobs.pop_back();
+    queued.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+}
+
+bool VulkanJobSystem::steal(Job& job)
+{
+    if (queued.load(std::memory_order_acquire) == 0)
+        return false;
+    uint32_t count = (uint32_t)workers.size();
+    uint32_t self = currentSystem == this ? currentWorker : 0;
+    for (uint32_t k = 1; k <= count; k++)
+    {
+        Worker& victim = *workers[(self + k) % count];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (victim.jobs.empty())
+            continue;
+        job = std::move(victim.jobs.front());
+        victim.jobs.pop_front();
+        queued.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+    }
+    return false;
+}
+
+bool VulkanJobSystem::popMain(Job& job)
+{
+    std::lock_guard<std::mutex> lock(mainMutex);
+    if (mainJobs.empty())
+        return false;
+    job = std::move(mainJobs.front());
+    mainJobs.pop_front();
+    return true;
+}
+
+void VulkanJobSystem::execute(Job& job)
+{
+    if (job.range != nullptr)
+        (*job.range)(job.begin, job.end);
+    else
+        job.function();
+    job.function = nullptr;
+    job.range = nullptr;
+    this->finish(job.counter);
+}
+
+void VulkanJobSystem::finish(VulkanJobCounter* counter)
+{
+    if (counter == nullptr)
+        return;
+
+    // decremented under the lock: wait() takes it before returning, so the
+    // counter cannot go away while this still touches it.
+    std::vector<VulkanJobCounter::Parked> ready;
+    {
+        std::lock_guard<std::mutex> lock(counter->mutex);
+        if (counter->value.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            ready.swap(counter->parked);
+    }
+    for (auto& parked : ready)
+        this->push({ std::move(parked.function), parked.counter });
+}
+
+void VulkanJobSystem::work(uint32_t index)
+{
+    currentSystem = this;
+    currentWorker = index;
+    VulkanProfiler::instance().setThreadName("worker " + std::to_string(index));
+    Job job;
+    while (running)
+    {
+        if (this->pop(job) || this->steal(job))
+        {
+            this->execute(job);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        wake.wait(lock, [this]() { return !running || queued.load(std::memory_order_acquire) != 0; });
+    }
+}
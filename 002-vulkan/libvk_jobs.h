@@ -0,0 +1,105 @@
+#ifndef _LIBVK_JOBS_H_
+#define _LIBVK_JOBS_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+typedef std::function<void()> VulkanJobFunction;
+typedef std::function<void(size_t, size_t)> VulkanJobRange;
+
+// Counts unfinished jobs. Every job run with a counter raises it when scheduled
+// and lowers it when done; jobs scheduled after a counter start when it is zero.
+// A counter must outlive the jobs that refer to it and is reusable once zero.
+class VulkanJobCounter
+{
+    friend class VulkanJobSystem;
+
+    struct Parked
+    {
+        VulkanJobFunction function;
+        VulkanJobCounter* counter;
+    };
+
+    std::atomic<uint32_t> value{ 0 };
+    std::mutex mutex;
+    std::vector<Parked> parked;     // waiting for value to reach zero
+
+public:
+    bool done() const { return value.load(std::memory_order_acquire) == 0; }
+};
+
+// Work-stealing scheduler: one deque per thread, the owner pushes and pops at the
+// back, idle threads steal from the front of the others. The thread that calls
+// init() becomes worker 0 and is the only one running main-thread jobs (window
+// system, queue submission, present); it executes jobs only inside wait() and
+// pumpMain(), so it never blocks while there is work it could do.
+class VulkanJobSystem
+{
+    struct Job
+    {
+        VulkanJobFunction function;
+        VulkanJobCounter* counter = nullptr;
+        const VulkanJobRange* range = nullptr;  // a parallelFor chunk instead of `function`
+        size_t begin = 0;
+        size_t end = 0;
+    };
+
+    struct Worker
+    {
+        std::mutex mutex;
+        std::deque<Job> jobs;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::thread> threads;
+    std::mutex mainMutex;
+    std::deque<Job> mainJobs;
+
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    std::atomic<uint32_t> queued{ 0 };
+    std::atomic<bool> running{ false };
+
+public:
+    // threadCount 0: one worker per hardware thread, counting the calling one.
+    void init(uint32_t threadCount = 0);
+    // Waits for the workers to finish their current job; queued jobs are dropped.
+    void quit();
+
+    void run(VulkanJobFunction function, VulkanJobCounter* counter = nullptr);
+    // Starts once `dependency` is zero.
+    void runAfter(VulkanJobCounter& dependency, VulkanJobFunction function, VulkanJobCounter* counter = nullptr);
+    // Runs on the init() thread, in submission order.
+    void runOnMain(VulkanJobFunction function, VulkanJobCounter* counter = nullptr);
+    // Splits [0, count) into jobs of `grain` items, function(begin, end) each.
+    // The jobs share `function` instead of copying it, so it must outlive them:
+    // wait for `counter` before it goes out of scope.
+    void parallelFor(size_t count, size_t grain, const VulkanJobRange& function, VulkanJobCounter* counter);
+    void parallelFor(size_t count, size_t grain, VulkanJobRange&& function, VulkanJobCounter* counter) = delete;
+
+    // Executes jobs until the counter is zero. From the main thread this includes
+    // main-thread jobs.
+    void wait(VulkanJobCounter& counter);
+    // Runs the main-thread jobs queued so far; main thread only.
+    void pumpMain();
+
+    uint32_t threadCount() const { return (uint32_t)workers.size(); }
+    bool isMainThread() const;
+
+private:
+    void push(Job&& job);
+    bool pop(Job& job);
+    bool steal(Job& job);
+    bool popMain(Job& job);
+    void execute(Job& job);
+    void finish(VulkanJobCounter* counter);
+    void work(uint32_t index);
+};
+
+#endif//_LIBVK_JOBS_H_
@@ -0,0 +1,418 @@
+
+#include "libvk_math.h"
+
+// One lane type per instruction set; the batched kernels below are written once
+// against it. Intrinsic vector types cannot overload operators, hence the wrapper.
+#if defined(LIBVK_MATH_AVX2)
+struct Lanes { __m256 v; };
+static const size_t LANE_COUNT = 8;
+static inline Lanes lanesLoad(const float* p) { return { _mm256_loadu_ps(p) }; }
+static inline void lanesStore(float* p, Lanes a) { _mm256_storeu_ps(p, a.v); }
+static inline Lanes lanesSet(float s) { return { _mm256_set1_ps(s) }; }
+static inline Lanes operator+(Lanes a, Lanes b) { return { _mm256_add_ps(a.v, b.v) }; }
+static inline Lanes operator-(Lanes a, Lanes b) { return { _mm256_sub_ps(a.v, b.v) }; }
+static inline Lanes operator*(Lanes a, Lanes b) { return { _mm256_mul_ps(a.v, b.v) }; }
+static inline Lanes lanesMin(Lanes a, Lanes b) { return { _mm256_min_ps(a.v, b.v) }; }
+// bit i set where a[i] >= b[i]
+static inline uint32_t lanesMaskGE(Lanes a, Lanes b) { return (uint32_t)_mm256_movemask_ps(_mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ)); }
+#elif defined(LIBVK_MATH_SSE)
+struct Lanes { __m128 v; };
+static const size_t LANE_COUNT = 4;
+static inline Lanes lanesLoad(const float* p) { return { _mm_loadu_ps(p) }; }
+static inline void lanesStore(float* p, Lanes a) { _mm_storeu_ps(p, a.v); }
+static inline Lanes lanesSet(float s) { return { _mm_set1_ps(s) }; }
+static inline Lanes operator+(Lanes a, Lanes b) { return { _mm_add_ps(a.v, b.v) }; }
+static inline Lanes operator-(Lanes a, Lanes b) { return { _mm_sub_ps(a.v, b.v) }; }
+static inline Lanes operator*(Lanes a, Lanes b) { return { _mm_mul_ps(a.v, b.v) }; }
+static inline Lanes lanesMin(Lanes a, Lanes b) { return { _mm_min_ps(a.v, b.v) }; }
+static inline uint32_t lanesMaskGE(Lanes a, Lanes b) { return (uint32_t)_mm_movemask_ps(_mm_cmpge_ps(a.v, b.v)); }
+#elif defined(LIBVK_MATH_NEON)
+struct Lanes { float32x4_t v; };
+static const size_t LANE_COUNT = 4;
+static inline Lanes lanesLoad(const float* p) { return { vld1q_f32(p) }; }
+static inline void lanesStore(float* p, Lanes a) { vst1q_f32(p, a.v); }
+static inline Lanes lanesSet(float s) { return { vdupq_n_f32(s) }; }
+static inline Lanes operator+(Lanes a, Lanes b) { return { vaddq_f32(a.v, b.v) }; }
+static inline Lanes operator-(Lanes a, Lanes b) { return { vsubq_f32(a.v, b.v) }; }
+static inline Lanes operator*(Lanes a, Lanes b) { return { vmulq_f32(a.v, b.v) }; }
+static inline Lanes lanesMin(Lanes a, Lanes b) { return { vminq_f32(a.v, b.v) }; }
+static inline uint32_t lanesMaskGE(Lanes a, Lanes b)
+{
+    static const uint32_t bits[4] = { 1, 2, 4, 8 };
+    uint32x4_t m = vandq_u32(vcgeq_f32(a.v, b.v), vld1q_u32(bits));
+    uint32x2_t s = vadd_u32(vget_low_u32(m), vget_high_u32(m));
+    return vget_lane_u32(vpadd_u32(s, s), 0);
+}
+#else
+struct Lanes { float v; };
+static const size_t LANE_COUNT = 1;
+static inline Lanes lanesLoad(const float* p) { return { *p }; }
+static inline void lanesStore(float* p, Lanes a) { *p = a.v; }
+static inline Lanes lanesSet(float s) { return { s }; }
+static inline Lanes operator+(Lanes a, Lanes b) { return { a.v + b.v }; }
+static inline Lanes operator-(Lanes a, Lanes b) { return { a.v - b.v }; }
+static inline Lanes operator*(Lanes a, Lanes b) { return { a.v * b.v }; }
+static inline Lanes lanesMin(Lanes a, Lanes b) { return { a.v < b.v ? a.v : b.v }; }
+static inline uint32_t lanesMaskGE(Lanes a, Lanes b) { return a.v >= b.v ? 1u : 0u; }
+#endif
+
+VulkanQuat VulkanQuat::axisAngle(const VulkanVec3& axis, float radians)
+{
+    VulkanVec3 n = normalize(axis);
+    float s = std::sin(radians * 0.5f);
+    return { n.x * s, n.y * s, n.z * s, std::cos(radians * 0.5f) };
+}
+
+VulkanQuat operator*(const VulkanQuat& a, const VulkanQuat& b)
+{
+    return {
+        a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+        a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+        a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w,
+        a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z
+    };
+}
+
+VulkanQuat normalize(const VulkanQuat& q)
+{
+    float len = std::sqrt(q.x * q.x + q.y * q.y + q.z * q.z + q.w * q.w);
+    if (len <= 0.0f)
+        return VulkanQuat();
+    float inv = 1.0f / len;
+    return { q.x * inv, q.y * inv, q.z * inv, q.w * inv };
+}
+
+VulkanQuat nlerp(const VulkanQuat& a, const VulkanQuat& b, float t)
+{
+    float d = a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+    float sb = d < 0.0f ? -t : t;
+    float sa = 1.0f - t;
+    return normalize(VulkanQuat(a.x * sa + b.x * sb, a.y * sa + b.y * sb, a.z * sa + b.z * sb, a.w * sa + b.w * sb));
+}
+
+VulkanVec3 rotate(const VulkanQuat& q, const VulkanVec3& v)
+{
+    // v + 2w(u x v) + 2u x (u x v)
+    VulkanVec3 u(q.x, q.y, q.z);
+    VulkanVec3 t = cross(u, v) * 2.0f;
+    return v + t * q.w + cross(u, t);
+}
+
+VulkanMat4 VulkanMat4::identity()
+{
+    VulkanMat4 r = {};
+    r.m[0] = r.m[5] = r.m[10] = r.m[15] = 1.0f;
+    return r;
+}
+
+VulkanMat4 VulkanMat4::translation(const VulkanVec3& t)
+{
+    VulkanMat4 r = identity();
+    r.m[12] = t.x;
+    r.m[13] = t.y;
+    r.m[14] = t.z;
+    return r;
+}
+
+VulkanMat4 VulkanMat4::scale(const VulkanVec3& s)
+{
+    VulkanMat4 r = {};
+    r.m[0] = s.x;
+    r.m[5] = s.y;
+    r.m[10] = s.z;
+    r.m[15] = 1.0f;
+    return r;
+}
+
+VulkanMat4 VulkanMat4::rotation(const VulkanQuat& q)
+{
+    return compose(VulkanVec3(), q, VulkanVec3(1.0f, 1.0f, 1.0f));
+}
+
+VulkanMat4 VulkanMat4::compose(const VulkanVec3& t, const VulkanQuat& q, const VulkanVec3& s)
+{
+    float xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+    float xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+    float wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+
+    VulkanMat4 r;
+    r.m[0] = (1.0f - 2.0f * (yy + zz)) * s.x;
+    r.m[1] = 2.0f * (xy + wz) * s.x;
+    r.m[2] = 2.0f * (xz - wy) * s.x;
+    r.m[3] = 0.0f;
+    r.m[4] = 2.0f * (xy - wz) * s.y;
+    r.m[5] = (1.0f - 2.0f * (xx + zz)) * s.y;
+    r.m[6] = 2.0f * (yz + wx) * s.y;
+    r.m[7] = 0.0f;
+    r.m[8] = 2.0f * (xz + wy) * s.z;
+    r.m[9] = 2.0f * (yz - wx) * s.z;
+    r.m[10] = (1.0f - 2.0f * (xx + yy)) * s.z;
+    r.m[11] = 0.0f;
+    r.m[12] = t.x;
+    r.m[13] = t.y;
+    r.m[14] = t.z;
+    r.m[15] = 1.0f;
+    return r;
+}
+
+VulkanMat4 VulkanMat4::perspective(float fovY, float aspect, float zNear, float zFar)
+{
+    float f = 1.0f / std::tan(fovY * 0.5f);
+    VulkanMat4 r = {};
+    r.m[0] = f / aspect;
+    r.m[5] = -f;
+    r.m[10] = zFar / (zNear - zFar);
+    r.m[11] = -1.0f;
+    r.m[14] = zNear * zFar / (zNear - zFar);
+    return r;
+}
+
+VulkanMat4 VulkanMat4::lookAt(const VulkanVec3& eye, const VulkanVec3& center, const VulkanVec3& up)
+{
+    VulkanVec3 f = normalize(center - eye);
+    VulkanVec3 s = normalize(cross(f, up));
+    VulkanVec3 u = cross(s, f);
+
+    VulkanMat4 r = identity();
+    r.m[0] = s.x;  r.m[4] = s.y;  r.m[8] = s.z;
+    r.m[1] = u.x;  r.m[5] = u.y;  r.m[9] = u.z;
+    r.m[2] = -f.x; r.m[6] = -f.y; r.m[10] = -f.z;
+    r.m[12] = -dot(s, eye);
+    r.m[13] = -dot(u, eye);
+    r.m[14] = dot(f, eye);
+    return r;
+}
+
+// out = a * b for one matrix; out may alias b.
+static inline void multiply(const VulkanMat4& a, const VulkanMat4& b, VulkanMat4& out)
+{
+#if defined(LIBVK_MATH_SSE)
+    __m128 a0 = _mm_load_ps(a.m), a1 = _mm_load_ps(a.m + 4), a2 = _mm_load_ps(a.m + 8), a3 = _mm_load_ps(a.m + 12);
+    __m128 c[4];
+    for (int i = 0; i < 4; i++)
+    {
+        __m128 col = _mm_load_ps(b.m + i * 4);
+        c[i] = _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(a0, _mm_shuffle_ps(col, col, 0x00)), _mm_mul_ps(a1, _mm_shuffle_ps(col, col, 0x55))),
+            _mm_add_ps(_mm_mul_ps(a2, _mm_shuffle_ps(col, col, 0xaa)), _mm_mul_ps(a3, _mm_shuffle_ps(col, col, 0xff))));
+    }
+    for (int i = 0; i < 4; i++)
+        _mm_store_ps(out.m + i * 4, c[i]);
+#elif defined(LIBVK_MATH_NEON)
+    float32x4_t a0 = vld1q_f32(a.m), a1 = vld1q_f32(a.m + 4), a2 = vld1q_f32(a.m + 8), a3 = vld1q_f32(a.m + 12);
+    float32x4_t c[4];
+    for (int i = 0; i < 4; i++)
+    {
+        const float* col = b.m + i * 4;
+        float32x4_t r = vmulq_n_f32(a0, col[0]);
+        r = vmlaq_n_f32(r, a1, col[1]);
+        r = vmlaq_n_f32(r, a2, col[2]);
+        c[i] = vmlaq_n_f32(r, a3, col[3]);
+    }
+    for (int i = 0; i < 4; i++)
+        vst1q_f32(out.m + i * 4, c[i]);
+#else
+    float c[16];
+    for (int col = 0; col < 4; col++)
+    {
+        for (int row = 0; row < 4; row++)
+        {
+            c[col * 4 + row] =
+                a.m[row] * b.m[col * 4] + a.m[4 + row] * b.m[col * 4 + 1] +
+                a.m[8 + row] * b.m[col * 4 + 2] + a.m[12 + row] * b.m[col * 4 + 3];
+        }
+    }
+    for (int i = 0; i < 16; i++)
+        out.m[i] = c[i];
+#endif
+}
+
+VulkanMat4 operator*(const VulkanMat4& a, const VulkanMat4& b)
+{
+    VulkanMat4 r;
+    multiply(a, b, r);
+    return r;
+}
+
+VulkanVec4 operator*(const VulkanMat4& a, const VulkanVec4& v)
+{
+    return {
+        a.m[0] * v.x + a.m[4] * v.y + a.m[8] * v.z + a.m[12] * v.w,
+        a.m[1] * v.x + a.m[5] * v.y + a.m[9] * v.z + a.m[13] * v.w,
+        a.m[2] * v.x + a.m[6] * v.y + a.m[10] * v.z + a.m[14] * v.w,
+        a.m[3] * v.x + a.m[7] * v.y + a.m[11] * v.z + a.m[15] * v.w
+    };
+}
+
+VulkanVec3 transformPoint(const VulkanMat4& a, const VulkanVec3& p)
+{
+    VulkanVec4 r = a * VulkanVec4(p, 1.0f);
+    return { r.x, r.y, r.z };
+}
+
+VulkanMat4 inverseAffine(const VulkanMat4& a)
+{
+    // columns are scaled axes: transpose and divide by the squared scale.
+    VulkanMat4 r = VulkanMat4::identity();
+    for (int c = 0; c < 3; c++)
+    {
+        VulkanVec3 axis(a.m[c * 4], a.m[c * 4 + 1], a.m[c * 4 + 2]);
+        float len2 = dot(axis, axis);
+        float inv = len2 > 0.0f ? 1.0f / len2 : 0.0f;
+        r.m[c] = axis.x * inv;
+        r.m[4 + c] = axis.y * inv;
+        r.m[8 + c] = axis.z * inv;
+    }
+    VulkanVec3 t(a.m[12], a.m[13], a.m[14]);
+    for (int row = 0; row < 3; row++)
+        r.m[12 + row] = -(r.m[row] * t.x + r.m[4 + row] * t.y + r.m[8 + row] * t.z);
+    return r;
+}
+
+VulkanFrustum VulkanFrustum::fromMatrix(const VulkanMat4& viewProj)
+{
+    auto row = [&viewProj](int i) {
+        return VulkanVec4(viewProj.m[i], viewProj.m[4 + i], viewProj.m[8 + i], viewProj.m[12 + i]);
+    };
+    auto add = [](const VulkanVec4& a, const VulkanVec4& b) { return VulkanVec4(a.x + b.x, a.y + b.y, a.z + b.z, a.w + b.w); };
+    auto sub = [](const VulkanVec4& a, const VulkanVec4& b) { return VulkanVec4(a.x - b.x, a.y - b.y, a.z - b.z, a.w - b.w); };
+
+    VulkanVec4 r0 = row(0), r1 = row(1), r2 = row(2), r3 = row(3);
+    VulkanFrustum f;
+    f.planes[0] = add(r3, r0);
+    f.planes[1] = sub(r3, r0);
+    f.planes[2] = add(r3, r1);
+    f.planes[3] = sub(r3, r1);
+    f.planes[4] = r2;           // Vulkan depth starts at 0, not -w
+    f.planes[5] = sub(r3, r2);
+    for (auto& p : f.planes)
+    {
+        float len = std::sqrt(p.x * p.x + p.y * p.y + p.z * p.z);
+        float inv = len > 0.0f ? 1.0f / len : 0.0f;
+        p = VulkanVec4(p.x * inv, p.y * inv, p.z * inv, p.w * inv);
+    }
+    return f;
+}
+
+void multiplyMatrices(const VulkanMat4* a, const VulkanMat4* b, VulkanMat4* out, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        multiply(a[i], b[i], out[i]);
+}
+
+void multiplyMatrices(const VulkanMat4& a, const VulkanMat4* b, VulkanMat4* out, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        multiply(a, b[i], out[i]);
+}
+
+// Lanes of `count` consecutive transforms; the tail is padded with identities.
+static inline void composeLanes(const VulkanTransformArrays& in, size_t first, size_t count, VulkanMat4* out)
+{
+    Lanes px, py, pz, qx, qy, qz, qw, sx, sy, sz;
+    if (count == LANE_COUNT)
+    {
+        px = lanesLoad(in.px + first); py = lanesLoad(in.py + first); pz = lanesLoad(in.pz + first);
+        qx = lanesLoad(in.qx + first); qy = lanesLoad(in.qy + first); qz = lanesLoad(in.qz + first); qw = lanesLoad(in.qw + first);
+        sx = lanesLoad(in.sx + first); sy = lanesLoad(in.sy + first); sz = lanesLoad(in.sz + first);
+    }
+    else
+    {
+        alignas(32) float tmp[10][LANE_COUNT];
+        const float* src[10] = { in.px, in.py, in.pz, in.qx, in.qy, in.qz, in.qw, in.sx, in.sy, in.sz };
+        const float pad[10] = { 0, 0, 0, 0, 0, 0, 1, 1, 1, 1 };
+        for (int k = 0; k < 10; k++)
+        {
+            for (size_t l = 0; l < LANE_COUNT; l++)
+                tmp[k][l] = l < count ? src[k][first + l] : pad[k];
+        }
+        px = lanesLoad(tmp[0]); py = lanesLoad(tmp[1]); pz = lanesLoad(tmp[2]);
+        qx = lanesLoad(tmp[3]); qy = lanesLoad(tmp[4]); qz = lanesLoad(tmp[5]); qw = lanesLoad(tmp[6]);
+        sx = lanesLoad(tmp[7]); sy = lanesLoad(tmp[8]); sz = lanesLoad(tmp[9]);
+    }
+
+    Lanes one = lanesSet(1.0f), two = lanesSet(2.0f);
+    Lanes xx = qx * qx, yy = qy * qy, zz = qz * qz;
+    Lanes xy = qx * qy, xz = qx * qz, yz = qy * qz;
+    Lanes wx = qw * qx, wy = qw * qy, wz = qw * qz;
+
+    // entry e of every lane, then scattered to the column-major matrices.
+    alignas(32) float e[12][LANE_COUNT];
+    lanesStore(e[0], (one - two * (yy + zz)) * sx);
+    lanesStore(e[1], two * (xy + wz) * sx);
+    lanesStore(e[2], two * (xz - wy) * sx);
+    lanesStore(e[3], two * (xy - wz) * sy);
+    lanesStore(e[4], (one - two * (xx + zz)) * sy);
+    lanesStore(e[5], two * (yz + wx) * sy);
+    lanesStore(e[6], two * (xz + wy) * sz);
+    lanesStore(e[7], two * (yz - wx) * sz);
+    lanesStore(e[8], (one - two * (xx + yy)) * sz);
+    lanesStore(e[9], px);
+    lanesStore(e[10], py);
+    lanesStore(e[11], pz);
+
+    for (size_t l = 0; l < count; l++)
+    {
+        float* m = out[first + l].m;
+        m[0] = e[0][l]; m[1] = e[1][l]; m[2] = e[2][l]; m[3] = 0.0f;
+        m[4] = e[3][l]; m[5] = e[4][l]; m[6] = e[5][l]; m[7] = 0.0f;
+        m[8] = e[6][l]; m[9] = e[7][l]; m[10] = e[8][l]; m[11] = 0.0f;
+        m[12] = e[9][l]; m[13] = e[10][l]; m[14] = e[11][l]; m[15] = 1.0f;
+    }
+}
+
+void composeTransforms(const VulkanTransformArrays& in, VulkanMat4* out, size_t count)
+{
+    size_t i = 0;
+    for (; i + LANE_COUNT <= count; i += LANE_COUNT)
+        composeLanes(in, i, LANE_COUNT, out);
+    if (i < count)
+        composeLanes(in, i, count - i, out);
+}
+
+size_t cullSpheres(const VulkanFrustum& frustum,
+    const float* x, const float* y, const float* z, const float* radius,
+    size_t count, uint32_t* visible)
+{
+    Lanes nx[6], ny[6], nz[6], d[6];
+    for (int p = 0; p < 6; p++)
+    {
+        nx[p] = lanesSet(frustum.planes[p].x);
+        ny[p] = lanesSet(frustum.planes[p].y);
+        nz[p] = lanesSet(frustum.planes[p].z);
+        d[p] = lanesSet(frustum.planes[p].w);
+    }
+
+    size_t n = 0;
+    size_t i = 0;
+    for (; i + LANE_COUNT <= count; i += LANE_COUNT)
+    {
+        Lanes cx = lanesLoad(x + i), cy = lanesLoad(y + i), cz = lanesLoad(z + i);
+        Lanes r = lanesLoad(radius + i);
+        // the nearest plane decides: inside when min(distance) >= -r.
+        Lanes dist = nx[0] * cx + ny[0] * cy + nz[0] * cz + d[0];
+        for (int p = 1; p < 6; p++)
+            dist = lanesMin(dist, nx[p] * cx + ny[p] * cy + nz[p] * cz + d[p]);
+        uint32_t mask = lanesMaskGE(dist, lanesSet(0.0f) - r);
+        while (mask != 0)
+        {
+            uint32_t lane = 0;
+            while ((mask & (1u << lane)) == 0)
+                lane++;
+            visible[n++] = (uint32_t)(i + lane);
+            mask &= mask - 1;
+        }
+    }
+    for (; i < count; i++)
+    {
+        bool inside = true;
+        for (int p = 0; p < 6 && inside; p++)
+        {
+            const VulkanVec4& plane = frustum.planes[p];
+            inside = plane.x * x[i] + plane.y * y[i] + plane.z * z[i] + plane.w >= -radius[i];
+        }
+        if (inside)
+            visible[n++] = (uint32_t)i;
+    }
+    return n;
+}
@@ -0,0 +1,138 @@
+#ifndef _LIBVK_MATH_H_
+#define _LIBVK_MATH_H_
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+// Kernel selection is done at compile time from the target flags: AVX2, then
+// SSE2 (any x86-64), then NEON, else plain C++. Define LIBVK_MATH_SCALAR to
+// force the fallback, e.g. to compare results.
+#if defined(LIBVK_MATH_SCALAR)
+#elif defined(__AVX2__)
+#define LIBVK_MATH_AVX2 1
+#define LIBVK_MATH_SSE 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LIBVK_MATH_SSE 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define LIBVK_MATH_NEON 1
+#endif
+
+#if defined(LIBVK_MATH_SSE)
+#include <immintrin.h>
+#elif defined(LIBVK_MATH_NEON)
+#include <arm_neon.h>
+#endif
+
+// Right-handed, column vectors, column-major storage (m[column * 4 + row]), as
+// GLSL expects. Projections target Vulkan clip space: depth in [0, 1], y down.
+
+struct VulkanVec3
+{
+    float x = 0.0f, y = 0.0f, z = 0.0f;
+
+    VulkanVec3() = default;
+    VulkanVec3(float x, float y, float z) : x(x), y(y), z(z) {}
+};
+
+struct VulkanVec4
+{
+    float x = 0.0f, y = 0.0f, z = 0.0f, w = 0.0f;
+
+    VulkanVec4() = default;
+    VulkanVec4(float x, float y, float z, float w) : x(x), y(y), z(z), w(w) {}
+    VulkanVec4(const VulkanVec3& v, float w) : x(v.x), y(v.y), z(v.z), w(w) {}
+};
+
+inline VulkanVec3 operator+(const VulkanVec3& a, const VulkanVec3& b) { return { a.x + b.x, a.y + b.y, a.z + b.z }; }
+inline VulkanVec3 operator-(const VulkanVec3& a, const VulkanVec3& b) { return { a.x - b.x, a.y - b.y, a.z - b.z }; }
+inline VulkanVec3 operator-(const VulkanVec3& a) { return { -a.x, -a.y, -a.z }; }
+inline VulkanVec3 operator*(const VulkanVec3& a, float s) { return { a.x * s, a.y * s, a.z * s }; }
+inline VulkanVec3 operator*(const VulkanVec3& a, const VulkanVec3& b) { return { a.x * b.x, a.y * b.y, a.z * b.z }; }
+inline float dot(const VulkanVec3& a, const VulkanVec3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+inline float length(const VulkanVec3& a) { return std::sqrt(dot(a, a)); }
+
+inline VulkanVec3 cross(const VulkanVec3& a, const VulkanVec3& b)
+{
+    return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+}
+
+inline VulkanVec3 normalize(const VulkanVec3& a)
+{
+    float len = length(a);
+    return len > 0.0f ? a * (1.0f / len) : a;
+}
+
+struct VulkanQuat
+{
+    float x = 0.0f, y = 0.0f, z = 0.0f, w = 1.0f;
+
+    VulkanQuat() = default;
+    VulkanQuat(float x, float y, float z, float w) : x(x), y(y), z(z), w(w) {}
+
+    static VulkanQuat axisAngle(const VulkanVec3& axis, float radians);
+};
+
+VulkanQuat operator*(const VulkanQuat& a, const VulkanQuat& b);
+VulkanQuat normalize(const VulkanQuat& q);
+// Normalized lerp along the shorter arc; close enough to slerp for animation steps.
+VulkanQuat nlerp(const VulkanQuat& a, const VulkanQuat& b, float t);
+VulkanVec3 rotate(const VulkanQuat& q, const VulkanVec3& v);
+
+struct alignas(16) VulkanMat4
+{
+    float m[16];
+
+    static VulkanMat4 identity();
+    static VulkanMat4 translation(const VulkanVec3& t);
+    static VulkanMat4 scale(const VulkanVec3& s);
+    static VulkanMat4 rotation(const VulkanQuat& q);
+    // translate * rotate * scale
+    static VulkanMat4 compose(const VulkanVec3& t, const VulkanQuat& r, const VulkanVec3& s);
+    static VulkanMat4 perspective(float fovY, float aspect, float zNear, float zFar);
+    static VulkanMat4 lookAt(const VulkanVec3& eye, const VulkanVec3& center, const VulkanVec3& up);
+
+    VulkanVec4 column(int c) const { return { m[c * 4], m[c * 4 + 1], m[c * 4 + 2], m[c * 4 + 3] }; }
+};
+
+VulkanMat4 operator*(const VulkanMat4& a, const VulkanMat4& b);
+VulkanVec4 operator*(const VulkanMat4& a, const VulkanVec4& v);
+VulkanVec3 transformPoint(const VulkanMat4& a, const VulkanVec3& p);
+// Inverse of a translate/rotate/scale matrix (no shear, no projection).
+VulkanMat4 inverseAffine(const VulkanMat4& a);
+
+// Planes as (normal, d), normals pointing inside: dot(n, p) + d >= 0 inside.
+struct VulkanFrustum
+{
+    VulkanVec4 planes[6];   // left, right, bottom, top, near, far
+
+    // From a Vulkan projection * view matrix; world-space planes.
+    static VulkanFrustum fromMatrix(const VulkanMat4& viewProj);
+};
+
+// Batched kernels over arrays. Inputs and outputs must not overlap unless
+// stated; no alignment is required.
+
+// out[i] = a[i] * b[i]. `out` may alias `b` (parent * local in place).
+void multiplyMatrices(const VulkanMat4* a, const VulkanMat4* b, VulkanMat4* out, size_t count);
+// out[i] = a * b[i]
+void multiplyMatrices(const VulkanMat4& a, const VulkanMat4* b, VulkanMat4* out, size_t count);
+
+// Structure-of-arrays local transforms; every pointer addresses `count` floats.
+struct VulkanTransformArrays
+{
+    const float* px; const float* py; const float* pz;
+    const float* qx; const float* qy; const float* qz; const float* qw;  // unit quaternions
+    const float* sx; const float* sy; const float* sz;
+};
+
+// out[i] = compose(p[i], q[i], s[i]), eight (AVX2) or four lanes at a time.
+void composeTransforms(const VulkanTransformArrays& in, VulkanMat4* out, size_t count);
+
+// Writes the index of every sphere at least partly inside the frustum to
+// `visible` (room for `count`), in increasing order; returns how many.
+size_t cullSpheres(const VulkanFrustum& frustum,
+    const float* x, const float* y, const float* z, const float* radius,
+    size_t count, uint32_t* visible);
+
+#endif//_LIBVK_MATH_H_
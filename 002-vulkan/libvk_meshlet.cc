@@ -0,0 +1,1118 @@
+
+#include "libvk_meshlet.h"
+#include "libvk_profiler.h"
+#include "meshlet.task.h"
+#include "meshlet.mesh.h"
+#include "meshlet.vert.h"
+#include "meshlet.frag.h"
+#include "meshlet_cull.comp.h"
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+
+// builder
+
+namespace
+{
+
+struct MeshletPositions
+{
+    const uint8_t* base;
+    uint32_t stride;
+
+    VulkanVec3 operator[](uint32_t vertex) const
+    {
+        float p[3];
+        memcpy(p, base + (size_t)vertex * stride, sizeof(p));
+        return { p[0], p[1], p[2] };
+    }
+};
+
+// Everything the levels share: positions, the vertex that stands for every
+// position, and per-vertex scratch that is left all ~0u between uses.
+struct MeshletContext
+{
+    MeshletPositions positions;
+    std::vector<uint32_t> canonical;
+    std::vector<uint32_t> remap;
+    VulkanMeshletData* data;
+};
+
+const uint32_t MESHLET_GROUP_SIZE = 4;
+
+void sphereOf(const MeshletPositions& positions, const uint32_t* vertices, size_t count, float sphere[4])
+{
+    VulkanVec3 lo(FLT_MAX, FLT_MAX, FLT_MAX);
+    VulkanVec3 hi(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    for (size_t i = 0; i < count; i++)
+    {
+        VulkanVec3 p = positions[vertices[i]];
+        lo = VulkanVec3(std::min(lo.x, p.x), std::min(lo.y, p.y), std::min(lo.z, p.z));
+        hi = VulkanVec3(std::max(hi.x, p.x), std::max(hi.y, p.y), std::max(hi.z, p.z));
+    }
+    VulkanVec3 center = (lo + hi) * 0.5f;
+    float radius = 0.0f;
+    for (size_t i = 0; i < count; i++)
+        radius = std::max(radius, length(positions[vertices[i]] - center));
+    sphere[0] = center.x;
+    sphere[1] = center.y;
+    sphere[2] = center.z;
+    sphere[3] = radius;
+}
+
+// grows `sphere` to also enclose `other`.
+void mergeSphere(float sphere[4], const float other[4])
+{
+    VulkanVec3 a(sphere[0], sphere[1], sphere[2]);
+    VulkanVec3 b(other[0], other[1], other[2]);
+    float d = length(b - a);
+    if (d + other[3] <= sphere[3])
+        return;
+    if (d + sphere[3] <= other[3])
+    {
+        memcpy(sphere, other, 4 * sizeof(float));
+        return;
+    }
+    float radius = (d + sphere[3] + other[3]) * 0.5f;
+    VulkanVec3 center = a + (b - a) * ((radius - sphere[3]) / d);
+    sphere[0] = center.x;
+    sphere[1] = center.y;
+    sphere[2] = center.z;
+    sphere[3] = radius;
+}
+
+void finishMeshlet(MeshletContext& ctx, const std::vector<uint32_t>& vertices, const std::vector<uint32_t>& corners,
+    uint32_t level, const float* lodBounds, float lodError, std::vector<uint32_t>& created)
+{
+    VulkanMeshletData& data = *ctx.data;
+    VulkanMeshlet meshlet = {};
+    meshlet.vertexOffset = (uint32_t)data.vertices.size();
+    meshlet.triangleOffset = (uint32_t)data.triangles.size();
+    meshlet.vertexCount = (uint32_t)vertices.size();
+    meshlet.triangleCount = (uint32_t)corners.size() / 3;
+    meshlet.level = level;
+    data.vertices.insert(data.vertices.end(), vertices.begin(), vertices.end());
+    for (size_t i = 0; i < corners.size(); i += 3)
+        data.triangles.push_back(corners[i] | corners[i + 1] << 8 | corners[i + 2] << 16);
+
+    sphereOf(ctx.positions, vertices.data(), vertices.size(), meshlet.bounds);
+
+    // clockwise front faces: the outward normal is (c - a) x (b - a).
+    std::vector<VulkanVec3> normals;
+    VulkanVec3 sum;
+    for (size_t i = 0; i < corners.size(); i += 3)
+    {
+        VulkanVec3 a = ctx.positions[vertices[corners[i]]];
+        VulkanVec3 b = ctx.positions[vertices[corners[i + 1]]];
+        VulkanVec3 c = ctx.positions[vertices[corners[i + 2]]];
+        VulkanVec3 n = cross(c - a, b - a);
+        if (length(n) <= 0.0f)
+            continue;
+        normals.push_back(normalize(n));
+        sum = sum + normals.back();
+    }
+    VulkanVec3 axis = normalize(sum);
+    float minDot = 1.0f;
+    for (auto& n : normals)
+        minDot = std::min(minDot, dot(n, axis));
+    meshlet.coneAxis[0] = axis.x;
+    meshlet.coneAxis[1] = axis.y;
+    meshlet.coneAxis[2] = axis.z;
+    // wider than ~84 degrees the test hardly ever passes.
+    meshlet.coneCutoff = normals.empty() || length(sum) <= 0.0f || minDot <= 0.1f ?
+        1.0f : std::sqrt(1.0f - minDot * minDot);
+
+    memcpy(meshlet.lodBounds, lodBounds != nullptr ? lodBounds : meshlet.bounds, sizeof(meshlet.lodBounds));
+    meshlet.lodError = lodError;
+    memcpy(meshlet.parentBounds, meshlet.lodBounds, sizeof(meshlet.parentBounds));
+    meshlet.parentError = FLT_MAX;
+
+    created.push_back((uint32_t)data.meshlets.size());
+    data.meshlets.push_back(meshlet);
+}
+
+// Greedy: keeps adding the unused triangle that brings the fewest new vertices
+// into the current meshlet, preferring ones whose vertices have few triangles
+// left, and starts a new meshlet where the next one does not fit. Without an
+// adjacent candidate it continues at the next unused triangle in index order.
+void splitMeshlets(MeshletContext& ctx, const std::vector<uint32_t>& indices, uint32_t level,
+    const float* lodBounds, float lodError, std::vector<uint32_t>& created)
+{
+    uint32_t triangleCount = (uint32_t)indices.size() / 3;
+    if (triangleCount == 0)
+        return;
+
+    // compact vertex ids and vertex -> triangle adjacency.
+    std::vector<uint32_t> unique;
+    for (uint32_t v : indices)
+    {
+        if (ctx.remap[v] == ~0u)
+        {
+            ctx.remap[v] = (uint32_t)unique.size();
+            unique.push_back(v);
+        }
+    }
+    std::vector<uint32_t> offsets(unique.size() + 1, 0);
+    for (uint32_t v : indices)
+        offsets[ctx.remap[v] + 1]++;
+    for (size_t i = 0; i < unique.size(); i++)
+        offsets[i + 1] += offsets[i];
+    std::vector<uint32_t> live(unique.size());
+    for (size_t i = 0; i < unique.size(); i++)
+        live[i] = offsets[i + 1] - offsets[i];
+    std::vector<uint32_t> adjacency(indices.size());
+    {
+        std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+        for (uint32_t t = 0; t < triangleCount; t++)
+        {
+            for (uint32_t k = 0; k < 3; k++)
+                adjacency[fill[ctx.remap[indices[t * 3 + k]]]++] = t;
+        }
+    }
+
+    std::vector<uint8_t> emitted(triangleCount, 0);
+    std::vector<uint32_t> local(unique.size(), ~0u);     // compact id -> meshlet vertex
+    std::vector<uint32_t> vertices;     // mesh indices
+    std::vector<uint32_t> members;      // compact ids, parallel to `vertices`
+    std::vector<uint32_t> corners;
+    uint32_t cursor = 0;
+    uint32_t seed = ~0u;
+
+    auto flush = [&]() {
+        finishMeshlet(ctx, vertices, corners, level, lodBounds, lodError, created);
+        for (uint32_t m : members)
+            local[m] = ~0u;
+        vertices.clear();
+        members.clear();
+        corners.clear();
+    };
+
+    for (;;)
+    {
+        uint32_t best = seed;
+        seed = ~0u;
+        uint32_t bestNew = 4;
+        uint32_t bestLive = ~0u;
+        if (best == ~0u)
+        {
+            for (uint32_t m : members)
+            {
+                for (uint32_t a = offsets[m]; a < offsets[m + 1]; a++)
+                {
+                    uint32_t t = adjacency[a];
+                    if (emitted[t])
+                        continue;
+                    uint32_t added = 0;
+                    uint32_t remaining = 0;
+                    for (uint32_t k = 0; k < 3; k++)
+                    {
+                        uint32_t c = ctx.remap[indices[t * 3 + k]];
+                        added += local[c] == ~0u ? 1 : 0;
+                        remaining += live[c];
+                    }
+                    if (added < bestNew || (added == bestNew && remaining < bestLive))
+                    {
+                        best = t;
+                        bestNew = added;
+                        bestLive = remaining;
+                    }
+                }
+            }
+        }
+        if (best == ~0u)
+        {
+            while (cursor < triangleCount && emitted[cursor])
+                cursor++;
+            if (cursor == triangleCount)
+                break;
+            best = cursor;
+        }
+
+        uint32_t added = 0;
+        for (uint32_t k = 0; k < 3; k++)
+        {
+            uint32_t c = ctx.remap[indices[best * 3 + k]];
+            added += local[c] == ~0u ? 1 : 0;
+        }
+        if (vertices.size() + added > VULKAN_MESHLET_MAX_VERTICES ||
+            corners.size() / 3 + 1 > VULKAN_MESHLET_MAX_TRIANGLES)
+        {
+            flush();
+            seed = best;
+            continue;
+        }
+
+        for (uint32_t k = 0; k < 3; k++)
+        {
+            uint32_t v = indices[best * 3 + k];
+            uint32_t c = ctx.remap[v];
+            if (local[c] == ~0u)
+            {
+                local[c] = (uint32_t)vertices.size();
+                vertices.push_back(v);
+                members.push_back(c);
+            }
+            corners.push_back(local[c]);
+            live[c]--;
+        }
+        emitted[best] = 1;
+    }
+    if (!corners.empty())
+        flush();
+
+    for (uint32_t v : unique)
+        ctx.remap[v] = ~0u;
+}
+
+// Groups of up to MESHLET_GROUP_SIZE meshlets that share the most vertices,
+// grown greedily from each meshlet not yet taken, in order.
+std::vector<std::vector<uint32_t>> groupMeshlets(const MeshletContext& ctx, const std::vector<uint32_t>& level)
+{
+    const VulkanMeshletData& data = *ctx.data;
+
+    // (position, meshlet) pairs, sorted: every run is one shared position.
+    std::vector<std::pair<uint32_t, uint32_t>> uses;
+    for (uint32_t i = 0; i < level.size(); i++)
+    {
+        const VulkanMeshlet& meshlet = data.meshlets[level[i]];
+        for (uint32_t v = 0; v < meshlet.vertexCount; v++)
+            uses.push_back({ ctx.canonical[data.vertices[meshlet.vertexOffset + v]], i });
+    }
+    std::sort(uses.begin(), uses.end());
+
+    std::vector<std::vector<std::pair<uint32_t, uint32_t>>> neighbours(level.size());   // (meshlet, shared)
+    auto connect = [&neighbours](uint32_t a, uint32_t b) {
+        for (auto& n : neighbours[a])
+        {
+            if (n.first == b)
+            {
+                n.second++;
+                return;
+            }
+        }
+        neighbours[a].push_back({ b, 1 });
+    };
+    for (size_t begin = 0, end; begin < uses.size(); begin = end)
+    {
+        end = begin + 1;
+        while (end < uses.size() && uses[end].first == uses[begin].first)
+            end++;
+        for (size_t a = begin; a < end; a++)
+        {
+            for (size_t b = a + 1; b < end; b++)
+            {
+                if (uses[a].second == uses[b].second)
+                    continue;
+                connect(uses[a].second, uses[b].second);
+                connect(uses[b].second, uses[a].second);
+            }
+        }
+    }
+
+    std::vector<std::vector<uint32_t>> groups;
+    std::vector<uint8_t> taken(level.size(), 0);
+    for (uint32_t seed = 0; seed < level.size(); seed++)
+    {
+        if (taken[seed])
+            continue;
+        std::vector<uint32_t> group = { seed };
+        taken[seed] = 1;
+        while (group.size() < MESHLET_GROUP_SIZE)
+        {
+            uint32_t best = ~0u;
+            uint32_t bestShared = 0;
+            for (uint32_t member : group)
+            {
+                for (auto& n : neighbours[member])
+                {
+                    if (!taken[n.first] && n.second > bestShared)
+                    {
+                        best = n.first;
+                        bestShared = n.second;
+                    }
+                }
+            }
+            if (best == ~0u)
+                break;
+            group.push_back(best);
+            taken[best] = 1;
+        }
+        for (auto& member : group)
+            member = level[member];
+        groups.push_back(std::move(group));
+    }
+    return groups;
+}
+
+// Vertex clustering on a grid over the group's bounds: every unlocked position
+// moves to the one of its cell nearest the cell's mean, triangles that
+// collapse are dropped. The coarsest grid that still keeps `target` triangles
+// is found by bisection. `error` is the farthest any position moved.
+std::vector<uint32_t> simplifyGroup(MeshletContext& ctx, const std::vector<uint32_t>& indices,
+    const std::vector<uint8_t>& locked, size_t target, float& error)
+{
+    std::vector<uint32_t> positions;   // canonical vertices
+    for (uint32_t v : indices)
+    {
+        uint32_t c = ctx.canonical[v];
+        if (ctx.remap[c] == ~0u)
+        {
+            ctx.remap[c] = (uint32_t)positions.size();
+            positions.push_back(c);
+        }
+    }
+    VulkanVec3 lo(FLT_MAX, FLT_MAX, FLT_MAX);
+    VulkanVec3 hi(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    for (uint32_t c : positions)
+    {
+        VulkanVec3 p = ctx.positions[c];
+        lo = VulkanVec3(std::min(lo.x, p.x), std::min(lo.y, p.y), std::min(lo.z, p.z));
+        hi = VulkanVec3(std::max(hi.x, p.x), std::max(hi.y, p.y), std::max(hi.z, p.z));
+    }
+    float extent = std::max(std::max(hi.x - lo.x, hi.y - lo.y), std::max(hi.z - lo.z, 1e-12f));
+
+    std::vector<uint32_t> moveTo;      // position slot -> canonical vertex it moves to
+    std::vector<std::pair<uint64_t, uint32_t>> cells;
+    auto cluster = [&](uint32_t grid, std::vector<uint32_t>& out, float& moved) {
+        moveTo.assign(positions.size(), 0);
+        cells.clear();
+        float scale = (float)grid / extent;
+        for (uint32_t i = 0; i < positions.size(); i++)
+        {
+            uint32_t c = positions[i];
+            if (locked[c])
+            {
+                moveTo[i] = c;
+                continue;
+            }
+            VulkanVec3 p = (ctx.positions[c] - lo) * scale;
+            uint64_t x = std::min((uint64_t)p.x, (uint64_t)grid - 1);
+            uint64_t y = std::min((uint64_t)p.y, (uint64_t)grid - 1);
+            uint64_t z = std::min((uint64_t)p.z, (uint64_t)grid - 1);
+            cells.push_back({ (x * grid + y) * grid + z, i });
+        }
+        std::sort(cells.begin(), cells.end());
+
+        moved = 0.0f;
+        for (size_t begin = 0, end; begin < cells.size(); begin = end)
+        {
+            end = begin + 1;
+            while (end < cells.size() && cells[end].first == cells[begin].first)
+                end++;
+            VulkanVec3 mean;
+            for (size_t j = begin; j < end; j++)
+                mean = mean + ctx.positions[positions[cells[j].second]];
+            mean = mean * (1.0f / (float)(end - begin));
+            uint32_t rep = positions[cells[begin].second];
+            float nearest = FLT_MAX;
+            for (size_t j = begin; j < end; j++)
+            {
+                uint32_t c = positions[cells[j].second];
+                float d = length(ctx.positions[c] - mean);
+                if (d < nearest)
+                {
+                    nearest = d;
+                    rep = c;
+                }
+            }
+            for (size_t j = begin; j < end; j++)
+            {
+                uint32_t c = positions[cells[j].second];
+                moveTo[cells[j].second] = rep;
+                moved = std::max(moved, length(ctx.positions[c] - ctx.positions[rep]));
+            }
+        }
+
+        // positions that stay keep their own vertex, so seams keep their attributes.
+        out.clear();
+        for (size_t t = 0; t < indices.size(); t += 3)
+        {
+            uint32_t v[3];
+            uint32_t p[3];
+            for (uint32_t k = 0; k < 3; k++)
+            {
+                uint32_t c = ctx.canonical[indices[t + k]];
+                p[k] = moveTo[ctx.remap[c]];
+                v[k] = p[k] == c ? indices[t + k] : p[k];
+            }
+            if (p[0] == p[1] || p[1] == p[2] || p[0] == p[2])
+                continue;
+            out.insert(out.end(), v, v + 3);
+        }
+    };
+
+    std::vector<uint32_t> best = indices;
+    error = 0.0f;
+    std::vector<uint32_t> result;
+    float moved = 0.0f;
+    uint32_t low = 1;
+    uint32_t high = 1024;
+    while (low < high)
+    {
+        uint32_t grid = (low + high) / 2;
+        cluster(grid, result, moved);
+        if (result.size() / 3 >= target)
+        {
+            high = grid;
+            if (result.size() < best.size())
+            {
+                best.swap(result);
+                error = moved;
+            }
+        }
+        else
+        {
+            low = grid + 1;
+        }
+    }
+
+    for (uint32_t c : positions)
+        ctx.remap[c] = ~0u;
+    return best;
+}
+
+}
+
+VulkanMeshletData buildMeshlets(const VulkanMeshletBuildArgs& args)
+{
+    VULKAN_PROFILE_ZONE("build meshlets");
+    VulkanMeshletData data;
+    MeshletContext ctx;
+    ctx.positions = { (const uint8_t*)args.vertices, args.vertexStride };
+    ctx.remap.assign(args.vertexCount, ~0u);
+    ctx.data = &data;
+
+    // vertices with the same position, by sorting: the first one stands for all.
+    ctx.canonical.resize(args.vertexCount);
+    {
+        std::vector<uint32_t> order(args.vertexCount);
+        for (uint32_t i = 0; i < args.vertexCount; i++)
+            order[i] = i;
+        auto less = [&ctx](uint32_t a, uint32_t b) {
+            VulkanVec3 pa = ctx.positions[a];
+            VulkanVec3 pb = ctx.positions[b];
+            if (pa.x != pb.x) return pa.x < pb.x;
+            if (pa.y != pb.y) return pa.y < pb.y;
+            if (pa.z != pb.z) return pa.z < pb.z;
+            return a < b;
+        };
+        std::sort(order.begin(), order.end(), less);
+        for (size_t begin = 0, end; begin < order.size(); begin = end)
+        {
+            end = begin + 1;
+            VulkanVec3 p = ctx.positions[order[begin]];
+            while (end < order.size())
+            {
+                VulkanVec3 q = ctx.positions[order[end]];
+                if (p.x != q.x || p.y != q.y || p.z != q.z)
+                    break;
+                end++;
+            }
+            for (size_t i = begin; i < end; i++)
+                ctx.canonical[order[i]] = order[begin];
+        }
+    }
+
+    std::vector<uint32_t> indices(args.indices, args.indices + args.indexCount / 3 * 3);
+    std::vector<uint32_t> level;
+    data.levels.push_back(0);
+    splitMeshlets(ctx, indices, 0, nullptr, 0.0f, level);
+    {
+        std::vector<uint32_t> used;
+        for (uint32_t v : indices)
+        {
+            if (ctx.remap[v] == ~0u)
+            {
+                ctx.remap[v] = 0;
+                used.push_back(v);
+            }
+        }
+        for (uint32_t v : used)
+            ctx.remap[v] = ~0u;
+        sphereOf(ctx.positions, used.data(), used.size(), data.bounds);
+    }
+
+    std::vector<uint8_t> locked(args.vertexCount, 0);
+    for (uint32_t depth = 1; depth < args.maxLevels && level.size() > 1; depth++)
+    {
+        auto groups = groupMeshlets(ctx, level);
+
+        // positions used by more than one group stay where they are.
+        std::vector<uint32_t> owner(args.vertexCount, ~0u);
+        for (uint32_t g = 0; g < groups.size(); g++)
+        {
+            for (uint32_t m : groups[g])
+            {
+                const VulkanMeshlet& meshlet = data.meshlets[m];
+                for (uint32_t v = 0; v < meshlet.vertexCount; v++)
+                {
+                    uint32_t c = ctx.canonical[data.vertices[meshlet.vertexOffset + v]];
+                    if (owner[c] == ~0u)
+                        owner[c] = g;
+                    else if (owner[c] != g)
+                        locked[c] = 1;
+                }
+            }
+        }
+
+        // groups that cannot be simplified carry over, so their border is locked
+        // again next time around.
+        std::vector<uint32_t> next;
+        uint32_t firstNew = (uint32_t)data.meshlets.size();
+        bool progress = false;
+        for (auto& group : groups)
+        {
+            std::vector<uint32_t> merged;
+            float childError = 0.0f;
+            float bounds[4];
+            memcpy(bounds, data.meshlets[group[0]].lodBounds, sizeof(bounds));
+            for (uint32_t m : group)
+            {
+                const VulkanMeshlet& meshlet = data.meshlets[m];
+                for (uint32_t t = 0; t < meshlet.triangleCount; t++)
+                {
+                    uint32_t packed = data.triangles[meshlet.triangleOffset + t];
+                    for (uint32_t k = 0; k < 3; k++)
+                        merged.push_back(data.vertices[meshlet.vertexOffset + (packed >> (8 * k) & 0xff)]);
+                }
+                childError = std::max(childError, meshlet.lodError);
+                mergeSphere(bounds, meshlet.lodBounds);
+            }
+
+            float error = 0.0f;
+            size_t triangles = merged.size() / 3;
+            auto simplified = simplifyGroup(ctx, merged, locked,
+                std::max((size_t)1, (size_t)(triangles * args.simplifyRatio)), error);
+            // mostly border: try again with other neighbours.
+            if (simplified.size() / 3 > triangles * 85 / 100)
+            {
+                next.insert(next.end(), group.begin(), group.end());
+                continue;
+            }
+            progress = true;
+
+            // errors add up, so a group is never finer than what it replaces.
+            float groupError = childError + error;
+            for (uint32_t m : group)
+            {
+                memcpy(data.meshlets[m].parentBounds, bounds, sizeof(bounds));
+                data.meshlets[m].parentError = groupError;
+            }
+            splitMeshlets(ctx, simplified, depth, bounds, groupError, next);
+        }
+
+        for (auto& group : groups)
+        {
+            for (uint32_t m : group)
+            {
+                const VulkanMeshlet& meshlet = data.meshlets[m];
+                for (uint32_t v = 0; v < meshlet.vertexCount; v++)
+                    locked[ctx.canonical[data.vertices[meshlet.vertexOffset + v]]] = 0;
+            }
+        }
+        if (!progress)
+            break;
+        data.levels.push_back(firstNew);
+        level.swap(next);
+    }
+    data.levels.push_back((uint32_t)data.meshlets.size());
+    return data;
+}
+
+static VkDeviceSize alignSection(VkDeviceSize offset)
+{
+    return (offset + 255) / 256 * 256;
+}
+
+VulkanMeshletLayout VulkanMeshletLayout::compute(const VulkanPackMeshletInfo& info)
+{
+    VulkanMeshletLayout layout;
+    layout.meshletOffset = alignSection((VkDeviceSize)info.vertexCount * info.vertexStride);
+    layout.vertexIndexOffset = alignSection(layout.meshletOffset + (VkDeviceSize)info.meshletCount * sizeof(VulkanMeshlet));
+    layout.triangleOffset = alignSection(layout.vertexIndexOffset + (VkDeviceSize)info.meshletVertexCount * sizeof(uint32_t));
+    layout.indexOffset = alignSection(layout.triangleOffset + (VkDeviceSize)info.triangleCount * sizeof(uint32_t));
+    layout.size = layout.indexOffset + (VkDeviceSize)info.triangleCount * 3 * sizeof(uint32_t);
+    return layout;
+}
+
+std::vector<uint8_t> encodeMeshlets(const void* vertices, uint32_t vertexCount, uint32_t vertexStride,
+    const VulkanMeshletData& data, VulkanPackMeshletInfo& info)
+{
+    info = {};
+    info.vertexCount = vertexCount;
+    info.vertexStride = vertexStride;
+    info.meshletCount = (uint32_t)data.meshlets.size();
+    info.meshletVertexCount = (uint32_t)data.vertices.size();
+    info.triangleCount = (uint32_t)data.triangles.size();
+    info.levelCount = data.levels.empty() ? 0 : (uint32_t)data.levels.size() - 1;
+    VulkanMeshletLayout layout = VulkanMeshletLayout::compute(info);
+
+    std::vector<uint8_t> blob((size_t)layout.size, 0);
+    memcpy(blob.data(), vertices, (size_t)vertexCount * vertexStride);
+    memcpy(blob.data() + layout.meshletOffset, data.meshlets.data(), data.meshlets.size() * sizeof(VulkanMeshlet));
+    memcpy(blob.data() + layout.vertexIndexOffset, data.vertices.data(), data.vertices.size() * sizeof(uint32_t));
+    memcpy(blob.data() + layout.triangleOffset, data.triangles.data(), data.triangles.size() * sizeof(uint32_t));
+    uint32_t* indices = (uint32_t*)(blob.data() + layout.indexOffset);
+    for (auto& meshlet : data.meshlets)
+    {
+        for (uint32_t t = 0; t < meshlet.triangleCount; t++)
+        {
+            uint32_t packed = data.triangles[meshlet.triangleOffset + t];
+            for (uint32_t k = 0; k < 3; k++)
+                indices[(meshlet.triangleOffset + t) * 3 + k] = data.vertices[meshlet.vertexOffset + (packed >> (8 * k) & 0xff)];
+        }
+    }
+    return blob;
+}
+
+// renderer
+
+namespace
+{
+
+// std430 mirrors of meshlet.inc.
+struct MeshletInstance
+{
+    VulkanMat4 model;
+    float scale[4];     // x: largest axis scale, for radii and errors
+};
+
+struct MeshletView
+{
+    VulkanMat4 viewProj;
+    VulkanVec4 planes[6];
+    float eye[4];       // w: nearest distance errors are projected at
+    float viewport[2];
+    float errorScale;   // pixels per unit at distance 1
+    float pixelError;
+    uint32_t flags;
+    uint32_t reserved[3];
+};
+
+struct MeshletParams
+{
+    uint32_t slot;
+    uint32_t firstInstance;
+    uint32_t instanceCount;
+    uint32_t meshletCount;
+    uint32_t vertexStride;      // floats
+    uint32_t firstDraw;
+    uint32_t drawCount;
+    uint32_t batch;
+};
+
+static_assert(sizeof(MeshletInstance) == 80, "meshlet instance layout changed");
+static_assert(sizeof(MeshletView) == 208, "meshlet view layout changed");
+
+const uint32_t MESHLET_VIEW_SMALL_TRIANGLES = 1;    // cull triangles between pixel centers
+const uint32_t MESHLET_TASK_SIZE = 32;              // local_size_x of meshlet.task.glsl
+const uint32_t MESHLET_CULL_SIZE = 64;              // local_size_x of meshlet_cull.comp.glsl
+const uint32_t MESHLET_MAX_TASK_GROUPS = 1u << 22;  // maxTaskWorkGroupTotalCount guaranteed by the spec
+
+enum MeshletBinding
+{
+    MESHLET_BINDING_MESHLETS = 0,
+    MESHLET_BINDING_MESHLET_VERTICES = 1,
+    MESHLET_BINDING_TRIANGLES = 2,
+    MESHLET_BINDING_VERTICES = 3,
+    MESHLET_BINDING_INSTANCES = 4,
+    MESHLET_BINDING_VIEWS = 5,
+    MESHLET_BINDING_DRAWS = 6,
+    MESHLET_BINDING_COUNTS = 7
+};
+
+VkDescriptorSetLayoutBinding storageBinding(uint32_t binding, VkShaderStageFlags stages)
+{
+    return { binding, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, stages, nullptr };
+}
+
+}
+
+bool VulkanMeshletRenderer::supported(const VulkanPhysicalDevice& physicalDevice)
+{
+    if (physicalDevice.checkMeshShaderSupport())
+        return true;
+    return physicalDevice.checkDrawIndirectCountSupport() &&
+        physicalDevice.features.multiDrawIndirect && physicalDevice.features.drawIndirectFirstInstance;
+}
+
+void VulkanMeshletRenderer::init(const VulkanLogicalDevice& logicalDevice, VulkanUploader& uploader,
+    const VulkanMeshletRendererArgs& args)
+{
+    this->logicalDevice = &logicalDevice;
+    this->uploader = &uploader;
+    this->args = args;
+    this->args.framesInFlight = std::max(args.framesInFlight, 1u);
+    this->args.maxMeshes = std::max(args.maxMeshes, 1u);
+    // instances are the y dimension of the dispatches.
+    this->args.maxInstances = std::min(std::max(args.maxInstances, 1u), 65535u);
+    if (!args.meshShader && logicalDevice.vkCmdDrawIndexedIndirectCountKHR == nullptr)
+    {
+        throw std::runtime_error("draw-indirect-count is not enabled on this device.");
+    }
+
+    VkShaderStageFlags drawStages = args.meshShader ?
+        VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT : VK_SHADER_STAGE_VERTEX_BIT;
+    VulkanGraphicsPipelineArgs pipelineArgs = {};
+    if (args.meshShader)
+    {
+        pipelineArgs.task = meshlet_task_spv;
+        pipelineArgs.mesh = meshlet_mesh_spv;
+        pipelineArgs.bindings.push_back(storageBinding(MESHLET_BINDING_MESHLETS, drawStages));
+        pipelineArgs.bindings.push_back(storageBinding(MESHLET_BINDING_MESHLET_VERTICES, drawStages));
+        pipelineArgs.bindings.push_back(storageBinding(MESHLET_BINDING_TRIANGLES, drawStages));
+    }
+    else
+    {
+        pipelineArgs.vert = meshlet_vert_spv;
+    }
+    pipelineArgs.bindings.push_back(storageBinding(MESHLET_BINDING_VERTICES, drawStages));
+    pipelineArgs.bindings.push_back(storageBinding(MESHLET_BINDING_INSTANCES, drawStages));
+    pipelineArgs.bindings.push_back(storageBinding(MESHLET_BINDING_VIEWS, drawStages));
+    pipelineArgs.frag = meshlet_frag_spv;
+    pipelineArgs.viewport = { 0.0f, 0.0f, (float)args.extent.width, (float)args.extent.height, 0.0f, 1.0f };
+    pipelineArgs.scissor = { { 0, 0 }, args.extent };
+    pipelineArgs.colorFormat = args.colorFormat;
+    pipelineArgs.depthFormat = args.depthFormat;
+    pipelineArgs.samples = args.samples;
+    pipelineArgs.dynamicRendering = args.dynamicRendering;
+    pipelineArgs.pushConstantSize = sizeof(MeshletParams);
+    this->pipeline = logicalDevice.createGraphicsPipeline(pipelineArgs);
+
+    uint32_t setsPerMesh = 1;
+    uint32_t buffersPerMesh = (uint32_t)pipelineArgs.bindings.size();
+    if (!args.meshShader)
+    {
+        VulkanComputePipelineArgs cullArgs;
+        cullArgs.comp = meshlet_cull_comp_spv;
+        cullArgs.bindings.push_back(storageBinding(MESHLET_BINDING_MESHLETS, VK_SHADER_STAGE_COMPUTE_BIT));
+        cullArgs.bindings.push_back(storageBinding(MESHLET_BINDING_INSTANCES, VK_SHADER_STAGE_COMPUTE_BIT));
+        cullArgs.bindings.push_back(storageBinding(MESHLET_BINDING_VIEWS, VK_SHADER_STAGE_COMPUTE_BIT));
+        cullArgs.bindings.push_back(storageBinding(MESHLET_BINDING_DRAWS, VK_SHADER_STAGE_COMPUTE_BIT));
+        cullArgs.bindings.push_back(storageBinding(MESHLET_BINDING_COUNTS, VK_SHADER_STAGE_COMPUTE_BIT));
+        cullArgs.pushConstantSize = sizeof(MeshletParams);
+        this->cullPipeline = logicalDevice.createComputePipeline(cullArgs);
+        setsPerMesh++;
+        buffersPerMesh += (uint32_t)cullArgs.bindings.size();
+    }
+
+    VkDescriptorPoolSize poolSize = { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, this->args.maxMeshes * buffersPerMesh };
+    VkDescriptorPoolCreateInfo dpci = {};
+    dpci.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    dpci.pNext = nullptr;
+    dpci.flags = 0;
+    dpci.maxSets = this->args.maxMeshes * setsPerMesh;
+    dpci.poolSizeCount = 1;
+    dpci.pPoolSizes = &poolSize;
+    if (VK_SUCCESS != vkCreateDescriptorPool(logicalDevice.device, &dpci, nullptr, descriptorPool.put(logicalDevice.device)))
+    {
+        throw std::runtime_error("Create meshlet descriptor-pool failed.");
+    }
+
+    // written once per frame, read by every cluster test: device-local when
+    // the heap allows it, like the sprite instances.
+    VulkanBufferArgs bufferArgs = {};
+    bufferArgs.size = (VkDeviceSize)this->args.framesInFlight * this->args.maxInstances * sizeof(MeshletInstance);
+    bufferArgs.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+    bufferArgs.memoryProps = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    bufferArgs.preferredMemoryProps = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    bufferArgs.mapped = true;
+    this->instances = logicalDevice.createBuffer(bufferArgs);
+    bufferArgs.size = (VkDeviceSize)this->args.framesInFlight * sizeof(MeshletView);
+    this->views = logicalDevice.createBuffer(bufferArgs);
+
+    // shared by the frames in flight: prepare() orders its writes after the
+    // previous frame's indirect reads.
+    if (!args.meshShader)
+    {
+        VulkanBufferArgs drawArgs = {};
+        drawArgs.size = (VkDeviceSize)std::max(args.maxDraws, 1u) * sizeof(VkDrawIndexedIndirectCommand);
+        drawArgs.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
+        drawArgs.memoryProps = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+        this->draws = logicalDevice.createBuffer(drawArgs);
+        drawArgs.size = (VkDeviceSize)this->args.maxMeshes * sizeof(uint32_t);
+        drawArgs.usage |= VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        this->counts = logicalDevice.createBuffer(drawArgs);
+    }
+
+    pending.resize(this->args.maxMeshes);
+    transforms.reserve(this->args.maxInstances);
+}
+
+void VulkanMeshletRenderer::quit()
+{
+    if (logicalDevice == nullptr)
+        return;
+    for (auto& mesh : meshes)
+        logicalDevice->destroyBuffer(mesh.buffer);
+    meshes.clear();
+    logicalDevice->destroyBuffer(counts);
+    logicalDevice->destroyBuffer(draws);
+    logicalDevice->destroyBuffer(views);
+    logicalDevice->destroyBuffer(instances);
+    descriptorPool.reset();
+    logicalDevice->destroyComputePipeline(cullPipeline);
+    logicalDevice->destroyGraphicsPipeline(pipeline);
+    pending.clear();
+    transforms.clear();
+    batches.clear();
+    logicalDevice = nullptr;
+    uploader = nullptr;
+}
+
+uint32_t VulkanMeshletRenderer::addMesh(const VulkanPackMeshletInfo& info, const void* blob)
+{
+    if (meshes.size() >= args.maxMeshes)
+    {
+        throw std::runtime_error("Too many meshlet meshes.");
+    }
+    if (info.vertexStride % sizeof(float) != 0)
+    {
+        throw std::runtime_error("Meshlet vertex stride is not a multiple of 4.");
+    }
+
+    Mesh mesh;
+    mesh.layout = VulkanMeshletLayout::compute(info);
+    mesh.vertexStride = info.vertexStride / sizeof(float);
+    mesh.meshletCount = info.meshletCount;
+
+    VulkanBufferArgs bufferArgs = {};
+    bufferArgs.size = mesh.layout.size;
+    bufferArgs.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    bufferArgs.memoryProps = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    mesh.buffer = logicalDevice->createBuffer(bufferArgs);
+    uploader->uploadBuffer(mesh.buffer.handle, 0, blob, mesh.layout.size);
+
+    VkDescriptorSetLayout layouts[2] = { pipeline.setLayout.get(), cullPipeline.setLayout.get() };
+    VkDescriptorSetAllocateInfo dsai = {};
+    dsai.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    dsai.pNext = nullptr;
+    dsai.descriptorPool = descriptorPool;
+    dsai.descriptorSetCount = args.meshShader ? 1 : 2;
+    dsai.pSetLayouts = layouts;
+    VkDescriptorSet sets[2] = {};
+    if (VK_SUCCESS != vkAllocateDescriptorSets(logicalDevice->device, &dsai, sets))
+    {
+        logicalDevice->destroyBuffer(mesh.buffer);
+        throw std::runtime_error("Allocate meshlet descriptor-sets failed.");
+    }
+    mesh.drawSet = sets[0];
+    mesh.cullSet = sets[1];
+
+    // empty sections still need a range: bind at least one word.
+    auto range = [](VkDeviceSize size) { return std::max(size, (VkDeviceSize)sizeof(uint32_t)); };
+    VkDescriptorBufferInfo buffers[8] = {};
+    buffers[MESHLET_BINDING_MESHLETS] = { mesh.buffer.handle, mesh.layout.meshletOffset,
+        range((VkDeviceSize)info.meshletCount * sizeof(VulkanMeshlet)) };
+    buffers[MESHLET_BINDING_MESHLET_VERTICES] = { mesh.buffer.handle, mesh.layout.vertexIndexOffset,
+        range((VkDeviceSize)info.meshletVertexCount * sizeof(uint32_t)) };
+    buffers[MESHLET_BINDING_TRIANGLES] = { mesh.buffer.handle, mesh.layout.triangleOffset,
+        range((VkDeviceSize)info.triangleCount * sizeof(uint32_t)) };
+    buffers[MESHLET_BINDING_VERTICES] = { mesh.buffer.handle, 0,
+        range((VkDeviceSize)info.vertexCount * info.vertexStride) };
+    buffers[MESHLET_BINDING_INSTANCES] = { instances.handle, 0, VK_WHOLE_SIZE };
+    buffers[MESHLET_BINDING_VIEWS] = { views.handle, 0, VK_WHOLE_SIZE };
+    buffers[MESHLET_BINDING_DRAWS] = { draws.handle, 0, VK_WHOLE_SIZE };
+    buffers[MESHLET_BINDING_COUNTS] = { counts.handle, 0, VK_WHOLE_SIZE };
+
+    std::vector<VkWriteDescriptorSet> writes;
+    auto write = [&writes, &buffers](VkDescriptorSet set, uint32_t binding) {
+        VkWriteDescriptorSet w = {};
+        w.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        w.pNext = nullptr;
+        w.dstSet = set;
+        w.dstBinding = binding;
+        w.dstArrayElement = 0;
+        w.descriptorCount = 1;
+        w.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        w.pBufferInfo = &buffers[binding];
+        writes.push_back(w);
+    };
+    if (args.meshShader)
+    {
+        write(mesh.drawSet, MESHLET_BINDING_MESHLETS);
+        write(mesh.drawSet, MESHLET_BINDING_MESHLET_VERTICES);
+        write(mesh.drawSet, MESHLET_BINDING_TRIANGLES);
+    }
+    write(mesh.drawSet, MESHLET_BINDING_VERTICES);
+    write(mesh.drawSet, MESHLET_BINDING_INSTANCES);
+    write(mesh.drawSet, MESHLET_BINDING_VIEWS);
+    if (!args.meshShader)
+    {
+        write(mesh.cullSet, MESHLET_BINDING_MESHLETS);
+        write(mesh.cullSet, MESHLET_BINDING_INSTANCES);
+        write(mesh.cullSet, MESHLET_BINDING_VIEWS);
+        write(mesh.cullSet, MESHLET_BINDING_DRAWS);
+        write(mesh.cullSet, MESHLET_BINDING_COUNTS);
+    }
+    vkUpdateDescriptorSets(logicalDevice->device, (uint32_t)writes.size(), writes.data(), 0, nullptr);
+
+    meshes.push_back(std::move(mesh));
+    return (uint32_t)meshes.size() - 1;
+}
+
+void VulkanMeshletRenderer::begin(uint64_t frame)
+{
+    slot = (uint32_t)(frame % args.framesInFlight);
+    for (auto& list : pending)
+        list.clear();
+    transforms.clear();
+    batches.clear();
+    stats = VulkanMeshletStats();
+}
+
+void VulkanMeshletRenderer::push(uint32_t mesh, const VulkanMat4& model)
+{
+    if (mesh >= meshes.size() || transforms.size() >= args.maxInstances)
+    {
+        stats.dropped++;
+        return;
+    }
+    pending[mesh].push_back((uint32_t)transforms.size());
+    transforms.push_back(model);
+}
+
+void VulkanMeshletRenderer::flush(const VulkanMat4& viewProj, const VulkanVec3& eye, float fovY)
+{
+    VULKAN_PROFILE_ZONE("meshlet flush");
+    uint32_t base = slot * args.maxInstances;
+    MeshletInstance* out = (MeshletInstance*)instances.mapped + base;
+    uint32_t written = 0;
+    uint32_t drawCursor = 0;
+    for (uint32_t m = 0; m < meshes.size(); m++)
+    {
+        if (pending[m].empty())
+            continue;
+        Batch batch = {};
+        batch.mesh = m;
+        batch.firstInstance = base + written;
+        batch.instanceCount = (uint32_t)pending[m].size();
+        for (uint32_t index : pending[m])
+        {
+            const VulkanMat4& model = transforms[index];
+            float scale = 0.0f;
+            for (int c = 0; c < 3; c++)
+            {
+                VulkanVec4 axis = model.column(c);
+                scale = std::max(scale, std::sqrt(axis.x * axis.x + axis.y * axis.y + axis.z * axis.z));
+            }
+            out[written].model = model;
+            out[written].scale[0] = scale;
+            out[written].scale[1] = out[written].scale[2] = out[written].scale[3] = 0.0f;
+            written++;
+        }
+        uint64_t clusters = (uint64_t)batch.instanceCount * meshes[m].meshletCount;
+        if (!args.meshShader)
+        {
+            batch.firstDraw = drawCursor;
+            batch.drawCount = (uint32_t)std::min(clusters, (uint64_t)(args.maxDraws - drawCursor));
+            drawCursor += batch.drawCount;
+        }
+        stats.clusters += clusters;
+        batches.push_back(batch);
+    }
+    stats.instances = written;
+
+    MeshletView& view = ((MeshletView*)views.mapped)[slot];
+    view.viewProj = viewProj;
+    VulkanFrustum frustum = VulkanFrustum::fromMatrix(viewProj);
+    for (int i = 0; i < 6; i++)
+        view.planes[i] = frustum.planes[i];
+    view.eye[0] = eye.x;
+    view.eye[1] = eye.y;
+    view.eye[2] = eye.z;
+    view.eye[3] = 1e-3f;
+    view.viewport[0] = (float)args.extent.width;
+    view.viewport[1] = (float)args.extent.height;
+    view.errorScale = (float)args.extent.height * 0.5f / std::tan(fovY * 0.5f);
+    view.pixelError = args.pixelError;
+    // with multisampling a triangle can cover samples without covering a center.
+    view.flags = args.samples == VK_SAMPLE_COUNT_1_BIT ? MESHLET_VIEW_SMALL_TRIANGLES : 0;
+}
+
+void VulkanMeshletRenderer::prepare(VkCommandBuffer commandBuffer) const
+{
+    if (args.meshShader || batches.empty())
+        return;
+
+    // the previous frame's draws read both buffers as indirect arguments.
+    vkCmdPipelineBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        0, 0, nullptr, 0, nullptr, 0, nullptr);
+    vkCmdFillBuffer(commandBuffer, counts.handle, 0, batches.size() * sizeof(uint32_t), 0);
+
+    VkMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.pNext = nullptr;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeline.handle);
+    for (uint32_t b = 0; b < batches.size(); b++)
+    {
+        const Batch& batch = batches[b];
+        const Mesh& mesh = meshes[batch.mesh];
+        MeshletParams params = { slot, batch.firstInstance, batch.instanceCount, mesh.meshletCount,
+            mesh.vertexStride, batch.firstDraw, batch.drawCount, b };
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeline.layout,
+            0, 1, &mesh.cullSet, 0, nullptr);
+        vkCmdPushConstants(commandBuffer, cullPipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT,
+            0, sizeof(params), &params);
+        vkCmdDispatch(commandBuffer, (mesh.meshletCount + MESHLET_CULL_SIZE - 1) / MESHLET_CULL_SIZE,
+            batch.instanceCount, 1);
+    }
+
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+        0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+void VulkanMeshletRenderer::record(VkCommandBuffer commandBuffer) const
+{
+    if (batches.empty())
+        return;
+
+    VkShaderStageFlags stages = args.meshShader ?
+        VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT | VK_SHADER_STAGE_FRAGMENT_BIT :
+        VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.handle);
+    VkViewport viewport = { 0.0f, 0.0f, (float)args.extent.width, (float)args.extent.height, 0.0f, 1.0f };
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+    for (uint32_t b = 0; b < batches.size(); b++)
+    {
+        const Batch& batch = batches[b];
+        const Mesh& mesh = meshes[batch.mesh];
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.layout,
+            0, 1, &mesh.drawSet, 0, nullptr);
+        if (!args.meshShader)
+        {
+            MeshletParams params = { slot, batch.firstInstance, batch.instanceCount, mesh.meshletCount,
+                mesh.vertexStride, batch.firstDraw, batch.drawCount, b };
+            vkCmdPushConstants(commandBuffer, pipeline.layout, stages, 0, sizeof(params), &params);
+            vkCmdBindIndexBuffer(commandBuffer, mesh.buffer.handle, mesh.layout.indexOffset, VK_INDEX_TYPE_UINT32);
+            logicalDevice->vkCmdDrawIndexedIndirectCountKHR(commandBuffer,
+                draws.handle, (VkDeviceSize)batch.firstDraw * sizeof(VkDrawIndexedIndirectCommand),
+                counts.handle, (VkDeviceSize)b * sizeof(uint32_t),
+                batch.drawCount, sizeof(VkDrawIndexedIndirectCommand));
+            continue;
+        }
+
+        // task workgroups: clusters along x, instances along y, split to stay
+        // under the total the spec guarantees.
+        uint32_t groups = (mesh.meshletCount + MESHLET_TASK_SIZE - 1) / MESHLET_TASK_SIZE;
+        uint32_t perDraw = std::max(MESHLET_MAX_TASK_GROUPS / std::max(groups, 1u), 1u);
+        for (uint32_t first = 0; first < batch.instanceCount; first += perDraw)
+        {
+            uint32_t count = std::min(perDraw, batch.instanceCount - first);
+            MeshletParams params = { slot, batch.firstInstance + first, count, mesh.meshletCount,
+                mesh.vertexStride, 0, 0, b };
+            vkCmdPushConstants(commandBuffer, pipeline.layout, stages, 0, sizeof(params), &params);
+            logicalDevice->vkCmdDrawMeshTasksEXT(commandBuffer, groups, count, 1);
+        }
+    }
+}
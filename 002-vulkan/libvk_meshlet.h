@@ -0,0 +1,201 @@
+#ifndef _LIBVK_MESHLET_H_
+#define _LIBVK_MESHLET_H_
+
+#include "libvk.h"
+#include "libvk_math.h"
+#include "libvk_upload.h"
+
+// Limits of one meshlet, baked into the mesh shader's output declaration.
+#define VULKAN_MESHLET_MAX_VERTICES     64u
+#define VULKAN_MESHLET_MAX_TRIANGLES    124u
+
+// One cluster as the shaders read it (std430). Spheres are (center, radius) in
+// mesh space.
+//
+// LOD: every level but the finest was made by merging a group of clusters of
+// the level below and simplifying it with the group's border locked. The group
+// shares one error and one sphere: its clusters carry them as `parent*`, the
+// clusters made from it as `lod*`. A cluster is drawn when its own error is
+// small enough on screen and its parent's is not, which picks the same cut for
+// a whole group, and since borders were locked, neighbouring groups at
+// different levels still meet without cracks.
+struct VulkanMeshlet
+{
+    float bounds[4];            // culling sphere
+    float coneAxis[3];          // normal cone of the front faces: clockwise, as the pipelines expect
+    float coneCutoff;           // sin of its half angle; 1: never entirely back-facing
+    float lodBounds[4];
+    float parentBounds[4];
+    float lodError;             // mesh-space distance, 0 at full detail
+    float parentError;          // FLT_MAX: no coarser level
+    uint32_t vertexOffset;      // into VulkanMeshletData::vertices
+    uint32_t triangleOffset;    // into VulkanMeshletData::triangles
+    uint32_t vertexCount;
+    uint32_t triangleCount;
+    uint32_t level;
+    uint32_t reserved;
+};
+
+static_assert(sizeof(VulkanMeshlet) == 96, "meshlet layout changed");
+
+struct VulkanMeshletBuildArgs
+{
+    const void* vertices = nullptr;     // a float3 position at the start of every vertex
+    uint32_t vertexCount = 0;
+    uint32_t vertexStride = 0;          // bytes
+    const uint32_t* indices = nullptr;  // triangle list
+    uint32_t indexCount = 0;
+    uint32_t maxLevels = 16;            // including the full-detail one
+    float simplifyRatio = 0.5f;         // triangles kept per level
+};
+
+struct VulkanMeshletData
+{
+    std::vector<VulkanMeshlet> meshlets;    // finest level first
+    std::vector<uint32_t> vertices;         // mesh vertex index of every meshlet vertex
+    std::vector<uint32_t> triangles;        // meshlet-local corners, 8 bits each, low byte first
+    std::vector<uint32_t> levels;           // first meshlet of every level, then the meshlet count
+    float bounds[4] = {};                   // of the whole mesh
+};
+
+// Offline: splits a triangle list into meshlets and builds the LOD levels. The
+// mesh's vertices are shared by all levels, simplification only drops and
+// rewires triangles, so it only looks at positions; vertices that share one
+// are treated as one, keeping attribute seams closed.
+VulkanMeshletData buildMeshlets(const VulkanMeshletBuildArgs& args);
+
+// Pack blob of a meshlet mesh (VULKAN_PACK_MESHLETS), sections at 256 bytes:
+//
+//   vertices           vertexCount * vertexStride
+//   meshlets           VulkanMeshlet[meshletCount]
+//   meshlet vertices   uint32_t[meshletVertexCount]
+//   triangles          uint32_t[triangleCount], packed corners
+//   indices            uint32_t[triangleCount * 3], the triangles with mesh vertex
+//                      indices, for indexed draws where mesh shaders are missing
+struct VulkanPackMeshletInfo
+{
+    uint32_t vertexCount;
+    uint32_t vertexStride;
+    uint32_t meshletCount;
+    uint32_t meshletVertexCount;
+    uint32_t triangleCount;
+    uint32_t levelCount;
+};
+
+struct VulkanMeshletLayout
+{
+    VkDeviceSize meshletOffset = 0;
+    VkDeviceSize vertexIndexOffset = 0;
+    VkDeviceSize triangleOffset = 0;
+    VkDeviceSize indexOffset = 0;
+    VkDeviceSize size = 0;
+
+    static VulkanMeshletLayout compute(const VulkanPackMeshletInfo& info);
+};
+
+std::vector<uint8_t> encodeMeshlets(const void* vertices, uint32_t vertexCount, uint32_t vertexStride,
+    const VulkanMeshletData& data, VulkanPackMeshletInfo& info);
+
+struct VulkanMeshletRendererArgs
+{
+    // must match the pass the meshlets are recorded into.
+    VkFormat colorFormat;
+    VkFormat depthFormat = VK_FORMAT_UNDEFINED;
+    VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+    bool dynamicRendering = false;
+    VkExtent2D extent;
+    bool meshShader = false;        // enabled on the device; otherwise draw-indirect-count must be
+    uint32_t maxMeshes = 64;
+    uint32_t maxInstances = 1u << 14;   // per frame, the rest is dropped
+    uint32_t maxDraws = 1u << 20;       // visible clusters per frame without mesh shaders
+    uint32_t framesInFlight = 2;
+    float pixelError = 1.0f;        // largest simplification error allowed on screen
+};
+
+struct VulkanMeshletStats
+{
+    uint32_t instances = 0;
+    uint32_t dropped = 0;
+    uint64_t clusters = 0;      // tested on the GPU, all levels
+};
+
+// Draws meshlet meshes with per-cluster LOD selection and culling on the GPU.
+// Every cluster of every level of every instance is tested, one invocation
+// each, against the frustum, its normal cone and the LOD criterion above, with
+// the error projected to pixels at the sphere's nearest distance.
+//
+// With mesh shaders a task shader tests 32 clusters and launches a mesh shader
+// per survivor, which also drops back-facing triangles and ones that miss every
+// pixel center. Without them a compute pass appends one indexed indirect draw
+// per visible cluster, and the pass draws them with draw-indirect-count: no
+// readback either way.
+//
+// Instances are streamed like sprites, one region of a mapped buffer per frame
+// in flight. Not thread-safe.
+class VulkanMeshletRenderer
+{
+    struct Mesh
+    {
+        VulkanBuffer buffer;
+        VulkanMeshletLayout layout;
+        uint32_t vertexStride = 0;
+        uint32_t meshletCount = 0;
+        VkDescriptorSet drawSet = VK_NULL_HANDLE;
+        VkDescriptorSet cullSet = VK_NULL_HANDLE;  // without mesh shaders
+    };
+
+    struct Batch
+    {
+        uint32_t mesh;
+        uint32_t firstInstance;     // in the whole instance buffer
+        uint32_t instanceCount;
+        uint32_t firstDraw;
+        uint32_t drawCount;         // room, without mesh shaders
+    };
+
+    const VulkanLogicalDevice* logicalDevice = nullptr;
+    VulkanUploader* uploader = nullptr;
+    VulkanMeshletRendererArgs args;
+    VulkanGraphicsPipeline pipeline;
+    VulkanComputePipeline cullPipeline;
+    VulkanDescriptorPoolHandle descriptorPool;
+    std::vector<Mesh> meshes;
+    VulkanBuffer instances;     // VulkanMat4 model, then scale, per instance
+    VulkanBuffer views;         // one per frame in flight
+    VulkanBuffer draws;         // VkDrawIndexedIndirectCommand, without mesh shaders
+    VulkanBuffer counts;        // visible clusters per batch
+
+    uint32_t slot = 0;
+    std::vector<std::vector<uint32_t>> pending;     // per mesh, instance indices into `transforms`
+    std::vector<VulkanMat4> transforms;
+    std::vector<Batch> batches;
+    VulkanMeshletStats stats;
+
+public:
+    static bool supported(const VulkanPhysicalDevice& physicalDevice);
+
+    void init(const VulkanLogicalDevice& logicalDevice, VulkanUploader& uploader, const VulkanMeshletRendererArgs& args);
+    void quit();
+
+    // Records the upload into the uploader's current batch. `blob` is what
+    // encodeMeshlets made (or a pack's VULKAN_PACK_MESHLETS entry) and is copied
+    // into staging right away.
+    uint32_t addMesh(const VulkanPackMeshletInfo& info, const void* blob);
+    void setExtent(VkExtent2D extent) { args.extent = extent; }
+
+    // Same frame contract as VulkanSpriteBatch: begin() after the frame slot's
+    // fence was waited, flush() before recording.
+    void begin(uint64_t frame);
+    void push(uint32_t mesh, const VulkanMat4& model);
+    // `fovY` of the projection in `viewProj`, for the error in pixels.
+    void flush(const VulkanMat4& viewProj, const VulkanVec3& eye, float fovY);
+
+    // Outside the render pass, before it begins (VulkanRecordArgs::prepare).
+    void prepare(VkCommandBuffer commandBuffer) const;
+    // Inside the render pass (or rendering scope) the renderer was created for.
+    void record(VkCommandBuffer commandBuffer) const;
+
+    const VulkanMeshletStats& statistics() const { return stats; }
+};
+
+#endif//_LIBVK_MESHLET_H_
@@ -0,0 +1,354 @@
+
+#include "libvk_pack.h"
+#include <fstream>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static uint64_t alignUp(uint64_t value, uint64_t alignment)
+{
+    return alignment > 1 ? (value + alignment - 1) / alignment * alignment : value;
+}
+
+VulkanPackEntry& VulkanAssetPackWriter::add(const std::string& name, VulkanPackEntryType type)
+{
+    if (name.empty() || name.size() >= sizeof(VulkanPackEntry::name))
+    {
+        throw std::runtime_error("pack entry name is empty or too long: " + name);
+    }
+    for (auto& item : items)
+    {
+        if (name == item.entry.name)
+            throw std::runtime_error("duplicate pack entry: " + name);
+    }
+
+    items.emplace_back();
+    VulkanPackEntry& entry = items.back().entry;
+    memset(&entry, 0, sizeof(entry));
+    memcpy(entry.name, name.c_str(), name.size());
+    entry.type = type;
+    return entry;
+}
+
+void VulkanAssetPackWriter::addMesh(const std::string& name,
+    const void* vertices, uint32_t vertexCount, uint32_t vertexStride,
+    const void* indices, uint32_t indexCount, VkIndexType indexType)
+{
+    VulkanPackEntry& entry = this->add(name, VULKAN_PACK_MESH);
+    VkDeviceSize vertexSize = (VkDeviceSize)vertexCount * vertexStride;
+    VkDeviceSize indexSize = (VkDeviceSize)indexCount * (indexType == VK_INDEX_TYPE_UINT16 ? 2 : 4);
+
+    entry.mesh.vertexCount = vertexCount;
+    entry.mesh.vertexStride = vertexStride;
+    entry.mesh.indexCount = indexCount;
+    entry.mesh.indexType = indexType;
+    entry.mesh.indexOffset = alignUp(vertexSize, 4);
+    entry.size = entry.mesh.indexOffset + indexSize;
+
+    auto& data = items.back().data;
+    data.resize((size_t)entry.size, 0);
+    memcpy(data.data(), vertices, (size_t)vertexSize);
+    memcpy(data.data() + entry.mesh.indexOffset, indices, (size_t)indexSize);
+}
+
+void VulkanAssetPackWriter::addTexture(const std::string& name, VkFormat format, VkExtent2D extent,
+    const void* data, VkDeviceSize size, uint32_t mipLevels)
+{
+    VkDeviceSize expected = 0;
+    for (uint32_t level = 0; level < mipLevels; level++)
+    {
+        expected += getImageLevelSize(format,
+            std::max(extent.width >> level, 1u), std::max(extent.height >> level, 1u));
+    }
+    if (mipLevels == 0 || size != expected)
+    {
+        throw std::runtime_error("pack texture data does not match its mip levels: " + name);
+    }
+
+    VulkanPackEntry& entry = this->add(name, VULKAN_PACK_TEXTURE);
+    entry.texture.format = format;
+    entry.texture.width = extent.width;
+    entry.texture.height = extent.height;
+    entry.texture.mipLevels = mipLevels;
+    entry.size = size;
+
+    auto& blob = items.back().data;
+    blob.assign((const uint8_t*)data, (const uint8_t*)data + size);
+}
+
+void VulkanAssetPackWriter::addMeshlets(const std::string& name,
+    const void* vertices, uint32_t vertexCount, uint32_t vertexStride,
+    const VulkanMeshletData& data)
+{
+    VulkanPackMeshletInfo info;
+    std::vector<uint8_t> blob = encodeMeshlets(vertices, vertexCount, vertexStride, data, info);
+    VulkanPackEntry& entry = this->add(name, VULKAN_PACK_MESHLETS);
+    entry.meshlets = info;
+    entry.size = blob.size();
+    items.back().data = std::move(blob);
+}
+
+void VulkanAssetPackWriter::write(const std::string& path) const
+{
+    std::vector<const Item*> sorted;
+    for (auto& item : items)
+        sorted.push_back(&item);
+    std::sort(sorted.begin(), sorted.end(), [](const Item* a, const Item* b) {
+        return strcmp(a->entry.name, b->entry.name) < 0;
+    });
+
+    VulkanPackHeader header = {};
+    header.magic = VULKAN_PACK_MAGIC;
+    header.version = VULKAN_PACK_VERSION;
+    header.entryCount = (uint32_t)sorted.size();
+    header.alignment = alignment;
+    header.tocOffset = sizeof(VulkanPackHeader);
+
+    std::vector<VulkanPackEntry> toc;
+    uint64_t offset = header.tocOffset + sorted.size() * sizeof(VulkanPackEntry);
+    for (auto item : sorted)
+    {
+        offset = alignUp(offset, alignment);
+        toc.push_back(item->entry);
+        toc.back().offset = offset;
+        offset += item->entry.size;
+    }
+    header.fileSize = offset;
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+    {
+        throw std::runtime_error("failed to create pack: " + path);
+    }
+    file.write((const char*)&header, sizeof(header));
+    file.write((const char*)toc.data(), toc.size() * sizeof(VulkanPackEntry));
+
+    static const char zeros[256] = {};
+    uint64_t position = header.tocOffset + toc.size() * sizeof(VulkanPackEntry);
+    for (size_t i = 0; i < sorted.size(); i++)
+    {
+        while (position < toc[i].offset)
+        {
+            uint64_t count = std::min<uint64_t>(toc[i].offset - position, sizeof(zeros));
+            file.write(zeros, (std::streamsize)count);
+            position += count;
+        }
+        file.write((const char*)sorted[i]->data.data(), (std::streamsize)sorted[i]->data.size());
+        position += sorted[i]->data.size();
+    }
+    if (!file)
+    {
+        throw std::runtime_error("failed to write pack: " + path);
+    }
+}
+
+void VulkanAssetPack::init(
+    const VulkanLogicalDevice& logicalDevice,
+    VulkanAllocator& allocator,
+    VulkanUploader& uploader,
+    VulkanTextureManager& textures)
+{
+    this->logicalDevice = &logicalDevice;
+    this->allocator = &allocator;
+    this->uploader = &uploader;
+    this->textures = &textures;
+}
+
+void VulkanAssetPack::quit()
+{
+    this->close();
+    logicalDevice = nullptr;
+}
+
+void VulkanAssetPack::open(const std::string& path)
+{
+    this->close();
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+        OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        throw std::runtime_error("failed to open pack: " + path);
+    }
+    LARGE_INTEGER size;
+    GetFileSizeEx(file, &size);
+    HANDLE mapping = size.QuadPart > 0 ? CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+    void* view = mapping != nullptr ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (mapping != nullptr)
+        CloseHandle(mapping);
+    CloseHandle(file);
+    if (view == nullptr)
+    {
+        throw std::runtime_error("failed to map pack: " + path);
+    }
+    length = (size_t)size.QuadPart;
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        throw std::runtime_error("failed to open pack: " + path);
+    }
+    struct stat st;
+    void* view = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+        view = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (view == MAP_FAILED)
+    {
+        throw std::runtime_error("failed to map pack: " + path);
+    }
+    length = (size_t)st.st_size;
+    // blobs are consumed front to back during a load.
+    madvise(view, length, MADV_WILLNEED);
+#endif
+    base = (const uint8_t*)view;
+    this->path = path;
+
+    header = (const VulkanPackHeader*)base;
+    if (length < sizeof(VulkanPackHeader) ||
+        header->magic != VULKAN_PACK_MAGIC || header->version != VULKAN_PACK_VERSION ||
+        header->fileSize > length ||
+        header->tocOffset > length || header->tocOffset % alignof(VulkanPackEntry) != 0 ||
+        header->entryCount > (length - header->tocOffset) / sizeof(VulkanPackEntry))
+    {
+        this->close();
+        throw std::runtime_error("not a valid pack: " + path);
+    }
+    toc = (const VulkanPackEntry*)(base + header->tocOffset);
+    for (uint32_t i = 0; i < header->entryCount; i++)
+    {
+        // written so that no sum can wrap around.
+        const VulkanPackEntry& entry = toc[i];
+        bool valid = entry.offset <= length && entry.size <= length - entry.offset &&
+            entry.name[sizeof(entry.name) - 1] == 0;
+        if (valid && entry.type == VULKAN_PACK_MESH)
+        {
+            const VulkanPackMeshInfo& mesh = entry.mesh;
+            uint64_t indexSize = mesh.indexType == VK_INDEX_TYPE_UINT16 ? 2 : 4;
+            valid = (mesh.indexType == VK_INDEX_TYPE_UINT16 || mesh.indexType == VK_INDEX_TYPE_UINT32) &&
+                mesh.indexOffset <= entry.size && mesh.indexCount <= (entry.size - mesh.indexOffset) / indexSize;
+        }
+        if (!valid)
+        {
+            this->close();
+            throw std::runtime_error("corrupt pack entry: " + path);
+        }
+    }
+}
+
+void VulkanAssetPack::close()
+{
+    if (base != nullptr)
+    {
+#ifdef _WIN32
+        UnmapViewOfFile(base);
+#else
+        munmap((void*)base, length);
+#endif
+    }
+    base = nullptr;
+    length = 0;
+    header = nullptr;
+    toc = nullptr;
+    path.clear();
+}
+
+const VulkanPackEntry* VulkanAssetPack::find(const char* name) const
+{
+    if (header == nullptr)
+        return nullptr;
+    const VulkanPackEntry* end = toc + header->entryCount;
+    const VulkanPackEntry* it = std::lower_bound(toc, end, name,
+        [](const VulkanPackEntry& entry, const char* name) { return strcmp(entry.name, name) < 0; });
+    return it != end && strcmp(it->name, name) == 0 ? it : nullptr;
+}
+
+VulkanTexture VulkanAssetPack::loadTexture(const VulkanPackEntry& entry) const
+{
+    if (entry.type != VULKAN_PACK_TEXTURE)
+    {
+        throw std::runtime_error(std::string("pack entry is not a texture: ") + entry.name);
+    }
+
+    VulkanTextureArgs args;
+    args.format = (VkFormat)entry.texture.format;
+    args.extent = { entry.texture.width, entry.texture.height };
+    args.data = this->blob(entry);
+    args.size = entry.size;
+    args.dataMipLevels = entry.texture.mipLevels;
+    return textures->createTexture(args);
+}
+
+VulkanMesh VulkanAssetPack::loadMesh(const VulkanPackEntry& entry) const
+{
+    if (entry.type != VULKAN_PACK_MESH)
+    {
+        throw std::runtime_error(std::string("pack entry is not a mesh: ") + entry.name);
+    }
+
+    VulkanMesh mesh;
+    mesh.indexOffset = entry.mesh.indexOffset;
+    mesh.vertexCount = entry.mesh.vertexCount;
+    mesh.indexCount = entry.mesh.indexCount;
+    mesh.indexType = (VkIndexType)entry.mesh.indexType;
+
+    VkBufferCreateInfo bci = {};
+    bci.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bci.pNext = nullptr;
+    bci.size = entry.size;
+    bci.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    bci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    if (VK_SUCCESS != vkCreateBuffer(logicalDevice->device, &bci, nullptr, &mesh.buffer))
+    {
+        throw std::runtime_error("Create mesh buffer failed.");
+    }
+
+    VkMemoryRequirements requirements;
+    vkGetBufferMemoryRequirements(logicalDevice->device, mesh.buffer, &requirements);
+    try
+    {
+        mesh.allocation = allocator->allocate(requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    }
+    catch (...)
+    {
+        this->destroyMesh(mesh);
+        throw;
+    }
+    vkBindBufferMemory(logicalDevice->device, mesh.buffer, mesh.allocation.memory, mesh.allocation.offset);
+
+    uploader->uploadBuffer(mesh.buffer, 0, this->blob(entry), entry.size);
+    return mesh;
+}
+
+void VulkanAssetPack::destroyMesh(VulkanMesh& mesh) const
+{
+    if (mesh.buffer != nullptr)
+    {
+        vkDestroyBuffer(logicalDevice->device, mesh.buffer, nullptr);
+        mesh.buffer = nullptr;
+    }
+    allocator->free(mesh.allocation);
+}
+
+VulkanStreamedTextureArgs VulkanAssetPack::streamedTexture(const VulkanPackEntry& entry) const
+{
+    if (entry.type != VULKAN_PACK_TEXTURE)
+    {
+        throw std::runtime_error(std::string("pack entry is not a texture: ") + entry.name);
+    }
+
+    VulkanStreamedTextureArgs args;
+    args.path = path;
+    args.offset = entry.offset;
+    args.format = (VkFormat)entry.texture.format;
+    args.extent = { entry.texture.width, entry.texture.height };
+    args.mipLevels = entry.texture.mipLevels;
+    return args;
+}
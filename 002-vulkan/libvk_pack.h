@@ -0,0 +1,154 @@
+#ifndef _LIBVK_PACK_H_
+#define _LIBVK_PACK_H_
+
+#include "libvk_meshlet.h"
+#include "libvk_streaming.h"
+#include "libvk_texture.h"
+
+// On-disk layout, little-endian:
+//
+//   VulkanPackHeader
+//   VulkanPackEntry[entryCount]    sorted by name
+//   blobs                          each at a multiple of `alignment`
+//
+// Blobs are stored exactly as the GPU consumes them: a texture is its mip levels
+// tightly packed, largest first (VulkanTextureArgs::data); a mesh is its vertices
+// followed by its indices at `indexOffset`, uploaded as one buffer; a meshlet
+// mesh is what VulkanMeshletRenderer::addMesh takes (see encodeMeshlets). Loading is a
+// lookup in the mapped table and a memcpy from the mapping into staging memory.
+
+#define VULKAN_PACK_MAGIC   0x4b504b56u     // "VKPK"
+#define VULKAN_PACK_VERSION 1u
+
+enum VulkanPackEntryType
+{
+    VULKAN_PACK_MESH = 1,
+    VULKAN_PACK_TEXTURE = 2,
+    VULKAN_PACK_MESHLETS = 3
+};
+
+struct VulkanPackHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t entryCount;
+    uint32_t alignment;
+    uint64_t tocOffset;
+    uint64_t fileSize;
+};
+
+struct VulkanPackMeshInfo
+{
+    uint32_t vertexCount;
+    uint32_t vertexStride;
+    uint32_t indexCount;
+    uint32_t indexType;     // VkIndexType
+    uint64_t indexOffset;   // inside the blob
+};
+
+struct VulkanPackTextureInfo
+{
+    uint32_t format;        // VkFormat
+    uint32_t width;
+    uint32_t height;
+    uint32_t mipLevels;     // levels stored in the blob
+    uint64_t reserved;
+};
+
+struct VulkanPackEntry
+{
+    char name[48];          // zero-terminated
+    uint32_t type;          // VulkanPackEntryType
+    uint32_t reserved;
+    uint64_t offset;        // blob, from the start of the file
+    uint64_t size;
+    union
+    {
+        VulkanPackMeshInfo mesh;
+        VulkanPackTextureInfo texture;
+        VulkanPackMeshletInfo meshlets;
+    };
+};
+
+static_assert(sizeof(VulkanPackHeader) == 32, "pack header layout changed");
+static_assert(sizeof(VulkanPackEntry) == 96, "pack entry layout changed");
+
+struct VulkanMesh
+{
+    VkBuffer buffer = nullptr;
+    VulkanAllocation allocation;
+    VkDeviceSize indexOffset = 0;
+    uint32_t vertexCount = 0;
+    uint32_t indexCount = 0;
+    VkIndexType indexType = VK_INDEX_TYPE_UINT32;
+};
+
+// Builds packs offline; keeps every blob in memory until write().
+class VulkanAssetPackWriter
+{
+    struct Item
+    {
+        VulkanPackEntry entry;
+        std::vector<uint8_t> data;
+    };
+
+    std::vector<Item> items;
+    uint32_t alignment;
+
+public:
+    explicit VulkanAssetPackWriter(uint32_t alignment = 256) : alignment(alignment) {}
+
+    void addMesh(const std::string& name,
+        const void* vertices, uint32_t vertexCount, uint32_t vertexStride,
+        const void* indices, uint32_t indexCount, VkIndexType indexType);
+    void addTexture(const std::string& name, VkFormat format, VkExtent2D extent,
+        const void* data, VkDeviceSize size, uint32_t mipLevels);
+    // `data` from buildMeshlets over the same vertices.
+    void addMeshlets(const std::string& name,
+        const void* vertices, uint32_t vertexCount, uint32_t vertexStride,
+        const VulkanMeshletData& data);
+
+    void write(const std::string& path) const;
+
+private:
+    VulkanPackEntry& add(const std::string& name, VulkanPackEntryType type);
+};
+
+// Maps a pack read-only and uploads its blobs straight from the mapping. The table
+// of contents is used in place, so open() costs one mmap and a header check.
+class VulkanAssetPack
+{
+    const VulkanLogicalDevice* logicalDevice = nullptr;
+    VulkanAllocator* allocator = nullptr;
+    VulkanUploader* uploader = nullptr;
+    VulkanTextureManager* textures = nullptr;
+
+    std::string path;
+    const uint8_t* base = nullptr;
+    size_t length = 0;
+    const VulkanPackHeader* header = nullptr;
+    const VulkanPackEntry* toc = nullptr;
+
+public:
+    void init(const VulkanLogicalDevice& logicalDevice, VulkanAllocator& allocator,
+        VulkanUploader& uploader, VulkanTextureManager& textures);
+    void quit();
+
+    void open(const std::string& path);
+    void close();
+
+    uint32_t entryCount() const { return header != nullptr ? header->entryCount : 0; }
+    const VulkanPackEntry& entry(uint32_t index) const { return toc[index]; }
+    const VulkanPackEntry* find(const char* name) const;
+    const uint8_t* blob(const VulkanPackEntry& entry) const { return base + entry.offset; }
+
+    // Both record into the uploader's current batch, see VulkanTextureManager::createTexture.
+    VulkanTexture loadTexture(const VulkanPackEntry& entry) const;
+    VulkanMesh loadMesh(const VulkanPackEntry& entry) const;
+    void destroyMesh(VulkanMesh& mesh) const;
+
+    // Streams the texture from the pack file instead of uploading it whole.
+    VulkanStreamedTextureArgs streamedTexture(const VulkanPackEntry& entry) const;
+};
+
+#endif//_LIBVK_PACK_H_
@@ -0,0 +1,451 @@
+
+#include "libvk_particles.h"
+#include "libvk_profiler.h"
+
+#include "particle_emit.comp.h"
+#include "particle_args.comp.h"
+#include "particle_simulate.comp.h"
+#include "particle_sort_local.comp.h"
+#include "particle_sort.comp.h"
+#include "particle.vert.h"
+#include "particle.frag.h"
+
+#include <algorithm>
+
+namespace
+{
+
+// std430 mirrors of particle.inc.
+struct ParticleEmitter
+{
+    float positionRadius[4];
+    float directionSpread[4];
+    float speedLife[4];         // speed min, max, life min, max
+    float size[4];              // start, end
+    uint32_t colorStart;
+    uint32_t colorEnd;
+    uint32_t first;             // of the frame's emissions
+    uint32_t count;
+};
+
+struct ParticleFrame
+{
+    VulkanMat4 viewProj;
+    float right[4];
+    float up[4];
+    float eye[4];
+    float gravity[4];           // w: drag
+    float dt;
+    uint32_t seed;
+    uint32_t emitCount;
+    uint32_t emitterCount;
+    uint32_t capacity;
+    uint32_t maxParticles;
+    uint32_t reserved[2];
+    ParticleEmitter emitters[VULKAN_PARTICLE_MAX_EMITTERS];
+};
+
+struct ParticleCounters
+{
+    int32_t deadCount;
+    uint32_t aliveCount[2];
+    uint32_t sortCount;
+    VkDispatchIndirectCommand simulate;
+    VkDispatchIndirectCommand sort;
+    VkDrawIndirectCommand draw;
+    uint32_t reserved[2];
+};
+
+struct ParticleParams
+{
+    uint32_t slot;
+    uint32_t list;      // alive list read, the other one is written
+    uint32_t k;         // bitonic stage; args: 0 before the simulation, 1 after
+    uint32_t j;         // bitonic step
+};
+
+static_assert(sizeof(ParticleEmitter) == 80, "particle emitter layout changed");
+static_assert(sizeof(ParticleFrame) == 160 + VULKAN_PARTICLE_MAX_EMITTERS * 80, "particle frame layout changed");
+static_assert(sizeof(ParticleCounters) == 64, "particle counters layout changed");
+
+const uint32_t PARTICLE_PARTICLE_SIZE = 48;     // Particle in particle.inc
+const uint32_t PARTICLE_GROUP_SIZE = 256;       // emit, simulate
+const uint32_t PARTICLE_SORT_BLOCK = 1024;      // keys sorted in shared memory by one workgroup
+
+enum ParticleBinding
+{
+    PARTICLE_BINDING_FRAMES = 0,
+    PARTICLE_BINDING_PARTICLES = 1,
+    PARTICLE_BINDING_DEAD = 2,
+    PARTICLE_BINDING_LISTS = 3,
+    PARTICLE_BINDING_COUNTERS = 4
+};
+
+uint32_t nextPowerOfTwo(uint32_t value)
+{
+    uint32_t p = 1;
+    while (p < value)
+        p <<= 1;
+    return p;
+}
+
+void computeBarrier(VkCommandBuffer commandBuffer, VkPipelineStageFlags dstStages, VkAccessFlags dstAccess)
+{
+    VkMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.pNext = nullptr;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = dstAccess;
+    vkCmdPipelineBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, dstStages,
+        0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+void computeBarrier(VkCommandBuffer commandBuffer)
+{
+    computeBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+}
+
+VkDescriptorSetLayoutBinding storageBinding(uint32_t binding, VkShaderStageFlags stages)
+{
+    return { binding, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, stages, nullptr };
+}
+
+}
+
+void VulkanParticleSystem::init(const VulkanLogicalDevice& logicalDevice, VulkanUploader& uploader,
+    const VulkanParticleSystemArgs& args)
+{
+    this->logicalDevice = &logicalDevice;
+    this->args = args;
+    this->args.framesInFlight = std::max(args.framesInFlight, 1u);
+    this->args.maxParticles = std::max(args.maxParticles, 1u);
+    this->capacity = std::max(nextPowerOfTwo(this->args.maxParticles), PARTICLE_SORT_BLOCK);
+
+    VulkanComputePipelineArgs computeArgs;
+    for (uint32_t binding = PARTICLE_BINDING_FRAMES; binding <= PARTICLE_BINDING_COUNTERS; binding++)
+        computeArgs.bindings.push_back(storageBinding(binding, VK_SHADER_STAGE_COMPUTE_BIT));
+    computeArgs.pushConstantSize = sizeof(ParticleParams);
+    computeArgs.comp = particle_emit_comp_spv;
+    this->emitPipeline = logicalDevice.createComputePipeline(computeArgs);
+    computeArgs.comp = particle_args_comp_spv;
+    this->argsPipeline = logicalDevice.createComputePipeline(computeArgs);
+    computeArgs.comp = particle_simulate_comp_spv;
+    this->simulatePipeline = logicalDevice.createComputePipeline(computeArgs);
+    computeArgs.comp = particle_sort_local_comp_spv;
+    this->sortLocalPipeline = logicalDevice.createComputePipeline(computeArgs);
+    computeArgs.comp = particle_sort_comp_spv;
+    this->sortPipeline = logicalDevice.createComputePipeline(computeArgs);
+
+    VulkanGraphicsPipelineArgs pipelineArgs = {};
+    pipelineArgs.vert = particle_vert_spv;
+    pipelineArgs.frag = particle_frag_spv;
+    pipelineArgs.viewport = { 0.0f, 0.0f, (float)args.extent.width, (float)args.extent.height, 0.0f, 1.0f };
+    pipelineArgs.scissor = { { 0, 0 }, args.extent };
+    pipelineArgs.colorFormat = args.colorFormat;
+    pipelineArgs.depthFormat = args.depthFormat;
+    pipelineArgs.samples = args.samples;
+    pipelineArgs.dynamicRendering = args.dynamicRendering;
+    pipelineArgs.bindings.push_back(storageBinding(PARTICLE_BINDING_FRAMES, VK_SHADER_STAGE_VERTEX_BIT));
+    pipelineArgs.bindings.push_back(storageBinding(PARTICLE_BINDING_PARTICLES, VK_SHADER_STAGE_VERTEX_BIT));
+    pipelineArgs.bindings.push_back(storageBinding(PARTICLE_BINDING_LISTS, VK_SHADER_STAGE_VERTEX_BIT));
+    pipelineArgs.pushConstantSize = sizeof(ParticleParams);
+    pipelineArgs.cullMode = VK_CULL_MODE_NONE;
+    pipelineArgs.depthWrite = false;
+    pipelineArgs.blend = true;
+    this->drawPipeline = logicalDevice.createGraphicsPipeline(pipelineArgs);
+
+    VkDescriptorPoolSize poolSize = { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        (uint32_t)computeArgs.bindings.size() + (uint32_t)pipelineArgs.bindings.size() };
+    VkDescriptorPoolCreateInfo dpci = {};
+    dpci.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    dpci.pNext = nullptr;
+    dpci.flags = 0;
+    dpci.maxSets = 2;
+    dpci.poolSizeCount = 1;
+    dpci.pPoolSizes = &poolSize;
+    if (VK_SUCCESS != vkCreateDescriptorPool(logicalDevice.device, &dpci, nullptr, descriptorPool.put(logicalDevice.device)))
+    {
+        throw std::runtime_error("Create particle descriptor-pool failed.");
+    }
+
+    // the compute pipelines' set layouts are defined identically, so one set
+    // serves all of them.
+    VkDescriptorSetLayout layouts[2] = { emitPipeline.setLayout.get(), drawPipeline.setLayout.get() };
+    VkDescriptorSetAllocateInfo dsai = {};
+    dsai.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    dsai.pNext = nullptr;
+    dsai.descriptorPool = descriptorPool;
+    dsai.descriptorSetCount = 2;
+    dsai.pSetLayouts = layouts;
+    VkDescriptorSet sets[2] = {};
+    if (VK_SUCCESS != vkAllocateDescriptorSets(logicalDevice.device, &dsai, sets))
+    {
+        throw std::runtime_error("Allocate particle descriptor-sets failed.");
+    }
+    this->computeSet = sets[0];
+    this->drawSet = sets[1];
+
+    VulkanBufferArgs bufferArgs = {};
+    bufferArgs.size = (VkDeviceSize)this->args.framesInFlight * sizeof(ParticleFrame);
+    bufferArgs.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+    bufferArgs.memoryProps = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    bufferArgs.preferredMemoryProps = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    bufferArgs.mapped = true;
+    this->frames = logicalDevice.createBuffer(bufferArgs);
+
+    bufferArgs = {};
+    bufferArgs.memoryProps = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    bufferArgs.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+    bufferArgs.size = (VkDeviceSize)this->args.maxParticles * PARTICLE_PARTICLE_SIZE;
+    this->particles = logicalDevice.createBuffer(bufferArgs);
+    bufferArgs.size = (VkDeviceSize)2 * capacity * 2 * sizeof(uint32_t);
+    this->lists = logicalDevice.createBuffer(bufferArgs);
+    bufferArgs.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    bufferArgs.size = (VkDeviceSize)this->args.maxParticles * sizeof(uint32_t);
+    this->deadList = logicalDevice.createBuffer(bufferArgs);
+    bufferArgs.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    bufferArgs.size = sizeof(ParticleCounters);
+    this->counters = logicalDevice.createBuffer(bufferArgs);
+
+    // every slot free, nothing alive: the only upload the system ever needs.
+    std::vector<uint32_t> dead(this->args.maxParticles);
+    for (uint32_t i = 0; i < this->args.maxParticles; i++)
+        dead[i] = i;
+    uploader.uploadBuffer(deadList.handle, 0, dead.data(), deadList.size);
+    ParticleCounters initial = {};
+    initial.deadCount = (int32_t)this->args.maxParticles;
+    initial.sortCount = PARTICLE_SORT_BLOCK;
+    initial.simulate = { 0, 1, 1 };
+    initial.sort = { 1, 1, 1 };
+    initial.draw = { 6, 0, 0, 0 };
+    uploader.uploadBuffer(counters.handle, 0, &initial, sizeof(initial));
+
+    VkDescriptorBufferInfo buffers[5] = {};
+    buffers[PARTICLE_BINDING_FRAMES] = { frames.handle, 0, VK_WHOLE_SIZE };
+    buffers[PARTICLE_BINDING_PARTICLES] = { particles.handle, 0, VK_WHOLE_SIZE };
+    buffers[PARTICLE_BINDING_DEAD] = { deadList.handle, 0, VK_WHOLE_SIZE };
+    buffers[PARTICLE_BINDING_LISTS] = { lists.handle, 0, VK_WHOLE_SIZE };
+    buffers[PARTICLE_BINDING_COUNTERS] = { counters.handle, 0, VK_WHOLE_SIZE };
+    std::vector<VkWriteDescriptorSet> writes;
+    auto write = [&writes, &buffers](VkDescriptorSet set, uint32_t binding) {
+        VkWriteDescriptorSet w = {};
+        w.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        w.pNext = nullptr;
+        w.dstSet = set;
+        w.dstBinding = binding;
+        w.dstArrayElement = 0;
+        w.descriptorCount = 1;
+        w.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        w.pBufferInfo = &buffers[binding];
+        writes.push_back(w);
+    };
+    for (uint32_t binding = PARTICLE_BINDING_FRAMES; binding <= PARTICLE_BINDING_COUNTERS; binding++)
+        write(computeSet, binding);
+    write(drawSet, PARTICLE_BINDING_FRAMES);
+    write(drawSet, PARTICLE_BINDING_PARTICLES);
+    write(drawSet, PARTICLE_BINDING_LISTS);
+    vkUpdateDescriptorSets(logicalDevice.device, (uint32_t)writes.size(), writes.data(), 0, nullptr);
+
+    list = 0;
+    step = 0;
+}
+
+void VulkanParticleSystem::quit()
+{
+    if (logicalDevice == nullptr)
+        return;
+    logicalDevice->destroyBuffer(counters);
+    logicalDevice->destroyBuffer(lists);
+    logicalDevice->destroyBuffer(deadList);
+    logicalDevice->destroyBuffer(particles);
+    logicalDevice->destroyBuffer(frames);
+    descriptorPool.reset();
+    computeSet = VK_NULL_HANDLE;
+    drawSet = VK_NULL_HANDLE;
+    logicalDevice->destroyGraphicsPipeline(drawPipeline);
+    logicalDevice->destroyComputePipeline(sortPipeline);
+    logicalDevice->destroyComputePipeline(sortLocalPipeline);
+    logicalDevice->destroyComputePipeline(simulatePipeline);
+    logicalDevice->destroyComputePipeline(argsPipeline);
+    logicalDevice->destroyComputePipeline(emitPipeline);
+    emitters.clear();
+    carry.clear();
+    logicalDevice = nullptr;
+}
+
+uint32_t VulkanParticleSystem::addEmitter(const VulkanParticleEmitter& emitter)
+{
+    if (emitters.size() >= VULKAN_PARTICLE_MAX_EMITTERS)
+    {
+        throw std::runtime_error("Too many particle emitters.");
+    }
+    emitters.push_back(emitter);
+    carry.push_back(0.0f);
+    return (uint32_t)emitters.size() - 1;
+}
+
+void VulkanParticleSystem::update(uint64_t frame, float dt, const VulkanMat4& view, const VulkanMat4& proj)
+{
+    VULKAN_PROFILE_ZONE("particle update");
+    slot = (uint32_t)(frame % args.framesInFlight);
+    stats = VulkanParticleStats();
+
+    ParticleFrame& out = ((ParticleFrame*)frames.mapped)[slot];
+    out.viewProj = proj * view;
+    // rows of the view rotation are the camera axes in world space.
+    VulkanMat4 world = inverseAffine(view);
+    for (int i = 0; i < 3; i++)
+    {
+        out.right[i] = view.m[i * 4 + 0];
+        out.up[i] = view.m[i * 4 + 1];
+        out.eye[i] = world.m[12 + i];
+    }
+    out.right[3] = out.up[3] = out.eye[3] = 0.0f;
+    out.gravity[0] = args.gravity.x;
+    out.gravity[1] = args.gravity.y;
+    out.gravity[2] = args.gravity.z;
+    out.gravity[3] = args.drag;
+    out.dt = dt;
+    out.seed = (uint32_t)(step * 0x9e3779b9u);
+    // every simulation ping-pongs the lists.
+    list = (uint32_t)(step & 1);
+    step++;
+    out.capacity = capacity;
+    out.maxParticles = args.maxParticles;
+
+    // at most what could ever be alive: the rest would find no free slot anyway.
+    emitCount = 0;
+    out.emitterCount = (uint32_t)emitters.size();
+    for (uint32_t e = 0; e < emitters.size(); e++)
+    {
+        const VulkanParticleEmitter& emitter = emitters[e];
+        carry[e] += std::max(emitter.rate, 0.0f) * dt;
+        uint32_t count = (uint32_t)std::min(carry[e], (float)(args.maxParticles - emitCount));
+        carry[e] = std::min(carry[e] - (float)count, 1.0f);
+
+        ParticleEmitter& gpu = out.emitters[e];
+        gpu.positionRadius[0] = emitter.position.x;
+        gpu.positionRadius[1] = emitter.position.y;
+        gpu.positionRadius[2] = emitter.position.z;
+        gpu.positionRadius[3] = emitter.radius;
+        VulkanVec3 direction = normalize(emitter.direction);
+        gpu.directionSpread[0] = direction.x;
+        gpu.directionSpread[1] = direction.y;
+        gpu.directionSpread[2] = direction.z;
+        gpu.directionSpread[3] = emitter.spread;
+        gpu.speedLife[0] = emitter.speedMin;
+        gpu.speedLife[1] = emitter.speedMax;
+        gpu.speedLife[2] = std::max(emitter.lifeMin, 1e-3f);
+        gpu.speedLife[3] = std::max(emitter.lifeMax, emitter.lifeMin);
+        gpu.size[0] = emitter.sizeStart;
+        gpu.size[1] = emitter.sizeEnd;
+        gpu.size[2] = gpu.size[3] = 0.0f;
+        gpu.colorStart = emitter.colorStart;
+        gpu.colorEnd = emitter.colorEnd;
+        gpu.first = emitCount;
+        gpu.count = count;
+        emitCount += count;
+    }
+    out.emitCount = emitCount;
+    stats.emitted = emitCount;
+    if (args.sort)
+    {
+        // as simulate() records them.
+        stats.sortPasses = 1;
+        for (uint32_t k = 2 * PARTICLE_SORT_BLOCK; k <= capacity; k <<= 1)
+        {
+            for (uint32_t j = k / 2; j >= PARTICLE_SORT_BLOCK; j >>= 1)
+                stats.sortPasses++;
+            stats.sortPasses++;
+        }
+    }
+}
+
+void VulkanParticleSystem::simulate(VkCommandBuffer commandBuffer) const
+{
+    if (logicalDevice == nullptr)
+        return;
+
+    // the previous frame drew from the lists and counters.
+    VkMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.pNext = nullptr;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+    ParticleParams params = { slot, list, 0, 0 };
+    auto dispatch = [&](const VulkanComputePipeline& pipeline, uint32_t groups, VkDeviceSize indirectOffset) {
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline.handle);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline.layout,
+            0, 1, &computeSet, 0, nullptr);
+        vkCmdPushConstants(commandBuffer, pipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(params), &params);
+        if (groups > 0)
+            vkCmdDispatch(commandBuffer, groups, 1, 1);
+        else
+            vkCmdDispatchIndirect(commandBuffer, counters.handle, indirectOffset);
+    };
+
+    if (emitCount > 0)
+    {
+        dispatch(emitPipeline, (emitCount + PARTICLE_GROUP_SIZE - 1) / PARTICLE_GROUP_SIZE, 0);
+        computeBarrier(commandBuffer);
+    }
+    params.k = 0;
+    dispatch(argsPipeline, 1, 0);
+    computeBarrier(commandBuffer, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+    dispatch(simulatePipeline, 0, offsetof(ParticleCounters, simulate));
+    computeBarrier(commandBuffer);
+    params.k = 1;
+    dispatch(argsPipeline, 1, 0);
+    computeBarrier(commandBuffer, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+    // the survivors are in the other list from here on.
+    params.list = list ^ 1;
+    if (args.sort)
+    {
+        // sort blocks of 1024 in shared memory (k = 0), then merge: the steps
+        // wider than a block in global memory, the rest of each stage in shared.
+        params.k = 0;
+        dispatch(sortLocalPipeline, 0, offsetof(ParticleCounters, sort));
+        for (uint32_t k = 2 * PARTICLE_SORT_BLOCK; k <= capacity; k <<= 1)
+        {
+            params.k = k;
+            for (uint32_t j = k / 2; j >= PARTICLE_SORT_BLOCK; j >>= 1)
+            {
+                computeBarrier(commandBuffer);
+                params.j = j;
+                dispatch(sortPipeline, 0, offsetof(ParticleCounters, sort));
+            }
+            computeBarrier(commandBuffer);
+            params.j = PARTICLE_SORT_BLOCK / 2;
+            dispatch(sortLocalPipeline, 0, offsetof(ParticleCounters, sort));
+        }
+    }
+
+    computeBarrier(commandBuffer, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+        VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT);
+}
+
+void VulkanParticleSystem::record(VkCommandBuffer commandBuffer) const
+{
+    if (logicalDevice == nullptr)
+        return;
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, drawPipeline.handle);
+    VkViewport viewport = { 0.0f, 0.0f, (float)args.extent.width, (float)args.extent.height, 0.0f, 1.0f };
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, drawPipeline.layout,
+        0, 1, &drawSet, 0, nullptr);
+    ParticleParams params = { slot, list ^ 1, 0, 0 };
+    vkCmdPushConstants(commandBuffer, drawPipeline.layout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+        0, sizeof(params), &params);
+    vkCmdDrawIndirect(commandBuffer, counters.handle, offsetof(ParticleCounters, draw), 1, sizeof(VkDrawIndirectCommand));
+}
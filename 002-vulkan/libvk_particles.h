@@ -0,0 +1,122 @@
+#ifndef _LIBVK_PARTICLES_H_
+#define _LIBVK_PARTICLES_H_
+
+#include "libvk.h"
+#include "libvk_math.h"
+#include "libvk_upload.h"
+
+#define VULKAN_PARTICLE_MAX_EMITTERS    16u
+
+// Where particles are born and how they start out. Values are picked
+// uniformly between the min and max, colors are RGBA8 with red in the low
+// byte and are interpolated over the particle's life.
+struct VulkanParticleEmitter
+{
+    VulkanVec3 position;
+    float radius = 0.0f;                        // spawn sphere
+    VulkanVec3 direction = VulkanVec3(0.0f, 1.0f, 0.0f);
+    float spread = 0.3f;                        // cone half angle around `direction`, radians
+    float speedMin = 1.0f;
+    float speedMax = 2.0f;
+    float lifeMin = 1.0f;                       // seconds
+    float lifeMax = 2.0f;
+    float sizeStart = 0.05f;                    // billboard half extent
+    float sizeEnd = 0.02f;
+    uint32_t colorStart = 0xffffffffu;
+    uint32_t colorEnd = 0x00ffffffu;
+    float rate = 1000.0f;                       // particles per second, 0: paused
+};
+
+struct VulkanParticleSystemArgs
+{
+    // must match the pass the particles are recorded into.
+    VkFormat colorFormat;
+    VkFormat depthFormat = VK_FORMAT_UNDEFINED;
+    VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+    bool dynamicRendering = false;
+    VkExtent2D extent;
+    uint32_t maxParticles = 1u << 20;   // alive at once, emission stalls when all are
+    uint32_t framesInFlight = 2;
+    VulkanVec3 gravity = VulkanVec3(0.0f, -9.81f, 0.0f);
+    float drag = 0.1f;                  // velocity lost per second, fraction
+    bool sort = true;                   // back to front, for alpha blending
+};
+
+struct VulkanParticleStats
+{
+    uint32_t emitted = 0;       // requested this frame; the GPU drops what has no free slot
+    uint32_t sortPasses = 0;    // dispatches recorded for the sort
+};
+
+// Particles that live entirely on the GPU. Every frame, in compute:
+//
+//   emit       pop free slots off the dead list, append them to the alive list
+//   args       alive count -> simulate dispatch size
+//   simulate   integrate the alive list; survivors are compacted into the other
+//              list with their view distance as sort key, the dead go back to
+//              the dead list
+//   args       survivors -> sort size and the draw's instance count
+//   sort       bitonic over the survivors padded to a power of two, in shared
+//              memory up to 1024 keys, in global memory above
+//
+// then one vkCmdDrawIndirect draws a camera-facing quad per survivor, in the
+// sorted list's order. The CPU only writes the emitters and camera (one small
+// region per frame in flight) and records a fixed sequence of dispatches: the
+// sizes come from the counters through indirect dispatches, and the sort passes
+// beyond the live count return immediately. Nothing is read back.
+//
+// The state advances once per update(), whose simulation must be recorded and
+// submitted, and is shared by the frames in flight, which the queue executes in
+// order. Not thread-safe, except that simulate() and record() only read it.
+class VulkanParticleSystem
+{
+    const VulkanLogicalDevice* logicalDevice = nullptr;
+    VulkanParticleSystemArgs args;
+    uint32_t capacity = 0;              // of each list, maxParticles rounded up to a power of two
+
+    VulkanComputePipeline emitPipeline;
+    VulkanComputePipeline argsPipeline;
+    VulkanComputePipeline simulatePipeline;
+    VulkanComputePipeline sortLocalPipeline;
+    VulkanComputePipeline sortPipeline;
+    VulkanGraphicsPipeline drawPipeline;
+    VulkanDescriptorPoolHandle descriptorPool;
+    VkDescriptorSet computeSet = VK_NULL_HANDLE;
+    VkDescriptorSet drawSet = VK_NULL_HANDLE;
+
+    VulkanBuffer frames;        // camera and emitters, one region per frame in flight
+    VulkanBuffer particles;
+    VulkanBuffer deadList;
+    VulkanBuffer lists;         // two alive lists of (sort key, particle), ping-ponged
+    VulkanBuffer counters;      // counts and the indirect arguments
+
+    std::vector<VulkanParticleEmitter> emitters;
+    std::vector<float> carry;   // fractional particles per emitter
+    uint32_t slot = 0;
+    uint32_t list = 0;          // alive list this frame's simulation reads, the survivors go to the other
+    uint32_t emitCount = 0;
+    uint64_t step = 0;
+    VulkanParticleStats stats;
+
+public:
+    void init(const VulkanLogicalDevice& logicalDevice, VulkanUploader& uploader, const VulkanParticleSystemArgs& args);
+    void quit();
+
+    uint32_t addEmitter(const VulkanParticleEmitter& emitter);
+    VulkanParticleEmitter& emitter(uint32_t index) { return emitters[index]; }
+    void setExtent(VkExtent2D extent) { args.extent = extent; }
+
+    // After the frame slot's fence was waited, before recording: advances the
+    // emitters by `dt` seconds and writes the frame's camera.
+    void update(uint64_t frame, float dt, const VulkanMat4& view, const VulkanMat4& proj);
+
+    // Outside the render pass, before it begins (VulkanRecordArgs::prepare).
+    void simulate(VkCommandBuffer commandBuffer) const;
+    // Inside the render pass (or rendering scope) the system was created for,
+    // after the opaque geometry.
+    void record(VkCommandBuffer commandBuffer) const;
+
+    const VulkanParticleStats& statistics() const { return stats; }
+};
+
+#endif//_LIBVK_PARTICLES_H_
@@ -0,0 +1,564 @@
+
+#include "libvk_postprocess.h"
+#include "post_bloom_down.comp.h"
+#include "post_bloom_up.comp.h"
+#include "post_exposure.comp.h"
+#include "post_tonemap.comp.h"
+#include <algorithm>
+#include <cstring>
+
+struct PostDownParams
+{
+    float srcTexel[2];
+    float srcLod;
+    uint32_t prefilter;
+    float threshold;
+    float knee;
+    float minLogLuminance;
+    float invLogRange;
+};
+
+struct PostExposureParams
+{
+    float minLogLuminance;
+    float logRange;
+    float adaptation;
+    float key;
+};
+
+struct PostUpParams
+{
+    float srcTexel[2];
+    float dstLod;
+    float radius;
+};
+
+struct PostTonemapParams
+{
+    float bloomStrength;
+    uint32_t encodeSrgb;
+};
+
+// matches the Luminance block of the shaders.
+static const VkDeviceSize LUMINANCE_SIZE = 4 * sizeof(uint32_t) + 256 * sizeof(uint32_t);
+
+static bool hasFeatures(VkPhysicalDevice device, VkFormat format, VkFormatFeatureFlags required)
+{
+    VkFormatProperties props;
+    vkGetPhysicalDeviceFormatProperties(device, format, &props);
+    return (props.optimalTilingFeatures & required) == required;
+}
+
+static bool isSrgb(VkFormat format)
+{
+    return format == VK_FORMAT_B8G8R8A8_SRGB || format == VK_FORMAT_R8G8B8A8_SRGB ||
+        format == VK_FORMAT_A8B8G8R8_SRGB_PACK32;
+}
+
+static uint32_t groupCount(uint32_t size)
+{
+    return (size + 7) / 8;
+}
+
+static VkExtent2D levelExtent(VkExtent2D extent, uint32_t level)
+{
+    return { std::max(extent.width >> level, 1u), std::max(extent.height >> level, 1u) };
+}
+
+static VkImageMemoryBarrier imageBarrier(VkImage image, uint32_t levelCount,
+    VkImageLayout oldLayout, VkImageLayout newLayout, VkAccessFlags srcAccess, VkAccessFlags dstAccess)
+{
+    VkImageMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.pNext = nullptr;
+    barrier.srcAccessMask = srcAccess;
+    barrier.dstAccessMask = dstAccess;
+    barrier.oldLayout = oldLayout;
+    barrier.newLayout = newLayout;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, levelCount, 0, 1 };
+    return barrier;
+}
+
+// compute writes -> compute reads and writes, for everything in GENERAL.
+static void computeBarrier(VkCommandBuffer commandBuffer)
+{
+    VkMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.pNext = nullptr;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+bool VulkanPostProcess::supported(const VulkanPhysicalDevice& physicalDevice, const VulkanLogicalDevice& logicalDevice)
+{
+    return logicalDevice.features.shaderStorageImageWriteWithoutFormat &&
+        physicalDevice.checkSubgroupSupport(VK_SHADER_STAGE_COMPUTE_BIT,
+            VK_SUBGROUP_FEATURE_BASIC_BIT | VK_SUBGROUP_FEATURE_BALLOT_BIT | VK_SUBGROUP_FEATURE_ARITHMETIC_BIT);
+}
+
+VkSurfaceFormatKHR VulkanPostProcess::findStorageFormat(const VulkanPhysicalDevice& physicalDevice,
+    const VulkanSwapchainSupport& support)
+{
+    VkSurfaceFormatKHR none = { VK_FORMAT_UNDEFINED, VK_COLOR_SPACE_SRGB_NONLINEAR_KHR };
+    if ((support.capabilities.supportedUsageFlags & VK_IMAGE_USAGE_STORAGE_BIT) == 0)
+        return none;
+    // sRGB formats practically never allow storage: the tonemap encodes instead.
+    const VkFormat candidates[] = {
+        VK_FORMAT_B8G8R8A8_UNORM,
+        VK_FORMAT_R8G8B8A8_UNORM,
+        VK_FORMAT_A8B8G8R8_UNORM_PACK32
+    };
+    for (VkFormat format : candidates)
+    {
+        for (const auto& f : support.formats)
+        {
+            if (f.format == format && f.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR &&
+                hasFeatures(physicalDevice.device, format, VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT))
+                return f;
+        }
+    }
+    return none;
+}
+
+VkFormat VulkanPostProcess::findSceneFormat(const VulkanPhysicalDevice& physicalDevice)
+{
+    VkFormatFeatureFlags required =
+        VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT | VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BLEND_BIT |
+        VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    if (hasFeatures(physicalDevice.device, VK_FORMAT_B10G11R11_UFLOAT_PACK32, required))
+        return VK_FORMAT_B10G11R11_UFLOAT_PACK32;
+    return VK_FORMAT_R16G16B16A16_SFLOAT;
+}
+
+void VulkanPostProcess::init(const VulkanLogicalDevice& logicalDevice, VulkanTextureManager& textures,
+    VkFormat sceneFormat, const VulkanPostProcessArgs& args)
+{
+    this->logicalDevice = &logicalDevice;
+    this->textures = &textures;
+    this->args = args;
+    this->extent = args.swapchain->extent;
+
+    VulkanAttachmentArgs sceneArgs;
+    sceneArgs.format = sceneFormat;
+    sceneArgs.extent = extent;
+    sceneArgs.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    sceneArgs.transient = false;
+    this->scene = logicalDevice.createAttachment(sceneArgs);
+
+    // half resolution is where bloom starts, anything finer is not visible in it.
+    VkExtent2D half = levelExtent(extent, 1);
+    uint32_t levels = std::clamp(args.bloomLevels, 1u, getFullMipLevels(half));
+    VkFormat bloomFormat = VK_FORMAT_B10G11R11_UFLOAT_PACK32;
+    if (!hasFeatures(logicalDevice.physicalDevice, bloomFormat,
+        VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT))
+        bloomFormat = VK_FORMAT_R16G16B16A16_SFLOAT;
+    this->bloom = textures.createImage(bloomFormat, half, levels,
+        VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT);
+    for (uint32_t level = 0; level < levels; level++)
+    {
+        VkImageViewCreateInfo ivci = {};
+        ivci.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        ivci.pNext = nullptr;
+        ivci.image = bloom.image;
+        ivci.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        ivci.format = bloomFormat;
+        ivci.components = {
+            VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY,
+            VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY
+        };
+        ivci.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 1 };
+        bloomLevelViews.emplace_back();
+        if (VK_SUCCESS != vkCreateImageView(logicalDevice.device, &ivci, nullptr, bloomLevelViews.back().put(logicalDevice.device)))
+        {
+            throw std::runtime_error("Create mip-level image-view failed.");
+        }
+    }
+
+    // a blit into an sRGB swapchain encodes by itself, storage writes never do.
+    encodeSrgb = !isSrgb(args.swapchain->format);
+    if (!args.storageOutput)
+    {
+        this->intermediate = textures.createImage(VK_FORMAT_R16G16B16A16_SFLOAT, extent, 1,
+            VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
+    }
+
+    // read and written by the GPU only, a few hundred bytes: host-visible so it
+    // can start zeroed without a transfer.
+    VulkanBufferArgs bufferArgs = {};
+    bufferArgs.size = LUMINANCE_SIZE;
+    bufferArgs.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+    bufferArgs.memoryProps = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    bufferArgs.preferredMemoryProps = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    bufferArgs.mapped = true;
+    this->luminance = logicalDevice.createBuffer(bufferArgs);
+    memset(luminance.mapped, 0, LUMINANCE_SIZE);
+
+    const VkShaderStageFlags COMPUTE = VK_SHADER_STAGE_COMPUTE_BIT;
+    VulkanComputePipelineArgs pipelineArgs;
+    pipelineArgs.comp = post_bloom_down_comp_spv;
+    pipelineArgs.bindings = {
+        { 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, COMPUTE, nullptr },
+        { 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, COMPUTE, nullptr },
+        { 2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, COMPUTE, nullptr },
+    };
+    pipelineArgs.pushConstantSize = sizeof(PostDownParams);
+    downPipeline = logicalDevice.createComputePipeline(pipelineArgs);
+
+    pipelineArgs.comp = post_exposure_comp_spv;
+    pipelineArgs.bindings = {
+        { 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, COMPUTE, nullptr },
+    };
+    pipelineArgs.pushConstantSize = sizeof(PostExposureParams);
+    exposurePipeline = logicalDevice.createComputePipeline(pipelineArgs);
+
+    pipelineArgs.comp = post_bloom_up_comp_spv;
+    pipelineArgs.bindings = {
+        { 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, COMPUTE, nullptr },
+        { 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, COMPUTE, nullptr },
+    };
+    pipelineArgs.pushConstantSize = sizeof(PostUpParams);
+    upPipeline = logicalDevice.createComputePipeline(pipelineArgs);
+
+    pipelineArgs.comp = post_tonemap_comp_spv;
+    pipelineArgs.bindings = {
+        { 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, COMPUTE, nullptr },
+        { 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, COMPUTE, nullptr },
+        { 2, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, COMPUTE, nullptr },
+        { 3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, COMPUTE, nullptr },
+    };
+    pipelineArgs.pushConstantSize = sizeof(PostTonemapParams);
+    tonemapPipeline = logicalDevice.createComputePipeline(pipelineArgs);
+
+    this->createDescriptors();
+}
+
+void VulkanPostProcess::quit()
+{
+    if (logicalDevice == nullptr)
+        return;
+    downSets.clear();
+    upSets.clear();
+    exposureSet = VK_NULL_HANDLE;
+    tonemapSets.clear();
+    descriptorPool.reset();
+    logicalDevice->destroyComputePipeline(tonemapPipeline);
+    logicalDevice->destroyComputePipeline(upPipeline);
+    logicalDevice->destroyComputePipeline(exposurePipeline);
+    logicalDevice->destroyComputePipeline(downPipeline);
+    logicalDevice->destroyBuffer(luminance);
+    textures->destroyTexture(intermediate);
+    bloomLevelViews.clear();
+    textures->destroyTexture(bloom);
+    logicalDevice->destroyAttachment(scene);
+    logicalDevice = nullptr;
+}
+
+static VkDescriptorSet allocateSet(VkDevice device, VkDescriptorPool pool, const VulkanComputePipeline& pipeline)
+{
+    VkDescriptorSetAllocateInfo dsai = {};
+    dsai.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    dsai.pNext = nullptr;
+    dsai.descriptorPool = pool;
+    dsai.descriptorSetCount = 1;
+    dsai.pSetLayouts = pipeline.setLayout.address();
+    VkDescriptorSet set;
+    if (VK_SUCCESS != vkAllocateDescriptorSets(device, &dsai, &set))
+    {
+        throw std::runtime_error("Allocate post-process descriptor-set failed.");
+    }
+    return set;
+}
+
+// Up to four bindings per set; images and buffers are written in one call.
+class PostSetWriter
+{
+    VkWriteDescriptorSet writes[4];
+    VkDescriptorImageInfo images[4];
+    VkDescriptorBufferInfo buffers[4];
+    uint32_t count = 0;
+    VkDescriptorSet set;
+
+public:
+    explicit PostSetWriter(VkDescriptorSet set) : set(set) {}
+
+    PostSetWriter& image(uint32_t binding, VkDescriptorType type, VkSampler sampler, VkImageView view, VkImageLayout layout)
+    {
+        images[count] = { sampler, view, layout };
+        VkWriteDescriptorSet& write = this->next(binding, type);
+        write.pImageInfo = &images[count++];
+        return *this;
+    }
+
+    PostSetWriter& buffer(uint32_t binding, VkBuffer buffer)
+    {
+        buffers[count] = { buffer, 0, VK_WHOLE_SIZE };
+        VkWriteDescriptorSet& write = this->next(binding, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+        write.pBufferInfo = &buffers[count++];
+        return *this;
+    }
+
+    void update(VkDevice device)
+    {
+        vkUpdateDescriptorSets(device, count, writes, 0, nullptr);
+    }
+
+private:
+    VkWriteDescriptorSet& next(uint32_t binding, VkDescriptorType type)
+    {
+        VkWriteDescriptorSet& write = writes[count];
+        write = {};
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.pNext = nullptr;
+        write.dstSet = set;
+        write.dstBinding = binding;
+        write.dstArrayElement = 0;
+        write.descriptorCount = 1;
+        write.descriptorType = type;
+        return write;
+    }
+};
+
+// Every set is static: the images are shared by all frames in flight, only the
+// tonemap's output differs per swapchain image.
+void VulkanPostProcess::createDescriptors()
+{
+    VkDevice device = logicalDevice->device;
+    uint32_t levels = bloom.mipLevels;
+    uint32_t outputs = args.storageOutput ? (uint32_t)args.swapchain->imageViews.size() : 1;
+
+    VkDescriptorPoolSize poolSizes[] = {
+        { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, levels + (levels - 1) + 2 * outputs },
+        { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, levels + (levels - 1) + outputs },
+        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, levels + 1 + outputs },
+    };
+    VkDescriptorPoolCreateInfo dpci = {};
+    dpci.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    dpci.pNext = nullptr;
+    dpci.flags = 0;
+    dpci.maxSets = levels + (levels - 1) + 1 + outputs;
+    dpci.poolSizeCount = 3;
+    dpci.pPoolSizes = poolSizes;
+    if (VK_SUCCESS != vkCreateDescriptorPool(device, &dpci, nullptr, descriptorPool.put(device)))
+    {
+        throw std::runtime_error("Create post-process descriptor-pool failed.");
+    }
+
+    // explicit lods only: nearest between levels, bilinear within one.
+    VulkanSamplerDesc desc;
+    desc.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    desc.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    desc.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    desc.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    VkSampler sampler = textures->getSampler(desc);
+
+    const VkDescriptorType SAMPLED = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    const VkDescriptorType STORAGE = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    for (uint32_t level = 0; level < levels; level++)
+    {
+        VkDescriptorSet set = allocateSet(device, descriptorPool, downPipeline);
+        PostSetWriter writer(set);
+        if (level == 0)
+            writer.image(0, SAMPLED, sampler, scene.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        else
+            writer.image(0, SAMPLED, sampler, bloom.view, VK_IMAGE_LAYOUT_GENERAL);
+        writer.image(1, STORAGE, VK_NULL_HANDLE, bloomLevelViews[level], VK_IMAGE_LAYOUT_GENERAL)
+            .buffer(2, luminance.handle)
+            .update(device);
+        downSets.push_back(set);
+    }
+    for (uint32_t level = 0; level + 1 < levels; level++)
+    {
+        VkDescriptorSet set = allocateSet(device, descriptorPool, upPipeline);
+        PostSetWriter(set)
+            .image(0, SAMPLED, sampler, bloom.view, VK_IMAGE_LAYOUT_GENERAL)
+            .image(1, STORAGE, VK_NULL_HANDLE, bloomLevelViews[level], VK_IMAGE_LAYOUT_GENERAL)
+            .update(device);
+        upSets.push_back(set);
+    }
+
+    exposureSet = allocateSet(device, descriptorPool, exposurePipeline);
+    PostSetWriter(exposureSet)
+        .buffer(0, luminance.handle)
+        .update(device);
+
+    for (uint32_t i = 0; i < outputs; i++)
+    {
+        VkImageView output = args.storageOutput ? args.swapchain->imageViews[i].get() : intermediate.view;
+        VkDescriptorSet set = allocateSet(device, descriptorPool, tonemapPipeline);
+        PostSetWriter(set)
+            .image(0, SAMPLED, sampler, scene.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
+            .image(1, SAMPLED, sampler, bloom.view, VK_IMAGE_LAYOUT_GENERAL)
+            .image(2, STORAGE, VK_NULL_HANDLE, output, VK_IMAGE_LAYOUT_GENERAL)
+            .buffer(3, luminance.handle)
+            .update(device);
+        tonemapSets.push_back(set);
+    }
+}
+
+VkPipelineStageFlags VulkanPostProcess::outputStage() const
+{
+    return args.storageOutput ? VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT : VK_PIPELINE_STAGE_TRANSFER_BIT;
+}
+
+void VulkanPostProcess::record(VkCommandBuffer commandBuffer, uint32_t imageIndex) const
+{
+    VkImage swapchainImage = args.swapchain->images[imageIndex];
+    uint32_t levels = bloom.mipLevels;
+    float logRange = args.maxLogLuminance - args.minLogLuminance;
+
+    // the scene becomes readable; bloom and intermediate are rebuilt every frame,
+    // only the previous frame has to be done reading them.
+    VkImageMemoryBarrier barriers[3];
+    uint32_t barrierCount = 0;
+    barriers[barrierCount++] = imageBarrier(scene.image, 1,
+        VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT);
+    barriers[barrierCount++] = imageBarrier(bloom.image, levels,
+        VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL,
+        0, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+    if (!args.storageOutput)
+    {
+        barriers[barrierCount++] = imageBarrier(intermediate.image, 1,
+            VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL,
+            0, VK_ACCESS_SHADER_WRITE_BIT);
+    }
+    // the luminance buffer carries the exposure over from the previous frame.
+    VkMemoryBarrier memory = {};
+    memory.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    memory.pNext = nullptr;
+    memory.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    memory.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        0, 1, &memory, 0, nullptr, barrierCount, barriers);
+
+    // downsample 0: threshold and histogram.
+    VkExtent2D size = levelExtent(bloom.extent, 0);
+    PostDownParams down = {};
+    down.srcTexel[0] = 1.0f / (float)extent.width;
+    down.srcTexel[1] = 1.0f / (float)extent.height;
+    down.srcLod = 0.0f;
+    down.prefilter = 1;
+    down.threshold = args.bloomThreshold;
+    down.knee = args.bloomKnee;
+    down.minLogLuminance = args.minLogLuminance;
+    down.invLogRange = 1.0f / logRange;
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, downPipeline.handle);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, downPipeline.layout, 0, 1, &downSets[0], 0, nullptr);
+    vkCmdPushConstants(commandBuffer, downPipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(down), &down);
+    vkCmdDispatch(commandBuffer, groupCount(size.width), groupCount(size.height), 1);
+    computeBarrier(commandBuffer);
+
+    // the exposure does not depend on the rest of the chain: no barrier between
+    // it and the next downsample, so they may overlap.
+    PostExposureParams exposure = {};
+    exposure.minLogLuminance = args.minLogLuminance;
+    exposure.logRange = logRange;
+    exposure.adaptation = args.adaptation;
+    exposure.key = args.exposureKey;
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, exposurePipeline.handle);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, exposurePipeline.layout, 0, 1, &exposureSet, 0, nullptr);
+    vkCmdPushConstants(commandBuffer, exposurePipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(exposure), &exposure);
+    vkCmdDispatch(commandBuffer, 1, 1, 1);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, downPipeline.handle);
+    for (uint32_t level = 1; level < levels; level++)
+    {
+        VkExtent2D src = levelExtent(bloom.extent, level - 1);
+        size = levelExtent(bloom.extent, level);
+        down.srcTexel[0] = 1.0f / (float)src.width;
+        down.srcTexel[1] = 1.0f / (float)src.height;
+        down.srcLod = (float)(level - 1);
+        down.prefilter = 0;
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, downPipeline.layout, 0, 1, &downSets[level], 0, nullptr);
+        vkCmdPushConstants(commandBuffer, downPipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(down), &down);
+        vkCmdDispatch(commandBuffer, groupCount(size.width), groupCount(size.height), 1);
+        computeBarrier(commandBuffer);
+    }
+
+    if (levels > 1)
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, upPipeline.handle);
+    for (uint32_t level = levels - 1; level-- > 0;)
+    {
+        VkExtent2D src = levelExtent(bloom.extent, level + 1);
+        size = levelExtent(bloom.extent, level);
+        PostUpParams up = {};
+        up.srcTexel[0] = 1.0f / (float)src.width;
+        up.srcTexel[1] = 1.0f / (float)src.height;
+        up.dstLod = (float)level;
+        up.radius = 1.0f;
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, upPipeline.layout, 0, 1, &upSets[level], 0, nullptr);
+        vkCmdPushConstants(commandBuffer, upPipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(up), &up);
+        vkCmdDispatch(commandBuffer, groupCount(size.width), groupCount(size.height), 1);
+        computeBarrier(commandBuffer);
+    }
+
+    // without bloom levels to chain, nothing has waited for the exposure yet.
+    if (levels == 1)
+        computeBarrier(commandBuffer);
+
+    // the swapchain image is only available from outputStage(), where the
+    // acquire semaphore is waited.
+    uint32_t set = 0;
+    if (args.storageOutput)
+    {
+        VkImageMemoryBarrier barrier = imageBarrier(swapchainImage, 1,
+            VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, 0, VK_ACCESS_SHADER_WRITE_BIT);
+        vkCmdPipelineBarrier(commandBuffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0, 0, nullptr, 0, nullptr, 1, &barrier);
+        set = imageIndex;
+    }
+
+    PostTonemapParams tonemap = {};
+    tonemap.bloomStrength = args.bloomStrength;
+    tonemap.encodeSrgb = encodeSrgb ? 1 : 0;
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, tonemapPipeline.handle);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, tonemapPipeline.layout, 0, 1, &tonemapSets[set], 0, nullptr);
+    vkCmdPushConstants(commandBuffer, tonemapPipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(tonemap), &tonemap);
+    vkCmdDispatch(commandBuffer, groupCount(extent.width), groupCount(extent.height), 1);
+
+    if (args.storageOutput)
+    {
+        VkImageMemoryBarrier barrier = imageBarrier(swapchainImage, 1,
+            VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, VK_ACCESS_SHADER_WRITE_BIT, 0);
+        vkCmdPipelineBarrier(commandBuffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+            0, 0, nullptr, 0, nullptr, 1, &barrier);
+        return;
+    }
+
+    VkImageMemoryBarrier blitBarriers[2];
+    blitBarriers[0] = imageBarrier(intermediate.image, 1,
+        VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+    blitBarriers[1] = imageBarrier(swapchainImage, 1,
+        VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        0, VK_ACCESS_TRANSFER_WRITE_BIT);
+    vkCmdPipelineBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+        0, 0, nullptr, 0, nullptr, 2, blitBarriers);
+
+    VkImageBlit blit = {};
+    blit.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+    blit.srcOffsets[1] = { (int32_t)extent.width, (int32_t)extent.height, 1 };
+    blit.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+    blit.dstOffsets[1] = { (int32_t)extent.width, (int32_t)extent.height, 1 };
+    vkCmdBlitImage(commandBuffer,
+        intermediate.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        swapchainImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        1, &blit, VK_FILTER_NEAREST);
+
+    VkImageMemoryBarrier presentBarrier = imageBarrier(swapchainImage, 1,
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, VK_ACCESS_TRANSFER_WRITE_BIT, 0);
+    vkCmdPipelineBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+        0, 0, nullptr, 0, nullptr, 1, &presentBarrier);
+}
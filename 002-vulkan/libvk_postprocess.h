@@ -0,0 +1,90 @@
+#ifndef _LIBVK_POSTPROCESS_H_
+#define _LIBVK_POSTPROCESS_H_
+
+#include "libvk.h"
+#include "libvk_texture.h"
+
+struct VulkanPostProcessArgs
+{
+    const VulkanSwapchain* swapchain = nullptr;
+    bool storageOutput = false;         // swapchain created with STORAGE usage: tonemap writes it directly
+    uint32_t bloomLevels = 6;           // clamped to the half-resolution mip chain
+    float bloomStrength = 0.05f;
+    float bloomThreshold = 1.0f;        // after exposure
+    float bloomKnee = 0.5f;
+    float exposureKey = 0.18f;          // average luminance is mapped to this
+    float adaptation = 0.05f;           // per frame, 1: no eye adaptation
+    float minLogLuminance = -10.0f;     // histogram range, log2
+    float maxLogLuminance = 6.0f;
+};
+
+// HDR post-processing in compute, recorded after the scene's rendering scope:
+//
+//   bloom down 0   scene -> bloom level 0, threshold, luminance histogram
+//   exposure       histogram -> adapted exposure, histogram cleared
+//   bloom down i   level i-1 -> level i
+//   bloom up i     level i+1 -> level i, added
+//   tonemap        scene + bloom level 0, exposed -> swapchain image
+//
+// The scene is drawn into sceneColor() instead of the swapchain image, is read
+// twice (first downsample, tonemap) and is never written by compute. The
+// histogram is built by the pass that already reads the scene, with subgroup
+// ballots merging equal bins before the shared atomics, and is reduced with
+// subgroup arithmetic. Everything lives in one command buffer with barriers,
+// no render pass. Images and the luminance buffer are shared by all frames in
+// flight, like the scene's attachments.
+//
+// Needs subgroup basic/ballot/arithmetic in compute and storage writes without
+// format: check supported() first.
+class VulkanPostProcess
+{
+    const VulkanLogicalDevice* logicalDevice = nullptr;
+    VulkanTextureManager* textures = nullptr;
+    VulkanPostProcessArgs args;
+    VkExtent2D extent = {};
+
+    VulkanAttachment scene;
+    VulkanTexture bloom;
+    std::vector<VulkanImageViewHandle> bloomLevelViews;
+    VulkanTexture intermediate;         // only without storage output
+    VulkanBuffer luminance;
+
+    VulkanComputePipeline downPipeline;
+    VulkanComputePipeline exposurePipeline;
+    VulkanComputePipeline upPipeline;
+    VulkanComputePipeline tonemapPipeline;
+    VulkanDescriptorPoolHandle descriptorPool;
+    std::vector<VkDescriptorSet> downSets;      // per bloom level
+    std::vector<VkDescriptorSet> upSets;        // per bloom level but the last
+    VkDescriptorSet exposureSet = VK_NULL_HANDLE;
+    std::vector<VkDescriptorSet> tonemapSets;   // per swapchain image, or one for the intermediate
+    bool encodeSrgb = false;
+
+public:
+    static bool supported(const VulkanPhysicalDevice& physicalDevice, const VulkanLogicalDevice& logicalDevice);
+    // A UNORM swapchain format the tonemap can store into, UNDEFINED if there
+    // is none; the image then also needs STORAGE usage.
+    static VkSurfaceFormatKHR findStorageFormat(const VulkanPhysicalDevice& physicalDevice,
+        const VulkanSwapchainSupport& support);
+    // What the scene is drawn in, best first: B10G11R11 halves the traffic of RGBA16F.
+    static VkFormat findSceneFormat(const VulkanPhysicalDevice& physicalDevice);
+
+    void init(const VulkanLogicalDevice& logicalDevice, VulkanTextureManager& textures,
+        VkFormat sceneFormat, const VulkanPostProcessArgs& args);
+    void quit();
+
+    // Single-sampled: the render target, or the resolve target of a multisampled one.
+    const VulkanAttachment& sceneColor() const { return scene; }
+
+    // Stage that first touches the swapchain image: wait for the acquire there.
+    VkPipelineStageFlags outputStage() const;
+
+    // After the scene's render pass or rendering scope ended, with the scene in
+    // COLOR_ATTACHMENT_OPTIMAL. Leaves the swapchain image in PRESENT_SRC.
+    void record(VkCommandBuffer commandBuffer, uint32_t imageIndex) const;
+
+private:
+    void createDescriptors();
+};
+
+#endif//_LIBVK_POSTPROCESS_H_
@@ -0,0 +1,264 @@
+
+#include "libvk_profiler.h"
+#include <chrono>
+#include <cstdio>
+#include <limits>
+#include <stdexcept>
+
+static const uint64_t EVENT_MASK = VULKAN_PROFILE_EVENTS_PER_THREAD - 1;
+static_assert((VULKAN_PROFILE_EVENTS_PER_THREAD & EVENT_MASK) == 0, "event ring size must be a power of two");
+
+static thread_local void* currentTrack = nullptr;
+static thread_local std::string currentName;      // until the thread records its first zone
+
+VulkanProfiler& VulkanProfiler::instance()
+{
+    static VulkanProfiler profiler;
+    return profiler;
+}
+
+uint64_t VulkanProfiler::now()
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void VulkanProfiler::start()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (gpuTrack == nullptr)
+    {
+        // created here, not on first GPU event, so the GPU shows up as the first track.
+        auto track = std::make_unique<Track>();
+        track->name = "GPU";
+        track->events.reset(new VulkanProfileEvent[VULKAN_PROFILE_EVENTS_PER_THREAD]);
+        gpuTrack = track.get();
+        tracks.push_back(std::move(track));
+    }
+    if (origin == 0)
+        origin = now();
+    active = true;
+}
+
+void VulkanProfiler::stop()
+{
+    active = false;
+}
+
+void VulkanProfiler::record(const char* name, uint64_t begin, uint64_t end)
+{
+    append(*this->threadTrack(), name, begin, end);
+}
+
+void VulkanProfiler::recordGpu(const char* name, uint64_t begin, uint64_t end)
+{
+    if (gpuTrack != nullptr && this->enabled())
+        append(*gpuTrack, name, begin, end);
+}
+
+// Only remembered until the thread records something: threads that never do
+// cost no ring.
+void VulkanProfiler::setThreadName(const std::string& name)
+{
+    if (currentTrack == nullptr)
+    {
+        currentName = name;
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    ((Track*)currentTrack)->name = name;
+}
+
+// Single writer per track: the slot is filled before `written` publishes it.
+void VulkanProfiler::append(Track& track, const char* name, uint64_t begin, uint64_t end)
+{
+    uint64_t i = track.written.load(std::memory_order_relaxed);
+    track.events[i & EVENT_MASK] = { name, begin, end };
+    track.written.store(i + 1, std::memory_order_release);
+}
+
+VulkanProfiler::Track* VulkanProfiler::addTrack(const std::string& name)
+{
+    auto track = std::make_unique<Track>();
+    track->name = name;
+    track->events.reset(new VulkanProfileEvent[VULKAN_PROFILE_EVENTS_PER_THREAD]);
+    Track* ret = track.get();
+    std::lock_guard<std::mutex> lock(mutex);
+    track->id = (uint32_t)tracks.size();
+    if (name.empty())
+        track->name = "thread " + std::to_string(track->id);
+    tracks.push_back(std::move(track));
+    return ret;
+}
+
+// Tracks are never freed, so a finished thread's events can still be exported.
+VulkanProfiler::Track* VulkanProfiler::threadTrack()
+{
+    if (currentTrack == nullptr)
+        currentTrack = this->addTrack(currentName);
+    return (Track*)currentTrack;
+}
+
+static void writeJsonString(std::ostream& out, const std::string& text)
+{
+    out << '"';
+    for (char c : text)
+    {
+        if (c == '"' || c == '\\')
+            out << '\\' << c;
+        else if ((unsigned char)c < 0x20)
+            out << ' ';
+        else
+            out << c;
+    }
+    out << '"';
+}
+
+void VulkanProfiler::writeChromeTrace(std::ostream& out) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    bool first = true;
+    char number[64];
+    for (auto& track : tracks)
+    {
+        out << (first ? "\n" : ",\n");
+        first = false;
+        out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << track->id << ",\"args\":{\"name\":";
+        writeJsonString(out, track->name);
+        out << "}}";
+
+        uint64_t written = track->written.load(std::memory_order_acquire);
+        uint64_t begin = written > VULKAN_PROFILE_EVENTS_PER_THREAD ? written - VULKAN_PROFILE_EVENTS_PER_THREAD : 0;
+        for (uint64_t i = begin; i < written; i++)
+        {
+            const VulkanProfileEvent& e = track->events[i & EVENT_MASK];
+            // microseconds with nanosecond digits; GPU events may start before the origin.
+            snprintf(number, sizeof(number), "\"ts\":%.3f,\"dur\":%.3f",
+                ((double)e.begin - (double)origin) / 1000.0, (double)(e.end - e.begin) / 1000.0);
+            out << ",\n{\"name\":";
+            writeJsonString(out, e.name);
+            out << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << track->id << ',' << number << '}';
+        }
+    }
+    out << "\n]}\n";
+}
+
+void VulkanGpuProfiler::init(const VulkanLogicalDevice& logicalDevice, const VulkanPhysicalDevice& physicalDevice,
+    uint32_t slotCount)
+{
+    this->logicalDevice = &logicalDevice;
+    uint32_t validBits = physicalDevice.queueFamilies.at(logicalDevice.queueFamilyIndex).timestampValidBits;
+    if (validBits == 0 || slotCount == 0)
+        return;
+    this->slotCount = slotCount;
+    period = physicalDevice.props.limits.timestampPeriod;
+    validMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+
+    // two queries per zone and slot, plus one for calibration.
+    uint32_t queryCount = slotCount * VULKAN_GPU_ZONE_COUNT * 2;
+    VkQueryPoolCreateInfo qpci = {};
+    qpci.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    qpci.pNext = nullptr;
+    qpci.flags = 0;
+    qpci.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    qpci.queryCount = queryCount + 1;
+    qpci.pipelineStatistics = 0;
+    if (VK_SUCCESS != vkCreateQueryPool(logicalDevice.device, &qpci, nullptr, pool.put(logicalDevice.device)))
+    {
+        throw std::runtime_error("Create timestamp query pool failed.");
+    }
+    results.resize(VULKAN_GPU_ZONE_COUNT * 2 * 2);
+    lastBegin.assign(slotCount * VULKAN_GPU_ZONE_COUNT, 0);
+
+    VkCommandBufferAllocateInfo cbai = {};
+    cbai.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    cbai.pNext = nullptr;
+    cbai.commandPool = logicalDevice.commandPool;
+    cbai.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    cbai.commandBufferCount = 1;
+    VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+    if (VK_SUCCESS != vkAllocateCommandBuffers(logicalDevice.device, &cbai, &commandBuffer))
+    {
+        throw std::runtime_error("Allocate command-buffers failed.");
+    }
+    VkCommandBufferBeginInfo cbbi = {};
+    cbbi.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    cbbi.pNext = nullptr;
+    cbbi.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    cbbi.pInheritanceInfo = nullptr;
+    vkBeginCommandBuffer(commandBuffer, &cbbi);
+    vkCmdResetQueryPool(commandBuffer, pool, queryCount, 1);
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, pool, queryCount);
+    vkEndCommandBuffer(commandBuffer);
+
+    VulkanFenceHandle fence = logicalDevice.createFence();
+    logicalDevice.submit(commandBuffer, VK_NULL_HANDLE, 0, VK_NULL_HANDLE, fence);
+    vkWaitForFences(logicalDevice.device, 1, fence.address(), VK_TRUE, std::numeric_limits<uint64_t>::max());
+    uint64_t cpu = VulkanProfiler::now();
+    uint64_t ticks = 0;
+    vkGetQueryPoolResults(logicalDevice.device, pool, queryCount, 1, sizeof(ticks), &ticks, sizeof(ticks),
+        VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+    offset = (double)cpu - (double)(ticks & validMask) * period;
+    vkFreeCommandBuffers(logicalDevice.device, logicalDevice.commandPool, 1, &commandBuffer);
+}
+
+void VulkanGpuProfiler::quit()
+{
+    pool.reset();
+    results.clear();
+    lastBegin.clear();
+    logicalDevice = nullptr;
+}
+
+void VulkanGpuProfiler::reset(VkCommandBuffer commandBuffer, uint32_t slot) const
+{
+    if (this->enabled())
+        vkCmdResetQueryPool(commandBuffer, pool, slot * VULKAN_GPU_ZONE_COUNT * 2, VULKAN_GPU_ZONE_COUNT * 2);
+}
+
+void VulkanGpuProfiler::begin(VkCommandBuffer commandBuffer, uint32_t slot, VulkanGpuZone zone) const
+{
+    if (this->enabled())
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, pool, (slot * VULKAN_GPU_ZONE_COUNT + zone) * 2);
+}
+
+void VulkanGpuProfiler::end(VkCommandBuffer commandBuffer, uint32_t slot, VulkanGpuZone zone) const
+{
+    if (this->enabled())
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, pool, (slot * VULKAN_GPU_ZONE_COUNT + zone) * 2 + 1);
+}
+
+void VulkanGpuProfiler::collect()
+{
+    static const char* const names[VULKAN_GPU_ZONE_COUNT] = { "command buffer", "rendering", "post-process" };
+    if (!this->enabled())
+        return;
+
+    const uint32_t queriesPerSlot = VULKAN_GPU_ZONE_COUNT * 2;
+    for (uint32_t slot = 0; slot < slotCount; slot++)
+    {
+        // value and availability per query; unavailable ones are simply skipped.
+        VkResult result = vkGetQueryPoolResults(logicalDevice->device, pool, slot * queriesPerSlot, queriesPerSlot,
+            results.size() * sizeof(uint64_t), results.data(), 2 * sizeof(uint64_t),
+            VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+        if (result != VK_SUCCESS && result != VK_NOT_READY)
+            continue;
+        for (uint32_t zone = 0; zone < VULKAN_GPU_ZONE_COUNT; zone++)
+        {
+            const uint64_t* begin = &results[zone * 4];
+            const uint64_t* end = &results[zone * 4 + 2];
+            uint64_t& last = lastBegin[slot * VULKAN_GPU_ZONE_COUNT + zone];
+            if (begin[1] == 0 || end[1] == 0 || begin[0] == last)
+                continue;
+            last = begin[0];
+            uint64_t beginTicks = begin[0] & validMask;
+            uint64_t endTicks = end[0] & validMask;
+            if (endTicks < beginTicks)
+                continue;
+            VulkanProfiler::instance().recordGpu(names[zone],
+                (uint64_t)(offset + (double)beginTicks * period),
+                (uint64_t)(offset + (double)endTicks * period));
+        }
+    }
+}
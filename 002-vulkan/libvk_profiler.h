@@ -0,0 +1,127 @@
+#ifndef _LIBVK_PROFILER_H_
+#define _LIBVK_PROFILER_H_
+
+#include "libvk.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <ostream>
+
+#define VULKAN_PROFILE_EVENTS_PER_THREAD (1u << 16)   // power of two, older events are overwritten
+
+#define _VULKAN_PROFILE_JOIN2(a, b) a##b
+#define _VULKAN_PROFILE_JOIN(a, b) _VULKAN_PROFILE_JOIN2(a, b)
+// Times the rest of the enclosing scope. `name` must be a string literal.
+#define VULKAN_PROFILE_ZONE(name) VulkanProfileZone _VULKAN_PROFILE_JOIN(_profileZone, __LINE__)(name)
+
+struct VulkanProfileEvent
+{
+    const char* name;
+    uint64_t begin;     // VulkanProfiler::now()
+    uint64_t end;
+};
+
+// Process-wide recorder of timed zones. Every thread writes to a ring of its own,
+// so recording takes no lock and costs two clock reads and a store; while the
+// profiler is stopped a zone is a single relaxed load. GPU zones converted to the
+// same clock go to a track of their own, and the whole timeline is exported as
+// Chrome trace JSON (chrome://tracing, Perfetto).
+class VulkanProfiler
+{
+    struct Track
+    {
+        std::string name;
+        uint32_t id = 0;
+        std::unique_ptr<VulkanProfileEvent[]> events;
+        std::atomic<uint64_t> written{ 0 };
+    };
+
+    mutable std::mutex mutex;   // guards the track list and names, never the events
+    std::vector<std::unique_ptr<Track>> tracks;
+    Track* gpuTrack = nullptr;
+    std::atomic<bool> active{ false };
+    uint64_t origin = 0;
+
+public:
+    static VulkanProfiler& instance();
+    // Nanoseconds on a monotonic clock (CLOCK_MONOTONIC where there is one).
+    static uint64_t now();
+
+    void start();
+    void stop();
+    bool enabled() const { return active.load(std::memory_order_relaxed); }
+
+    void record(const char* name, uint64_t begin, uint64_t end);
+    void recordGpu(const char* name, uint64_t begin, uint64_t end);
+    void setThreadName(const std::string& name);
+
+    // Writes what the rings still hold. Threads still recording may tear the
+    // oldest events, so export after stop() or once the workers are idle.
+    void writeChromeTrace(std::ostream& out) const;
+
+private:
+    Track* addTrack(const std::string& name);
+    Track* threadTrack();
+    static void append(Track& track, const char* name, uint64_t begin, uint64_t end);
+};
+
+class VulkanProfileZone
+{
+    const char* name;
+    uint64_t begin;
+
+public:
+    explicit VulkanProfileZone(const char* name)
+        : name(name), begin(VulkanProfiler::instance().enabled() ? VulkanProfiler::now() : 0) {}
+    ~VulkanProfileZone()
+    {
+        if (begin != 0)
+            VulkanProfiler::instance().record(name, begin, VulkanProfiler::now());
+    }
+
+    VulkanProfileZone(const VulkanProfileZone&) = delete;
+    VulkanProfileZone& operator=(const VulkanProfileZone&) = delete;
+};
+
+enum VulkanGpuZone
+{
+    VULKAN_GPU_ZONE_COMMAND_BUFFER,     // everything recorded by beginCommandBuffers/endCommandBuffers
+    VULKAN_GPU_ZONE_RENDERING,          // the render pass or dynamic rendering scope
+    VULKAN_GPU_ZONE_POST_PROCESS,       // compute passes after it, see VulkanPostProcess
+    VULKAN_GPU_ZONE_COUNT
+};
+
+typedef VulkanHandle<VkQueryPool, VkDevice, vkDestroyQueryPool> VulkanQueryPoolHandle;
+
+// Timestamp queries around the zones above, one set per command buffer slot.
+// Queries are reset inside the command buffer, so pre-recorded buffers measure
+// every execution. The GPU clock is mapped to VulkanProfiler::now() once at init
+// with a blocking timestamp submission; the mapping is off by about the submit
+// latency, which shifts the GPU track but not its durations.
+class VulkanGpuProfiler
+{
+    const VulkanLogicalDevice* logicalDevice = nullptr;
+    VulkanQueryPoolHandle pool;
+    uint32_t slotCount = 0;
+    double period = 1.0;        // ns per tick
+    double offset = 0.0;        // ns, now() - ticks * period
+    uint64_t validMask = 0;
+    std::vector<uint64_t> results;
+    std::vector<uint64_t> lastBegin;    // per slot and zone, to report each execution once
+
+public:
+    // Does nothing when the queue family has no timestamp support.
+    void init(const VulkanLogicalDevice& logicalDevice, const VulkanPhysicalDevice& physicalDevice, uint32_t slotCount);
+    void quit();
+    bool enabled() const { return pool != VK_NULL_HANDLE; }
+
+    // Outside any render pass, before the first begin() of the slot.
+    void reset(VkCommandBuffer commandBuffer, uint32_t slot) const;
+    void begin(VkCommandBuffer commandBuffer, uint32_t slot, VulkanGpuZone zone) const;
+    void end(VkCommandBuffer commandBuffer, uint32_t slot, VulkanGpuZone zone) const;
+
+    // Records every zone finished since the last call. Does not block.
+    void collect();
+};
+
+#endif//_LIBVK_PROFILER_H_
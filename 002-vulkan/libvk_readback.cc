@@ -0,0 +1,419 @@
+
+#include "libvk_readback.h"
+
+static bool isBGRA(VkFormat format)
+{
+    return format == VK_FORMAT_B8G8R8A8_UNORM || format == VK_FORMAT_B8G8R8A8_SRGB;
+}
+
+static bool isRGBA(VkFormat format)
+{
+    return format == VK_FORMAT_R8G8B8A8_UNORM || format == VK_FORMAT_R8G8B8A8_SRGB;
+}
+
+void VulkanReadback::init(const VulkanLogicalDevice& logicalDevice, const VulkanReadbackArgs& args)
+{
+    if (!isBGRA(args.format) && !isRGBA(args.format))
+    {
+        throw std::runtime_error("readback supports 8-bit RGBA/BGRA formats only.");
+    }
+    if (args.slotCount == 0)
+    {
+        throw std::runtime_error("readback needs at least one slot.");
+    }
+
+    this->logicalDevice = &logicalDevice;
+    this->args = args;
+    this->slotSize = (VkDeviceSize)args.extent.width * args.extent.height * 4;
+
+    VkCommandPoolCreateInfo cpci = {};
+    cpci.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    cpci.pNext = nullptr;
+    cpci.queueFamilyIndex = logicalDevice.queueFamilyIndex;
+    cpci.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    if (VK_SUCCESS != vkCreateCommandPool(logicalDevice.device, &cpci, nullptr, commandPool.put(logicalDevice.device)))
+    {
+        throw std::runtime_error("Create readback command-pool failed.");
+    }
+
+    slots.reset(new Slot[args.slotCount]);
+    for (uint32_t i = 0; i < args.slotCount; i++)
+    {
+        auto& slot = slots[i];
+
+        VulkanBufferArgs bufferArgs = {};
+        bufferArgs.size = slotSize;
+        bufferArgs.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        bufferArgs.memoryProps = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+        bufferArgs.preferredMemoryProps = VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+        bufferArgs.mapped = true;
+        slot.buffer = logicalDevice.createBuffer(bufferArgs);
+
+        VkCommandBufferAllocateInfo cbai = {};
+        cbai.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        cbai.pNext = nullptr;
+        cbai.commandPool = commandPool;
+        cbai.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        cbai.commandBufferCount = 1;
+        if (VK_SUCCESS != vkAllocateCommandBuffers(logicalDevice.device, &cbai, &slot.commandBuffer))
+        {
+            throw std::runtime_error("Allocate readback command-buffer failed.");
+        }
+
+        slot.fence = logicalDevice.createFence();
+    }
+
+    running = true;
+    worker = std::thread(&VulkanReadback::run, this);
+}
+
+void VulkanReadback::quit()
+{
+    if (logicalDevice == nullptr)
+        return;
+
+    // shutdown only: drain the copies that are still on the GPU.
+    waitForCopies();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+    }
+    condition.notify_all();
+    if (worker.joinable())
+        worker.join();
+
+    for (uint32_t i = 0; i < args.slotCount; i++)
+    {
+        auto& slot = slots[i];
+        logicalDevice->destroyFence(slot.fence);
+        logicalDevice->destroyBuffer(slot.buffer);
+    }
+    slots.reset();
+
+    commandPool.reset();
+    logicalDevice = nullptr;
+}
+
+bool VulkanReadback::capture(
+    VkImage image, VkImageLayout layout, uint64_t frame,
+    VkSemaphore waitSemaphore, VkSemaphore signalSemaphore)
+{
+    Slot* slot = findFreeSlot();
+    // offline, the oldest copy is waited for rather than the frame lost.
+    while (slot == nullptr && !args.dropWhenBusy)
+    {
+        waitForCopies();
+        std::unique_lock<std::mutex> lock(mutex);
+        freed.wait(lock, [this] {
+            for (uint32_t i = 0; i < args.slotCount; i++)
+            {
+                if (slots[i].state == SLOT_FREE)
+                    return true;
+            }
+            return false;
+        });
+        lock.unlock();
+        slot = findFreeSlot();
+    }
+
+    if (slot == nullptr)
+    {
+        dropped++;
+        logicalDevice->submit(VK_NULL_HANDLE,
+            waitSemaphore, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+            signalSemaphore);
+        return false;
+    }
+
+    VkCommandBuffer cmd = slot->commandBuffer;
+    vkResetCommandBuffer(cmd, 0);
+
+    VkCommandBufferBeginInfo cbbi = {};
+    cbbi.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    cbbi.pNext = nullptr;
+    cbbi.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    cbbi.pInheritanceInfo = nullptr;
+    if (VK_SUCCESS != vkBeginCommandBuffer(cmd, &cbbi))
+    {
+        throw std::runtime_error("Begin readback command-buffer failed.");
+    }
+
+    VkImageMemoryBarrier imb = {};
+    imb.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    imb.pNext = nullptr;
+    imb.srcAccessMask = 0;
+    imb.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    imb.oldLayout = layout;
+    imb.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    imb.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    imb.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    imb.image = image;
+    imb.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+    vkCmdPipelineBarrier(cmd,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+        0, 0, nullptr, 0, nullptr, 1, &imb);
+
+    VkBufferImageCopy region = {};
+    region.bufferOffset = 0;
+    region.bufferRowLength = 0;
+    region.bufferImageHeight = 0;
+    region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+    region.imageOffset = { 0, 0, 0 };
+    region.imageExtent = { args.extent.width, args.extent.height, 1 };
+    vkCmdCopyImageToBuffer(cmd, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot->buffer.handle, 1, &region);
+
+    imb.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    imb.dstAccessMask = 0;
+    imb.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    imb.newLayout = layout;
+
+    VkBufferMemoryBarrier bmb = {};
+    bmb.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    bmb.pNext = nullptr;
+    bmb.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    bmb.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    bmb.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    bmb.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    bmb.buffer = slot->buffer.handle;
+    bmb.offset = 0;
+    bmb.size = VK_WHOLE_SIZE;
+    vkCmdPipelineBarrier(cmd,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT | VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+        0, 0, nullptr, 1, &bmb, 1, &imb);
+
+    if (VK_SUCCESS != vkEndCommandBuffer(cmd))
+    {
+        throw std::runtime_error("End readback command-buffer failed.");
+    }
+
+    vkResetFences(logicalDevice->device, 1, slot->fence.address());
+    slot->frame = frame;
+    slot->state = SLOT_IN_FLIGHT;
+    logicalDevice->submit(cmd,
+        waitSemaphore, VK_PIPELINE_STAGE_TRANSFER_BIT,
+        signalSemaphore, slot->fence);
+
+    return true;
+}
+
+void VulkanReadback::poll()
+{
+    bool queued = false;
+    for (uint32_t i = 0; i < args.slotCount; i++)
+    {
+        auto& slot = slots[i];
+        if (slot.state != SLOT_IN_FLIGHT)
+            continue;
+        if (vkGetFenceStatus(logicalDevice->device, slot.fence) != VK_SUCCESS)
+            continue;
+
+        slot.state = SLOT_ENCODING;
+        std::lock_guard<std::mutex> lock(mutex);
+        pending.push_back(&slot);
+        encoding++;
+        queued = true;
+    }
+    if (queued)
+        condition.notify_one();
+}
+
+void VulkanReadback::flush()
+{
+    waitForCopies();
+    std::unique_lock<std::mutex> lock(mutex);
+    freed.wait(lock, [this] { return encoding == 0; });
+}
+
+VulkanReadback::Slot* VulkanReadback::findFreeSlot()
+{
+    for (uint32_t i = 0; i < args.slotCount; i++)
+    {
+        auto& candidate = slots[(nextSlot + i) % args.slotCount];
+        if (candidate.state == SLOT_FREE)
+        {
+            nextSlot = (nextSlot + i + 1) % args.slotCount;
+            return &candidate;
+        }
+    }
+    return nullptr;
+}
+
+// Hands every copy still on the GPU to the worker once it is done.
+void VulkanReadback::waitForCopies()
+{
+    for (uint32_t i = 0; i < args.slotCount; i++)
+    {
+        if (slots[i].state == SLOT_IN_FLIGHT)
+            vkWaitForFences(logicalDevice->device, 1, slots[i].fence.address(), VK_TRUE, std::numeric_limits<uint64_t>::max());
+    }
+    this->poll();
+}
+
+void VulkanReadback::encode(Slot& slot)
+{
+    if ((slot.buffer.memoryFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) == 0)
+    {
+        VkMappedMemoryRange range = {};
+        range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+        range.pNext = nullptr;
+        range.memory = slot.buffer.memory;
+        range.offset = 0;
+        range.size = VK_WHOLE_SIZE;
+        vkInvalidateMappedMemoryRanges(logicalDevice->device, 1, &range);
+    }
+
+    VulkanReadbackResult result;
+    result.frame = slot.frame;
+    result.width = args.extent.width;
+    result.height = args.extent.height;
+    result.format = args.format;
+    result.encoding = args.encoding;
+
+    const uint8_t* pixels = (const uint8_t*)slot.buffer.mapped;
+    if (args.encoding == VulkanReadbackEncoding::PNG)
+        result.data = encodePNG(pixels, result.width, result.height, isBGRA(args.format));
+    else
+        result.data.assign(pixels, pixels + slotSize);
+
+    // the mapping is no longer read, the GPU may overwrite it again.
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        slot.state = SLOT_FREE;
+    }
+    freed.notify_all();
+
+    if (args.callback)
+        args.callback(result);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        encoding--;
+    }
+    freed.notify_all();
+}
+
+void VulkanReadback::run()
+{
+    for (;;)
+    {
+        Slot* slot = nullptr;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [this] { return !pending.empty() || !running; });
+            if (pending.empty())
+                return;
+            slot = pending.front();
+            pending.pop_front();
+        }
+        this->encode(*slot);
+    }
+}
+
+static uint32_t crc32(uint32_t crc, const uint8_t* data, size_t size)
+{
+    static const std::array<uint32_t, 256> table = [] {
+        std::array<uint32_t, 256> t = {};
+        for (uint32_t n = 0; n < 256; n++)
+        {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++)
+                c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            t[n] = c;
+        }
+        return t;
+    }();
+
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++)
+        crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+static void writeU32BE(std::vector<uint8_t>& out, uint32_t v)
+{
+    out.push_back((uint8_t)(v >> 24));
+    out.push_back((uint8_t)(v >> 16));
+    out.push_back((uint8_t)(v >> 8));
+    out.push_back((uint8_t)(v));
+}
+
+static void writeChunk(std::vector<uint8_t>& out, const char* type, const uint8_t* data, size_t size)
+{
+    writeU32BE(out, (uint32_t)size);
+    size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data, data + size);
+    writeU32BE(out, crc32(0, out.data() + start, size + 4));
+}
+
+// Uncompressed (stored deflate blocks) PNG: the encoder is memory-bound, which keeps
+// the worker ahead of the render loop at video frame rates.
+std::vector<uint8_t> encodePNG(const uint8_t* rgba, uint32_t width, uint32_t height, bool bgra)
+{
+    const size_t rowSize = (size_t)width * 4 + 1;
+    std::vector<uint8_t> raw(rowSize * height);
+    for (uint32_t y = 0; y < height; y++)
+    {
+        uint8_t* dst = raw.data() + rowSize * y;
+        const uint8_t* src = rgba + (size_t)width * 4 * y;
+        dst[0] = 0;
+        if (bgra)
+        {
+            for (uint32_t x = 0; x < width; x++)
+            {
+                dst[1 + x * 4 + 0] = src[x * 4 + 2];
+                dst[1 + x * 4 + 1] = src[x * 4 + 1];
+                dst[1 + x * 4 + 2] = src[x * 4 + 0];
+                dst[1 + x * 4 + 3] = src[x * 4 + 3];
+            }
+        }
+        else
+        {
+            memcpy(dst + 1, src, (size_t)width * 4);
+        }
+    }
+
+    std::vector<uint8_t> zlib;
+    zlib.reserve(raw.size() + raw.size() / 65535 * 5 + 16);
+    zlib.push_back(0x78);
+    zlib.push_back(0x01);
+    uint32_t a = 1, b = 0;
+    size_t offset = 0;
+    do
+    {
+        size_t size = std::min<size_t>(raw.size() - offset, 65535);
+        bool last = offset + size == raw.size();
+        zlib.push_back(last ? 1 : 0);
+        zlib.push_back((uint8_t)(size & 0xff));
+        zlib.push_back((uint8_t)(size >> 8));
+        zlib.push_back((uint8_t)(~size & 0xff));
+        zlib.push_back((uint8_t)((~size >> 8) & 0xff));
+        zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + size);
+        // adler32, reducing once per 5552 bytes as zlib does.
+        for (size_t i = offset; i < offset + size; )
+        {
+            size_t end = std::min(offset + size, i + 5552);
+            for (; i < end; i++)
+            {
+                a += raw[i];
+                b += a;
+            }
+            a %= 65521;
+            b %= 65521;
+        }
+        offset += size;
+    } while (offset < raw.size());
+    writeU32BE(zlib, (b << 16) | a);
+
+    std::vector<uint8_t> png = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    uint8_t ihdr[13] = {
+        (uint8_t)(width >> 24), (uint8_t)(width >> 16), (uint8_t)(width >> 8), (uint8_t)width,
+        (uint8_t)(height >> 24), (uint8_t)(height >> 16), (uint8_t)(height >> 8), (uint8_t)height,
+        8, 6, 0, 0, 0
+    };
+    writeChunk(png, "IHDR", ihdr, sizeof(ihdr));
+    writeChunk(png, "IDAT", zlib.data(), zlib.size());
+    writeChunk(png, "IEND", nullptr, 0);
+    return png;
+}
@@ -0,0 +1,105 @@
+#ifndef _LIBVK_READBACK_H_
+#define _LIBVK_READBACK_H_
+
+#include "libvk.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+enum class VulkanReadbackEncoding
+{
+    Raw,
+    PNG
+};
+
+struct VulkanReadbackResult
+{
+    uint64_t frame = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    VkFormat format;
+    VulkanReadbackEncoding encoding;
+    std::vector<uint8_t> data;
+};
+
+// Invoked on the readback worker thread, never on the render thread.
+typedef std::function<void(VulkanReadbackResult& result)> VulkanReadbackCallback;
+
+struct VulkanReadbackArgs
+{
+    VkExtent2D extent;
+    VkFormat format;
+    uint32_t slotCount = 2;
+    VulkanReadbackEncoding encoding = VulkanReadbackEncoding::PNG;
+    VulkanReadbackCallback callback;
+    bool dropWhenBusy = true;   // false: capture() waits for a slot, for offline rendering
+};
+
+// Copies images into a ring of host-visible buffers, one slot per frame in flight.
+// capture() only records and submits; poll() picks up finished copies without
+// blocking and hands them to a worker thread for encoding. A slot is reused once
+// its callback returned, so nothing on the render thread waits for the GPU.
+class VulkanReadback
+{
+    enum SlotState
+    {
+        SLOT_FREE,
+        SLOT_IN_FLIGHT,
+        SLOT_ENCODING
+    };
+
+    struct Slot
+    {
+        VulkanBuffer buffer;
+        VkCommandBuffer commandBuffer = nullptr;
+        VulkanFenceHandle fence;
+        uint64_t frame = 0;
+        std::atomic<int> state{ SLOT_FREE };
+    };
+
+    const VulkanLogicalDevice* logicalDevice = nullptr;
+    VulkanReadbackArgs args;
+    VkDeviceSize slotSize = 0;
+    VulkanCommandPoolHandle commandPool;
+    std::unique_ptr<Slot[]> slots;
+    size_t nextSlot = 0;
+    uint64_t dropped = 0;
+
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::deque<Slot*> pending;
+    std::condition_variable freed;     // a slot was freed or a callback returned
+    uint32_t encoding = 0;             // handed to the worker, callback not yet returned
+    bool running = false;
+
+public:
+    void init(const VulkanLogicalDevice& logicalDevice, const VulkanReadbackArgs& args);
+    void quit();
+
+    // Copies `image` (currently in `layout`, left in `layout`) once `waitSemaphore`
+    // is signaled, then signals `signalSemaphore`. When every slot is busy the frame
+    // is dropped, but the semaphores are still chained so presentation is unaffected.
+    bool capture(VkImage image, VkImageLayout layout, uint64_t frame,
+        VkSemaphore waitSemaphore, VkSemaphore signalSemaphore);
+
+    void poll();
+    // Blocks until every capture so far went through the callback.
+    void flush();
+
+    uint64_t droppedFrames() const { return dropped; }
+
+private:
+    Slot* findFreeSlot();
+    void waitForCopies();
+    void encode(Slot& slot);
+    void run();
+};
+
+std::vector<uint8_t> encodePNG(const uint8_t* rgba, uint32_t width, uint32_t height, bool bgra);
+
+#endif//_LIBVK_READBACK_H_
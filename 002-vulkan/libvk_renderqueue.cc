@@ -0,0 +1,341 @@
+
+#include "libvk_renderqueue.h"
+#include "libvk_capture.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+// Positive floats keep their order as unsigned integers; the top 24 bits are
+// plenty for sorting.
+static uint64_t depthBits(float depth)
+{
+    if (!(depth > 0.0f))
+        return 0;
+    uint32_t bits;
+    memcpy(&bits, &depth, sizeof(bits));
+    return bits >> 8;
+}
+
+// 0 is "none", so a missing descriptor set sorts before every bound one.
+static uint64_t idBits(uint32_t id)
+{
+    return id == VULKAN_RENDER_QUEUE_NONE ? 0 : (uint64_t)id + 1;
+}
+
+uint32_t VulkanRenderQueue::addPipeline(VkPipeline pipeline, VkPipelineLayout layout)
+{
+    if (pipelines.size() >= VULKAN_RENDER_QUEUE_MAX_IDS)
+    {
+        throw std::runtime_error("render queue: too many pipelines.");
+    }
+    pipelines.push_back({ pipeline, layout });
+    return (uint32_t)pipelines.size() - 1;
+}
+
+uint32_t VulkanRenderQueue::addDescriptorSet(VkDescriptorSet set)
+{
+    if (descriptorSets.size() >= VULKAN_RENDER_QUEUE_MAX_IDS)
+    {
+        throw std::runtime_error("render queue: too many descriptor sets.");
+    }
+    descriptorSets.push_back(set);
+    return (uint32_t)descriptorSets.size() - 1;
+}
+
+uint32_t VulkanRenderQueue::addGeometry(const VulkanDrawGeometry& geometry)
+{
+    geometries.push_back(geometry);
+    return (uint32_t)geometries.size() - 1;
+}
+
+void VulkanRenderQueue::setBackToFront(uint32_t pass, bool enable)
+{
+    if (enable)
+        backToFront |= (uint16_t)(1u << pass);
+    else
+        backToFront &= (uint16_t)~(1u << pass);
+}
+
+void VulkanRenderQueue::reset()
+{
+    this->clear();
+    pipelines.clear();
+    descriptorSets.clear();
+    geometries.clear();
+    backToFront = 0;
+}
+
+uint64_t VulkanRenderQueue::key(const VulkanDrawItem& item) const
+{
+    uint64_t pass = (uint64_t)item.pass << 60;
+    uint64_t state = (idBits(item.pipeline) << 24) | (idBits(item.descriptorSet) << 12) | idBits(item.material);
+    uint64_t depth = depthBits(item.depth);
+    if ((backToFront >> item.pass) & 1u)
+        return pass | ((~depth & 0xffffffull) << 36) | state;
+    return pass | (state << 24) | depth;
+}
+
+void VulkanRenderQueue::push(const VulkanDrawItem& item)
+{
+    if (item.pass >= VULKAN_RENDER_QUEUE_PASSES || item.pipeline >= pipelines.size() || item.geometry >= geometries.size() ||
+        (item.descriptorSet != VULKAN_RENDER_QUEUE_NONE && item.descriptorSet >= descriptorSets.size()) ||
+        (item.material != VULKAN_RENDER_QUEUE_NONE && item.material >= descriptorSets.size()))
+    {
+        throw std::runtime_error("render queue: draw item refers to an unknown id.");
+    }
+    keys.push_back(this->key(item));
+    order.push_back((uint32_t)items.size());
+    items.push_back(item);
+    sorted = false;
+}
+
+void VulkanRenderQueue::clear()
+{
+    items.clear();
+    keys.clear();
+    order.clear();
+    sorted = true;
+}
+
+void VulkanRenderQueue::sort()
+{
+    if (sorted)
+        return;
+    size_t count = keys.size();
+    if (count < 2)
+    {
+        sorted = true;
+        return;
+    }
+    scratchKeys.resize(count);
+    scratchOrder.resize(count);
+
+    // one pass over the keys builds the histograms of all eight digits.
+    uint32_t histograms[8][256] = {};
+    for (size_t i = 0; i < count; i++)
+    {
+        uint64_t k = keys[i];
+        for (int d = 0; d < 8; d++)
+            histograms[d][(k >> (d * 8)) & 0xff]++;
+    }
+
+    uint64_t* srcKeys = keys.data();
+    uint32_t* srcOrder = order.data();
+    uint64_t* dstKeys = scratchKeys.data();
+    uint32_t* dstOrder = scratchOrder.data();
+    for (int d = 0; d < 8; d++)
+    {
+        uint32_t* histogram = histograms[d];
+        if (histogram[(srcKeys[0] >> (d * 8)) & 0xff] == count)
+            continue;
+
+        uint32_t offset = 0;
+        for (int b = 0; b < 256; b++)
+        {
+            uint32_t n = histogram[b];
+            histogram[b] = offset;
+            offset += n;
+        }
+        for (size_t i = 0; i < count; i++)
+        {
+            uint32_t slot = histogram[(srcKeys[i] >> (d * 8)) & 0xff]++;
+            dstKeys[slot] = srcKeys[i];
+            dstOrder[slot] = srcOrder[i];
+        }
+        std::swap(srcKeys, dstKeys);
+        std::swap(srcOrder, dstOrder);
+    }
+    if (srcKeys != keys.data())
+    {
+        keys.swap(scratchKeys);
+        order.swap(scratchOrder);
+    }
+    sorted = true;
+}
+
+void VulkanRenderQueue::sort(VulkanJobSystem& jobs)
+{
+    const size_t MIN_CHUNK = 16384;
+    size_t count = keys.size();
+    size_t chunkCount = std::min((size_t)jobs.threadCount(), count / MIN_CHUNK);
+    if (sorted || chunkCount < 2)
+    {
+        this->sort();
+        return;
+    }
+    size_t chunkSize = (count + chunkCount - 1) / chunkCount;
+    scratchKeys.resize(count);
+    scratchOrder.resize(count);
+
+    // bits that differ between any two keys; rounds over constant digits are skipped.
+    std::vector<uint64_t> varying(chunkCount, 0);
+    VulkanJobCounter counter;
+    VulkanJobRange findVarying = [&](size_t begin, size_t end) {
+        size_t c = begin / chunkSize;
+        uint64_t first = keys[begin], diff = 0;
+        for (size_t i = begin; i < end; i++)
+            diff |= keys[i] ^ first;
+        varying[c] = diff | (first ^ keys[0]);
+    };
+    jobs.parallelFor(count, chunkSize, findVarying, &counter);
+    jobs.wait(counter);
+    uint64_t diff = 0;
+    for (auto v : varying)
+        diff |= v;
+
+    // per round: every chunk counts its digits, the offsets are laid out chunk by
+    // chunk within each bucket, then every chunk scatters its own range. Chunks
+    // keep their order, so each round stays stable.
+    std::vector<uint32_t> histograms(chunkCount * 256);
+    uint64_t* srcKeys = keys.data();
+    uint32_t* srcOrder = order.data();
+    uint64_t* dstKeys = scratchKeys.data();
+    uint32_t* dstOrder = scratchOrder.data();
+    int shift = 0;
+    // built once, the rounds only change what they capture by reference.
+    VulkanJobRange countDigits = [&](size_t begin, size_t end) {
+        uint32_t* histogram = &histograms[begin / chunkSize * 256];
+        for (size_t i = begin; i < end; i++)
+            histogram[(srcKeys[i] >> shift) & 0xff]++;
+    };
+    VulkanJobRange scatter = [&](size_t begin, size_t end) {
+        uint32_t* histogram = &histograms[begin / chunkSize * 256];
+        for (size_t i = begin; i < end; i++)
+        {
+            uint32_t slot = histogram[(srcKeys[i] >> shift) & 0xff]++;
+            dstKeys[slot] = srcKeys[i];
+            dstOrder[slot] = srcOrder[i];
+        }
+    };
+    for (int d = 0; d < 8; d++)
+    {
+        shift = d * 8;
+        if (((diff >> shift) & 0xff) == 0)
+            continue;
+
+        std::fill(histograms.begin(), histograms.end(), 0);
+        jobs.parallelFor(count, chunkSize, countDigits, &counter);
+        jobs.wait(counter);
+
+        uint32_t offset = 0;
+        for (int b = 0; b < 256; b++)
+        {
+            for (size_t c = 0; c < chunkCount; c++)
+            {
+                uint32_t n = histograms[c * 256 + b];
+                histograms[c * 256 + b] = offset;
+                offset += n;
+            }
+        }
+
+        jobs.parallelFor(count, chunkSize, scatter, &counter);
+        jobs.wait(counter);
+
+        std::swap(srcKeys, dstKeys);
+        std::swap(srcOrder, dstOrder);
+    }
+    if (srcKeys != keys.data())
+    {
+        keys.swap(scratchKeys);
+        order.swap(scratchOrder);
+    }
+    sorted = true;
+}
+
+void VulkanRenderQueue::record(VkCommandBuffer commandBuffer)
+{
+    this->sort();
+    VulkanRenderQueueStats stats;
+
+    uint32_t boundPipeline = VULKAN_RENDER_QUEUE_NONE;
+    VkPipelineLayout boundLayout = VK_NULL_HANDLE;
+    VkDescriptorSet boundSets[2] = { VK_NULL_HANDLE, VK_NULL_HANDLE };
+    VkBuffer boundVertexBuffer = VK_NULL_HANDLE;
+    VkDeviceSize boundVertexOffset = 0;
+    VkBuffer boundIndexBuffer = VK_NULL_HANDLE;
+    VkDeviceSize boundIndexOffset = 0;
+    VkIndexType boundIndexType = VK_INDEX_TYPE_UINT32;
+
+    for (uint32_t index : order)
+    {
+        const VulkanDrawItem& item = items[index];
+        if (item.pipeline != boundPipeline)
+        {
+            const Pipeline& pipeline = pipelines[item.pipeline];
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.handle);
+            boundPipeline = item.pipeline;
+            stats.pipelineBinds++;
+            // sets bound through another layout may be disturbed, bind them again.
+            if (pipeline.layout != boundLayout)
+            {
+                boundLayout = pipeline.layout;
+                boundSets[0] = boundSets[1] = VK_NULL_HANDLE;
+            }
+        }
+
+        VkDescriptorSet sets[2] = {
+            item.descriptorSet != VULKAN_RENDER_QUEUE_NONE ? descriptorSets[item.descriptorSet] : VK_NULL_HANDLE,
+            item.material != VULKAN_RENDER_QUEUE_NONE ? descriptorSets[item.material] : VK_NULL_HANDLE
+        };
+        for (uint32_t s = 0; s < 2; s++)
+        {
+            if (sets[s] == VK_NULL_HANDLE || sets[s] == boundSets[s])
+                continue;
+            // set 0 and 1 changing together go in one call.
+            uint32_t n = s == 0 && sets[1] != VK_NULL_HANDLE && sets[1] != boundSets[1] ? 2 : 1;
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, boundLayout,
+                s, n, &sets[s], 0, nullptr);
+            for (uint32_t k = s; k < s + n; k++)
+                boundSets[k] = sets[k];
+            stats.descriptorSetBinds++;
+            s += n - 1;
+        }
+
+        const VulkanDrawGeometry& geometry = geometries[item.geometry];
+        if (geometry.vertexBuffer != VK_NULL_HANDLE &&
+            (geometry.vertexBuffer != boundVertexBuffer || geometry.vertexOffset != boundVertexOffset))
+        {
+            vkCmdBindVertexBuffers(commandBuffer, 0, 1, &geometry.vertexBuffer, &geometry.vertexOffset);
+            boundVertexBuffer = geometry.vertexBuffer;
+            boundVertexOffset = geometry.vertexOffset;
+            stats.bufferBinds++;
+        }
+        if (geometry.indexBuffer != VK_NULL_HANDLE)
+        {
+            if (geometry.indexBuffer != boundIndexBuffer || geometry.indexOffset != boundIndexOffset ||
+                geometry.indexType != boundIndexType)
+            {
+                vkCmdBindIndexBuffer(commandBuffer, geometry.indexBuffer, geometry.indexOffset, geometry.indexType);
+                boundIndexBuffer = geometry.indexBuffer;
+                boundIndexOffset = geometry.indexOffset;
+                boundIndexType = geometry.indexType;
+                stats.bufferBinds++;
+            }
+            vkCmdDrawIndexed(commandBuffer, geometry.count, item.instanceCount, 0, 0, item.firstInstance);
+        }
+        else
+        {
+            vkCmdDraw(commandBuffer, geometry.count, item.instanceCount, 0, item.firstInstance);
+        }
+        stats.draws++;
+    }
+    std::lock_guard<std::mutex> lock(statsMutex);
+    this->stats = stats;
+}
+
+VulkanRenderQueueStats VulkanRenderQueue::statistics() const
+{
+    std::lock_guard<std::mutex> lock(statsMutex);
+    return stats;
+}
+
+void VulkanRenderQueue::capture(VulkanCapture& capture) const
+{
+    for (uint32_t index : order)
+    {
+        const VulkanDrawItem& item = items[index];
+        bool descriptorSets = item.descriptorSet != VULKAN_RENDER_QUEUE_NONE || item.material != VULKAN_RENDER_QUEUE_NONE;
+        capture.draw(pipelines[item.pipeline].handle, geometries[item.geometry], item.firstInstance, item.instanceCount,
+            descriptorSets);
+    }
+}
@@ -0,0 +1,111 @@
+#ifndef _LIBVK_RENDERQUEUE_H_
+#define _LIBVK_RENDERQUEUE_H_
+
+#include "libvk.h"
+#include "libvk_jobs.h"
+#include <mutex>
+
+#define VULKAN_RENDER_QUEUE_NONE 0xffffffffu
+#define VULKAN_RENDER_QUEUE_PASSES 16u
+#define VULKAN_RENDER_QUEUE_MAX_IDS 4095u   // per table, ids have 12 bits in the key
+
+// Buffers and counts of one draw. Without an index buffer `count` vertices are
+// drawn, e.g. the full-screen quad generated in the vertex shader.
+struct VulkanDrawGeometry
+{
+    VkBuffer vertexBuffer = nullptr;
+    VkDeviceSize vertexOffset = 0;
+    VkBuffer indexBuffer = nullptr;
+    VkDeviceSize indexOffset = 0;
+    VkIndexType indexType = VK_INDEX_TYPE_UINT32;
+    uint32_t count = 0;
+};
+
+// Ids are the values returned by the add* calls of the queue it is pushed to.
+struct VulkanDrawItem
+{
+    uint32_t pass = 0;                                  // < VULKAN_RENDER_QUEUE_PASSES, drawn in order
+    uint32_t pipeline = 0;
+    uint32_t descriptorSet = VULKAN_RENDER_QUEUE_NONE;  // bound at set 0
+    uint32_t material = VULKAN_RENDER_QUEUE_NONE;       // descriptor set bound at set 1
+    uint32_t geometry = 0;
+    float depth = 0.0f;                                 // view-space distance
+    uint32_t firstInstance = 0;                         // e.g. VulkanDrawPacket::transform
+    uint32_t instanceCount = 1;
+};
+
+struct VulkanRenderQueueStats
+{
+    uint32_t draws = 0;
+    uint32_t pipelineBinds = 0;
+    uint32_t descriptorSetBinds = 0;
+    uint32_t bufferBinds = 0;
+};
+
+// Collects draws for one frame, sorts them by a 64-bit key and records them with
+// every redundant bind dropped. Keys are, from the most significant bits:
+//
+//   pass(4) pipeline(12) descriptor set(12) material(12) depth(24)
+//
+// so draws sharing state end up adjacent and opaque draws go front to back
+// within a state bucket. Passes set to back to front (blending) swap the order:
+//
+//   pass(4) inverted depth(24) pipeline(12) descriptor set(12) material(12)
+//
+// The pipeline, descriptor set and geometry tables outlive clear(); items do not.
+// Passes are layers within the render pass or rendering scope being recorded.
+class VulkanRenderQueue
+{
+    struct Pipeline
+    {
+        VkPipeline handle;
+        VkPipelineLayout layout;
+    };
+
+    std::vector<Pipeline> pipelines;
+    std::vector<VkDescriptorSet> descriptorSets;
+    std::vector<VulkanDrawGeometry> geometries;
+    uint16_t backToFront = 0;       // bit per pass
+
+    std::vector<VulkanDrawItem> items;
+    std::vector<uint64_t> keys;
+    std::vector<uint32_t> order;    // item indices, sorted by key after sort()
+    std::vector<uint64_t> scratchKeys;
+    std::vector<uint32_t> scratchOrder;
+    bool sorted = true;
+    mutable std::mutex statsMutex;  // record() may run on several threads
+    VulkanRenderQueueStats stats;
+
+public:
+    uint32_t addPipeline(VkPipeline pipeline, VkPipelineLayout layout);
+    uint32_t addPipeline(const VulkanGraphicsPipeline& pipeline) { return this->addPipeline(pipeline.handle, pipeline.layout); }
+    uint32_t addDescriptorSet(VkDescriptorSet set);
+    uint32_t addGeometry(const VulkanDrawGeometry& geometry);
+    void setBackToFront(uint32_t pass, bool enable);
+    // Drops the tables as well.
+    void reset();
+
+    void push(const VulkanDrawItem& item);
+    void clear();
+    // Least significant digit radix sort, 8 bits per round; rounds in which every
+    // key has the same digit are skipped.
+    void sort();
+    // Same result; histogram and scatter rounds are split across the job system
+    // once the queue is large enough to pay for it.
+    void sort(VulkanJobSystem& jobs);
+
+    // Sorts if needed, then binds and draws everything in key order. The caller
+    // has begun the render pass and set the viewport, the scissor is baked into
+    // the pipelines. Once sorted, several command buffers can record the queue
+    // at the same time.
+    void record(VkCommandBuffer commandBuffer);
+    // The draws of the last record(), in its order, see VulkanCapture.
+    void capture(VulkanCapture& capture) const;
+
+    uint32_t size() const { return (uint32_t)items.size(); }
+    uint64_t key(const VulkanDrawItem& item) const;
+    // Of the last record().
+    VulkanRenderQueueStats statistics() const;
+};
+
+#endif//_LIBVK_RENDERQUEUE_H_
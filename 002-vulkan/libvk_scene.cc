@@ -0,0 +1,381 @@
+
+#include "libvk_scene.h"
+#include <algorithm>
+#include <stdexcept>
+
+template<typename T>
+static void permute(std::vector<T>& values, const std::vector<uint32_t>& order)
+{
+    std::vector<T> sorted;
+    sorted.reserve(order.size());
+    for (auto i : order)
+        sorted.push_back(values[i]);
+    values.swap(sorted);
+}
+
+VulkanEntity VulkanScene::create(const VulkanEntityArgs& args)
+{
+    uint32_t parentSlot = VULKAN_SCENE_NONE;
+    if (args.parent.slot != VULKAN_SCENE_NONE)
+    {
+        this->index(args.parent);
+        parentSlot = args.parent.slot;
+    }
+
+    VulkanEntity entity;
+    if (!freeSlots.empty())
+    {
+        entity.slot = freeSlots.back();
+        freeSlots.pop_back();
+    }
+    else
+    {
+        entity.slot = (uint32_t)slots.size();
+        slots.emplace_back();
+    }
+    Slot& slot = slots[entity.slot];
+    slot.index = (uint32_t)flags.size();
+    entity.generation = slot.generation;
+
+    px.push_back(args.position.x);
+    py.push_back(args.position.y);
+    pz.push_back(args.position.z);
+    qx.push_back(args.rotation.x);
+    qy.push_back(args.rotation.y);
+    qz.push_back(args.rotation.z);
+    qw.push_back(args.rotation.w);
+    sx.push_back(args.scale.x);
+    sy.push_back(args.scale.y);
+    sz.push_back(args.scale.z);
+    bx.push_back(args.boundsCenter.x);
+    by.push_back(args.boundsCenter.y);
+    bz.push_back(args.boundsCenter.z);
+    br.push_back(args.boundsRadius);
+    wx.push_back(0.0f);
+    wy.push_back(0.0f);
+    wz.push_back(0.0f);
+    wr.push_back(0.0f);
+    locals.push_back(VulkanMat4::identity());
+    worlds.push_back(VulkanMat4::identity());
+    parents.push_back(VULKAN_SCENE_NONE);
+    parentSlots.push_back(parentSlot);
+    entitySlots.push_back(entity.slot);
+    meshes.push_back(args.mesh);
+    materials.push_back(args.material);
+    flags.push_back(LOCAL_DIRTY | WORLD_DIRTY);
+
+    structureChanged = true;
+    return entity;
+}
+
+void VulkanScene::destroy(VulkanEntity entity)
+{
+    uint32_t i = this->index(entity);
+    // the slot stays taken until flatten(), so children still find their dead parent.
+    slots[entity.slot].generation++;
+    this->kill(i);
+    structureChanged = true;
+}
+
+bool VulkanScene::alive(VulkanEntity entity) const
+{
+    return entity.slot < slots.size() &&
+        slots[entity.slot].generation == entity.generation &&
+        slots[entity.slot].index != VULKAN_SCENE_NONE;
+}
+
+void VulkanScene::clear()
+{
+    freeSlots.clear();
+    for (uint32_t s = (uint32_t)slots.size(); s-- > 0;)
+    {
+        if (slots[s].index != VULKAN_SCENE_NONE)
+            slots[s].generation++;
+        slots[s].index = VULKAN_SCENE_NONE;
+        freeSlots.push_back(s);
+    }
+    for (auto* v : { &px, &py, &pz, &qx, &qy, &qz, &qw, &sx, &sy, &sz, &bx, &by, &bz, &br, &wx, &wy, &wz, &wr })
+        v->clear();
+    locals.clear();
+    worlds.clear();
+    parents.clear();
+    parentSlots.clear();
+    entitySlots.clear();
+    meshes.clear();
+    materials.clear();
+    flags.clear();
+    structureChanged = false;
+}
+
+void VulkanScene::setParent(VulkanEntity entity, VulkanEntity parent)
+{
+    uint32_t i = this->index(entity);
+    uint32_t parentSlot = VULKAN_SCENE_NONE;
+    if (parent.slot != VULKAN_SCENE_NONE)
+    {
+        for (uint32_t j = this->index(parent); j != VULKAN_SCENE_NONE;)
+        {
+            if (j == i)
+            {
+                throw std::runtime_error("scene entity cannot be parented to itself or a descendant");
+            }
+            j = parentSlots[j] != VULKAN_SCENE_NONE ? slots[parentSlots[j]].index : VULKAN_SCENE_NONE;
+        }
+        parentSlot = parent.slot;
+    }
+    if (parentSlots[i] == parentSlot)
+        return;
+    parentSlots[i] = parentSlot;
+    flags[i] |= WORLD_DIRTY;
+    structureChanged = true;
+}
+
+void VulkanScene::setPosition(VulkanEntity entity, const VulkanVec3& position)
+{
+    uint32_t i = this->index(entity);
+    px[i] = position.x;
+    py[i] = position.y;
+    pz[i] = position.z;
+    flags[i] |= LOCAL_DIRTY;
+}
+
+void VulkanScene::setRotation(VulkanEntity entity, const VulkanQuat& rotation)
+{
+    uint32_t i = this->index(entity);
+    qx[i] = rotation.x;
+    qy[i] = rotation.y;
+    qz[i] = rotation.z;
+    qw[i] = rotation.w;
+    flags[i] |= LOCAL_DIRTY;
+}
+
+void VulkanScene::setScale(VulkanEntity entity, const VulkanVec3& scale)
+{
+    uint32_t i = this->index(entity);
+    sx[i] = scale.x;
+    sy[i] = scale.y;
+    sz[i] = scale.z;
+    flags[i] |= LOCAL_DIRTY;
+}
+
+void VulkanScene::setMesh(VulkanEntity entity, uint32_t mesh, uint32_t material)
+{
+    uint32_t i = this->index(entity);
+    meshes[i] = mesh;
+    materials[i] = material;
+}
+
+void VulkanScene::setBounds(VulkanEntity entity, const VulkanVec3& center, float radius)
+{
+    uint32_t i = this->index(entity);
+    bx[i] = center.x;
+    by[i] = center.y;
+    bz[i] = center.z;
+    br[i] = radius;
+    flags[i] |= WORLD_DIRTY;
+}
+
+VulkanVec3 VulkanScene::position(VulkanEntity entity) const
+{
+    uint32_t i = this->index(entity);
+    return { px[i], py[i], pz[i] };
+}
+
+VulkanQuat VulkanScene::rotation(VulkanEntity entity) const
+{
+    uint32_t i = this->index(entity);
+    return { qx[i], qy[i], qz[i], qw[i] };
+}
+
+VulkanVec3 VulkanScene::scale(VulkanEntity entity) const
+{
+    uint32_t i = this->index(entity);
+    return { sx[i], sy[i], sz[i] };
+}
+
+void VulkanScene::update()
+{
+    stats.reordered = structureChanged;
+    stats.composed = 0;
+    stats.propagated = 0;
+    if (structureChanged)
+        this->flatten();
+    this->composeDirty();
+    this->propagate();
+    stats.entityCount = this->size();
+}
+
+void VulkanScene::collectDraws(const VulkanMat4& viewProj, std::vector<VulkanDrawPacket>& packets,
+    uint32_t first, uint32_t count) const
+{
+    // cullSpheres output, one per thread so ranges can be collected concurrently.
+    static thread_local std::vector<uint32_t> visible;
+
+    first = std::min(first, this->size());
+    count = std::min(count, this->size() - first);
+    VulkanFrustum frustum = VulkanFrustum::fromMatrix(viewProj);
+    visible.resize(count);
+    size_t visibleCount = cullSpheres(frustum, wx.data() + first, wy.data() + first, wz.data() + first, wr.data() + first,
+        count, visible.data());
+
+    const float* m = viewProj.m;
+    for (size_t k = 0; k < visibleCount; k++)
+    {
+        uint32_t i = first + visible[k];
+        if (meshes[i] == VULKAN_SCENE_NONE)
+            continue;
+        VulkanDrawPacket packet;
+        packet.mesh = meshes[i];
+        packet.material = materials[i];
+        packet.transform = i;
+        packet.depth = m[3] * wx[i] + m[7] * wy[i] + m[11] * wz[i] + m[15];
+        packets.push_back(packet);
+    }
+}
+
+uint32_t VulkanScene::index(VulkanEntity entity) const
+{
+    if (!this->alive(entity))
+    {
+        throw std::runtime_error("stale scene entity");
+    }
+    return slots[entity.slot].index;
+}
+
+void VulkanScene::kill(uint32_t index)
+{
+    flags[index] |= DEAD;
+    meshes[index] = VULKAN_SCENE_NONE;
+}
+
+// Drops dead entities and their descendants and stable-sorts the rest by depth.
+void VulkanScene::flatten()
+{
+    uint32_t count = (uint32_t)flags.size();
+    std::vector<uint32_t> depths(count, VULKAN_SCENE_NONE);
+    std::vector<uint32_t> chain;
+    uint32_t maxDepth = 0;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        // walk up to the first entity with a known depth, then assign on the way down.
+        uint32_t j = i;
+        while (j != VULKAN_SCENE_NONE && depths[j] == VULKAN_SCENE_NONE)
+        {
+            chain.push_back(j);
+            j = parentSlots[j] != VULKAN_SCENE_NONE ? slots[parentSlots[j]].index : VULKAN_SCENE_NONE;
+        }
+        uint32_t depth = j != VULKAN_SCENE_NONE ? depths[j] + 1 : 0;
+        bool dead = j != VULKAN_SCENE_NONE && (flags[j] & DEAD) != 0;
+        for (size_t c = chain.size(); c-- > 0; depth++)
+        {
+            uint32_t k = chain[c];
+            if (dead && (flags[k] & DEAD) == 0)
+            {
+                slots[entitySlots[k]].generation++;
+                this->kill(k);
+            }
+            dead = (flags[k] & DEAD) != 0;
+            depths[k] = depth;
+            maxDepth = std::max(maxDepth, depth);
+        }
+        chain.clear();
+    }
+
+    std::vector<uint32_t> offsets(maxDepth + 2, 0);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if ((flags[i] & DEAD) == 0)
+            offsets[depths[i] + 1]++;
+    }
+    for (uint32_t d = 1; d < offsets.size(); d++)
+        offsets[d] += offsets[d - 1];
+    std::vector<uint32_t> order(offsets.back());
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if ((flags[i] & DEAD) == 0)
+            order[offsets[depths[i]]++] = i;
+        else
+        {
+            slots[entitySlots[i]].index = VULKAN_SCENE_NONE;
+            freeSlots.push_back(entitySlots[i]);
+        }
+    }
+
+    for (auto* v : { &px, &py, &pz, &qx, &qy, &qz, &qw, &sx, &sy, &sz, &bx, &by, &bz, &br, &wx, &wy, &wz, &wr })
+        permute(*v, order);
+    permute(locals, order);
+    permute(worlds, order);
+    permute(parentSlots, order);
+    permute(entitySlots, order);
+    permute(meshes, order);
+    permute(materials, order);
+    permute(flags, order);
+
+    for (uint32_t i = 0; i < (uint32_t)order.size(); i++)
+        slots[entitySlots[i]].index = i;
+    parents.resize(order.size());
+    for (uint32_t i = 0; i < (uint32_t)order.size(); i++)
+        parents[i] = parentSlots[i] != VULKAN_SCENE_NONE ? slots[parentSlots[i]].index : VULKAN_SCENE_NONE;
+
+    structureChanged = false;
+}
+
+// Recomposes runs of flagged local matrices in batches.
+void VulkanScene::composeDirty()
+{
+    uint32_t count = (uint32_t)flags.size();
+    for (uint32_t i = 0; i < count;)
+    {
+        if ((flags[i] & LOCAL_DIRTY) == 0)
+        {
+            i++;
+            continue;
+        }
+        uint32_t end = i + 1;
+        while (end < count && (flags[end] & LOCAL_DIRTY) != 0)
+            end++;
+
+        VulkanTransformArrays in;
+        in.px = px.data() + i; in.py = py.data() + i; in.pz = pz.data() + i;
+        in.qx = qx.data() + i; in.qy = qy.data() + i; in.qz = qz.data() + i; in.qw = qw.data() + i;
+        in.sx = sx.data() + i; in.sy = sy.data() + i; in.sz = sz.data() + i;
+        composeTransforms(in, locals.data() + i, end - i);
+        for (uint32_t k = i; k < end; k++)
+            flags[k] = (flags[k] & ~LOCAL_DIRTY) | WORLD_DIRTY;
+        stats.composed += end - i;
+        i = end;
+    }
+}
+
+// Parents come first, so one forward pass sees every parent already updated.
+void VulkanScene::propagate()
+{
+    uint32_t count = (uint32_t)flags.size();
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint32_t parent = parents[i];
+        if (parent != VULKAN_SCENE_NONE && (flags[parent] & WORLD_DIRTY) != 0)
+            flags[i] |= WORLD_DIRTY;
+        if ((flags[i] & WORLD_DIRTY) == 0)
+            continue;
+
+        VulkanMat4& world = worlds[i];
+        world = parent != VULKAN_SCENE_NONE ? worlds[parent] * locals[i] : locals[i];
+
+        VulkanVec3 center = transformPoint(world, VulkanVec3(bx[i], by[i], bz[i]));
+        float scale = 0.0f;
+        for (int c = 0; c < 3; c++)
+        {
+            const float* axis = world.m + c * 4;
+            scale = std::max(scale, axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+        }
+        wx[i] = center.x;
+        wy[i] = center.y;
+        wz[i] = center.z;
+        wr[i] = br[i] * std::sqrt(scale);
+        stats.propagated++;
+    }
+    // cleared afterwards: children test their parent's flag.
+    for (auto& f : flags)
+        f &= ~WORLD_DIRTY;
+}
@@ -0,0 +1,132 @@
+#ifndef _LIBVK_SCENE_H_
+#define _LIBVK_SCENE_H_
+
+#include "libvk_math.h"
+#include <vector>
+
+#define VULKAN_SCENE_NONE 0xffffffffu
+
+// Stable reference to an entity. The slot is reused after destroy(), the
+// generation tells old handles apart.
+struct VulkanEntity
+{
+    uint32_t slot = VULKAN_SCENE_NONE;
+    uint32_t generation = 0;
+};
+
+struct VulkanEntityArgs
+{
+    VulkanEntity parent;            // none: root
+    VulkanVec3 position;
+    VulkanQuat rotation;
+    VulkanVec3 scale = VulkanVec3(1.0f, 1.0f, 1.0f);
+    uint32_t mesh = VULKAN_SCENE_NONE;     // none: not drawn
+    uint32_t material = 0;
+    VulkanVec3 boundsCenter;        // local bounding sphere
+    float boundsRadius = 0.0f;
+};
+
+// What the renderer needs for one visible entity, nothing else.
+struct VulkanDrawPacket
+{
+    uint32_t mesh;
+    uint32_t material;
+    uint32_t transform;     // index into VulkanScene::worldMatrices()
+    float depth;            // view-space distance, for sorting
+};
+
+struct VulkanSceneStats
+{
+    uint32_t entityCount = 0;
+    uint32_t composed = 0;      // local matrices rebuilt by the last update()
+    uint32_t propagated = 0;    // world matrices rebuilt by the last update()
+    bool reordered = false;     // the last update() re-flattened the hierarchy
+};
+
+// Entities live in parallel arrays sorted by hierarchy depth, so every parent
+// precedes its children and world matrices are one linear pass with no pointer
+// chasing. Setters only flag the entity; update() recomposes the flagged local
+// matrices in SIMD batches and pushes world changes down the hierarchy. Creating,
+// destroying and reparenting re-flatten the arrays in O(n) at the next update(),
+// which also destroys the descendants of destroyed entities.
+//
+// Array positions change on re-flattening: draw packets and worldMatrices() are
+// valid until the next update().
+class VulkanScene
+{
+    struct Slot
+    {
+        uint32_t index = VULKAN_SCENE_NONE;     // into the arrays
+        uint32_t generation = 0;
+    };
+
+    enum Flags : uint8_t
+    {
+        LOCAL_DIRTY = 1,
+        WORLD_DIRTY = 2,
+        DEAD = 4
+    };
+
+    std::vector<Slot> slots;
+    std::vector<uint32_t> freeSlots;
+
+    // one element per entity, in hierarchy order once update() has run.
+    std::vector<float> px, py, pz;
+    std::vector<float> qx, qy, qz, qw;
+    std::vector<float> sx, sy, sz;
+    std::vector<float> bx, by, bz, br;      // local bounds
+    std::vector<float> wx, wy, wz, wr;      // world bounds
+    std::vector<VulkanMat4> locals;
+    std::vector<VulkanMat4> worlds;
+    std::vector<uint32_t> parents;          // array index, none for roots
+    std::vector<uint32_t> parentSlots;      // authoritative until re-flattened
+    std::vector<uint32_t> entitySlots;
+    std::vector<uint32_t> meshes;
+    std::vector<uint32_t> materials;
+    std::vector<uint8_t> flags;
+
+    bool structureChanged = false;
+    VulkanSceneStats stats;
+
+public:
+    VulkanEntity create(const VulkanEntityArgs& args = VulkanEntityArgs());
+    void destroy(VulkanEntity entity);
+    bool alive(VulkanEntity entity) const;
+    void clear();
+
+    // Throws if `parent` is `entity` or one of its descendants.
+    void setParent(VulkanEntity entity, VulkanEntity parent);
+    void setPosition(VulkanEntity entity, const VulkanVec3& position);
+    void setRotation(VulkanEntity entity, const VulkanQuat& rotation);
+    void setScale(VulkanEntity entity, const VulkanVec3& scale);
+    void setMesh(VulkanEntity entity, uint32_t mesh, uint32_t material);
+    void setBounds(VulkanEntity entity, const VulkanVec3& center, float radius);
+
+    VulkanVec3 position(VulkanEntity entity) const;
+    VulkanQuat rotation(VulkanEntity entity) const;
+    VulkanVec3 scale(VulkanEntity entity) const;
+    // As of the last update().
+    const VulkanMat4& world(VulkanEntity entity) const { return worlds[this->index(entity)]; }
+
+    // Once per frame, before collecting draws.
+    void update();
+
+    // Appends a packet for every drawable entity whose world bounds touch the
+    // frustum of `viewProj`, in array order. Only reads the scene: disjoint
+    // ranges [first, first + count) can be collected on several threads.
+    void collectDraws(const VulkanMat4& viewProj, std::vector<VulkanDrawPacket>& packets,
+        uint32_t first = 0, uint32_t count = VULKAN_SCENE_NONE) const;
+
+    const VulkanMat4* worldMatrices() const { return worlds.data(); }
+    uint32_t size() const { return (uint32_t)flags.size(); }
+    const VulkanSceneStats& statistics() const { return stats; }
+
+private:
+    uint32_t index(VulkanEntity entity) const;
+    void kill(uint32_t index);
+    void flatten();
+    void composeDirty();
+    void propagate();
+};
+
+#endif//_LIBVK_SCENE_H_
@@ -0,0 +1,258 @@
+
+#include "libvk_sprites.h"
+#include "libvk_capture.h"
+#include "libvk_profiler.h"
+#include "sprite.vert.h"
+#include "sprite.frag.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+
+VulkanSprite VulkanSprite::make(float x, float y, float width, float height, float rotation, uint32_t color)
+{
+    float c = std::cos(rotation);
+    float s = std::sin(rotation);
+    VulkanSprite sprite;
+    sprite.axes[0] = c * width;
+    sprite.axes[1] = s * width;
+    sprite.axes[2] = -s * height;
+    sprite.axes[3] = c * height;
+    sprite.origin[0] = x;
+    sprite.origin[1] = y;
+    sprite.uv[0] = 0.0f;
+    sprite.uv[1] = 0.0f;
+    sprite.uv[2] = 1.0f;
+    sprite.uv[3] = 1.0f;
+    sprite.color = color;
+    return sprite;
+}
+
+void VulkanSpriteBatch::init(const VulkanLogicalDevice& logicalDevice, const VulkanSpriteBatchArgs& args)
+{
+    this->logicalDevice = &logicalDevice;
+    this->args = args;
+    this->args.framesInFlight = std::max(args.framesInFlight, 1u);
+
+    VulkanGraphicsPipelineArgs pipelineArgs = {};
+    pipelineArgs.vert = sprite_vert_spv;
+    pipelineArgs.frag = sprite_frag_spv;
+    pipelineArgs.viewport = { 0.0f, 0.0f, (float)args.extent.width, (float)args.extent.height, 0.0f, 1.0f };
+    pipelineArgs.scissor = { { 0, 0 }, args.extent };
+    pipelineArgs.colorFormat = args.colorFormat;
+    pipelineArgs.depthFormat = args.depthFormat;
+    pipelineArgs.samples = args.samples;
+    pipelineArgs.dynamicRendering = args.dynamicRendering;
+    pipelineArgs.vertexBindings.push_back({ 0, sizeof(VulkanSprite), VK_VERTEX_INPUT_RATE_INSTANCE });
+    pipelineArgs.vertexAttributes.push_back({ 0, 0, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(VulkanSprite, axes) });
+    pipelineArgs.vertexAttributes.push_back({ 1, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(VulkanSprite, origin) });
+    pipelineArgs.vertexAttributes.push_back({ 2, 0, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(VulkanSprite, uv) });
+    pipelineArgs.vertexAttributes.push_back({ 3, 0, VK_FORMAT_R8G8B8A8_UNORM, offsetof(VulkanSprite, color) });
+    pipelineArgs.bindings.push_back({ 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr });
+    pipelineArgs.pushConstantSize = 4 * sizeof(float);
+    pipelineArgs.cullMode = VK_CULL_MODE_NONE;
+    pipelineArgs.depthTest = false;
+    pipelineArgs.blend = true;
+    this->pipeline = logicalDevice.createGraphicsPipeline(pipelineArgs);
+
+    VkDescriptorPoolSize poolSize = { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, std::max(args.maxTextures, 1u) };
+    VkDescriptorPoolCreateInfo dpci = {};
+    dpci.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    dpci.pNext = nullptr;
+    dpci.flags = 0;
+    dpci.maxSets = poolSize.descriptorCount;
+    dpci.poolSizeCount = 1;
+    dpci.pPoolSizes = &poolSize;
+    if (VK_SUCCESS != vkCreateDescriptorPool(logicalDevice.device, &dpci, nullptr, descriptorPool.put(logicalDevice.device)))
+    {
+        throw std::runtime_error("Create sprite descriptor-pool failed.");
+    }
+
+    // written once per frame in order, read once by the GPU: host-visible is
+    // enough, device-local when the heap allows it.
+    VulkanBufferArgs bufferArgs = {};
+    bufferArgs.size = (VkDeviceSize)this->args.framesInFlight * args.maxSprites * sizeof(VulkanSprite);
+    bufferArgs.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+    bufferArgs.memoryProps = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    bufferArgs.preferredMemoryProps = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    bufferArgs.mapped = true;
+    this->instances = logicalDevice.createBuffer(bufferArgs);
+
+    sprites.reserve(args.maxSprites);
+    keys.reserve(args.maxSprites);
+    order.reserve(args.maxSprites);
+    scratch.reserve(args.maxSprites);
+    if (logicalDevice.capture != nullptr)
+        logicalDevice.capture->spriteBatch(this, this->args);
+}
+
+void VulkanSpriteBatch::quit()
+{
+    if (logicalDevice == nullptr)
+        return;
+    logicalDevice->destroyBuffer(instances);
+    descriptorPool.reset();
+    textures.clear();
+    logicalDevice->destroyGraphicsPipeline(pipeline);
+    sprites.clear();
+    keys.clear();
+    order.clear();
+    scratch.clear();
+    runs.clear();
+    logicalDevice = nullptr;
+}
+
+uint32_t VulkanSpriteBatch::addTexture(VkImageView view, VkSampler sampler)
+{
+    if (textures.size() >= args.maxTextures)
+    {
+        throw std::runtime_error("Too many sprite textures.");
+    }
+
+    VkDescriptorSetAllocateInfo dsai = {};
+    dsai.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    dsai.pNext = nullptr;
+    dsai.descriptorPool = descriptorPool;
+    dsai.descriptorSetCount = 1;
+    dsai.pSetLayouts = pipeline.setLayout.address();
+    VkDescriptorSet set;
+    if (VK_SUCCESS != vkAllocateDescriptorSets(logicalDevice->device, &dsai, &set))
+    {
+        throw std::runtime_error("Allocate sprite descriptor-set failed.");
+    }
+
+    VkDescriptorImageInfo image = { sampler, view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+    VkWriteDescriptorSet write = {};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.pNext = nullptr;
+    write.dstSet = set;
+    write.dstBinding = 0;
+    write.dstArrayElement = 0;
+    write.descriptorCount = 1;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    write.pImageInfo = &image;
+    vkUpdateDescriptorSets(logicalDevice->device, 1, &write, 0, nullptr);
+
+    textures.push_back(set);
+    if (logicalDevice->capture != nullptr)
+        logicalDevice->capture->spriteTexture(this, view);
+    return (uint32_t)textures.size() - 1;
+}
+
+void VulkanSpriteBatch::begin(uint64_t frame)
+{
+    regionOffset = (frame % args.framesInFlight) * args.maxSprites * sizeof(VulkanSprite);
+    sprites.clear();
+    keys.clear();
+    runs.clear();
+    stats = VulkanSpriteStats();
+}
+
+void VulkanSpriteBatch::push(const VulkanSprite& sprite, uint32_t texture, uint16_t layer)
+{
+    if (sprites.size() >= args.maxSprites || texture >= textures.size())
+    {
+        stats.dropped++;
+        return;
+    }
+    sprites.push_back(sprite);
+    keys.push_back((uint32_t)layer << 16 | (texture & 0xffff));
+}
+
+// Stable LSD radix sort of indices by key, one pass per byte that is not the
+// same for every key: with a single layer and fewer than 256 textures that is
+// one pass. Input already in order costs one scan.
+void VulkanSpriteBatch::sort()
+{
+    uint32_t count = (uint32_t)keys.size();
+    order.resize(count);
+    for (uint32_t i = 0; i < count; i++)
+        order[i] = i;
+
+    bool sorted = true;
+    uint32_t lowest = ~0u;
+    uint32_t highest = 0;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (i > 0 && keys[i] < keys[i - 1])
+            sorted = false;
+        lowest &= keys[i];
+        highest |= keys[i];
+    }
+    if (sorted)
+        return;
+
+    scratch.resize(count);
+    uint32_t varying = lowest ^ highest;
+    for (uint32_t shift = 0; shift < 32; shift += 8)
+    {
+        if (((varying >> shift) & 0xff) == 0)
+            continue;
+        uint32_t offsets[256] = {};
+        for (uint32_t i = 0; i < count; i++)
+            offsets[(keys[order[i]] >> shift) & 0xff]++;
+        uint32_t sum = 0;
+        for (uint32_t d = 0; d < 256; d++)
+        {
+            uint32_t n = offsets[d];
+            offsets[d] = sum;
+            sum += n;
+        }
+        for (uint32_t i = 0; i < count; i++)
+            scratch[offsets[(keys[order[i]] >> shift) & 0xff]++] = order[i];
+        order.swap(scratch);
+    }
+}
+
+void VulkanSpriteBatch::flush()
+{
+    VULKAN_PROFILE_ZONE("flush sprites");
+    this->sort();
+    // push order and keys: the replay sorts them again.
+    if (logicalDevice->capture != nullptr)
+        logicalDevice->capture->sprites(this, sprites.data(), keys.data(), (uint32_t)sprites.size());
+
+    // sequential writes only: the mapping may be write-combined.
+    VulkanSprite* out = (VulkanSprite*)((uint8_t*)instances.mapped + regionOffset);
+    uint32_t count = (uint32_t)order.size();
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint32_t index = order[i];
+        memcpy(&out[i], &sprites[index], sizeof(VulkanSprite));
+
+        uint32_t texture = keys[index] & 0xffff;
+        if (runs.empty() || runs.back().texture != texture)
+            runs.push_back({ texture, i, 0 });
+        runs.back().count++;
+    }
+    stats.sprites = count;
+    stats.draws = (uint32_t)runs.size();
+}
+
+void VulkanSpriteBatch::record(VkCommandBuffer commandBuffer) const
+{
+    if (logicalDevice->capture != nullptr)
+        logicalDevice->capture->spriteDraw(this);
+    if (runs.empty())
+        return;
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.handle);
+    VkViewport viewport = { 0.0f, 0.0f, (float)args.extent.width, (float)args.extent.height, 0.0f, 1.0f };
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+    // pixels, y down, to NDC.
+    float transform[4] = {
+        2.0f / (float)args.extent.width, 2.0f / (float)args.extent.height,
+        -1.0f, -1.0f
+    };
+    vkCmdPushConstants(commandBuffer, pipeline.layout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+        0, sizeof(transform), transform);
+    VkBuffer buffer = instances.handle;
+    vkCmdBindVertexBuffers(commandBuffer, 0, 1, &buffer, &regionOffset);
+
+    for (const Run& run : runs)
+    {
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.layout,
+            0, 1, &textures[run.texture], 0, nullptr);
+        vkCmdDraw(commandBuffer, 6, run.count, 0, run.first);
+    }
+}
@@ -0,0 +1,97 @@
+#ifndef _LIBVK_SPRITES_H_
+#define _LIBVK_SPRITES_H_
+
+#include "libvk.h"
+
+// Per-instance vertex data of one sprite: a unit quad centered at the origin,
+// mapped to pixels (y down) by two axes and a center.
+struct VulkanSprite
+{
+    float axes[4];      // where the quad's x and y axes end up
+    float origin[2];    // center
+    float uv[4];        // u0, v0, u1, v1
+    uint32_t color;     // RGBA8, red in the low byte; multiplies the texel
+
+    // `width` x `height` centered at (x, y), rotated by `rotation` radians.
+    static VulkanSprite make(float x, float y, float width, float height,
+        float rotation = 0.0f, uint32_t color = 0xffffffffu);
+};
+
+struct VulkanSpriteBatchArgs
+{
+    // must match the pass the batch is recorded into.
+    VkFormat colorFormat;
+    VkFormat depthFormat = VK_FORMAT_UNDEFINED;
+    VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+    bool dynamicRendering = false;
+    VkExtent2D extent;                  // target size, sprite coordinates are pixels of it
+    uint32_t maxSprites = 1u << 18;     // per frame, the rest is dropped
+    uint32_t maxTextures = 256;
+    uint32_t framesInFlight = 2;
+};
+
+struct VulkanSpriteStats
+{
+    uint32_t sprites = 0;
+    uint32_t dropped = 0;
+    uint32_t draws = 0;     // one texture bind each
+};
+
+// Collects sprites for a frame and draws them with as few draws as there are
+// texture changes. push() only appends to CPU arrays; flush() orders them by
+// layer then texture (stable, so within a layer and texture they keep push
+// order) and streams them in that order into a persistently mapped instance
+// buffer, one region per frame in flight. Every texture has a descriptor set
+// of its own, bound once per run of sprites that use it.
+//
+// Sprites on the same layer with different textures may be reordered: put
+// overlapping translucent sprites on different layers when order matters.
+// Not thread-safe.
+class VulkanSpriteBatch
+{
+    struct Run
+    {
+        uint32_t texture;
+        uint32_t first;
+        uint32_t count;
+    };
+
+    const VulkanLogicalDevice* logicalDevice = nullptr;
+    VulkanSpriteBatchArgs args;
+    VulkanGraphicsPipeline pipeline;
+    VulkanDescriptorPoolHandle descriptorPool;
+    std::vector<VkDescriptorSet> textures;
+    VulkanBuffer instances;
+    VkDeviceSize regionOffset = 0;
+
+    std::vector<VulkanSprite> sprites;      // push order
+    std::vector<uint32_t> keys;             // layer << 16 | texture
+    std::vector<uint32_t> order;
+    std::vector<uint32_t> scratch;
+    std::vector<Run> runs;
+    VulkanSpriteStats stats;
+
+public:
+    void init(const VulkanLogicalDevice& logicalDevice, const VulkanSpriteBatchArgs& args);
+    void quit();
+
+    // `view` must be in SHADER_READ_ONLY_OPTIMAL whenever the batch is drawn.
+    uint32_t addTexture(VkImageView view, VkSampler sampler);
+    void setExtent(VkExtent2D extent) { args.extent = extent; }
+
+    // Starts the frame's sprite list. The frame's region of the instance buffer
+    // is overwritten by flush(): call after the frame slot's fence was waited.
+    void begin(uint64_t frame);
+    void push(const VulkanSprite& sprite, uint32_t texture, uint16_t layer = 0);
+    void flush();
+
+    // Inside the render pass (or rendering scope) the batch was created for.
+    void record(VkCommandBuffer commandBuffer) const;
+
+    const VulkanSpriteStats& statistics() const { return stats; }
+
+private:
+    void sort();
+};
+
+#endif//_LIBVK_SPRITES_H_
@@ -0,0 +1,412 @@
+
+#include "libvk_streaming.h"
+#include <fstream>
+
+// frames an entry waits before asking again for detail the budget could not hold.
+static const uint64_t BUDGET_RETRY_FRAMES = 60;
+
+void VulkanTextureStreamer::init(
+    const VulkanLogicalDevice& logicalDevice,
+    VulkanAllocator& allocator,
+    VulkanUploader& uploader,
+    VulkanTextureManager& textures,
+    const VulkanTextureStreamerArgs& args)
+{
+    this->logicalDevice = &logicalDevice;
+    this->allocator = &allocator;
+    this->uploader = &uploader;
+    this->textures = &textures;
+    this->args = args;
+
+    uint32_t memoryType = logicalDevice.findMemoryType(~0u, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    heapIndex = logicalDevice.memoryProps.memoryTypes[memoryType].heapIndex;
+
+    running = true;
+    for (uint32_t i = 0; i < std::max(args.threadCount, 1u); i++)
+        workers.emplace_back(&VulkanTextureStreamer::run, this);
+}
+
+void VulkanTextureStreamer::quit()
+{
+    if (logicalDevice == nullptr)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+        queued.clear();
+    }
+    condition.notify_all();
+    for (auto& worker : workers)
+        worker.join();
+    workers.clear();
+    finished.clear();
+    ready.clear();
+    scratch.clear();
+
+    // replaced images are released by upload-batch callbacks.
+    uploader->flush();
+    uploader->waitIdle();
+
+    for (auto& entry : entries)
+    {
+        if (entry.alive)
+            textures->destroyTexture(entry.texture);
+    }
+    entries.clear();
+    freeIds.clear();
+    stats = VulkanStreamingStats();
+    logicalDevice = nullptr;
+}
+
+VkDeviceSize VulkanTextureStreamer::levelsSize(const Entry& entry, uint32_t baseLevel, uint32_t endLevel) const
+{
+    VkDeviceSize size = 0;
+    for (uint32_t level = baseLevel; level < endLevel; level++)
+    {
+        size += getImageLevelSize(entry.args.format,
+            std::max(entry.args.extent.width >> level, 1u),
+            std::max(entry.args.extent.height >> level, 1u));
+    }
+    return size;
+}
+
+std::vector<uint8_t> VulkanTextureStreamer::readLevels(const std::string& path, uint64_t offset, VkDeviceSize size) const
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open())
+    {
+        throw std::runtime_error("failed to open streamed texture: " + path);
+    }
+
+    std::vector<uint8_t> data((size_t)size);
+    file.seekg((std::streamoff)offset);
+    file.read((char*)data.data(), (std::streamsize)size);
+    if (!file)
+    {
+        throw std::runtime_error("streamed texture is shorter than its mip chain: " + path);
+    }
+    return data;
+}
+
+VulkanStreamedTextureId VulkanTextureStreamer::add(const VulkanStreamedTextureArgs& args)
+{
+    Entry entry;
+    entry.args = args;
+    entry.mipLevels = args.mipLevels != 0 ? args.mipLevels : getFullMipLevels(args.extent);
+    while (entry.tailLevel + 1 < entry.mipLevels &&
+        std::max(args.extent.width >> entry.tailLevel, args.extent.height >> entry.tailLevel) > this->args.tailSize)
+    {
+        entry.tailLevel++;
+    }
+    entry.residentLevel = entry.mipLevels;
+    entry.requestedLevel = entry.tailLevel;
+    entry.lastUsed = frame;
+    entry.alive = true;
+
+    // the whole chain has to be there, so later loads cannot fail on a short file.
+    std::ifstream file(args.path, std::ios::binary | std::ios::ate);
+    if (!file.is_open() || (uint64_t)file.tellg() < args.offset + this->levelsSize(entry, 0, entry.mipLevels))
+    {
+        throw std::runtime_error("streamed texture is missing or too short: " + args.path);
+    }
+    file.close();
+
+    auto tail = this->readLevels(args.path,
+        args.offset + this->levelsSize(entry, 0, entry.tailLevel),
+        this->levelsSize(entry, entry.tailLevel, entry.mipLevels));
+    this->resize(entry, entry.tailLevel, tail.data(), tail.size());
+
+    VulkanStreamedTextureId id;
+    if (!freeIds.empty())
+    {
+        id = freeIds.back();
+        freeIds.pop_back();
+        entry.generation = entries[id].generation + 1;
+        entries[id] = std::move(entry);
+    }
+    else
+    {
+        id = (VulkanStreamedTextureId)entries.size();
+        entries.push_back(std::move(entry));
+    }
+    return id;
+}
+
+void VulkanTextureStreamer::remove(VulkanStreamedTextureId id)
+{
+    Entry& entry = entries.at(id);
+    if (!entry.alive)
+        return;
+
+    stats.residentBytes -= entry.texture.allocation.size;
+    this->retire(entry.texture);
+    entry.alive = false;
+    entry.pending = false;
+    entry.generation++;
+    freeIds.push_back(id);
+}
+
+void VulkanTextureStreamer::request(VulkanStreamedTextureId id, uint32_t level)
+{
+    Entry& entry = entries.at(id);
+    level = std::min(level, entry.tailLevel);
+    entry.requestedLevel = entry.lastUsed == frame ? std::min(entry.requestedLevel, level) : level;
+    entry.lastUsed = frame;
+}
+
+// Replaces the entry's image by one holding levels [baseLevel, mipLevels). Levels
+// missing from the old image come from `data`, the others are copied on the GPU.
+void VulkanTextureStreamer::resize(Entry& entry, uint32_t baseLevel, const uint8_t* data, VkDeviceSize size)
+{
+    uint32_t oldLevel = entry.residentLevel;
+    VkExtent2D extent = {
+        std::max(entry.args.extent.width >> baseLevel, 1u),
+        std::max(entry.args.extent.height >> baseLevel, 1u)
+    };
+    VulkanTexture texture = textures->createImage(entry.args.format, extent, entry.mipLevels - baseLevel,
+        VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
+
+    if (baseLevel < oldLevel)
+        textures->uploadLevels(texture, 0, data, size, oldLevel - baseLevel);
+
+    uint32_t copyLevel = std::max(baseLevel, oldLevel);
+    if (entry.texture.image != nullptr && copyLevel < entry.mipLevels)
+    {
+        textures->copyLevels(entry.texture, copyLevel - oldLevel,
+            texture, copyLevel - baseLevel, entry.mipLevels - copyLevel);
+    }
+
+    stats.residentBytes += texture.allocation.size;
+    stats.residentBytes -= entry.texture.allocation.size;
+    this->retire(entry.texture);
+    entry.texture = texture;
+    entry.residentLevel = baseLevel;
+}
+
+void VulkanTextureStreamer::retire(VulkanTexture& texture)
+{
+    if (texture.image == nullptr)
+        return;
+
+    VkDeviceSize size = texture.allocation.size;
+    retiringBytes += size;
+    uploader->onComplete([this, texture, size]() mutable {
+        textures->destroyTexture(texture);
+        retiringBytes -= size;
+    });
+    texture = VulkanTexture();
+}
+
+// Device-local bytes in use, not counting free space inside the allocator's blocks
+// (new images land there first) nor images about to be released.
+VkDeviceSize VulkanTextureStreamer::currentUsage(VkDeviceSize& limit) const
+{
+    VulkanMemoryBudget budget = logicalDevice->queryMemoryBudget();
+    // the fallback budget already leaves a fifth of the heap to others.
+    limit = budget.reported ? (VkDeviceSize)((double)budget.budget[heapIndex] * args.budgetFraction) : budget.budget[heapIndex];
+
+    VkDeviceSize used = allocator->usedBytes(heapIndex);
+    VkDeviceSize usage = used;
+    if (budget.reported)
+    {
+        VkDeviceSize slack = allocator->allocatedBytes(heapIndex) - used;
+        usage = budget.usage[heapIndex] > slack ? budget.usage[heapIndex] - slack : 0;
+    }
+    return usage > retiringBytes ? usage - retiringBytes : 0;
+}
+
+// Drops the finest levels of the least recently used entries until `bytes` are
+// freed. With `keepRequested` only levels finer than the last request go.
+VkDeviceSize VulkanTextureStreamer::evict(VkDeviceSize bytes, bool keepRequested)
+{
+    std::vector<Entry*>& candidates = scratch;
+    candidates.clear();
+    for (auto& entry : entries)
+    {
+        if (!entry.alive || entry.pending)
+            continue;
+        if (!keepRequested && entry.lastUsed + 1 >= frame)
+            continue;
+        uint32_t floor = keepRequested ? entry.requestedLevel : entry.tailLevel;
+        if (entry.residentLevel < floor)
+            candidates.push_back(&entry);
+    }
+    std::sort(candidates.begin(), candidates.end(),
+        [](const Entry* a, const Entry* b) { return a->lastUsed < b->lastUsed; });
+
+    VkDeviceSize freed = 0;
+    for (auto entry : candidates)
+    {
+        if (freed >= bytes)
+            break;
+
+        uint32_t floor = keepRequested ? entry->requestedLevel : entry->tailLevel;
+        uint32_t level = entry->residentLevel;
+        while (level < floor && freed < bytes)
+        {
+            freed += this->levelsSize(*entry, level, level + 1);
+            level++;
+        }
+        stats.evictedBytes += this->levelsSize(*entry, entry->residentLevel, level);
+        this->resize(*entry, level, nullptr, 0);
+    }
+    return freed;
+}
+
+void VulkanTextureStreamer::update(uint64_t frame)
+{
+    this->frame = frame;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        while (!finished.empty())
+        {
+            ready.push_back(std::move(finished.front()));
+            finished.pop_front();
+        }
+    }
+
+    VkDeviceSize limit = 0;
+    VkDeviceSize usage = this->currentUsage(limit);
+    if (usage > limit)
+    {
+        // someone else grew, or the budget shrank: shed what nobody asked for first.
+        VkDeviceSize excess = usage - limit;
+        VkDeviceSize freed = this->evict(excess, true);
+        if (freed < excess)
+            freed += this->evict(excess - freed, false);
+        usage -= std::min(freed, usage);
+    }
+
+    VkDeviceSize uploaded = 0;
+    while (!ready.empty() && uploaded < args.maxUploadBytesPerFrame)
+    {
+        std::unique_ptr<Load> load = std::move(ready.front());
+        ready.pop_front();
+        stats.pendingLoads--;
+
+        Entry& entry = entries.at(load->id);
+        if (!entry.alive || entry.generation != load->generation)
+            continue;
+        if (load->failed)
+        {
+            // the frame goes on with the levels already resident.
+            entry.pending = false;
+            entry.failed = true;
+            stats.failedLoads++;
+            continue;
+        }
+        if (entry.residentLevel != load->residentLevel)
+        {
+            entry.pending = false;
+            continue;
+        }
+
+        // make room while the entry is still marked pending, so it is not evicted itself.
+        uint32_t baseLevel = load->baseLevel;
+        VkDeviceSize growth = this->levelsSize(entry, baseLevel, entry.residentLevel);
+        if (usage + growth > limit)
+        {
+            VkDeviceSize needed = usage + growth - limit;
+            VkDeviceSize freed = this->evict(needed, true);
+            if (freed < needed)
+                freed += this->evict(needed - freed, false);
+            usage -= std::min(freed, usage);
+        }
+        entry.pending = false;
+
+        // still too big: settle for the finest levels that fit and back off for a while.
+        VkDeviceSize skipped = 0;
+        while (baseLevel < entry.residentLevel && usage + growth > limit)
+        {
+            VkDeviceSize levelSize = this->levelsSize(entry, baseLevel, baseLevel + 1);
+            growth -= levelSize;
+            skipped += levelSize;
+            baseLevel++;
+        }
+        if (baseLevel > load->baseLevel)
+            entry.retryFrame = frame + BUDGET_RETRY_FRAMES;
+        if (baseLevel == entry.residentLevel)
+            continue;
+
+        this->resize(entry, baseLevel, load->data.data() + skipped, load->data.size() - skipped);
+        usage += growth;
+        uploaded += growth;
+        stats.loadedBytes += growth;
+    }
+
+    std::vector<Entry*>& wanted = scratch;
+    wanted.clear();
+    for (auto& entry : entries)
+    {
+        if (entry.alive && !entry.pending && !entry.failed && entry.requestedLevel < entry.residentLevel &&
+            entry.lastUsed + 1 >= frame && entry.retryFrame <= frame)
+        {
+            wanted.push_back(&entry);
+        }
+    }
+    // most recently used first, then the blurriest.
+    std::sort(wanted.begin(), wanted.end(), [](const Entry* a, const Entry* b) {
+        if (a->lastUsed != b->lastUsed)
+            return a->lastUsed > b->lastUsed;
+        return a->residentLevel - a->requestedLevel > b->residentLevel - b->requestedLevel;
+    });
+
+    size_t count = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto entry : wanted)
+        {
+            if (stats.pendingLoads >= args.maxPendingLoads)
+                break;
+
+            std::unique_ptr<Load> load(new Load());
+            load->id = (VulkanStreamedTextureId)(entry - entries.data());
+            load->generation = entry->generation;
+            load->baseLevel = entry->requestedLevel;
+            load->residentLevel = entry->residentLevel;
+            load->path = entry->args.path;
+            load->offset = entry->args.offset + this->levelsSize(*entry, 0, entry->requestedLevel);
+            load->size = this->levelsSize(*entry, entry->requestedLevel, entry->residentLevel);
+            queued.push_back(std::move(load));
+
+            entry->pending = true;
+            stats.pendingLoads++;
+            count++;
+        }
+    }
+    if (count > 0)
+        condition.notify_all();
+
+    stats.usageBytes = usage;
+    stats.budgetBytes = limit;
+}
+
+void VulkanTextureStreamer::run()
+{
+    for (;;)
+    {
+        std::unique_ptr<Load> load;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [this]() { return !running || !queued.empty(); });
+            if (!running)
+                return;
+            load = std::move(queued.front());
+            queued.pop_front();
+        }
+
+        try
+        {
+            load->data = this->readLevels(load->path, load->offset, load->size);
+        }
+        catch (const std::exception&)
+        {
+            load->failed = true;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        finished.push_back(std::move(load));
+    }
+}
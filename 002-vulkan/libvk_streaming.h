@@ -0,0 +1,141 @@
+#ifndef _LIBVK_STREAMING_H_
+#define _LIBVK_STREAMING_H_
+
+#include "libvk_texture.h"
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+typedef uint32_t VulkanStreamedTextureId;
+
+struct VulkanStreamedTextureArgs
+{
+    std::string path;
+    uint64_t offset = 0;            // file offset of level 0, the others follow tightly packed
+    VkFormat format;
+    VkExtent2D extent;
+    uint32_t mipLevels = 0;         // 0: full chain down to 1x1
+};
+
+struct VulkanTextureStreamerArgs
+{
+    uint32_t threadCount = 2;
+    uint32_t tailSize = 128;        // levels this small (in texels per side) are always resident
+    float budgetFraction = 0.9f;    // share of the reported device-local heap budget the process may fill
+    uint32_t maxPendingLoads = 16;
+    VkDeviceSize maxUploadBytesPerFrame = 16ull << 20;
+};
+
+struct VulkanStreamingStats
+{
+    VkDeviceSize residentBytes = 0;
+    VkDeviceSize usageBytes = 0;
+    VkDeviceSize budgetBytes = 0;
+    uint32_t pendingLoads = 0;
+    uint64_t loadedBytes = 0;
+    uint64_t evictedBytes = 0;
+    uint32_t failedLoads = 0;       // reads that failed, see failed()
+};
+
+// Keeps the detail levels of many textures resident on demand. Every texture owns an
+// image holding levels [residentLevel, mipLevels) of its chain; the mip tail is read
+// when the texture is added and never leaves. request() records which level the
+// renderer wants, worker threads read the missing levels from disk, and update()
+// grows the image by uploading them and copying the resident levels across. When
+// the device-local heap is over budget the least recently used textures shrink the
+// same way, first down to what they were last asked for, then down to the tail.
+//
+// A replaced image is destroyed once the upload batch that copied out of it has
+// finished; by then the GPU has also retired every frame that could sample it, as
+// long as views are fetched after update() and the uploader is flushed before the
+// frame is submitted.
+class VulkanTextureStreamer
+{
+    struct Entry
+    {
+        VulkanStreamedTextureArgs args;
+        VulkanTexture texture;
+        uint32_t mipLevels = 0;
+        uint32_t tailLevel = 0;
+        uint32_t residentLevel = 0;
+        uint32_t requestedLevel = 0;
+        bool pending = false;
+        bool alive = false;
+        bool failed = false;        // a load could not be read: stays at what is resident
+        uint32_t generation = 0;
+        uint64_t lastUsed = 0;
+        uint64_t retryFrame = 0;
+    };
+
+    struct Load
+    {
+        VulkanStreamedTextureId id;
+        uint32_t generation;
+        uint32_t baseLevel;
+        uint32_t residentLevel;
+        std::string path;
+        uint64_t offset;
+        VkDeviceSize size;
+        std::vector<uint8_t> data;
+        bool failed = false;
+    };
+
+    const VulkanLogicalDevice* logicalDevice = nullptr;
+    VulkanAllocator* allocator = nullptr;
+    VulkanUploader* uploader = nullptr;
+    VulkanTextureManager* textures = nullptr;
+    VulkanTextureStreamerArgs args;
+    uint32_t heapIndex = 0;
+
+    std::vector<Entry> entries;
+    std::vector<VulkanStreamedTextureId> freeIds;
+    std::deque<std::unique_ptr<Load>> ready;
+    std::vector<Entry*> scratch;    // update() and evict() candidates, kept to avoid per-frame allocation
+    uint64_t frame = 0;
+    VkDeviceSize retiringBytes = 0;
+    VulkanStreamingStats stats;
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::deque<std::unique_ptr<Load>> queued;
+    std::deque<std::unique_ptr<Load>> finished;
+    bool running = false;
+
+public:
+    void init(const VulkanLogicalDevice& logicalDevice, VulkanAllocator& allocator,
+        VulkanUploader& uploader, VulkanTextureManager& textures,
+        const VulkanTextureStreamerArgs& args = VulkanTextureStreamerArgs());
+    void quit();
+
+    // Reads the mip tail synchronously; the texture can be sampled right away.
+    VulkanStreamedTextureId add(const VulkanStreamedTextureArgs& args);
+    void remove(VulkanStreamedTextureId id);
+
+    // Marks the texture as used this frame and asks for `level` as its finest
+    // resident level; several requests in one frame keep the finest.
+    void request(VulkanStreamedTextureId id, uint32_t level);
+
+    // Once per frame on the render thread: applies finished loads, evicts under
+    // budget pressure and schedules new loads.
+    void update(uint64_t frame);
+
+    VkImageView view(VulkanStreamedTextureId id) const { return entries.at(id).texture.view; }
+    uint32_t residentLevel(VulkanStreamedTextureId id) const { return entries.at(id).residentLevel; }
+    // A load could not be read: the texture stays at its resident levels.
+    bool failed(VulkanStreamedTextureId id) const { return entries.at(id).failed; }
+    const VulkanStreamingStats& statistics() const { return stats; }
+
+private:
+    VkDeviceSize levelsSize(const Entry& entry, uint32_t baseLevel, uint32_t endLevel) const;
+    std::vector<uint8_t> readLevels(const std::string& path, uint64_t offset, VkDeviceSize size) const;
+    void resize(Entry& entry, uint32_t baseLevel, const uint8_t* data, VkDeviceSize size);
+    void retire(VulkanTexture& texture);
+    VkDeviceSize currentUsage(VkDeviceSize& limit) const;
+    VkDeviceSize evict(VkDeviceSize bytes, bool keepRequested);
+    void run();
+};
+
+#endif//_LIBVK_STREAMING_H_
@@ -0,0 +1,567 @@
+
+#include "libvk_texture.h"
+#include "libvk_capture.h"
+#include "mipmap.comp.h"
+
+static void hashCombine(size_t& seed, size_t value)
+{
+    seed ^= value + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2);
+}
+
+size_t VulkanSamplerDescHash::operator()(const VulkanSamplerDesc& d) const
+{
+    size_t seed = 0;
+    hashCombine(seed, std::hash<uint32_t>()(d.magFilter | (d.minFilter << 4) | (d.mipmapMode << 8) | (d.compareEnable << 12)));
+    hashCombine(seed, std::hash<uint32_t>()(d.addressModeU | (d.addressModeV << 8) | (d.addressModeW << 16)));
+    hashCombine(seed, std::hash<uint32_t>()(d.compareOp | (d.borderColor << 8)));
+    hashCombine(seed, std::hash<float>()(d.mipLodBias));
+    hashCombine(seed, std::hash<float>()(d.maxAnisotropy));
+    hashCombine(seed, std::hash<float>()(d.minLod));
+    hashCombine(seed, std::hash<float>()(d.maxLod));
+    return seed;
+}
+
+void VulkanSamplerCache::init(const VulkanLogicalDevice& logicalDevice, float maxAnisotropy)
+{
+    this->logicalDevice = &logicalDevice;
+    this->maxAnisotropy = logicalDevice.features.samplerAnisotropy ? maxAnisotropy : 1.0f;
+}
+
+void VulkanSamplerCache::quit()
+{
+    for (auto& it : samplers)
+        vkDestroySampler(logicalDevice->device, it.second, nullptr);
+    samplers.clear();
+}
+
+VkSampler VulkanSamplerCache::get(const VulkanSamplerDesc& desc)
+{
+    // anisotropy is clamped before the lookup so 16x and 64x share one sampler.
+    VulkanSamplerDesc key = desc;
+    key.maxAnisotropy = std::max(1.0f, std::min(desc.maxAnisotropy, maxAnisotropy));
+
+    auto it = samplers.find(key);
+    if (it != samplers.end())
+        return it->second;
+
+    VkSamplerCreateInfo sci = {};
+    sci.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    sci.pNext = nullptr;
+    sci.magFilter = key.magFilter;
+    sci.minFilter = key.minFilter;
+    sci.mipmapMode = key.mipmapMode;
+    sci.addressModeU = key.addressModeU;
+    sci.addressModeV = key.addressModeV;
+    sci.addressModeW = key.addressModeW;
+    sci.mipLodBias = key.mipLodBias;
+    sci.anisotropyEnable = key.maxAnisotropy > 1.0f ? VK_TRUE : VK_FALSE;
+    sci.maxAnisotropy = key.maxAnisotropy;
+    sci.compareEnable = key.compareEnable;
+    sci.compareOp = key.compareOp;
+    sci.minLod = key.minLod;
+    sci.maxLod = key.maxLod;
+    sci.borderColor = key.borderColor;
+    sci.unnormalizedCoordinates = VK_FALSE;
+
+    VkSampler sampler;
+    if (VK_SUCCESS != vkCreateSampler(logicalDevice->device, &sci, nullptr, &sampler))
+    {
+        throw std::runtime_error("Create sampler failed.");
+    }
+    samplers.emplace(key, sampler);
+    return sampler;
+}
+
+uint32_t getFullMipLevels(VkExtent2D extent)
+{
+    uint32_t size = std::max(extent.width, extent.height);
+    uint32_t levels = 1;
+    while (size > 1)
+    {
+        size >>= 1;
+        levels++;
+    }
+    return levels;
+}
+
+static VkImageMemoryBarrier makeImageBarrier(
+    VkImage image, uint32_t baseLevel, uint32_t levelCount,
+    VkImageLayout oldLayout, VkImageLayout newLayout,
+    VkAccessFlags srcAccess, VkAccessFlags dstAccess)
+{
+    VkImageMemoryBarrier imb = {};
+    imb.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    imb.pNext = nullptr;
+    imb.srcAccessMask = srcAccess;
+    imb.dstAccessMask = dstAccess;
+    imb.oldLayout = oldLayout;
+    imb.newLayout = newLayout;
+    imb.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    imb.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    imb.image = image;
+    imb.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, baseLevel, levelCount, 0, 1 };
+    return imb;
+}
+
+static const VkPipelineStageFlags SHADER_READ_STAGES =
+    VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+
+void VulkanTextureManager::init(
+    const VulkanLogicalDevice& logicalDevice,
+    VulkanAllocator& allocator,
+    VulkanUploader& uploader,
+    float maxAnisotropy)
+{
+    this->logicalDevice = &logicalDevice;
+    this->allocator = &allocator;
+    this->uploader = &uploader;
+    samplerCache.init(logicalDevice, maxAnisotropy);
+
+    if (logicalDevice.features.shaderStorageImageWriteWithoutFormat)
+    {
+        VulkanComputePipelineArgs args;
+        args.comp = mipmap_comp_spv;
+        args.bindings = {
+            { 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+            { 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+        };
+        mipmapPipeline = logicalDevice.createComputePipeline(args);
+    }
+}
+
+void VulkanTextureManager::quit()
+{
+    if (logicalDevice == nullptr)
+        return;
+    logicalDevice->destroyComputePipeline(mipmapPipeline);
+    samplerCache.quit();
+    logicalDevice = nullptr;
+}
+
+bool VulkanTextureManager::canBlit(VkFormat format) const
+{
+    VkFormatProperties props;
+    vkGetPhysicalDeviceFormatProperties(logicalDevice->physicalDevice, format, &props);
+    VkFormatFeatureFlags required =
+        VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT |
+        VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    return (props.optimalTilingFeatures & required) == required;
+}
+
+bool VulkanTextureManager::canCompute(VkFormat format) const
+{
+    if (mipmapPipeline.handle == nullptr)
+        return false;
+    VkFormatProperties props;
+    vkGetPhysicalDeviceFormatProperties(logicalDevice->physicalDevice, format, &props);
+    VkFormatFeatureFlags required =
+        VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+    return (props.optimalTilingFeatures & required) == required;
+}
+
+VulkanTexture VulkanTextureManager::createImage(VkFormat format, VkExtent2D extent, uint32_t mipLevels, VkImageUsageFlags usage)
+{
+    VulkanTexture texture;
+    texture.format = format;
+    texture.extent = extent;
+    texture.mipLevels = mipLevels;
+    texture.usage = usage;
+
+    VkImageCreateInfo ici = {};
+    ici.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    ici.pNext = nullptr;
+    ici.flags = 0;
+    ici.imageType = VK_IMAGE_TYPE_2D;
+    ici.format = format;
+    ici.extent = { extent.width, extent.height, 1 };
+    ici.mipLevels = mipLevels;
+    ici.arrayLayers = 1;
+    ici.samples = VK_SAMPLE_COUNT_1_BIT;
+    ici.tiling = VK_IMAGE_TILING_OPTIMAL;
+    ici.usage = usage;
+    ici.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    ici.queueFamilyIndexCount = 0;
+    ici.pQueueFamilyIndices = nullptr;
+    ici.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    if (VK_SUCCESS != vkCreateImage(logicalDevice->device, &ici, nullptr, &texture.image))
+    {
+        throw std::runtime_error("Create texture image failed.");
+    }
+
+    VkMemoryRequirements requirements;
+    vkGetImageMemoryRequirements(logicalDevice->device, texture.image, &requirements);
+    try
+    {
+        texture.allocation = allocator->allocate(requirements,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, VulkanAllocationKind::Optimal);
+    }
+    catch (...)
+    {
+        this->destroyTexture(texture);
+        throw;
+    }
+    vkBindImageMemory(logicalDevice->device, texture.image, texture.allocation.memory, texture.allocation.offset);
+
+    VkImageViewCreateInfo ivci = {};
+    ivci.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    ivci.pNext = nullptr;
+    ivci.image = texture.image;
+    ivci.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    ivci.format = format;
+    ivci.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
+    ivci.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
+    ivci.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
+    ivci.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+    ivci.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, mipLevels, 0, 1 };
+    if (VK_SUCCESS != vkCreateImageView(logicalDevice->device, &ivci, nullptr, &texture.view))
+    {
+        this->destroyTexture(texture);
+        throw std::runtime_error("Create texture image-view failed.");
+    }
+
+    return texture;
+}
+
+VulkanTexture VulkanTextureManager::createTexture(const VulkanTextureArgs& args)
+{
+    uint32_t mipLevels = args.mipLevels != 0 ? args.mipLevels : getFullMipLevels(args.extent);
+    uint32_t dataMipLevels = std::min(std::max(args.dataMipLevels, 1u), mipLevels);
+
+    VkImageUsageFlags usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | args.usage;
+    bool blit = false;
+    if (dataMipLevels < mipLevels)
+    {
+        if (this->canBlit(args.format))
+        {
+            blit = true;
+            usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        }
+        else if (this->canCompute(args.format))
+        {
+            usage |= VK_IMAGE_USAGE_STORAGE_BIT;
+        }
+        else
+        {
+            throw std::runtime_error("texture format supports neither blit nor compute mip generation.");
+        }
+    }
+
+    VulkanTexture texture = this->createImage(args.format, args.extent, mipLevels, usage);
+    if (logicalDevice->capture != nullptr)
+        logicalDevice->capture->texture(texture.view, args);
+    if (args.data == nullptr)
+        return texture;
+
+    this->uploadLevels(texture, 0, args.data, args.size, dataMipLevels);
+    if (dataMipLevels < mipLevels)
+    {
+        if (blit)
+            this->generateMipsBlit(texture, dataMipLevels);
+        else
+            this->generateMipsCompute(texture, dataMipLevels);
+    }
+    return texture;
+}
+
+void VulkanTextureManager::destroyTexture(VulkanTexture& texture)
+{
+    if (texture.view != nullptr)
+    {
+        vkDestroyImageView(logicalDevice->device, texture.view, nullptr);
+        texture.view = nullptr;
+    }
+    if (texture.image != nullptr)
+    {
+        vkDestroyImage(logicalDevice->device, texture.image, nullptr);
+        texture.image = nullptr;
+    }
+    allocator->free(texture.allocation);
+}
+
+void VulkanTextureManager::uploadLevels(
+    VulkanTexture& texture, uint32_t baseLevel,
+    const void* data, VkDeviceSize size, uint32_t levelCount)
+{
+    std::vector<VkBufferImageCopy> regions(levelCount);
+    VkDeviceSize offset = 0;
+    for (uint32_t i = 0; i < levelCount; i++)
+    {
+        uint32_t level = baseLevel + i;
+        uint32_t width = std::max(texture.extent.width >> level, 1u);
+        uint32_t height = std::max(texture.extent.height >> level, 1u);
+
+        auto& region = regions[i];
+        region.bufferOffset = offset;
+        region.bufferRowLength = 0;
+        region.bufferImageHeight = 0;
+        region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1 };
+        region.imageOffset = { 0, 0, 0 };
+        region.imageExtent = { width, height, 1 };
+        offset += getImageLevelSize(texture.format, width, height);
+    }
+    if (offset > size)
+    {
+        throw std::runtime_error("texture data is smaller than its mip levels.");
+    }
+
+    VkDeviceSize alignment = std::max<VkDeviceSize>(getFormatInfo(texture.format).blockSize, 4);
+    VulkanStagingRegion staging = uploader->stage(data, offset, alignment);
+    for (auto& region : regions)
+        region.bufferOffset += staging.offset;
+
+    VkCommandBuffer cmd = uploader->commandBuffer();
+
+    VkImageMemoryBarrier imb = makeImageBarrier(texture.image, baseLevel, levelCount,
+        VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        0, VK_ACCESS_TRANSFER_WRITE_BIT);
+    vkCmdPipelineBarrier(cmd,
+        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+        0, 0, nullptr, 0, nullptr, 1, &imb);
+
+    vkCmdCopyBufferToImage(cmd, staging.buffer, texture.image,
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, (uint32_t)regions.size(), regions.data());
+
+    imb = makeImageBarrier(texture.image, baseLevel, levelCount,
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT);
+    vkCmdPipelineBarrier(cmd,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, SHADER_READ_STAGES | VK_PIPELINE_STAGE_TRANSFER_BIT,
+        0, 0, nullptr, 0, nullptr, 1, &imb);
+}
+
+void VulkanTextureManager::generateMips(VulkanTexture& texture, uint32_t baseLevel)
+{
+    if (baseLevel == 0 || baseLevel >= texture.mipLevels)
+        return;
+    if (this->canBlit(texture.format) && (texture.usage & VK_IMAGE_USAGE_TRANSFER_SRC_BIT) != 0)
+        this->generateMipsBlit(texture, baseLevel);
+    else if (this->canCompute(texture.format) && (texture.usage & VK_IMAGE_USAGE_STORAGE_BIT) != 0)
+        this->generateMipsCompute(texture, baseLevel);
+    else
+        throw std::runtime_error("texture supports neither blit nor compute mip generation.");
+}
+
+void VulkanTextureManager::copyLevels(
+    const VulkanTexture& src, uint32_t srcLevel,
+    VulkanTexture& dst, uint32_t dstLevel, uint32_t levelCount)
+{
+    if (levelCount == 0)
+        return;
+
+    VkCommandBuffer cmd = uploader->commandBuffer();
+
+    VkImageMemoryBarrier barriers[2];
+    barriers[0] = makeImageBarrier(src.image, srcLevel, levelCount,
+        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        0, VK_ACCESS_TRANSFER_READ_BIT);
+    barriers[1] = makeImageBarrier(dst.image, dstLevel, levelCount,
+        VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        0, VK_ACCESS_TRANSFER_WRITE_BIT);
+    vkCmdPipelineBarrier(cmd,
+        SHADER_READ_STAGES | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+        0, 0, nullptr, 0, nullptr, 2, barriers);
+
+    std::vector<VkImageCopy> regions(levelCount);
+    for (uint32_t i = 0; i < levelCount; i++)
+    {
+        auto& region = regions[i];
+        region.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, srcLevel + i, 0, 1 };
+        region.srcOffset = { 0, 0, 0 };
+        region.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, dstLevel + i, 0, 1 };
+        region.dstOffset = { 0, 0, 0 };
+        region.extent = {
+            std::max(src.extent.width >> (srcLevel + i), 1u),
+            std::max(src.extent.height >> (srcLevel + i), 1u),
+            1
+        };
+    }
+    vkCmdCopyImage(cmd,
+        src.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        dst.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        (uint32_t)regions.size(), regions.data());
+
+    barriers[0] = makeImageBarrier(src.image, srcLevel, levelCount,
+        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        0, VK_ACCESS_SHADER_READ_BIT);
+    barriers[1] = makeImageBarrier(dst.image, dstLevel, levelCount,
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT);
+    vkCmdPipelineBarrier(cmd,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, SHADER_READ_STAGES | VK_PIPELINE_STAGE_TRANSFER_BIT,
+        0, 0, nullptr, 0, nullptr, 2, barriers);
+}
+
+// levels [0, baseLevel) are SHADER_READ_ONLY, the rest UNDEFINED; afterwards all
+// levels are SHADER_READ_ONLY.
+void VulkanTextureManager::generateMipsBlit(VulkanTexture& texture, uint32_t baseLevel)
+{
+    VkCommandBuffer cmd = uploader->commandBuffer();
+
+    VkImageMemoryBarrier barriers[2];
+    barriers[0] = makeImageBarrier(texture.image, baseLevel - 1, 1,
+        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+    barriers[1] = makeImageBarrier(texture.image, baseLevel, texture.mipLevels - baseLevel,
+        VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        0, VK_ACCESS_TRANSFER_WRITE_BIT);
+    vkCmdPipelineBarrier(cmd,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+        0, 0, nullptr, 0, nullptr, 2, barriers);
+
+    for (uint32_t level = baseLevel; level < texture.mipLevels; level++)
+    {
+        int32_t srcWidth = (int32_t)std::max(texture.extent.width >> (level - 1), 1u);
+        int32_t srcHeight = (int32_t)std::max(texture.extent.height >> (level - 1), 1u);
+        int32_t dstWidth = (int32_t)std::max(texture.extent.width >> level, 1u);
+        int32_t dstHeight = (int32_t)std::max(texture.extent.height >> level, 1u);
+
+        VkImageBlit blit = {};
+        blit.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level - 1, 0, 1 };
+        blit.srcOffsets[0] = { 0, 0, 0 };
+        blit.srcOffsets[1] = { srcWidth, srcHeight, 1 };
+        blit.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1 };
+        blit.dstOffsets[0] = { 0, 0, 0 };
+        blit.dstOffsets[1] = { dstWidth, dstHeight, 1 };
+        vkCmdBlitImage(cmd,
+            texture.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            texture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            1, &blit, VK_FILTER_LINEAR);
+
+        VkImageMemoryBarrier imb = makeImageBarrier(texture.image, level, 1,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+        vkCmdPipelineBarrier(cmd,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+            0, 0, nullptr, 0, nullptr, 1, &imb);
+    }
+
+    VkImageMemoryBarrier imb = makeImageBarrier(texture.image, baseLevel - 1, texture.mipLevels - baseLevel + 1,
+        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT);
+    vkCmdPipelineBarrier(cmd,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, SHADER_READ_STAGES | VK_PIPELINE_STAGE_TRANSFER_BIT,
+        0, 0, nullptr, 0, nullptr, 1, &imb);
+}
+
+void VulkanTextureManager::generateMipsCompute(VulkanTexture& texture, uint32_t baseLevel)
+{
+    VkDevice device = logicalDevice->device;
+    uint32_t levelCount = texture.mipLevels - baseLevel;
+
+    VkDescriptorPoolSize poolSizes[] = {
+        { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, levelCount },
+        { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, levelCount },
+    };
+    VkDescriptorPoolCreateInfo dpci = {};
+    dpci.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    dpci.pNext = nullptr;
+    dpci.maxSets = levelCount;
+    dpci.poolSizeCount = 2;
+    dpci.pPoolSizes = poolSizes;
+    VkDescriptorPool descriptorPool;
+    if (VK_SUCCESS != vkCreateDescriptorPool(device, &dpci, nullptr, &descriptorPool))
+    {
+        throw std::runtime_error("Create mipmap descriptor-pool failed.");
+    }
+
+    // one view per level, the shader reads level N through a single-level view.
+    std::vector<VkImageView> views(texture.mipLevels, VK_NULL_HANDLE);
+    for (uint32_t level = baseLevel - 1; level < texture.mipLevels; level++)
+    {
+        VkImageViewCreateInfo ivci = {};
+        ivci.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        ivci.pNext = nullptr;
+        ivci.image = texture.image;
+        ivci.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        ivci.format = texture.format;
+        ivci.components = {
+            VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY,
+            VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY
+        };
+        ivci.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 1 };
+        if (VK_SUCCESS != vkCreateImageView(device, &ivci, nullptr, &views[level]))
+        {
+            // nothing owns the pool and the views made so far yet.
+            for (auto view : views)
+            {
+                if (view != VK_NULL_HANDLE)
+                    vkDestroyImageView(device, view, nullptr);
+            }
+            vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+            throw std::runtime_error("Create mip-level image-view failed.");
+        }
+    }
+
+    // the views and descriptors are referenced by the batch until it completes.
+    uploader->onComplete([device, descriptorPool, views]() {
+        for (auto view : views)
+        {
+            if (view != VK_NULL_HANDLE)
+                vkDestroyImageView(device, view, nullptr);
+        }
+        vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+    });
+
+    VulkanSamplerDesc nearest;
+    nearest.magFilter = VK_FILTER_NEAREST;
+    nearest.minFilter = VK_FILTER_NEAREST;
+    nearest.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    nearest.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    nearest.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    nearest.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    VkSampler sampler = samplerCache.get(nearest);
+
+    VkCommandBuffer cmd = uploader->commandBuffer();
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, mipmapPipeline.handle);
+
+    for (uint32_t level = baseLevel; level < texture.mipLevels; level++)
+    {
+        VkDescriptorSetAllocateInfo dsai = {};
+        dsai.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        dsai.pNext = nullptr;
+        dsai.descriptorPool = descriptorPool;
+        dsai.descriptorSetCount = 1;
+        dsai.pSetLayouts = mipmapPipeline.setLayout.address();
+        VkDescriptorSet set;
+        if (VK_SUCCESS != vkAllocateDescriptorSets(device, &dsai, &set))
+        {
+            throw std::runtime_error("Allocate mipmap descriptor-set failed.");
+        }
+
+        VkDescriptorImageInfo src = { sampler, views[level - 1], VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+        VkDescriptorImageInfo dst = { VK_NULL_HANDLE, views[level], VK_IMAGE_LAYOUT_GENERAL };
+        VkWriteDescriptorSet writes[2] = {};
+        writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[0].dstSet = set;
+        writes[0].dstBinding = 0;
+        writes[0].descriptorCount = 1;
+        writes[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        writes[0].pImageInfo = &src;
+        writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[1].dstSet = set;
+        writes[1].dstBinding = 1;
+        writes[1].descriptorCount = 1;
+        writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        writes[1].pImageInfo = &dst;
+        vkUpdateDescriptorSets(device, 2, writes, 0, nullptr);
+
+        VkImageMemoryBarrier imb = makeImageBarrier(texture.image, level, 1,
+            VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL,
+            0, VK_ACCESS_SHADER_WRITE_BIT);
+        vkCmdPipelineBarrier(cmd,
+            VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0, 0, nullptr, 0, nullptr, 1, &imb);
+
+        vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, mipmapPipeline.layout, 0, 1, &set, 0, nullptr);
+        uint32_t width = std::max(texture.extent.width >> level, 1u);
+        uint32_t height = std::max(texture.extent.height >> level, 1u);
+        vkCmdDispatch(cmd, (width + 7) / 8, (height + 7) / 8, 1);
+
+        imb = makeImageBarrier(texture.image, level, 1,
+            VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT);
+        vkCmdPipelineBarrier(cmd,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, SHADER_READ_STAGES,
+            0, 0, nullptr, 0, nullptr, 1, &imb);
+    }
+}
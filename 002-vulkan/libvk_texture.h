@@ -0,0 +1,120 @@
+#ifndef _LIBVK_TEXTURE_H_
+#define _LIBVK_TEXTURE_H_
+
+#include "libvk.h"
+#include "libvk_allocator.h"
+#include "libvk_upload.h"
+#include <unordered_map>
+
+struct VulkanSamplerDesc
+{
+    VkFilter magFilter = VK_FILTER_LINEAR;
+    VkFilter minFilter = VK_FILTER_LINEAR;
+    VkSamplerMipmapMode mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+    VkSamplerAddressMode addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    VkSamplerAddressMode addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    VkSamplerAddressMode addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    float mipLodBias = 0.0f;
+    float maxAnisotropy = 1.0f;
+    VkBool32 compareEnable = VK_FALSE;
+    VkCompareOp compareOp = VK_COMPARE_OP_ALWAYS;
+    float minLod = 0.0f;
+    float maxLod = VK_LOD_CLAMP_NONE;
+    VkBorderColor borderColor = VK_BORDER_COLOR_FLOAT_TRANSPARENT_BLACK;
+
+    bool operator==(const VulkanSamplerDesc& o) const
+    {
+        return magFilter == o.magFilter && minFilter == o.minFilter && mipmapMode == o.mipmapMode &&
+            addressModeU == o.addressModeU && addressModeV == o.addressModeV && addressModeW == o.addressModeW &&
+            mipLodBias == o.mipLodBias && maxAnisotropy == o.maxAnisotropy &&
+            compareEnable == o.compareEnable && compareOp == o.compareOp &&
+            minLod == o.minLod && maxLod == o.maxLod && borderColor == o.borderColor;
+    }
+};
+
+struct VulkanSamplerDescHash
+{
+    size_t operator()(const VulkanSamplerDesc& d) const;
+};
+
+// Samplers are deduplicated by their full description: drivers cap the number of
+// live VkSamplers (maxSamplerAllocationCount, as low as 4000), while real scenes
+// only ever use a handful of distinct ones.
+class VulkanSamplerCache
+{
+    const VulkanLogicalDevice* logicalDevice = nullptr;
+    float maxAnisotropy = 1.0f;
+    std::unordered_map<VulkanSamplerDesc, VkSampler, VulkanSamplerDescHash> samplers;
+
+public:
+    void init(const VulkanLogicalDevice& logicalDevice, float maxAnisotropy);
+    void quit();
+
+    VkSampler get(const VulkanSamplerDesc& desc);
+    size_t size() const { return samplers.size(); }
+};
+
+struct VulkanTextureArgs
+{
+    VkFormat format;
+    VkExtent2D extent;
+    uint32_t mipLevels = 0;         // 0: full chain down to 1x1
+    const void* data = nullptr;     // levels [0, dataMipLevels), tightly packed, largest first
+    VkDeviceSize size = 0;
+    uint32_t dataMipLevels = 1;     // levels not in `data` are generated on the GPU
+    VkImageUsageFlags usage = 0;    // in addition to SAMPLED | TRANSFER_DST
+};
+
+struct VulkanTexture
+{
+    VkImage image = nullptr;
+    VkImageView view = nullptr;
+    VulkanAllocation allocation;
+    VkFormat format;
+    VkExtent2D extent;
+    uint32_t mipLevels = 0;
+    VkImageUsageFlags usage = 0;
+};
+
+class VulkanTextureManager
+{
+    const VulkanLogicalDevice* logicalDevice = nullptr;
+    VulkanAllocator* allocator = nullptr;
+    VulkanUploader* uploader = nullptr;
+    VulkanSamplerCache samplerCache;
+    VulkanComputePipeline mipmapPipeline;
+
+public:
+    void init(const VulkanLogicalDevice& logicalDevice, VulkanAllocator& allocator, VulkanUploader& uploader, float maxAnisotropy);
+    void quit();
+
+    // Records the upload into the uploader's current batch; the texture can be
+    // sampled by any submission made after the uploader's next flush().
+    VulkanTexture createTexture(const VulkanTextureArgs& args);
+    void destroyTexture(VulkanTexture& texture);
+
+    VkSampler getSampler(const VulkanSamplerDesc& desc) { return samplerCache.get(desc); }
+    VulkanSamplerCache& samplers() { return samplerCache; }
+
+    VulkanTexture createImage(VkFormat format, VkExtent2D extent, uint32_t mipLevels, VkImageUsageFlags usage);
+    void uploadLevels(VulkanTexture& texture, uint32_t baseLevel, const void* data, VkDeviceSize size, uint32_t levelCount);
+    // By blit, which needs TRANSFER_SRC usage, or else by compute, which needs
+    // STORAGE usage; throws when the format or the usage allows neither.
+    void generateMips(VulkanTexture& texture, uint32_t baseLevel);
+
+    // Copies whole levels between textures of the same format; `src` needs
+    // TRANSFER_SRC usage. Source levels stay SHADER_READ_ONLY, destination levels go
+    // from UNDEFINED to SHADER_READ_ONLY.
+    void copyLevels(const VulkanTexture& src, uint32_t srcLevel,
+        VulkanTexture& dst, uint32_t dstLevel, uint32_t levelCount);
+
+private:
+    bool canBlit(VkFormat format) const;
+    bool canCompute(VkFormat format) const;
+    void generateMipsBlit(VulkanTexture& texture, uint32_t baseLevel);
+    void generateMipsCompute(VulkanTexture& texture, uint32_t baseLevel);
+};
+
+uint32_t getFullMipLevels(VkExtent2D extent);
+
+#endif//_LIBVK_TEXTURE_H_
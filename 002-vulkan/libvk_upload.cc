@@ -0,0 +1,224 @@
+
+#include "libvk_upload.h"
+#include "libvk_capture.h"
+
+static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+{
+    return alignment > 1 ? (value + alignment - 1) / alignment * alignment : value;
+}
+
+void VulkanUploader::init(const VulkanLogicalDevice& logicalDevice, VkDeviceSize stagingSize, uint32_t batchCount)
+{
+    this->logicalDevice = &logicalDevice;
+
+    VkCommandPoolCreateInfo cpci = {};
+    cpci.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    cpci.pNext = nullptr;
+    cpci.queueFamilyIndex = logicalDevice.queueFamilyIndex;
+    cpci.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    if (VK_SUCCESS != vkCreateCommandPool(logicalDevice.device, &cpci, nullptr, &commandPool))
+    {
+        throw std::runtime_error("Create upload command-pool failed.");
+    }
+
+    batches.resize(batchCount);
+    for (auto& batch : batches)
+    {
+        VulkanBufferArgs bufferArgs = {};
+        bufferArgs.size = stagingSize;
+        bufferArgs.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+        bufferArgs.memoryProps = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        bufferArgs.mapped = true;
+        batch.staging = logicalDevice.createBuffer(bufferArgs);
+
+        VkCommandBufferAllocateInfo cbai = {};
+        cbai.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        cbai.pNext = nullptr;
+        cbai.commandPool = commandPool;
+        cbai.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        cbai.commandBufferCount = 1;
+        if (VK_SUCCESS != vkAllocateCommandBuffers(logicalDevice.device, &cbai, &batch.commandBuffer))
+        {
+            throw std::runtime_error("Allocate upload command-buffer failed.");
+        }
+
+        batch.fence = logicalDevice.createFence();
+    }
+    current = 0;
+}
+
+void VulkanUploader::quit()
+{
+    if (logicalDevice == nullptr)
+        return;
+
+    this->flush();
+    this->waitIdle();
+    for (auto& batch : batches)
+    {
+        logicalDevice->destroyFence(batch.fence);
+        logicalDevice->destroyBuffer(batch.staging);
+    }
+    batches.clear();
+
+    if (commandPool != nullptr)
+    {
+        vkDestroyCommandPool(logicalDevice->device, commandPool, nullptr);
+        commandPool = nullptr;
+    }
+    logicalDevice = nullptr;
+}
+
+void VulkanUploader::recycle(Batch& batch)
+{
+    for (auto& callback : batch.onComplete)
+        callback();
+    batch.onComplete.clear();
+    for (auto& buffer : batch.overflow)
+        logicalDevice->destroyBuffer(buffer);
+    batch.overflow.clear();
+    batch.used = 0;
+    batch.inFlight = false;
+}
+
+VulkanUploader::Batch& VulkanUploader::begin()
+{
+    Batch& batch = batches[current];
+    if (batch.recording)
+        return batch;
+
+    if (batch.inFlight)
+    {
+        // the whole ring is busy: back-pressure on the producer.
+        vkWaitForFences(logicalDevice->device, 1, batch.fence.address(), VK_TRUE, std::numeric_limits<uint64_t>::max());
+        this->recycle(batch);
+    }
+
+    vkResetCommandBuffer(batch.commandBuffer, 0);
+
+    VkCommandBufferBeginInfo cbbi = {};
+    cbbi.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    cbbi.pNext = nullptr;
+    cbbi.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    cbbi.pInheritanceInfo = nullptr;
+    if (VK_SUCCESS != vkBeginCommandBuffer(batch.commandBuffer, &cbbi))
+    {
+        throw std::runtime_error("Begin upload command-buffer failed.");
+    }
+    batch.recording = true;
+    return batch;
+}
+
+VulkanStagingRegion VulkanUploader::stage(VkDeviceSize size, VkDeviceSize alignment)
+{
+    Batch* batch = &this->begin();
+    VkDeviceSize offset = alignUp(batch->used, alignment);
+
+    if (offset + size > batch->staging.size && batch->used > 0)
+    {
+        this->flush();
+        batch = &this->begin();
+        offset = 0;
+    }
+
+    VulkanStagingRegion region;
+    if (offset + size > batch->staging.size)
+    {
+        // larger than a whole staging buffer: a temporary one, released with the batch.
+        VulkanBufferArgs bufferArgs = {};
+        bufferArgs.size = size;
+        bufferArgs.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+        bufferArgs.memoryProps = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        bufferArgs.mapped = true;
+        batch->overflow.push_back(logicalDevice->createBuffer(bufferArgs));
+        region.buffer = batch->overflow.back().handle;
+        region.offset = 0;
+        region.mapped = batch->overflow.back().mapped;
+        return region;
+    }
+
+    batch->used = offset + size;
+    region.buffer = batch->staging.handle;
+    region.offset = offset;
+    region.mapped = (uint8_t*)batch->staging.mapped + offset;
+    return region;
+}
+
+VulkanStagingRegion VulkanUploader::stage(const void* data, VkDeviceSize size, VkDeviceSize alignment)
+{
+    VulkanStagingRegion region = this->stage(size, alignment);
+    memcpy(region.mapped, data, (size_t)size);
+    return region;
+}
+
+VkCommandBuffer VulkanUploader::commandBuffer()
+{
+    return this->begin().commandBuffer;
+}
+
+void VulkanUploader::uploadBuffer(VkBuffer dst, VkDeviceSize dstOffset, const void* data, VkDeviceSize size)
+{
+    VulkanStagingRegion region = this->stage(data, size);
+
+    VkBufferCopy copy = {};
+    copy.srcOffset = region.offset;
+    copy.dstOffset = dstOffset;
+    copy.size = size;
+    vkCmdCopyBuffer(this->commandBuffer(), region.buffer, dst, 1, &copy);
+    if (logicalDevice->capture != nullptr)
+        logicalDevice->capture->upload(dst, dstOffset, data, size);
+}
+
+void VulkanUploader::onComplete(std::function<void()> callback)
+{
+    this->begin().onComplete.push_back(std::move(callback));
+}
+
+void VulkanUploader::flush()
+{
+    Batch& batch = batches[current];
+    if (!batch.recording)
+        return;
+
+    // make the uploads visible to every later submission on this queue.
+    VkMemoryBarrier mb = {};
+    mb.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    mb.pNext = nullptr;
+    mb.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    mb.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+    vkCmdPipelineBarrier(batch.commandBuffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+        0, 1, &mb, 0, nullptr, 0, nullptr);
+
+    if (VK_SUCCESS != vkEndCommandBuffer(batch.commandBuffer))
+    {
+        throw std::runtime_error("End upload command-buffer failed.");
+    }
+
+    vkResetFences(logicalDevice->device, 1, batch.fence.address());
+    logicalDevice->submit(batch.commandBuffer, VK_NULL_HANDLE, 0, VK_NULL_HANDLE, batch.fence);
+    batch.recording = false;
+    batch.inFlight = true;
+    current = (current + 1) % batches.size();
+}
+
+void VulkanUploader::collect()
+{
+    for (auto& batch : batches)
+    {
+        if (batch.inFlight && vkGetFenceStatus(logicalDevice->device, batch.fence) == VK_SUCCESS)
+            this->recycle(batch);
+    }
+}
+
+void VulkanUploader::waitIdle()
+{
+    for (auto& batch : batches)
+    {
+        if (!batch.inFlight)
+            continue;
+        vkWaitForFences(logicalDevice->device, 1, batch.fence.address(), VK_TRUE, std::numeric_limits<uint64_t>::max());
+        this->recycle(batch);
+    }
+}
@@ -0,0 +1,64 @@
+#ifndef _LIBVK_UPLOAD_H_
+#define _LIBVK_UPLOAD_H_
+
+#include "libvk.h"
+#include <functional>
+
+struct VulkanStagingRegion
+{
+    VkBuffer buffer = nullptr;
+    VkDeviceSize offset = 0;
+    void* mapped = nullptr;
+};
+
+// Records transfers into a small ring of batches. Each batch owns a persistently
+// mapped staging buffer, a command buffer and a fence; flush() submits the current
+// batch without waiting, collect() recycles the ones the GPU has finished. Only
+// when every batch is still in flight does the uploader wait for the oldest one.
+class VulkanUploader
+{
+    struct Batch
+    {
+        VulkanBuffer staging;
+        VkDeviceSize used = 0;
+        VkCommandBuffer commandBuffer = nullptr;
+        VulkanFenceHandle fence;
+        bool recording = false;
+        bool inFlight = false;
+        std::vector<VulkanBuffer> overflow;
+        std::vector<std::function<void()>> onComplete;
+    };
+
+    const VulkanLogicalDevice* logicalDevice = nullptr;
+    VkCommandPool commandPool = nullptr;
+    std::vector<Batch> batches;
+    size_t current = 0;
+
+public:
+    void init(const VulkanLogicalDevice& logicalDevice, VkDeviceSize stagingSize = 32ull << 20, uint32_t batchCount = 3);
+    void quit();
+
+    // Host-visible space for `size` bytes, valid until the current batch completes.
+    // Staging may flush a full batch, so fetch commandBuffer() after staging.
+    VulkanStagingRegion stage(VkDeviceSize size, VkDeviceSize alignment = 16);
+    VulkanStagingRegion stage(const void* data, VkDeviceSize size, VkDeviceSize alignment = 16);
+
+    // The command buffer of the batch being recorded.
+    VkCommandBuffer commandBuffer();
+
+    void uploadBuffer(VkBuffer dst, VkDeviceSize dstOffset, const void* data, VkDeviceSize size);
+
+    // Runs `callback` once the GPU has finished the current batch, e.g. to release
+    // temporaries that the recorded commands still reference.
+    void onComplete(std::function<void()> callback);
+
+    void flush();
+    void collect();
+    void waitIdle();
+
+private:
+    Batch& begin();
+    void recycle(Batch& batch);
+};
+
+#endif//_LIBVK_UPLOAD_H_
@@ -1,33 +1,226 @@
 
 #include "header.h"
 #include "libvk.h"
+#include "libvk_arena.h"
+#include "libvk_batch.h"
+#include "libvk_capture.h"
+#include "libvk_deletion.h"
+#include "libvk_jobs.h"
+#include "libvk_meshlet.h"
+#include "libvk_pack.h"
+#include "libvk_particles.h"
+#include "libvk_postprocess.h"
+#include "libvk_profiler.h"
+#include "libvk_readback.h"
+#include "libvk_renderqueue.h"
+#include "libvk_scene.h"
+#include "libvk_sprites.h"
+#include "libvk_streaming.h"
+#include "libvk_texture.h"
 #include "utils.h"
 
+#include "shader.vert.h"
+#include "shader.frag.h"
+#include "scene.vert.h"
+#include "meshlet.frag.h"
+
 #include <GLFW/glfw3.h>
 
+enum class LogLevel {
+    Quiet,      // errors only
+    Info,       // what was selected and created
+    Verbose     // every extension, layer, device and queue family
+};
+
+struct VulkanAppOptions {
+    std::string captureDir;
+    std::string packPath;
+    std::string device;     // index or part of the name, overrides the device score
+    std::string tracePath;  // Chrome trace JSON written on exit, empty: no profiling
+    VulkanLatencyPolicy latency = VulkanLatencyPolicy::Throughput;
+    LogLevel logLevel = LogLevel::Info;
+    uint32_t threads = 0;   // job system workers, 0: one per hardware thread
+    uint32_t msaa = 4;      // upper bound, clamped to what the device supports
+    uint32_t sprites = 10000;   // animated sprites drawn over the scene
+    uint32_t meshlets = 256;    // instances of a generated dense mesh, LOD and culling per cluster on the GPU
+    uint32_t particles = 1u << 20;  // alive at once in the GPU particle fountains, 0: none
+    uint32_t windows = 1;       // each with its own swapchain, all presented together
+    uint64_t batchFrames = 0;   // render this many frames offscreen on every device and exit, 0: windowed
+    uint32_t tilesX = 1;        // batch work items per frame, across and down
+    uint32_t tilesY = 1;
+    std::string recordPath;     // capture the calls of the first `recordFrames` frames into this file
+    uint32_t recordFrames = 300;
+    std::string replayPath;     // replay a capture offscreen and exit
+    bool paced = false;         // replay at the recorded frame times instead of as fast as possible
+    bool renderPass = false;    // keep render pass and framebuffers even with dynamic rendering
+    bool post = true;           // HDR scene, bloom and tonemapping in compute, where supported
+};
+
+// A white disc with a soft edge, tinted per sprite.
+static VulkanTexture createSpriteTexture(VulkanTextureManager& textures) {
+    const uint32_t SPRITE_SIZE = 64;
+    std::vector<uint32_t> texels(SPRITE_SIZE * SPRITE_SIZE);
+    for (uint32_t y = 0; y < SPRITE_SIZE; y++) {
+        for (uint32_t x = 0; x < SPRITE_SIZE; x++) {
+            float dx = (x + 0.5f) / SPRITE_SIZE * 2.0f - 1.0f;
+            float dy = (y + 0.5f) / SPRITE_SIZE * 2.0f - 1.0f;
+            float alpha = std::clamp((1.0f - std::sqrt(dx * dx + dy * dy)) * 8.0f, 0.0f, 1.0f);
+            texels[y * SPRITE_SIZE + x] = 0x00ffffffu | (uint32_t)(alpha * 255.0f) << 24;
+        }
+    }
+    VulkanTextureArgs spriteTextureArgs;
+    spriteTextureArgs.format = VK_FORMAT_R8G8B8A8_UNORM;
+    spriteTextureArgs.extent = { SPRITE_SIZE, SPRITE_SIZE };
+    spriteTextureArgs.mipLevels = 1;
+    spriteTextureArgs.data = texels.data();
+    spriteTextureArgs.size = texels.size() * sizeof(uint32_t);
+    return textures.createTexture(spriteTextureArgs);
+}
+
+// Circles drifting on Lissajous paths over a `frameExtent` frame, a layer per
+// texture so the pack's textures draw over the disc. `origin` is where the
+// batch's target starts in the frame.
+static void animateSprites(VulkanSpriteBatch& sprites, uint32_t count, uint32_t textureCount,
+    VkExtent2D frameExtent, VkOffset2D origin, uint64_t frame) {
+    float width = (float)frameExtent.width;
+    float height = (float)frameExtent.height;
+    float t = (float)frame / 60.0f;
+    for (uint32_t i = 0; i < count; i++) {
+        float phase = (float)i * 0.618034f;
+        float x = width * (0.5f + 0.45f * std::sin(t * 0.31f + phase * 1.7f)) - (float)origin.x;
+        float y = height * (0.5f + 0.45f * std::cos(t * 0.23f + phase * 2.3f)) - (float)origin.y;
+        float size = 8.0f + (float)(i % 24);
+        uint32_t color = 0xff000000u | (i * 2654435761u & 0x00ffffffu);
+        uint32_t texture = i % textureCount;
+        sprites.push(VulkanSprite::make(x, y, size, size, t + phase, color), texture, (uint16_t)texture);
+    }
+}
+
+// One output of the app: a window, its swapchain, and what the scene renders
+// into on the way there. The windows share the device, pipeline and renderers,
+// so they all have the same surface format and extent.
+struct VulkanAppWindow {
+    GLFWwindow* handle = nullptr;
+    VkSurfaceKHR surface = nullptr;
+    VulkanSwapchain swapchain;
+    VulkanAttachment colorAttachment;
+    VulkanAttachment depthAttachment;
+    VulkanFrameBufferObject frameBuffers;
+    VulkanRenderTargets targets;
+    VulkanPostProcess post;
+    VulkanSemaphoreHandle onImageAvailable;
+    bool dirty = false;         // resized or out of date: recreated after the next slot fence
+    bool surfaceLost = false;   // the surface too
+    std::vector<uint8_t> captureRecords;    // this frame's, written after all windows recorded
+};
+
 class VulkanApp {
-    GLFWwindow* window = nullptr;
+public:
+    VulkanAppOptions options;
+
+private:
+    static const uint32_t CULL_CHUNK = 4096;    // entities per culling job
+
+    std::vector<std::unique_ptr<VulkanAppWindow>> windows;     // the first one is paced and captured
+    VulkanJobSystem jobs;
     VulkanInstance instance;
     VulkanPhysicalDevice physicalDevice;
-    VkSurfaceKHR surface = nullptr;
     VulkanLogicalDevice logicalDevice;
-    VulkanSwapchain swapchain;
+    VulkanFrameTimeline frames;
+    VulkanFrameArenas frameArenas;
+    VulkanFrameCommands frameCommands;
+    VulkanDeletionQueue deletions;
+    VulkanAllocator allocator;
+    VulkanUploader uploader;
+    VulkanTextureManager textures;
+    VulkanTextureStreamer streamer;
+    VulkanAssetPack pack;
+    std::vector<VulkanTexture> packTextures;
+    std::vector<VulkanMesh> packMeshes;
+    std::vector<uint32_t> packMeshStrides;
+    std::vector<const VulkanPackEntry*> packMeshlets;  // added once the renderer exists
+    VulkanScene scene;
+    VulkanVec3 eye = VulkanVec3(0.0f, 2.0f, 10.0f);
+    float fovY = 1.0f;
+    VulkanMat4 view;
+    VulkanMat4 proj;
+    VulkanMat4 viewProj;
+    VulkanArenaVector<VulkanDrawPacket> drawPackets;        // on the frame's arena
+    std::vector<std::vector<VulkanDrawPacket>> cullPackets;     // one list per culling job
+    VulkanJobRange cull;                // shared by the culling jobs, see parallelFor
+    VulkanPresentPacer pacer;
+    VulkanPresentBatch presentBatch;
+    VulkanSwapchainArgs swapchainArgs;  // every window's but the surface, kept for recreation
+    VkFormat sceneFormat = VK_FORMAT_UNDEFINED;     // what the pipelines draw into
+    std::vector<VkCommandBuffer> commandBuffers;    // one per window, submitted together
+    uint32_t leadWindow = 0;            // the first acquired this frame, has the profiler zones
     VulkanGraphicsPipeline pipeline;
-    VulkanFrameBufferObject frameBuffers;
-    std::vector<VkCommandBuffer> commandBuffers;
-    VkSemaphore onImageAvailable = nullptr;
-    VkSemaphore onRenderFinished = nullptr;
+    VulkanRenderQueue renderQueue;
+    VulkanDrawItem quadItem;
+    std::vector<VulkanGraphicsPipeline> scenePipelines;     // one per vertex stride of the pack meshes
+    std::vector<uint32_t> meshPipelines;        // render queue ids, per pack mesh
+    std::vector<uint32_t> meshGeometries;
+    VulkanBuffer sceneTransforms;               // viewProj then the world matrices, a region per frame in flight
+    VkDeviceSize sceneRegionSize = 0;
+    uint32_t sceneCapacity = 0;                 // world matrices per region
+    VulkanDescriptorPoolHandle sceneDescriptorPool;
+    std::vector<uint32_t> sceneSets;            // render queue ids, per frame in flight
+    VulkanGpuProfiler gpuProfiler;
+    VulkanRecordArgs recordArgs;
+    bool dynamicRendering = false;
+    VulkanTexture spriteTexture;
+    VulkanSpriteBatch sprites;
+    VulkanMeshletRenderer meshlets;
+    bool meshletRendering = false;
+    VulkanParticleSystem particles;
+    bool postProcessing = false;
+    VulkanSemaphoreHandle onRenderFinished;
+    VulkanSemaphoreHandle onCaptureFinished;
+    VulkanReadback readback;
+    VulkanCapture capture;
+
+    bool logs(LogLevel level) const { return options.logLevel >= level; }
+
+    bool windowClosed() const
+    {
+        for (auto& window : windows) {
+            if (glfwWindowShouldClose(window->handle))
+                return true;
+        }
+        return false;
+    }
+
+    static VkExtent2D swapchainExtent(const VkSurfaceCapabilitiesKHR& capabilities)
+    {
+        VkExtent2D extent = capabilities.currentExtent;
+        extent.width = std::clamp(extent.width, capabilities.minImageExtent.width, capabilities.maxImageExtent.width);
+        extent.height = std::clamp(extent.height, capabilities.minImageExtent.height, capabilities.maxImageExtent.height);
+        return extent;
+    }
 
 public:
     void init()
     {
+        // the calling thread becomes the job system's main thread.
+        jobs.init(options.threads);
+        if (!options.tracePath.empty()) {
+            VulkanProfiler::instance().start();
+        }
         glfwInit();
 
         glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-        this->window = glfwCreateWindow(_WINDOW_WIDTH, _WINDOW_HEIGHT, _WINDOW_TITLE, NULL, NULL);
-        
-        glfwSetWindowUserPointer(window, this);
-        glfwSetWindowSizeCallback(window, VulkanApp::onWindowResize);
+        // one present batch covers them all.
+        for (uint32_t i = 0; i < std::min(std::max(options.windows, 1u), VULKAN_PRESENT_BATCH_MAX); i++) {
+            auto window = std::make_unique<VulkanAppWindow>();
+            window->handle = glfwCreateWindow(_WINDOW_WIDTH, _WINDOW_HEIGHT, _WINDOW_TITLE, NULL, NULL);
+            if (window->handle == nullptr)
+            {
+                throw std::runtime_error("Failed to create window!");
+            }
+            glfwSetWindowUserPointer(window->handle, this);
+            glfwSetWindowSizeCallback(window->handle, VulkanApp::onWindowResize);
+            windows.push_back(std::move(window));
+        }
 
         uint32_t glfwExtensionCount = 0;
         const char** glfwExtensions;
@@ -40,68 +233,62 @@ public:
             args.extensions.push_back(glfwExtensions[i]);
         }
 
-        const auto& extensions = VulkanInstance::enumerateExtensions();
-        std::cout << std::endl << "instance extensions count: " << extensions.size() << std::endl;
-        std::cout << hr;
-        for (auto& e : extensions) {
-            std::cout << tab(1) << e.extensionName;
-            if (_DEBUG && strstr(e.extensionName, "debug")) {
-                args.extensions.push_back(e.extensionName);
-                std::cout << "  USED";
-            }
-            if (strstr(e.extensionName, "swapchain")) {
-                args.extensions.push_back(e.extensionName);
-                std::cout << "  USED";
-            }
-            std::cout << std::endl;
+        const auto& instanceCaps = VulkanCapabilities::instance();
+        if (_DEBUG && instanceCaps.enableLayer(VULKAN_VALIDATION_LAYER_NAME, args.layers)) {
+            instanceCaps.enableExtension(VK_EXT_DEBUG_REPORT_EXTENSION_NAME, args.extensions);
+        }
+        if (logs(LogLevel::Verbose)) {
+            instanceCaps.dump(std::cout, "instance", args.extensions, args.layers);
         }
 
-        const auto& layers = VulkanInstance::enumerateLayers();
-        std::cout << std::endl << "instance layers count: " << layers.size() << std::endl;
-        std::cout << hr;
-        for (auto& l : layers) {
-            std::cout << tab(1) << l.layerName;
-            if (_DEBUG && strstr(l.layerName, "validation")) {
-                args.layers.push_back(l.layerName);
-                std::cout << "  USED";
+        this->instance = VulkanInstance::createInstance(args);
+
+        for (auto& window : windows) {
+            if (glfwCreateWindowSurface(instance.handle, window->handle, nullptr, &window->surface) != VK_SUCCESS)
+            {
+                throw std::runtime_error("Failed to create window surface!");
             }
-            std::cout << std::endl;
         }
 
-        this->instance = VulkanInstance::createInstance(args);
+        VulkanDeviceRequirements requirements;
+        requirements.extensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+        requirements.preferredExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+        requirements.preferredFeatures.samplerAnisotropy = VK_TRUE;
+        requirements.preferredFeatures.shaderStorageImageWriteWithoutFormat = VK_TRUE;
+        requirements.surface = windows[0]->surface;
 
         const auto& devices = instance.enumeratePhysicalDevices();
-        std::cout << std::endl << "physical devices count: " << devices.size() << std::endl;
-        std::cout << hr;
-        for (auto& dev : devices) {
-            std::cout << tab(1) << dev.props.deviceName << std::endl;
-            std::cout << tab(2) << "queue families: " << dev.queueFamilies.size() << std::endl;
-            for (size_t i = 0; i < dev.queueFamilies.size(); i++) {
-                std::cout << tab(3) << i << ">" << std::endl;
-                auto& queueFamily = dev.queueFamilies.at(i);
-                std::cout << tab(4) << "queue count: " << queueFamily.queueCount << std::endl;
-                auto flags = queueFamily.queueFlags;
-                std::cout << tab(4) << "queue flags:";
-                if (flags & VK_QUEUE_GRAPHICS_BIT)std::cout << " GRAPHICS";
-                if (flags & VK_QUEUE_COMPUTE_BIT) std::cout << " COMPUTE";
-                if (flags & VK_QUEUE_TRANSFER_BIT) std::cout << " TRANSFER";
-                if (flags & VK_QUEUE_SPARSE_BINDING_BIT) std::cout << " SPARSE";
-                if (flags & VK_QUEUE_PROTECTED_BIT)std::cout << " PROTECTED";
-                std::cout << std::endl;
+        if (logs(LogLevel::Verbose)) {
+            std::cout << '\n' << "physical devices count: " << devices.size() << '\n';
+            std::cout << hr;
+            for (auto& dev : devices) {
+                auto rating = dev.rate(requirements);
+                std::cout << tab(1) << dev.props.deviceName << '\n';
+                std::cout << tab(2) << "score: " << rating.score << " (" << rating.reason << ")" << '\n';
+                std::cout << tab(2) << "queue families: " << dev.queueFamilies.size() << '\n';
+                for (size_t i = 0; i < dev.queueFamilies.size(); i++) {
+                    std::cout << tab(3) << i << ">" << '\n';
+                    auto& queueFamily = dev.queueFamilies.at(i);
+                    std::cout << tab(4) << "queue count: " << queueFamily.queueCount << '\n';
+                    auto flags = queueFamily.queueFlags;
+                    std::cout << tab(4) << "queue flags:";
+                    if (flags & VK_QUEUE_GRAPHICS_BIT)std::cout << " GRAPHICS";
+                    if (flags & VK_QUEUE_COMPUTE_BIT) std::cout << " COMPUTE";
+                    if (flags & VK_QUEUE_TRANSFER_BIT) std::cout << " TRANSFER";
+                    if (flags & VK_QUEUE_SPARSE_BINDING_BIT) std::cout << " SPARSE";
+                    if (flags & VK_QUEUE_PROTECTED_BIT)std::cout << " PROTECTED";
+                    std::cout << '\n';
+                }
             }
         }
         if (devices.empty())
         {
             throw std::runtime_error("Physical Devices not found.");
         }
-        this->physicalDevice = devices.at(0);
-
-        VkSurfaceKHR surface;
-        if (glfwCreateWindowSurface(instance.handle, window, nullptr, &surface) != VK_SUCCESS) 
-        {
-            throw std::runtime_error("Failed to create window surface!");
+        this->physicalDevice = devices.at(VulkanInstance::selectPhysicalDevice(devices, requirements, options.device));
+        if (logs(LogLevel::Info)) {
+            std::cout << "Selected Physical Device: " << physicalDevice.props.deviceName << '\n';
         }
-        this->surface = surface;
 
         uint32_t graphicsQueueFamilyIndex = -1;
         uint32_t presentQueueFamilyIndex = -1;
@@ -109,55 +296,121 @@ public:
             const auto& qf = physicalDevice.queueFamilies.at(i);
             if (graphicsQueueFamilyIndex == -1 && (qf.queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0)
                 graphicsQueueFamilyIndex = i;
-            if (presentQueueFamilyIndex == -1 && physicalDevice.checkSurfaceSupport(surface, i))
+            // one present covers every window, so its queue must support them all.
+            bool presents = true;
+            for (auto& window : windows)
+                presents = presents && physicalDevice.checkSurfaceSupport(window->surface, i);
+            if (presentQueueFamilyIndex == -1 && presents)
                 presentQueueFamilyIndex = i;
             if (graphicsQueueFamilyIndex != -1 && presentQueueFamilyIndex != -1) {
                 break;
             }
         }
 
-        std::cout << hr << std::endl;
-        std::cout << "Selected Graphics Queue Family: " << graphicsQueueFamilyIndex << std::endl;
-        std::cout << "Selected Present Queue Family: " << presentQueueFamilyIndex << std::endl;
+        if (presentQueueFamilyIndex == -1)
+        {
+            throw std::runtime_error("No queue family presents to every window.");
+        }
+        if (logs(LogLevel::Info)) {
+            std::cout << "Selected Graphics Queue Family: " << graphicsQueueFamilyIndex << '\n';
+            std::cout << "Selected Present Queue Family: " << presentQueueFamilyIndex << '\n';
+        }
 
-        auto deviceExtensions = physicalDevice.enumerateExtensions();
-        auto deviceLayers = physicalDevice.enumerateLayers();
+        const auto& deviceCaps = physicalDevice.capabilities;
 
         VulkanLogicalDeviceArgs logicalDeviceInitArgs;
         logicalDeviceInitArgs.queueFamilyIndex = graphicsQueueFamilyIndex;
-        std::cout << std::endl << "device extensions count: " << deviceExtensions.size() << std::endl;
-        std::cout << hr;
-        for (auto& e : deviceExtensions)
-        {
-            std::cout << tab(1) << e.extensionName;
-            if (_DEBUG && strstr(e.extensionName, "debug")) {
-                logicalDeviceInitArgs.extensions.push_back(e.extensionName);
-                std::cout << "  USED";
-            }
-            if (strstr(e.extensionName, "swapchain")) {
-                logicalDeviceInitArgs.extensions.push_back(e.extensionName);
-                std::cout << "  USED";
-            }
-            std::cout << std::endl;
+        logicalDeviceInitArgs.features.samplerAnisotropy = physicalDevice.features.samplerAnisotropy;
+        logicalDeviceInitArgs.features.shaderStorageImageWriteWithoutFormat =
+            physicalDevice.features.shaderStorageImageWriteWithoutFormat;
+        bool presentWait = options.latency != VulkanLatencyPolicy::Throughput && physicalDevice.checkPresentWaitSupport();
+        logicalDeviceInitArgs.presentWait = presentWait;
+        this->dynamicRendering = !options.renderPass && physicalDevice.checkDynamicRenderingSupport();
+        logicalDeviceInitArgs.dynamicRendering = dynamicRendering;
+        // mesh shaders where available, else culling in compute and draw-indirect-count.
+        this->meshletRendering = options.meshlets > 0 && VulkanMeshletRenderer::supported(physicalDevice);
+        bool meshShader = meshletRendering && physicalDevice.checkMeshShaderSupport();
+        logicalDeviceInitArgs.meshShader = meshShader;
+        logicalDeviceInitArgs.drawIndirectCount = meshletRendering && !meshShader;
+        if (logicalDeviceInitArgs.drawIndirectCount) {
+            logicalDeviceInitArgs.features.multiDrawIndirect = VK_TRUE;
+            logicalDeviceInitArgs.features.drawIndirectFirstInstance = VK_TRUE;
         }
-
-        std::cout << std::endl << "device layers count: " << deviceLayers.size() << std::endl;
-        std::cout << hr;
-        for (auto& l : deviceLayers)
-        {
-            std::cout << tab(1) << l.layerName;
-            if (_DEBUG && strstr(l.layerName, "validation")) {
-                logicalDeviceInitArgs.layers.push_back(l.layerName);
-                std::cout << "  USED";
-            }
-            std::cout << std::endl;
+        deviceCaps.requireExtension(VK_KHR_SWAPCHAIN_EXTENSION_NAME, logicalDeviceInitArgs.extensions);
+        deviceCaps.enableExtension(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME, logicalDeviceInitArgs.extensions);
+        if (presentWait) {
+            deviceCaps.requireExtension(VK_KHR_PRESENT_ID_EXTENSION_NAME, logicalDeviceInitArgs.extensions);
+            deviceCaps.requireExtension(VK_KHR_PRESENT_WAIT_EXTENSION_NAME, logicalDeviceInitArgs.extensions);
+        }
+        if (dynamicRendering) {
+            deviceCaps.requireExtension(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME, logicalDeviceInitArgs.extensions);
+        }
+        if (meshShader) {
+            deviceCaps.requireExtension(VK_EXT_MESH_SHADER_EXTENSION_NAME, logicalDeviceInitArgs.extensions);
+        }
+        if (logicalDeviceInitArgs.drawIndirectCount) {
+            deviceCaps.requireExtension(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME, logicalDeviceInitArgs.extensions);
+        }
+        // only for loaders that still honour device layers.
+        if (_DEBUG) {
+            deviceCaps.enableLayer(VULKAN_VALIDATION_LAYER_NAME, logicalDeviceInitArgs.layers);
+        }
+        if (logs(LogLevel::Verbose)) {
+            deviceCaps.dump(std::cout, "device", logicalDeviceInitArgs.extensions, logicalDeviceInitArgs.layers);
         }
-        std::cout << std::endl;
 
         this->logicalDevice = physicalDevice.createLogicalDevice(logicalDeviceInitArgs);
-        std::cout << "LogicalDevice created: " << (size_t)logicalDevice.device << std::endl;
+        if (logs(LogLevel::Info)) {
+            std::cout << "LogicalDevice created: " << (size_t)logicalDevice.device.get() << '\n';
+        }
+        // before anything is made on the device, the replay needs all of it.
+        if (!options.recordPath.empty()) {
+            capture.open(options.recordPath, std::max(options.recordFrames, 1u));
+            logicalDevice.capture = &capture;
+        }
+
+        this->postProcessing = options.post && VulkanPostProcess::supported(physicalDevice, logicalDevice);
+
+        frames.init(logicalDevice);
+        frameArenas.init(frames.framesInFlight());
+        // the compute ahead of the passes, then one per window.
+        frameCommands.init(logicalDevice, frames.framesInFlight(), 1 + (uint32_t)windows.size());
+        deletions.init(logicalDevice);
+        allocator.init(logicalDevice);
+        uploader.init(logicalDevice);
+        textures.init(logicalDevice, allocator, uploader, physicalDevice.props.limits.maxSamplerAnisotropy);
+        streamer.init(logicalDevice, allocator, uploader, textures);
+        pack.init(logicalDevice, allocator, uploader, textures);
+        if (!options.packPath.empty()) {
+            pack.open(options.packPath);
+            for (uint32_t i = 0; i < pack.entryCount(); i++) {
+                const auto& entry = pack.entry(i);
+                if (entry.type == VULKAN_PACK_TEXTURE)
+                    packTextures.push_back(pack.loadTexture(entry));
+                else if (entry.type == VULKAN_PACK_MESH) {
+                    packMeshes.push_back(pack.loadMesh(entry));
+                    packMeshStrides.push_back(entry.mesh.vertexStride);
+                }
+                else if (entry.type == VULKAN_PACK_MESHLETS)
+                    packMeshlets.push_back(&entry);
+            }
+            uploader.flush();
+            // one entity per mesh, in a row along x.
+            for (uint32_t i = 0; i < packMeshes.size(); i++) {
+                VulkanEntityArgs entityArgs;
+                entityArgs.position = VulkanVec3(2.0f * i, 0.0f, 0.0f);
+                entityArgs.mesh = i;
+                entityArgs.boundsRadius = 1.0f;
+                scene.create(entityArgs);
+            }
+            if (logs(LogLevel::Info)) {
+                std::cout << "Pack loaded: " << packTextures.size() << " textures, "
+                    << packMeshes.size() << " meshes, " << packMeshlets.size() << " meshlet meshes" << '\n';
+            }
+        }
 
-        const auto& swapchainSupport = physicalDevice.checkSwapchainSupport(surface);
+        // the first window picks the format and extent, the others must offer the same.
+        const auto& swapchainSupport = physicalDevice.checkSwapchainSupport(windows[0]->surface);
         const VkSurfaceFormatKHR* format = &swapchainSupport.formats[0];
         for (auto& f : swapchainSupport.formats) {
             if (f.format == VK_FORMAT_B8G8R8A8_SRGB && f.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR) {
@@ -165,38 +418,71 @@ public:
                 break;
             }
         }
-        VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR;
-        for (auto& p : swapchainSupport.presentModes) {
-            if (p == VK_PRESENT_MODE_MAILBOX_KHR) {
-                presentMode = p;
-                break;
+        // post-processing writes the swapchain image from compute when a format
+        // allows it, otherwise blits into it.
+        VkSurfaceFormatKHR surfaceFormat = *format;
+        VkImageUsageFlags postUsage = 0;
+        if (postProcessing) {
+            VkSurfaceFormatKHR storageFormat = VulkanPostProcess::findStorageFormat(physicalDevice, swapchainSupport);
+            if (storageFormat.format != VK_FORMAT_UNDEFINED) {
+                surfaceFormat = storageFormat;
+                postUsage = VK_IMAGE_USAGE_STORAGE_BIT;
+            }
+            else if (swapchainSupport.capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_DST_BIT) {
+                postUsage = VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+            }
+            else {
+                this->postProcessing = false;
             }
         }
-        VkExtent2D extent = swapchainSupport.capabilities.currentExtent;
-        extent.width = std::clamp(extent.width,
-            swapchainSupport.capabilities.minImageExtent.width,
-            swapchainSupport.capabilities.maxImageExtent.width
-        );
-        extent.height = std::clamp(extent.height,
-            swapchainSupport.capabilities.minImageExtent.height,
-            swapchainSupport.capabilities.maxImageExtent.height
-        );
-        VulkanSwapchainArgs swapchainArgs;
-        swapchainArgs.surface = surface;
-        swapchainArgs.minImageCount = swapchainSupport.capabilities.minImageCount + 1;
+        VulkanPresentConfig presentConfig = choosePresentConfig(swapchainSupport, options.latency);
+        VkExtent2D extent = swapchainExtent(swapchainSupport.capabilities);
+        swapchainArgs.minImageCount = presentConfig.imageCount;
         swapchainArgs.extent = extent;
-        swapchainArgs.format = *format;
-        swapchainArgs.presentMode = presentMode;
+        swapchainArgs.format = surfaceFormat;
+        swapchainArgs.imageUsage |= postUsage;
+        swapchainArgs.presentMode = presentConfig.presentMode;
         swapchainArgs.queueFamilyIndices = {
             graphicsQueueFamilyIndex,
             presentQueueFamilyIndex
         };
         swapchainArgs.preTransform = swapchainSupport.capabilities.currentTransform;
-        this->swapchain = logicalDevice.createSwapchain(swapchainArgs);
+        if (!options.captureDir.empty()) {
+            if ((swapchainSupport.capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT) == 0) {
+                throw std::runtime_error("Swapchain images cannot be captured on this surface.");
+            }
+            swapchainArgs.imageUsage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        }
+        for (auto& window : windows) {
+            if (window != windows[0]) {
+                const auto& support = physicalDevice.checkSwapchainSupport(window->surface);
+                bool sameFormat = false;
+                for (auto& f : support.formats)
+                    sameFormat = sameFormat || (f.format == surfaceFormat.format && f.colorSpace == surfaceFormat.colorSpace);
+                VkExtent2D windowExtent = swapchainExtent(support.capabilities);
+                if (!sameFormat || windowExtent.width != extent.width || windowExtent.height != extent.height
+                    || (support.capabilities.supportedUsageFlags & swapchainArgs.imageUsage) != swapchainArgs.imageUsage) {
+                    throw std::runtime_error("Windows differ in surface format, extent or image usage.");
+                }
+            }
+            swapchainArgs.surface = window->surface;
+            window->swapchain = logicalDevice.createSwapchain(swapchainArgs);
+            window->onImageAvailable = logicalDevice.createSemaphore();
+            presentBatch.swapchains.push_back(window->swapchain.handle);
+            presentBatch.onImageAvailable.push_back(window->onImageAvailable);
+        }
+        presentBatch.presentIds.assign(windows.size(), 0);
+        if (logs(LogLevel::Info) && windows.size() > 1) {
+            std::cout << "Windows: " << windows.size() << ", one submit and one present per frame" << '\n';
+        }
+        this->view = VulkanMat4::lookAt(eye, VulkanVec3(), VulkanVec3(0.0f, 1.0f, 0.0f));
+        this->proj = VulkanMat4::perspective(fovY, (float)extent.width / (float)extent.height, 0.1f, 1000.0f);
+        this->viewProj = proj * view;
+        pacer.init(logicalDevice, windows[0]->swapchain.handle, presentConfig.maxQueuedFrames);
 
         VulkanGraphicsPipelineArgs pipelineArgs = {};
-        pipelineArgs.vert = readFile("./shader.vert.spv");
-        pipelineArgs.frag = readFile("./shader.frag.spv");
+        pipelineArgs.vert = shader_vert_spv;
+        pipelineArgs.frag = shader_frag_spv;
         pipelineArgs.viewport = {
             0, 0,
             (float)extent.width, (float)extent.height,
@@ -206,60 +492,728 @@ public:
             {0, 0},
             extent
         };
-        pipelineArgs.colorFormat = swapchain.format;
-        auto pipeline = logicalDevice.createGraphicsPipeline(pipelineArgs);
-        std::cout << "GraphicsPipeline created: " << (size_t)pipeline.handle << std::endl;
+        pipelineArgs.colorFormat = postProcessing ? VulkanPostProcess::findSceneFormat(physicalDevice) : surfaceFormat.format;
+        this->sceneFormat = pipelineArgs.colorFormat;
+        pipelineArgs.present = !postProcessing;
+        pipelineArgs.depthFormat = physicalDevice.findDepthFormat();
+        pipelineArgs.samples = physicalDevice.maxSampleCount((VkSampleCountFlagBits)std::max(options.msaa, 1u));
+        pipelineArgs.dynamicRendering = dynamicRendering;
+
+        // per window: their command buffers run in one submission and may overlap.
+        for (auto& window : windows) {
+            if (pipelineArgs.samples != VK_SAMPLE_COUNT_1_BIT) {
+                VulkanAttachmentArgs colorArgs;
+                colorArgs.format = pipelineArgs.colorFormat;
+                colorArgs.extent = extent;
+                colorArgs.samples = pipelineArgs.samples;
+                colorArgs.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+                window->colorAttachment = logicalDevice.createAttachment(colorArgs);
+            }
+            if (pipelineArgs.depthFormat != VK_FORMAT_UNDEFINED) {
+                VulkanAttachmentArgs depthArgs;
+                depthArgs.format = pipelineArgs.depthFormat;
+                depthArgs.extent = extent;
+                depthArgs.samples = pipelineArgs.samples;
+                depthArgs.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+                window->depthAttachment = logicalDevice.createAttachment(depthArgs);
+            }
+        }
+        if (logs(LogLevel::Info)) {
+            std::cout << "Attachments: " << pipelineArgs.samples << "x MSAA, depth format " << pipelineArgs.depthFormat
+                << (windows[0]->depthAttachment.lazilyAllocated ? ", lazily allocated" : "") << '\n';
+        }
+
+        this->pipeline = logicalDevice.createGraphicsPipeline(pipelineArgs);
+        if (logs(LogLevel::Info)) {
+            std::cout << "GraphicsPipeline created: " << (size_t)pipeline.handle.get() << (dynamicRendering ? " (dynamic rendering)" : "") << '\n';
+        }
+
+        // the demo quad, generated by the vertex shader.
+        VulkanDrawGeometry quad;
+        quad.count = 6;
+        quadItem.pipeline = renderQueue.addPipeline(pipeline);
+        quadItem.geometry = renderQueue.addGeometry(quad);
+        renderQueue.push(quadItem);
+        createSceneDraws(pipelineArgs);
 
-        this->frameBuffers = logicalDevice.createFrameBufferObject({
-            pipeline.renderPass,
-            swapchain.imageViews,
-            extent.width,
-            extent.height
-            });
+        // one timestamp slot per frame in flight, like the command buffers.
+        if (!options.tracePath.empty()) {
+            gpuProfiler.init(logicalDevice, physicalDevice, frames.framesInFlight());
+        }
+        recordArgs.queue = &renderQueue;
+        recordArgs.profiler = gpuProfiler.enabled() ? &gpuProfiler : nullptr;
+        recordArgs.usage = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+        for (auto& window : windows)
+            createWindowTargets(*window);
+        if (logs(LogLevel::Info) && postProcessing) {
+            std::cout << "Post-processing: scene format " << pipelineArgs.colorFormat
+                << ((postUsage & VK_IMAGE_USAGE_STORAGE_BIT) != 0 ? ", tonemapped into the swapchain image" : ", blitted into the swapchain image") << '\n';
+        }
 
-        this->commandBuffers = logicalDevice.beginCommandBuffers(pipeline, frameBuffers);
-        logicalDevice.endCommandBuffers(commandBuffers);
+        this->spriteTexture = createSpriteTexture(textures);
+        uploader.flush();
+
+        VulkanSpriteBatchArgs spriteArgs;
+        spriteArgs.colorFormat = pipelineArgs.colorFormat;
+        spriteArgs.depthFormat = pipelineArgs.depthFormat;
+        spriteArgs.samples = pipelineArgs.samples;
+        spriteArgs.dynamicRendering = dynamicRendering;
+        spriteArgs.extent = extent;
+        spriteArgs.maxSprites = std::max(options.sprites, 1u);
+        spriteArgs.framesInFlight = frames.framesInFlight();
+        sprites.init(logicalDevice, spriteArgs);
+        VkSampler spriteSampler = textures.getSampler(VulkanSamplerDesc());
+        sprites.addTexture(spriteTexture.view, spriteSampler);
+        for (auto& texture : packTextures)
+            sprites.addTexture(texture.view, spriteSampler);
+
+        if (meshletRendering) {
+            VulkanMeshletRendererArgs meshletArgs;
+            meshletArgs.colorFormat = pipelineArgs.colorFormat;
+            meshletArgs.depthFormat = pipelineArgs.depthFormat;
+            meshletArgs.samples = pipelineArgs.samples;
+            meshletArgs.dynamicRendering = dynamicRendering;
+            meshletArgs.extent = extent;
+            meshletArgs.meshShader = meshShader;
+            meshletArgs.maxInstances = options.meshlets;
+            meshletArgs.framesInFlight = frames.framesInFlight();
+            meshlets.init(logicalDevice, uploader, meshletArgs);
+            createMeshlets();
+            for (auto* entry : packMeshlets)
+                meshlets.addMesh(entry->meshlets, pack.blob(*entry));
+            uploader.flush();
+            if (logs(LogLevel::Info)) {
+                std::cout << "Meshlets: " << (meshShader ? "mesh shaders" : "compute culling and draw-indirect-count") << '\n';
+            }
+        }
+        else if (options.meshlets > 0 && logs(LogLevel::Info)) {
+            std::cout << "Meshlets: not supported on this device" << '\n';
+        }
+
+        if (options.particles > 0) {
+            VulkanParticleSystemArgs particleArgs;
+            particleArgs.colorFormat = pipelineArgs.colorFormat;
+            particleArgs.depthFormat = pipelineArgs.depthFormat;
+            particleArgs.samples = pipelineArgs.samples;
+            particleArgs.dynamicRendering = dynamicRendering;
+            particleArgs.extent = extent;
+            particleArgs.maxParticles = options.particles;
+            particleArgs.framesInFlight = frames.framesInFlight();
+            particles.init(logicalDevice, uploader, particleArgs);
+            uploader.flush();
+            // four fountains that together keep about `particles` alive.
+            const uint32_t FOUNTAINS = 4;
+            for (uint32_t i = 0; i < FOUNTAINS; i++) {
+                VulkanParticleEmitter emitter;
+                emitter.position = VulkanVec3(i % 2 == 0 ? -4.0f : 4.0f, -1.0f, i < 2 ? 0.0f : -6.0f);
+                emitter.radius = 0.1f;
+                emitter.spread = 0.25f;
+                emitter.speedMin = 5.0f;
+                emitter.speedMax = 7.0f;
+                emitter.lifeMin = 2.0f;
+                emitter.lifeMax = 3.0f;
+                emitter.colorStart = 0xff40c0ffu - i * 0x00200000u;
+                emitter.colorEnd = 0x002040ffu;
+                emitter.rate = (float)options.particles / 2.5f / FOUNTAINS;
+                particles.addEmitter(emitter);
+            }
+        }
+
+        cull = [this](size_t begin, size_t end) {
+            VULKAN_PROFILE_ZONE("cull");
+            for (size_t c = begin; c < end; c++) {
+                cullPackets[c].clear();
+                scene.collectDraws(viewProj, cullPackets[c], (uint32_t)c * CULL_CHUNK, CULL_CHUNK);
+            }
+        };
 
-        this->onImageAvailable = logicalDevice.createSemaphore();
         this->onRenderFinished = logicalDevice.createSemaphore();
+
+        if (!options.captureDir.empty()) {
+            this->onCaptureFinished = logicalDevice.createSemaphore();
+
+            VulkanReadbackArgs readbackArgs;
+            readbackArgs.extent = windows[0]->swapchain.extent;
+            readbackArgs.format = windows[0]->swapchain.format;
+            readbackArgs.slotCount = (uint32_t)windows[0]->swapchain.images.size();
+            readbackArgs.encoding = VulkanReadbackEncoding::PNG;
+            readbackArgs.callback = [dir = options.captureDir](VulkanReadbackResult& result) {
+                char name[32];
+                snprintf(name, sizeof(name), "/frame_%06llu.png", (unsigned long long)result.frame);
+                std::ofstream file(dir + name, std::ios::binary);
+                file.write((const char*)result.data.data(), result.data.size());
+            };
+            readback.init(logicalDevice, readbackArgs);
+        }
     }
 
     void quit()
     {
+        if (logicalDevice.capture != nullptr) {
+            capture.close();
+            logicalDevice.capture = nullptr;
+            if (logs(LogLevel::Info)) {
+                std::cout << "Capture: " << capture.size() << " bytes written to " << options.recordPath << '\n';
+            }
+        }
+        deletions.quit();
+        readback.quit();
+        logicalDevice.destroySemaphore(onCaptureFinished);
         logicalDevice.destroySemaphore(onRenderFinished);
-        logicalDevice.destroySemaphore(onImageAvailable);
-        logicalDevice.destroyFrameBufferObject(frameBuffers);
+        particles.quit();
+        meshlets.quit();
+        sprites.quit();
+        textures.destroyTexture(spriteTexture);
+        renderQueue.reset();
+        meshPipelines.clear();
+        meshGeometries.clear();
+        sceneSets.clear();
+        sceneDescriptorPool.reset();
+        logicalDevice.destroyBuffer(sceneTransforms);
+        for (auto& scenePipeline : scenePipelines)
+            logicalDevice.destroyGraphicsPipeline(scenePipeline);
+        scenePipelines.clear();
+        gpuProfiler.quit();
         logicalDevice.destroyGraphicsPipeline(pipeline);
-        logicalDevice.destroySwapchain(swapchain);
+        for (auto& window : windows) {
+            logicalDevice.destroySemaphore(window->onImageAvailable);
+            logicalDevice.destroyFrameBufferObject(window->frameBuffers);
+            window->post.quit();
+            logicalDevice.destroyAttachment(window->depthAttachment);
+            logicalDevice.destroyAttachment(window->colorAttachment);
+            logicalDevice.destroySwapchain(window->swapchain);
+        }
+        presentBatch = VulkanPresentBatch();
+        scene.clear();
+        for (auto& mesh : packMeshes)
+            pack.destroyMesh(mesh);
+        packMeshes.clear();
+        packMeshStrides.clear();
+        packMeshlets.clear();
+        for (auto& texture : packTextures)
+            textures.destroyTexture(texture);
+        packTextures.clear();
+        pack.quit();
+        streamer.quit();
+        textures.quit();
+        uploader.quit();
+        allocator.quit();
+        drawPackets = VulkanArenaVector<VulkanDrawPacket>();
+        frameArenas.quit();
+        frameCommands.quit();
+        frames.quit();
         physicalDevice.destroyLogicalDevice(logicalDevice);
-        if (surface != nullptr)
-        {
-            vkDestroySurfaceKHR(instance.handle, surface, nullptr);
-            surface = nullptr;
+        for (auto& window : windows) {
+            if (window->surface != nullptr)
+            {
+                vkDestroySurfaceKHR(instance.handle, window->surface, nullptr);
+                window->surface = nullptr;
+            }
         }
         VulkanInstance::destroyInstance(instance);
-        if (window != nullptr)
-        {
-            glfwDestroyWindow(window);
-            window = nullptr;
+        for (auto& window : windows) {
+            if (window->handle != nullptr)
+            {
+                glfwDestroyWindow(window->handle);
+                window->handle = nullptr;
+            }
         }
+        windows.clear();
         glfwTerminate();
+        jobs.quit();
     }
 
     void exec()
     {
-        VulkanPresentArgs presentArgs;
-        presentArgs.swapchain = swapchain.handle;
-        presentArgs.commandBuffers = commandBuffers;
-        presentArgs.onImageAvailable = onImageAvailable;
-        presentArgs.onRenderFinished = onRenderFinished;
-
-        while (!glfwWindowShouldClose(window)) {
+        uint64_t frame = 0;
+        while (!windowClosed()) {
+            VULKAN_PROFILE_ZONE("frame");
+            // wait before polling, so the frame is built from the freshest input.
+            pacer.pace();
+            VkFence fence = frames.begin(frame);
+            frameArenas.begin(frame);
             glfwPollEvents();
-            logicalDevice.present(presentArgs);
+            recreateSwapchains(frame);
+            this->update(frame);
+            render(frame, pacer.nextPresentId(), fence);
+            deletions.collect(frames.completedFrames());
+            gpuProfiler.collect();
+            frame++;
         }
 
         vkDeviceWaitIdle(logicalDevice.device);
+        if (!options.tracePath.empty()) {
+            gpuProfiler.collect();
+            VulkanProfiler::instance().stop();
+            std::ofstream trace(options.tracePath);
+            VulkanProfiler::instance().writeChromeTrace(trace);
+            if (logs(LogLevel::Info)) {
+                std::cout << "Trace written: " << options.tracePath << '\n';
+            }
+        }
+        if (readback.droppedFrames() > 0 && logs(LogLevel::Info)) {
+            std::cout << "Capture dropped " << readback.droppedFrames() << " frames" << '\n';
+        }
+    }
+
+    // The CPU side of a frame as jobs: scene update, then culling split across the
+    // workers; texture streaming and uploads submit to the queue, so they stay on
+    // the main thread, which runs them while it waits for the rest.
+    void update(uint64_t frame)
+    {
+        VulkanJobCounter sceneUpdated;
+        VulkanJobCounter done;
+
+        VULKAN_PROFILE_ZONE("update");
+        jobs.run([this]() {
+            VULKAN_PROFILE_ZONE("scene update");
+            scene.update();
+        }, &sceneUpdated);
+        jobs.runAfter(sceneUpdated, [this, &done]() {
+            uint32_t chunks = (scene.size() + CULL_CHUNK - 1) / CULL_CHUNK;
+            cullPackets.resize(chunks);
+            jobs.parallelFor(chunks, 1, cull, &done);
+        }, &done);
+        jobs.run([this, frame]() {
+            updateSprites(frame);
+        }, &done);
+        if (meshletRendering) {
+            jobs.run([this, frame]() {
+                updateMeshlets(frame);
+            }, &done);
+        }
+        if (options.particles > 0) {
+            jobs.run([this, frame]() {
+                particles.update(frame, 1.0f / 60.0f, view, proj);
+            }, &done);
+        }
+        jobs.runOnMain([this, frame]() {
+            VULKAN_PROFILE_ZONE("streaming and uploads");
+            streamer.update(frame);
+            uploader.flush();
+            uploader.collect();
+        }, &done);
+        jobs.wait(done);
+
+        // the previous list was on another frame's arena, dropping it is free.
+        size_t packetCount = 0;
+        for (auto& packets : cullPackets)
+            packetCount += packets.size();
+        drawPackets = VulkanArenaVector<VulkanDrawPacket>(frameArenas.arena());
+        drawPackets.reserve(packetCount);
+        for (auto& packets : cullPackets)
+            drawPackets.insert(drawPackets.end(), packets.begin(), packets.end());
+        pushSceneDraws(frame);
+    }
+
+    // The pack meshes, drawn through the render queue: a pipeline per vertex
+    // stride, a geometry per mesh, and per frame in flight a region of the
+    // transform buffer with its descriptor set. The scene keeps its size after
+    // init, its matrices are sized for it.
+    void createSceneDraws(const VulkanGraphicsPipelineArgs& baseArgs)
+    {
+        if (packMeshes.empty())
+            return;
+
+        VulkanGraphicsPipelineArgs meshArgs = baseArgs;
+        meshArgs.vert = scene_vert_spv;
+        meshArgs.frag = meshlet_frag_spv;
+        meshArgs.vertexAttributes.push_back({ 0, 0, VK_FORMAT_R32G32B32_SFLOAT, 0 });
+        meshArgs.bindings.push_back({ 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT, nullptr });
+        std::vector<uint32_t> strides;
+        std::vector<uint32_t> pipelineIds;
+        for (uint32_t i = 0; i < packMeshes.size(); i++) {
+            size_t p = std::find(strides.begin(), strides.end(), packMeshStrides[i]) - strides.begin();
+            if (p == strides.size()) {
+                meshArgs.vertexBindings.assign(1, { 0, packMeshStrides[i], VK_VERTEX_INPUT_RATE_VERTEX });
+                scenePipelines.push_back(logicalDevice.createGraphicsPipeline(meshArgs));
+                strides.push_back(packMeshStrides[i]);
+                pipelineIds.push_back(renderQueue.addPipeline(scenePipelines.back()));
+            }
+            meshPipelines.push_back(pipelineIds[p]);
+
+            VulkanDrawGeometry geometry;
+            geometry.vertexBuffer = packMeshes[i].buffer;
+            geometry.indexBuffer = packMeshes[i].buffer;
+            geometry.indexOffset = packMeshes[i].indexOffset;
+            geometry.indexType = packMeshes[i].indexType;
+            geometry.count = packMeshes[i].indexCount;
+            meshGeometries.push_back(renderQueue.addGeometry(geometry));
+        }
+
+        uint32_t slots = frames.framesInFlight();
+        VkDeviceSize alignment = std::max<VkDeviceSize>(physicalDevice.props.limits.minStorageBufferOffsetAlignment, 1);
+        this->sceneCapacity = scene.size();
+        this->sceneRegionSize = ((1 + sceneCapacity) * sizeof(VulkanMat4) + alignment - 1) / alignment * alignment;
+        VulkanBufferArgs bufferArgs = {};
+        bufferArgs.size = slots * sceneRegionSize;
+        bufferArgs.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+        bufferArgs.memoryProps = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        bufferArgs.preferredMemoryProps = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+        bufferArgs.mapped = true;
+        this->sceneTransforms = logicalDevice.createBuffer(bufferArgs);
+
+        VkDescriptorPoolSize poolSize = { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, slots };
+        VkDescriptorPoolCreateInfo dpci = {};
+        dpci.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        dpci.pNext = nullptr;
+        dpci.flags = 0;
+        dpci.maxSets = slots;
+        dpci.poolSizeCount = 1;
+        dpci.pPoolSizes = &poolSize;
+        if (VK_SUCCESS != vkCreateDescriptorPool(logicalDevice.device, &dpci, nullptr, sceneDescriptorPool.put(logicalDevice.device)))
+        {
+            throw std::runtime_error("Create scene descriptor-pool failed.");
+        }
+        for (uint32_t slot = 0; slot < slots; slot++) {
+            VkDescriptorSetAllocateInfo dsai = {};
+            dsai.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+            dsai.pNext = nullptr;
+            dsai.descriptorPool = sceneDescriptorPool;
+            dsai.descriptorSetCount = 1;
+            dsai.pSetLayouts = scenePipelines[0].setLayout.address();
+            VkDescriptorSet set;
+            if (VK_SUCCESS != vkAllocateDescriptorSets(logicalDevice.device, &dsai, &set))
+            {
+                throw std::runtime_error("Allocate scene descriptor-set failed.");
+            }
+
+            VkDescriptorBufferInfo buffer = { sceneTransforms.handle, slot * sceneRegionSize, sceneRegionSize };
+            VkWriteDescriptorSet write = {};
+            write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            write.pNext = nullptr;
+            write.dstSet = set;
+            write.dstBinding = 0;
+            write.dstArrayElement = 0;
+            write.descriptorCount = 1;
+            write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            write.pBufferInfo = &buffer;
+            vkUpdateDescriptorSets(logicalDevice.device, 1, &write, 0, nullptr);
+            sceneSets.push_back(renderQueue.addDescriptorSet(set));
+        }
+        if (logs(LogLevel::Info)) {
+            std::cout << "Scene draws: " << packMeshes.size() << " meshes, " << scenePipelines.size() << " pipelines" << '\n';
+        }
+    }
+
+    // The queue holds this frame's draws only: the demo quad, then an item per
+    // culled packet. The transforms go to the frame slot's region, which the
+    // GPU is done with once the slot's fence has been waited for.
+    void pushSceneDraws(uint64_t frame)
+    {
+        renderQueue.clear();
+        renderQueue.push(quadItem);
+        if (scenePipelines.empty())
+            return;
+
+        uint32_t slot = frameCommands.slot(frame);
+        uint32_t count = std::min(scene.size(), sceneCapacity);
+        auto* transforms = (VulkanMat4*)((uint8_t*)sceneTransforms.mapped + slot * sceneRegionSize);
+        transforms[0] = viewProj;
+        memcpy(transforms + 1, scene.worldMatrices(), count * sizeof(VulkanMat4));
+        for (const auto& packet : drawPackets) {
+            if (packet.transform >= count || packet.mesh >= packMeshes.size())
+                continue;
+            VulkanDrawItem item;
+            item.pipeline = meshPipelines[packet.mesh];
+            item.descriptorSet = sceneSets[slot];
+            item.geometry = meshGeometries[packet.mesh];
+            item.firstInstance = packet.transform;
+            item.depth = packet.depth;
+            renderQueue.push(item);
+        }
+    }
+
+    void updateSprites(uint64_t frame)
+    {
+        VULKAN_PROFILE_ZONE("sprites");
+        sprites.begin(frame);
+        animateSprites(sprites, options.sprites, 1 + (uint32_t)packTextures.size(),
+            windows[0]->swapchain.extent, { 0, 0 }, frame);
+        sprites.flush();
+    }
+
+    // A torus dense enough that most of its triangles are sub-pixel at a
+    // distance; front faces clockwise from outside, like the pipelines expect.
+    void createMeshlets()
+    {
+        const uint32_t RING = 512;
+        const uint32_t TUBE = 256;
+        std::vector<float> positions;
+        positions.reserve(RING * TUBE * 3);
+        for (uint32_t i = 0; i < RING; i++) {
+            for (uint32_t j = 0; j < TUBE; j++) {
+                float a = 6.2831853f * i / RING;
+                float b = 6.2831853f * j / TUBE;
+                float r = 1.0f + 0.35f * std::cos(b);
+                positions.push_back(r * std::cos(a));
+                positions.push_back(0.35f * std::sin(b));
+                positions.push_back(r * std::sin(a));
+            }
+        }
+        std::vector<uint32_t> indices;
+        indices.reserve(RING * TUBE * 6);
+        for (uint32_t i = 0; i < RING; i++) {
+            for (uint32_t j = 0; j < TUBE; j++) {
+                uint32_t a = i * TUBE + j;
+                uint32_t b = (i + 1) % RING * TUBE + j;
+                uint32_t c = (i + 1) % RING * TUBE + (j + 1) % TUBE;
+                uint32_t d = i * TUBE + (j + 1) % TUBE;
+                indices.insert(indices.end(), { a, b, c, a, c, d });
+            }
+        }
+
+        VulkanMeshletBuildArgs buildArgs;
+        buildArgs.vertices = positions.data();
+        buildArgs.vertexCount = RING * TUBE;
+        buildArgs.vertexStride = 3 * sizeof(float);
+        buildArgs.indices = indices.data();
+        buildArgs.indexCount = (uint32_t)indices.size();
+        VulkanMeshletData data = buildMeshlets(buildArgs);
+
+        VulkanPackMeshletInfo info;
+        std::vector<uint8_t> blob = encodeMeshlets(positions.data(), buildArgs.vertexCount, buildArgs.vertexStride, data, info);
+        meshlets.addMesh(info, blob.data());
+        if (logs(LogLevel::Info)) {
+            std::cout << "Meshlet mesh: " << indices.size() / 3 << " triangles, " << data.meshlets.size()
+                << " clusters in " << info.levelCount << " levels" << '\n';
+        }
+    }
+
+    // Tori on a grid receding from the camera, each spinning on its own axis;
+    // every mesh in the pack takes a share of the instances.
+    void updateMeshlets(uint64_t frame)
+    {
+        VULKAN_PROFILE_ZONE("meshlets");
+        meshlets.begin(frame);
+        float t = (float)frame / 60.0f;
+        uint32_t side = (uint32_t)std::ceil(std::sqrt((float)options.meshlets));
+        uint32_t meshCount = 1 + (uint32_t)packMeshlets.size();
+        for (uint32_t i = 0; i < options.meshlets; i++) {
+            float phase = (float)i * 0.618034f;
+            VulkanVec3 position(3.0f * ((float)(i % side) - 0.5f * (float)side), 0.0f, -3.0f * (float)(i / side));
+            VulkanVec3 axis = normalize(VulkanVec3(std::sin(phase), 1.0f, std::cos(phase)));
+            VulkanMat4 model = VulkanMat4::compose(position, VulkanQuat::axisAngle(axis, t + phase), VulkanVec3(1.0f, 1.0f, 1.0f));
+            meshlets.push(i % meshCount, model);
+        }
+        meshlets.flush(viewProj, eye, fovY);
+    }
+
+    // Recorded every frame into the frame slot's command buffers, one per
+    // window, each on its own job: the sprites change each frame, and recording
+    // is cheap next to the fence wait. Every window's image is acquired up
+    // front, so the whole frame is one submission and one present however many
+    // windows there are. A window whose acquire fails (out of date, minimized)
+    // sits the frame out; with none left only the compute is submitted. Windows
+    // whose acquire or present reports out of date, suboptimal or surface lost
+    // are recreated at the start of a later frame.
+    void render(uint64_t frame, uint64_t presentId, VkFence fence)
+    {
+        presentBatch.presentIds[0] = presentId;
+        uint32_t acquired = logicalDevice.acquireNextImages(presentBatch);
+
+        // sorted once, across the workers, so the windows only read the queue.
+        renderQueue.sort(jobs);
+        frameCommands.begin(frame);
+        commandBuffers.assign(1 + windows.size(), VK_NULL_HANDLE);
+        commandBuffers[0] = recordPrepare(frame);
+        leadWindow = 0;
+        while (leadWindow < windows.size() && presentBatch.imageIndices[leadWindow] == UINT32_MAX)
+            leadWindow++;
+        VulkanJobCounter recorded;
+        VulkanJobRange record = [this, frame](size_t begin, size_t end) {
+            for (size_t w = begin; w < end; w++)
+                recordWindow(frame, (uint32_t)w);
+        };
+        jobs.parallelFor(windows.size(), 1, record, &recorded);
+        jobs.wait(recorded);
+        if (logicalDevice.capture != nullptr) {
+            for (auto& window : windows)
+                capture.flush(window->captureRecords);
+        }
+        commandBuffers.erase(std::remove(commandBuffers.begin(), commandBuffers.end(), VK_NULL_HANDLE), commandBuffers.end());
+
+        // with post-processing the swapchain image is first written by compute
+        // or a blit: the scene renders before the image is even available.
+        VkPipelineStageFlags waitStage = postProcessing ? windows[0]->post.outputStage() : VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        logicalDevice.submit(commandBuffers.data(), (uint32_t)commandBuffers.size(), presentBatch,
+            waitStage, acquired > 0 ? onRenderFinished.get() : VK_NULL_HANDLE, fence);
+        if (acquired > 0)
+            present(frame);
+        for (size_t w = 0; w < windows.size(); w++) {
+            VkResult result = presentBatch.results[w];
+            if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || result == VK_ERROR_SURFACE_LOST_KHR)
+                windows[w]->dirty = true;
+            if (result == VK_ERROR_SURFACE_LOST_KHR)
+                windows[w]->surfaceLost = true;
+        }
+    }
+
+    void present(uint64_t frame)
+    {
+        if (options.captureDir.empty() || presentBatch.imageIndices[0] == UINT32_MAX) {
+            logicalDevice.presentImages(presentBatch, onRenderFinished);
+            return;
+        }
+        readback.capture(windows[0]->swapchain.images[presentBatch.imageIndices[0]], VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, frame,
+            onRenderFinished, onCaptureFinished);
+        logicalDevice.presentImages(presentBatch, onCaptureFinished);
+        readback.poll();
+    }
+
+    // What the scene renders into on its way to the window's swapchain images:
+    // the post chain, and the render targets or the frame buffers.
+    void createWindowTargets(VulkanAppWindow& window)
+    {
+        if (postProcessing) {
+            VulkanPostProcessArgs postArgs;
+            postArgs.swapchain = &window.swapchain;
+            postArgs.storageOutput = (swapchainArgs.imageUsage & VK_IMAGE_USAGE_STORAGE_BIT) != 0;
+            window.post.init(logicalDevice, textures, sceneFormat, postArgs);
+        }
+
+        if (dynamicRendering) {
+            window.targets.swapchain = &window.swapchain;
+            window.targets.color = window.colorAttachment.view != VK_NULL_HANDLE ? &window.colorAttachment : nullptr;
+            window.targets.depth = window.depthAttachment.view != VK_NULL_HANDLE ? &window.depthAttachment : nullptr;
+            window.targets.output = postProcessing ? &window.post.sceneColor() : nullptr;
+        }
+        else {
+            VulkanFrameBufferArgs frameBufferArgs;
+            frameBufferArgs.renderPass = pipeline.renderPass;
+            frameBufferArgs.imageViews = postProcessing ? &window.post.sceneColor().view : window.swapchain.imageViews.data();
+            frameBufferArgs.imageViewCount = postProcessing ? 1 : (uint32_t)window.swapchain.imageViews.size();
+            frameBufferArgs.width = swapchainArgs.extent.width;
+            frameBufferArgs.height = swapchainArgs.extent.height;
+            frameBufferArgs.colorView = window.colorAttachment.view;
+            frameBufferArgs.depthView = window.depthAttachment.view;
+            window.frameBuffers = logicalDevice.createFrameBufferObject(frameBufferArgs);
+        }
+    }
+
+    // Past the slot fence, for the windows marked dirty: a new swapchain, post
+    // chain and targets or frame buffers, the old ones retired with this frame
+    // since the frames still in flight may use them. The pipelines, renderers
+    // and attachments are built for the extent picked in init(), so a window is
+    // recreated only while its surface allows that extent; minimized or resized
+    // away from it, it stays dirty and its acquires keep failing.
+    void recreateSwapchains(uint64_t frame)
+    {
+        for (size_t w = 0; w < windows.size(); w++) {
+            auto& window = *windows[w];
+            if (!window.dirty)
+                continue;
+            // a lost surface is replaced too; until the new one takes a
+            // swapchain the old pair stays, failing its acquires.
+            VkSurfaceKHR surface = window.surface;
+            if (window.surfaceLost && glfwCreateWindowSurface(instance.handle, window.handle, nullptr, &surface) != VK_SUCCESS)
+            {
+                throw std::runtime_error("Failed to create window surface!");
+            }
+            const auto& support = physicalDevice.checkSwapchainSupport(surface);
+            const VkSurfaceCapabilitiesKHR& capabilities = support.capabilities;
+            VkExtent2D extent = swapchainArgs.extent;
+            if (extent.width < capabilities.minImageExtent.width || extent.width > capabilities.maxImageExtent.width
+                || extent.height < capabilities.minImageExtent.height || extent.height > capabilities.maxImageExtent.height) {
+                if (surface != window.surface)
+                    vkDestroySurfaceKHR(instance.handle, surface, nullptr);
+                continue;
+            }
+
+            VulkanSwapchainArgs args = swapchainArgs;
+            args.surface = surface;
+            args.preTransform = capabilities.currentTransform;
+            args.oldSwapchain = surface == window.surface ? window.swapchain.handle.get() : VK_NULL_HANDLE;
+            VulkanSwapchain swapchain = logicalDevice.createSwapchain(args);
+            deletions.retire(frame, window.swapchain);
+            window.swapchain = std::move(swapchain);
+            if (surface != window.surface) {
+                // retired after the swapchain, so destroyed after it.
+                deletions.retire(frame, [instance = instance.handle, lost = window.surface]() {
+                    vkDestroySurfaceKHR(instance, lost, nullptr);
+                });
+                window.surface = surface;
+                window.surfaceLost = false;
+            }
+            if (postProcessing) {
+                auto post = std::make_shared<VulkanPostProcess>(std::move(window.post));
+                window.post = VulkanPostProcess();
+                deletions.retire(frame, [post]() { post->quit(); });
+            }
+            if (!dynamicRendering)
+                deletions.retire(frame, window.frameBuffers);
+            createWindowTargets(window);
+
+            presentBatch.swapchains[w] = window.swapchain.handle;
+            if (w == 0)
+                pacer.init(logicalDevice, window.swapchain.handle, pacer.maxQueuedFrames);
+            window.dirty = false;
+            if (logs(LogLevel::Info)) {
+                std::cout << "Swapchain recreated: window " << w << ", " << window.swapchain.images.size() << " images" << '\n';
+            }
+        }
+    }
+
+    void recordWindow(uint64_t frame, uint32_t w)
+    {
+        VULKAN_PROFILE_ZONE("record");
+        auto& window = *windows[w];
+        uint32_t imageIndex = presentBatch.imageIndices[w];
+        if (imageIndex == UINT32_MAX)
+            return;
+        VkCommandBuffer commandBuffer = frameCommands.get(frame, 1 + w);
+        VulkanRecordArgs args = recordArgs;
+        args.slot = frameCommands.slot(frame);
+        args.post = postProcessing ? &window.post : nullptr;
+        // the profiler has one zone per slot.
+        if (w != leadWindow)
+            args.profiler = nullptr;
+        // the windows record in parallel: their capture records are written in order by render().
+        if (logicalDevice.capture != nullptr)
+            capture.beginDeferred(window.captureRecords);
+        if (dynamicRendering) {
+            logicalDevice.beginCommandBuffer(commandBuffer, imageIndex, pipeline, window.targets, args);
+            meshlets.record(commandBuffer);
+            particles.record(commandBuffer);
+            sprites.record(commandBuffer);
+            logicalDevice.endCommandBuffer(commandBuffer, imageIndex, window.targets, args);
+        }
+        else {
+            logicalDevice.beginCommandBuffer(commandBuffer, imageIndex, pipeline, window.frameBuffers, args);
+            meshlets.record(commandBuffer);
+            particles.record(commandBuffer);
+            sprites.record(commandBuffer);
+            logicalDevice.endCommandBuffer(commandBuffer, imageIndex, args);
+        }
+        if (logicalDevice.capture != nullptr)
+            capture.endDeferred();
+        commandBuffers[1 + w] = commandBuffer;
+    }
+
+    // Culling and simulation write indirect arguments before the passes begin.
+    // Recorded before the windows' jobs start and submitted ahead of them, even
+    // when no window acquired an image: the simulation must keep up with the
+    // CPU side advanced by update().
+    VkCommandBuffer recordPrepare(uint64_t frame)
+    {
+        VkCommandBuffer commandBuffer = frameCommands.get(frame, 0);
+        VkCommandBufferBeginInfo cbbi = {};
+        cbbi.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        cbbi.pNext = nullptr;
+        cbbi.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        cbbi.pInheritanceInfo = nullptr;
+        if (VK_SUCCESS != vkBeginCommandBuffer(commandBuffer, &cbbi))
+        {
+            throw std::runtime_error("Begin command-buffer failed.");
+        }
+        meshlets.prepare(commandBuffer);
+        particles.simulate(commandBuffer);
+        if (VK_SUCCESS != vkEndCommandBuffer(commandBuffer))
+        {
+            throw std::runtime_error("End command-buffer failed.");
+        }
+        return commandBuffer;
     }
 
     static void onWindowResize(GLFWwindow* window, int width, int height) {
@@ -267,11 +1221,341 @@ public:
         if (userPointer == nullptr || width <= 0 || height <= 0)
             return;
         auto& app = *(VulkanApp*)userPointer;
+        for (auto& appWindow : app.windows) {
+            if (appWindow->handle == window)
+                appWindow->dirty = true;
+        }
     }
 };
 
+// Batch mode: the demo quad under the sprite animation for `batchFrames`
+// frames, rendered offscreen on every device at once and written to the
+// capture directory, if any, as frame_NNNNNN.png (with a _tNN tile suffix when
+// frames are split into tiles).
+static int runBatch(const VulkanAppOptions& options) {
+    struct BatchScene {
+        VulkanAllocator allocator;
+        VulkanUploader uploader;
+        VulkanTextureManager textures;
+        VulkanTexture texture;
+        VulkanSpriteBatch sprites;
+    };
+    std::vector<std::unique_ptr<BatchScene>> scenes;    // one per device
+    VulkanInstance instance;
+    VulkanBatchRenderer batch;
+    try {
+        if (!options.tracePath.empty()) {
+            VulkanProfiler::instance().start();
+        }
+        VulkanInstanceArgs instanceArgs = {};
+        instanceArgs.appName = _WINDOW_TITLE;
+        instanceArgs.appVersion = 1;
+        const auto& instanceCaps = VulkanCapabilities::instance();
+        if (_DEBUG && instanceCaps.enableLayer(VULKAN_VALIDATION_LAYER_NAME, instanceArgs.layers)) {
+            instanceCaps.enableExtension(VK_EXT_DEBUG_REPORT_EXTENSION_NAME, instanceArgs.extensions);
+        }
+        instance = VulkanInstance::createInstance(instanceArgs);
+
+        VulkanBatchArgs batchArgs;
+        batchArgs.extent = { _WINDOW_WIDTH, _WINDOW_HEIGHT };
+        batchArgs.frameCount = options.batchFrames;
+        batchArgs.tilesX = std::max(options.tilesX, 1u);
+        batchArgs.tilesY = std::max(options.tilesY, 1u);
+        batchArgs.pipeline.vert = shader_vert_spv;
+        batchArgs.pipeline.frag = shader_frag_spv;
+        VkExtent2D frameExtent = batchArgs.extent;
+        VkExtent2D tileExtent = { frameExtent.width / batchArgs.tilesX, frameExtent.height / batchArgs.tilesY };
+        VkFormat format = batchArgs.format;
+        uint32_t framesInFlight = batchArgs.framesInFlight;
+        uint32_t spriteCount = options.sprites;
+
+        batchArgs.setup = [&scenes, tileExtent, format, framesInFlight, spriteCount](VulkanBatchContext& context) {
+            auto& scene = *scenes[context.index];
+            const VulkanLogicalDevice& logicalDevice = *context.logicalDevice;
+            scene.allocator.init(logicalDevice);
+            scene.uploader.init(logicalDevice);
+            scene.textures.init(logicalDevice, scene.allocator, scene.uploader, 1.0f);
+            scene.texture = createSpriteTexture(scene.textures);
+            scene.uploader.flush();
+
+            VulkanSpriteBatchArgs spriteArgs;
+            spriteArgs.colorFormat = format;
+            spriteArgs.extent = tileExtent;
+            spriteArgs.maxSprites = std::max(spriteCount, 1u);
+            spriteArgs.framesInFlight = framesInFlight;
+            scene.sprites.init(logicalDevice, spriteArgs);
+            scene.sprites.addTexture(scene.texture.view, scene.textures.getSampler(VulkanSamplerDesc()));
+        };
+        batchArgs.record = [&scenes, frameExtent, spriteCount](VulkanBatchContext& context, VkCommandBuffer commandBuffer, const VulkanBatchItem& item) {
+            auto& scene = *scenes[context.index];
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, context.pipeline->handle);
+            vkCmdDraw(commandBuffer, 6, 1, 0, 0);
+            scene.sprites.begin(context.recorded);
+            animateSprites(scene.sprites, spriteCount, 1, frameExtent, item.area.offset, item.frame);
+            scene.sprites.flush();
+            scene.sprites.record(commandBuffer);
+        };
+        batchArgs.teardown = [&scenes](VulkanBatchContext& context) {
+            auto& scene = *scenes[context.index];
+            scene.sprites.quit();
+            scene.textures.destroyTexture(scene.texture);
+            scene.textures.quit();
+            scene.uploader.quit();
+            scene.allocator.quit();
+        };
+        if (!options.captureDir.empty()) {
+            bool tiled = batchArgs.tilesX * batchArgs.tilesY > 1;
+            batchArgs.output = [dir = options.captureDir, tiled](const VulkanBatchItem& item, VulkanReadbackResult& result) {
+                char name[48];
+                if (tiled)
+                    snprintf(name, sizeof(name), "/frame_%06llu_t%02u.png", (unsigned long long)item.frame, item.tile);
+                else
+                    snprintf(name, sizeof(name), "/frame_%06llu.png", (unsigned long long)item.frame);
+                std::ofstream file(dir + name, std::ios::binary);
+                file.write((const char*)result.data.data(), result.data.size());
+            };
+        }
+
+        batch.init(instance, batchArgs);
+        for (uint32_t i = 0; i < batch.deviceCount(); i++) {
+            scenes.push_back(std::make_unique<BatchScene>());
+        }
+        if (options.logLevel >= LogLevel::Info) {
+            std::cout << "Batch: " << options.batchFrames << " frames in " << batchArgs.tilesX * batchArgs.tilesY
+                << " tiles each, on " << batch.deviceCount() << " devices" << '\n';
+        }
+        batch.run();
+
+        if (options.logLevel >= LogLevel::Info) {
+            for (uint32_t i = 0; i < batch.deviceCount(); i++) {
+                auto stats = batch.statistics(i);
+                std::cout << tab(1) << stats.name << ": " << stats.items << " items, "
+                    << (stats.seconds > 0.0 ? stats.items / stats.seconds : 0.0) << " items/s" << '\n';
+            }
+            std::cout << "Batch done: " << options.batchFrames / batch.totalSeconds() << " frames/s" << '\n';
+        }
+        batch.quit();
+        scenes.clear();
+        VulkanInstance::destroyInstance(instance);
+        if (!options.tracePath.empty()) {
+            VulkanProfiler::instance().stop();
+            std::ofstream trace(options.tracePath);
+            VulkanProfiler::instance().writeChromeTrace(trace);
+        }
+        return 0;
+    }
+    catch (const std::exception& e) {
+        batch.quit();
+        scenes.clear();
+        VulkanInstance::destroyInstance(instance);
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+}
+
+// Replay mode: a capture written with --record, replayed offscreen on the
+// selected device as fast as it goes, or with --paced at the recorded frame
+// times, then the timings of both.
+static int runReplay(const VulkanAppOptions& options) {
+    VulkanInstance instance;
+    VulkanPhysicalDevice physicalDevice;
+    VulkanLogicalDevice logicalDevice;
+    VulkanAllocator allocator;
+    VulkanUploader uploader;
+    VulkanTextureManager textures;
+    VulkanReplay replay;
+    auto quit = [&]() {
+        replay.quit();
+        textures.quit();
+        uploader.quit();
+        allocator.quit();
+        physicalDevice.destroyLogicalDevice(logicalDevice);
+        VulkanInstance::destroyInstance(instance);
+    };
+    try {
+        if (!options.tracePath.empty()) {
+            VulkanProfiler::instance().start();
+        }
+        VulkanInstanceArgs instanceArgs = {};
+        instanceArgs.appName = _WINDOW_TITLE;
+        instanceArgs.appVersion = 1;
+        const auto& instanceCaps = VulkanCapabilities::instance();
+        if (_DEBUG && instanceCaps.enableLayer(VULKAN_VALIDATION_LAYER_NAME, instanceArgs.layers)) {
+            instanceCaps.enableExtension(VK_EXT_DEBUG_REPORT_EXTENSION_NAME, instanceArgs.extensions);
+        }
+        instance = VulkanInstance::createInstance(instanceArgs);
+
+        VulkanDeviceRequirements requirements;
+        requirements.preferredFeatures.samplerAnisotropy = VK_TRUE;
+        const auto& devices = instance.enumeratePhysicalDevices();
+        if (devices.empty())
+        {
+            throw std::runtime_error("Physical Devices not found.");
+        }
+        physicalDevice = devices.at(VulkanInstance::selectPhysicalDevice(devices, requirements, options.device));
+        uint32_t queueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        for (size_t i = 0; i < physicalDevice.queueFamilies.size(); i++) {
+            if (physicalDevice.queueFamilies[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+                queueFamilyIndex = (uint32_t)i;
+                break;
+            }
+        }
+        if (queueFamilyIndex == VK_QUEUE_FAMILY_IGNORED)
+        {
+            throw std::runtime_error("Selected device has no graphics queue family.");
+        }
+        VulkanLogicalDeviceArgs logicalDeviceArgs;
+        logicalDeviceArgs.queueFamilyIndex = queueFamilyIndex;
+        logicalDeviceArgs.features.samplerAnisotropy = physicalDevice.features.samplerAnisotropy;
+        logicalDevice = physicalDevice.createLogicalDevice(logicalDeviceArgs);
+        allocator.init(logicalDevice);
+        uploader.init(logicalDevice);
+        textures.init(logicalDevice, allocator, uploader, physicalDevice.props.limits.maxSamplerAnisotropy);
+
+        VulkanReplayArgs replayArgs;
+        replayArgs.paced = options.paced;
+        replay.init(logicalDevice, uploader, textures, replayArgs);
+        replay.load(options.replayPath);
+        if (options.logLevel >= LogLevel::Info) {
+            std::cout << "Replay: " << options.replayPath << " on " << physicalDevice.props.deviceName
+                << (options.paced ? ", paced" : ", as fast as possible") << '\n';
+        }
+        VulkanReplayStats stats = replay.run();
+
+        if (options.logLevel >= LogLevel::Info) {
+            std::cout << tab(1) << "frames: " << stats.frames << ", draws: " << stats.draws
+                << ", skipped draws: " << stats.skippedDraws << '\n';
+            std::cout << tab(1) << "recorded: " << stats.recordedSeconds << " s, replayed: " << stats.seconds << " s, "
+                << (stats.seconds > 0.0 ? stats.frames / stats.seconds : 0.0) << " frames/s" << '\n';
+            std::cout << tab(1) << "frame interval ms: min " << stats.intervalMin << ", avg " << stats.intervalAverage
+                << ", p99 " << stats.intervalP99 << ", max " << stats.intervalMax << '\n';
+            std::cout << tab(1) << "cpu per frame ms: " << stats.cpuAverage << '\n';
+        }
+        quit();
+        if (!options.tracePath.empty()) {
+            VulkanProfiler::instance().stop();
+            std::ofstream trace(options.tracePath);
+            VulkanProfiler::instance().writeChromeTrace(trace);
+        }
+        return 0;
+    }
+    catch (const std::exception& e) {
+        quit();
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+}
+
 int main(int argc, char** argv) {
     VulkanApp app;
+    if (const char* device = getenv("VKAPPS_DEVICE")) {
+        app.options.device = device;
+    }
+    auto parseLogLevel = [](const std::string& level) {
+        if (level == "quiet")
+            return LogLevel::Quiet;
+        if (level == "verbose")
+            return LogLevel::Verbose;
+        return LogLevel::Info;
+    };
+    if (const char* level = getenv("VKAPPS_LOG")) {
+        app.options.logLevel = parseLogLevel(level);
+    }
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--capture" && i + 1 < argc) {
+            app.options.captureDir = argv[++i];
+        }
+        else if (arg.rfind("--capture=", 0) == 0) {
+            app.options.captureDir = arg.substr(strlen("--capture="));
+        }
+        else if (arg == "--device" && i + 1 < argc) {
+            app.options.device = argv[++i];
+        }
+        else if (arg.rfind("--device=", 0) == 0) {
+            app.options.device = arg.substr(strlen("--device="));
+        }
+        else if (arg == "--latency" && i + 1 < argc) {
+            std::string policy = argv[++i];
+            if (policy == "low-latency")
+                app.options.latency = VulkanLatencyPolicy::LowLatency;
+            else if (policy == "power-save")
+                app.options.latency = VulkanLatencyPolicy::PowerSave;
+            else
+                app.options.latency = VulkanLatencyPolicy::Throughput;
+        }
+        else if (arg == "--log" && i + 1 < argc) {
+            app.options.logLevel = parseLogLevel(argv[++i]);
+        }
+        else if (arg.rfind("--log=", 0) == 0) {
+            app.options.logLevel = parseLogLevel(arg.substr(strlen("--log=")));
+        }
+        else if (arg == "--threads" && i + 1 < argc) {
+            app.options.threads = (uint32_t)atoi(argv[++i]);
+        }
+        else if (arg == "--msaa" && i + 1 < argc) {
+            app.options.msaa = (uint32_t)atoi(argv[++i]);
+        }
+        else if (arg == "--sprites" && i + 1 < argc) {
+            app.options.sprites = (uint32_t)atoi(argv[++i]);
+        }
+        else if (arg == "--meshlets" && i + 1 < argc) {
+            app.options.meshlets = (uint32_t)atoi(argv[++i]);
+        }
+        else if (arg == "--particles" && i + 1 < argc) {
+            app.options.particles = (uint32_t)atoi(argv[++i]);
+        }
+        else if (arg == "--windows" && i + 1 < argc) {
+            app.options.windows = (uint32_t)atoi(argv[++i]);
+        }
+        else if (arg == "--batch" && i + 1 < argc) {
+            app.options.batchFrames = (uint64_t)atoll(argv[++i]);
+        }
+        else if (arg == "--tiles" && i + 1 < argc) {
+            // COLUMNSxROWS
+            unsigned columns = 1, rows = 1;
+            sscanf(argv[++i], "%ux%u", &columns, &rows);
+            app.options.tilesX = columns;
+            app.options.tilesY = rows;
+        }
+        else if (arg == "--record" && i + 1 < argc) {
+            app.options.recordPath = argv[++i];
+        }
+        else if (arg == "--record-frames" && i + 1 < argc) {
+            app.options.recordFrames = (uint32_t)atoi(argv[++i]);
+        }
+        else if (arg == "--replay" && i + 1 < argc) {
+            app.options.replayPath = argv[++i];
+        }
+        else if (arg == "--paced") {
+            app.options.paced = true;
+        }
+        else if (arg == "--no-post") {
+            app.options.post = false;
+        }
+        else if (arg == "--render-pass") {
+            app.options.renderPass = true;
+        }
+        else if (arg == "--trace" && i + 1 < argc) {
+            app.options.tracePath = argv[++i];
+        }
+        else if (arg.rfind("--trace=", 0) == 0) {
+            app.options.tracePath = arg.substr(strlen("--trace="));
+        }
+        else if (arg == "--pack" && i + 1 < argc) {
+            app.options.packPath = argv[++i];
+        }
+        else if (arg.rfind("--pack=", 0) == 0) {
+            app.options.packPath = arg.substr(strlen("--pack="));
+        }
+    }
+
+    if (app.options.batchFrames > 0) {
+        return runBatch(app.options);
+    }
+    if (!app.options.replayPath.empty()) {
+        return runReplay(app.options);
+    }
     try {
         app.init();
         app.exec();
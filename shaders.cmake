@@ -0,0 +1,79 @@
+set(_SHADER_DIR "${_SOURCE_DIR}/shaders")
+set(_SHADER_OUTPUT_DIR "${_BINARY_DIR}/shaders")
+set(_SHADER_TARGET_ENV "vulkan1.1" CACHE STRING "glslang --target-env for all shaders, 1.1 for subgroup operations")
+
+message("============================================================================")
+message("_SHADER_DIR = ${_SHADER_DIR}")
+message("_SHADER_OUTPUT_DIR = ${_SHADER_OUTPUT_DIR}")
+
+find_program(_GLSLANG_VALIDATOR glslangValidator
+        HINTS "$ENV{VULKAN_SDK_PATH}/macOS/bin" "$ENV{VULKAN_SDK}/bin"
+        REQUIRED
+)
+find_program(_SPIRV_OPT spirv-opt
+        HINTS "$ENV{VULKAN_SDK_PATH}/macOS/bin" "$ENV{VULKAN_SDK}/bin"
+)
+
+message("_GLSLANG_VALIDATOR = ${_GLSLANG_VALIDATOR}")
+message("_SPIRV_OPT = ${_SPIRV_OPT}")
+
+file(GLOB _SHADER_SOURCES
+        "${_SHADER_DIR}/*.glsl"
+)
+
+# shared code, pulled in with GL_GOOGLE_include_directive
+file(GLOB _SHADER_INCLUDES
+        "${_SHADER_DIR}/*.inc"
+)
+
+file(MAKE_DIRECTORY "${_SHADER_OUTPUT_DIR}")
+
+# shader.vert.glsl -> shader.vert.spv -> shader.vert.h (constexpr uint32_t shader_vert_spv[])
+set(_SHADER_HEADERS "")
+foreach(_SHADER_SOURCE ${_SHADER_SOURCES})
+    get_filename_component(_SHADER_NAME "${_SHADER_SOURCE}" NAME)
+    string(REGEX REPLACE "\\.glsl$" "" _SHADER_BASE "${_SHADER_NAME}")
+    string(REGEX REPLACE "^.*\\." "" _SHADER_STAGE "${_SHADER_BASE}")
+    string(REGEX REPLACE "[^A-Za-z0-9]" "_" _SHADER_SYMBOL "${_SHADER_BASE}_spv")
+
+    # VK_EXT_mesh_shader needs SPIR-V 1.4, and GL_EXT_mesh_shader glslang from SDK 1.3.226
+    set(_SHADER_ENV ${_SHADER_TARGET_ENV})
+    if(_SHADER_STAGE STREQUAL "task" OR _SHADER_STAGE STREQUAL "mesh")
+        set(_SHADER_ENV "vulkan1.2")
+    endif()
+
+    set(_SHADER_SPV "${_SHADER_OUTPUT_DIR}/${_SHADER_BASE}.spv")
+    set(_SHADER_HEADER "${_SHADER_OUTPUT_DIR}/${_SHADER_BASE}.h")
+
+    if(_SPIRV_OPT)
+        set(_SHADER_COMMANDS
+                COMMAND "${_GLSLANG_VALIDATOR}" -V --target-env ${_SHADER_ENV}
+                        -S ${_SHADER_STAGE} "${_SHADER_SOURCE}" -o "${_SHADER_SPV}.raw"
+                COMMAND "${_SPIRV_OPT}" -O --strip-debug "${_SHADER_SPV}.raw" -o "${_SHADER_SPV}"
+        )
+    else()
+        set(_SHADER_COMMANDS
+                COMMAND "${_GLSLANG_VALIDATOR}" -V --target-env ${_SHADER_ENV}
+                        -S ${_SHADER_STAGE} "${_SHADER_SOURCE}" -o "${_SHADER_SPV}"
+        )
+    endif()
+
+    add_custom_command(
+            OUTPUT "${_SHADER_HEADER}"
+            ${_SHADER_COMMANDS}
+            COMMAND "${CMAKE_COMMAND}"
+                    -DINPUT=${_SHADER_SPV}
+                    -DOUTPUT=${_SHADER_HEADER}
+                    -DSYMBOL=${_SHADER_SYMBOL}
+                    -DSOURCE=${_SHADER_NAME}
+                    -P "${_SHADER_DIR}/spv2h.cmake"
+            DEPENDS "${_SHADER_SOURCE}" ${_SHADER_INCLUDES} "${_SHADER_DIR}/spv2h.cmake"
+            COMMENT "Compiling shader ${_SHADER_NAME}"
+            VERBATIM
+    )
+    list(APPEND _SHADER_HEADERS "${_SHADER_HEADER}")
+endforeach()
+
+message("_SHADER_HEADERS = ${_SHADER_HEADERS}")
+
+add_custom_target(shaders DEPENDS ${_SHADER_HEADERS})
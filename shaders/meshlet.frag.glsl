@@ -0,0 +1,18 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// Meshlet meshes have positions only: faceted shading from the screen-space
+// derivatives of the world position.
+
+layout(location = 0) in vec3 worldPosition;
+
+layout(location = 0) out vec4 outColor;
+
+const vec3 lightDirection = vec3(0.4, 0.8, 0.45);
+
+void main() {
+    // y down: dFdy x dFdx points towards the eye on front faces.
+    vec3 normal = normalize(cross(dFdy(worldPosition), dFdx(worldPosition)));
+    float diffuse = max(dot(normal, normalize(lightDirection)), 0.0);
+    outColor = vec4(vec3(0.8, 0.75, 0.7) * (0.15 + 0.85 * diffuse), 1.0);
+}
@@ -0,0 +1,66 @@
+#version 460
+#extension GL_EXT_mesh_shader : require
+#extension GL_GOOGLE_include_directive : require
+
+// One workgroup per visible cluster. Triangles that face away or fall between
+// pixel centers are culled per primitive, the rasterizer never sees them.
+
+layout(local_size_x = 32) in;
+layout(triangles, max_vertices = 64, max_primitives = 124) out;
+
+#include "meshlet.inc"
+
+struct Payload {
+    uint instance;
+    uint meshlets[32];
+};
+
+taskPayloadSharedEXT Payload payload;
+
+layout(location = 0) out vec3 worldPosition[];
+
+shared vec3 screen[64];     // xy: pixels, z: 1 when behind the eye
+
+void main() {
+    Meshlet meshlet = meshlets[payload.meshlets[gl_WorkGroupID.x]];
+    Instance instance = instances[payload.instance];
+    View view = views[params.slot];
+    SetMeshOutputsEXT(meshlet.vertexCount, meshlet.triangleCount);
+
+    for (uint i = gl_LocalInvocationIndex; i < meshlet.vertexCount; i += 32) {
+        vec4 world = instance.model * vec4(vertexPosition(meshletVertices[meshlet.vertexOffset + i]), 1.0);
+        vec4 clip = view.viewProj * world;
+        gl_MeshVerticesEXT[i].gl_Position = clip;
+        worldPosition[i] = world.xyz;
+        screen[i] = clip.w > 0.0 ?
+            vec3((clip.xy / clip.w * 0.5 + 0.5) * view.viewport, 0.0) : vec3(0.0, 0.0, 1.0);
+    }
+    barrier();
+
+    for (uint i = gl_LocalInvocationIndex; i < meshlet.triangleCount; i += 32) {
+        uint triangle = meshletTriangles[meshlet.triangleOffset + i];
+        uvec3 corners = uvec3(triangle & 0xffu, (triangle >> 8) & 0xffu, (triangle >> 16) & 0xffu);
+        gl_PrimitiveTriangleIndicesEXT[i] = corners;
+
+        vec3 a = screen[corners.x];
+        vec3 b = screen[corners.y];
+        vec3 c = screen[corners.z];
+        bool culled = false;
+        // crossing the eye plane: leave it to the clipper.
+        if (a.z + b.z + c.z == 0.0) {
+            vec2 ab = b.xy - a.xy;
+            vec2 ac = c.xy - a.xy;
+            // front faces are clockwise on screen, y down.
+            culled = ab.x * ac.y - ab.y * ac.x <= 0.0;
+
+            vec2 lo = min(a.xy, min(b.xy, c.xy));
+            vec2 hi = max(a.xy, max(b.xy, c.xy));
+            culled = culled || any(lessThan(hi, vec2(0.0))) || any(greaterThan(lo, view.viewport));
+            // no pixel center inside the bounds.
+            if ((view.flags & VIEW_SMALL_TRIANGLES) != 0u) {
+                culled = culled || any(greaterThan(ceil(lo - 0.5), floor(hi - 0.5)));
+            }
+        }
+        gl_MeshPrimitivesEXT[i].gl_CullPrimitiveEXT = culled;
+    }
+}
@@ -0,0 +1,37 @@
+#version 460
+#extension GL_EXT_mesh_shader : require
+#extension GL_GOOGLE_include_directive : require
+
+// One invocation per cluster of one instance (gl_WorkGroupID.y). Survivors are
+// compacted in shared memory and get one mesh workgroup each.
+
+layout(local_size_x = 32) in;
+
+#include "meshlet.inc"
+
+struct Payload {
+    uint instance;
+    uint meshlets[32];
+};
+
+taskPayloadSharedEXT Payload payload;
+
+shared uint visibleCount;
+
+void main() {
+    if (gl_LocalInvocationIndex == 0) {
+        visibleCount = 0;
+    }
+    barrier();
+
+    uint index = gl_GlobalInvocationID.x;
+    uint instanceIndex = params.firstInstance + gl_WorkGroupID.y;
+    if (index < params.meshletCount &&
+        clusterVisible(meshlets[index], instances[instanceIndex], views[params.slot])) {
+        payload.meshlets[atomicAdd(visibleCount, 1)] = index;
+    }
+    payload.instance = instanceIndex;
+    barrier();
+
+    EmitMeshTasksEXT(visibleCount, 1, 1);
+}
@@ -0,0 +1,22 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
+
+// Without mesh shaders: one indexed draw per visible cluster from
+// meshlet_cull.comp.glsl, the instance in firstInstance, vertices pulled from
+// the storage buffer.
+
+#include "meshlet.inc"
+
+out gl_PerVertex {
+    vec4 gl_Position;
+};
+
+layout(location = 0) out vec3 worldPosition;
+
+void main() {
+    Instance instance = instances[gl_InstanceIndex];
+    vec4 world = instance.model * vec4(vertexPosition(gl_VertexIndex), 1.0);
+    gl_Position = views[params.slot].viewProj * world;
+    worldPosition = world.xyz;
+}
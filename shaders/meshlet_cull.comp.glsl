@@ -0,0 +1,44 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
+
+// Without mesh shaders: one invocation per cluster of one instance
+// (gl_WorkGroupID.y); visible ones append an indexed draw of their triangles
+// for draw-indirect-count. Counts were cleared by the renderer.
+
+layout(local_size_x = 64) in;
+
+#include "meshlet.inc"
+
+struct DrawCommand {
+    uint indexCount;
+    uint instanceCount;
+    uint firstIndex;
+    int vertexOffset;
+    uint firstInstance;
+};
+
+layout(std430, binding = 6) writeonly buffer Draws {
+    DrawCommand draws[];
+};
+layout(std430, binding = 7) buffer Counts {
+    uint counts[];
+};
+
+void main() {
+    uint index = gl_GlobalInvocationID.x;
+    uint instanceIndex = params.firstInstance + gl_WorkGroupID.y;
+    if (index >= params.meshletCount) {
+        return;
+    }
+    Meshlet meshlet = meshlets[index];
+    if (!clusterVisible(meshlet, instances[instanceIndex], views[params.slot])) {
+        return;
+    }
+
+    uint slot = atomicAdd(counts[params.batch], 1);
+    if (slot < params.drawCount) {
+        draws[params.firstDraw + slot] = DrawCommand(meshlet.triangleCount * 3, 1,
+            meshlet.triangleOffset * 3, 0, instanceIndex);
+    }
+}
@@ -0,0 +1,27 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// Fallback mip generation for formats that cannot be blitted.
+// Writes level N+1 as the 2x2 box filter of level N.
+
+layout(local_size_x = 8, local_size_y = 8) in;
+
+layout(binding = 0) uniform sampler2D src;
+layout(binding = 1) uniform writeonly image2D dst;
+
+void main() {
+    ivec2 p = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 dstSize = imageSize(dst);
+    if (p.x >= dstSize.x || p.y >= dstSize.y) {
+        return;
+    }
+
+    ivec2 srcMax = textureSize(src, 0) - 1;
+    ivec2 s = p * 2;
+    vec4 color =
+        texelFetch(src, min(s, srcMax), 0) +
+        texelFetch(src, min(s + ivec2(1, 0), srcMax), 0) +
+        texelFetch(src, min(s + ivec2(0, 1), srcMax), 0) +
+        texelFetch(src, min(s + ivec2(1, 1), srcMax), 0);
+    imageStore(dst, p, color * 0.25);
+}
@@ -0,0 +1,36 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
+
+// One instance per alive particle, in list order: a quad facing the camera.
+
+#define PARTICLE_ACCESS readonly
+#include "particle.inc"
+
+out gl_PerVertex {
+    vec4 gl_Position;
+};
+
+layout(location = 0) out vec2 fragCorner;
+layout(location = 1) out vec4 fragColor;
+
+const vec2 corners[6] = vec2[](
+    vec2(-1.0, -1.0),
+    vec2(1.0, -1.0),
+    vec2(1.0, 1.0),
+    vec2(1.0, 1.0),
+    vec2(-1.0, 1.0),
+    vec2(-1.0, -1.0)
+);
+
+void main() {
+    uint index = entries[params.list * frames[params.slot].capacity + gl_InstanceIndex].y;
+    Particle p = particles[index];
+    float age = clamp(1.0 - p.life / p.lifetime, 0.0, 1.0);
+    float size = mix(p.sizeStart, p.sizeEnd, age);
+    vec2 corner = corners[gl_VertexIndex];
+    vec3 world = p.position + (frames[params.slot].right.xyz * corner.x + frames[params.slot].up.xyz * corner.y) * size;
+    gl_Position = frames[params.slot].viewProj * vec4(world, 1.0);
+    fragCorner = corner;
+    fragColor = mix(unpackUnorm4x8(p.colorStart), unpackUnorm4x8(p.colorEnd), age);
+}
@@ -0,0 +1,34 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
+
+// Turns counts into indirect arguments, so the CPU never needs them.
+// k = 0, before the simulation: its dispatch size, and the list it compacts
+// into is emptied. k = 1, after it: sort size and the draw's instance count.
+
+layout(local_size_x = 1) in;
+
+#include "particle.inc"
+
+void main() {
+    uint next = params.list ^ 1u;
+    if (params.k == 0u) {
+        counters.simulateArgs[0] = (counters.aliveCount[params.list] + 255u) / 256u;
+        counters.simulateArgs[1] = 1u;
+        counters.simulateArgs[2] = 1u;
+        counters.aliveCount[next] = 0u;
+        return;
+    }
+
+    uint alive = counters.aliveCount[next];
+    uint sortCount = alive > SORT_BLOCK ? 1u << (findMSB(alive - 1u) + 1) : SORT_BLOCK;
+    counters.sortCount = sortCount;
+    // one workgroup per block of keys, in both sort shaders.
+    counters.sortArgs[0] = sortCount / SORT_BLOCK;
+    counters.sortArgs[1] = 1u;
+    counters.sortArgs[2] = 1u;
+    counters.drawArgs[0] = 6u;
+    counters.drawArgs[1] = alive;
+    counters.drawArgs[2] = 0u;
+    counters.drawArgs[3] = 0u;
+}
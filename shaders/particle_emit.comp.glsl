@@ -0,0 +1,68 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
+
+// One invocation per particle emitted this frame: pops a free slot off the
+// dead list, initializes it from its emitter and appends it to the alive list
+// the simulation reads next. Nothing is emitted once every slot is alive.
+
+layout(local_size_x = 256) in;
+
+#include "particle.inc"
+
+uint hash(uint x) {
+    uint state = x * 747796405u + 2891336453u;
+    uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+float random(inout uint state) {
+    state = hash(state);
+    return float(state >> 8) / 16777216.0;
+}
+
+void main() {
+    uint id = gl_GlobalInvocationID.x;
+    if (id >= frames[params.slot].emitCount) {
+        return;
+    }
+    uint e = 0;
+    for (uint i = 1; i < frames[params.slot].emitterCount; i++) {
+        if (id >= frames[params.slot].emitters[i].first) {
+            e = i;
+        }
+    }
+
+    int top = atomicAdd(counters.deadCount, -1);
+    if (top <= 0) {
+        atomicAdd(counters.deadCount, 1);
+        return;
+    }
+    uint index = deadList[top - 1];
+
+    Emitter emitter = frames[params.slot].emitters[e];
+    uint rng = hash(id ^ frames[params.slot].seed);
+
+    // uniform in the spawn sphere.
+    float z = random(rng) * 2.0 - 1.0;
+    float a = random(rng) * 6.2831853;
+    vec3 onSphere = vec3(sqrt(1.0 - z * z) * vec2(cos(a), sin(a)), z);
+    vec3 position = emitter.positionRadius.xyz + onSphere * emitter.positionRadius.w * pow(random(rng), 1.0 / 3.0);
+
+    // uniform in the cone around the direction.
+    vec3 axis = emitter.directionSpread.xyz;
+    vec3 tangent = normalize(cross(abs(axis.y) < 0.99 ? vec3(0.0, 1.0, 0.0) : vec3(1.0, 0.0, 0.0), axis));
+    vec3 bitangent = cross(axis, tangent);
+    float cosTheta = mix(1.0, cos(emitter.directionSpread.w), random(rng));
+    float sinTheta = sqrt(max(1.0 - cosTheta * cosTheta, 0.0));
+    float phi = random(rng) * 6.2831853;
+    vec3 direction = (tangent * cos(phi) + bitangent * sin(phi)) * sinTheta + axis * cosTheta;
+
+    float speed = mix(emitter.speedLife.x, emitter.speedLife.y, random(rng));
+    float life = mix(emitter.speedLife.z, emitter.speedLife.w, random(rng));
+    particles[index] = Particle(position, life, direction * speed, life,
+        emitter.colorStart, emitter.colorEnd, emitter.size.x, emitter.size.y);
+
+    uint slot = atomicAdd(counters.aliveCount[params.list], 1u);
+    entries[params.list * frames[params.slot].capacity + slot] = uvec2(0u, index);
+}
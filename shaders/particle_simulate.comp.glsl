@@ -0,0 +1,72 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
+
+// One invocation per alive particle: integrates it, then compacts the
+// survivors into the other list with their distance to the eye as sort key and
+// returns the dead to the dead list. Slots are reserved per workgroup, one
+// global atomic per list.
+
+layout(local_size_x = 256) in;
+
+#include "particle.inc"
+
+shared uint groupAlive;
+shared uint groupDead;
+shared uint aliveBase;
+shared int deadBase;
+
+void main() {
+    if (gl_LocalInvocationIndex == 0) {
+        groupAlive = 0;
+        groupDead = 0;
+    }
+    barrier();
+
+    uint i = gl_GlobalInvocationID.x;
+    uint capacity = frames[params.slot].capacity;
+    bool valid = i < counters.aliveCount[params.list];
+    uint index = 0;
+    bool alive = false;
+    uint local = 0;
+    float eyeDistance = 0.0;
+    if (valid) {
+        index = entries[params.list * capacity + i].y;
+        Particle p = particles[index];
+        float dt = frames[params.slot].dt;
+        vec4 gravity = frames[params.slot].gravity;
+        p.velocity = (p.velocity + gravity.xyz * dt) * max(1.0 - gravity.w * dt, 0.0);
+        p.position += p.velocity * dt;
+        p.life -= dt;
+        alive = p.life > 0.0;
+        if (alive) {
+            particles[index].position = p.position;
+            particles[index].velocity = p.velocity;
+            particles[index].life = p.life;
+            eyeDistance = length(p.position - frames[params.slot].eye.xyz);
+            local = atomicAdd(groupAlive, 1u);
+        }
+        else {
+            local = atomicAdd(groupDead, 1u);
+        }
+    }
+    barrier();
+
+    if (gl_LocalInvocationIndex == 0) {
+        aliveBase = atomicAdd(counters.aliveCount[params.list ^ 1u], groupAlive);
+        deadBase = atomicAdd(counters.deadCount, int(groupDead));
+    }
+    barrier();
+
+    if (!valid) {
+        return;
+    }
+    if (alive) {
+        // ascending keys: farthest first. Never the sentinel.
+        uint key = min(~floatBitsToUint(eyeDistance), SORT_SENTINEL - 1u);
+        entries[(params.list ^ 1u) * capacity + aliveBase + local] = uvec2(key, index);
+    }
+    else {
+        deadList[uint(deadBase) + local] = index;
+    }
+}
@@ -0,0 +1,26 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
+
+// One bitonic sort step wider than a block: step j of stage k, one pair of
+// keys per invocation, in global memory.
+
+layout(local_size_x = 512) in;
+
+#include "particle.inc"
+
+void main() {
+    if (params.k > counters.sortCount) {
+        return;
+    }
+    uint t = gl_GlobalInvocationID.x;
+    uint i = 2u * params.j * (t / params.j) + t % params.j;
+    uint listBase = params.list * frames[params.slot].capacity;
+    uvec2 a = entries[listBase + i];
+    uvec2 b = entries[listBase + i + params.j];
+    bool ascending = (i & params.k) == 0u;
+    if ((a.x > b.x) == ascending) {
+        entries[listBase + i] = b;
+        entries[listBase + i + params.j] = a;
+    }
+}
@@ -0,0 +1,60 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
+
+// Bitonic sort steps that stay within a block of 1024 keys, in shared memory.
+// k = 0: sorts each block, alternating directions, and pads the list past the
+// alive count with sentinels. Otherwise: the steps j..1 of stage k, after the
+// wider ones ran in particle_sort.comp.glsl.
+
+layout(local_size_x = 512) in;
+
+#include "particle.inc"
+
+shared uvec2 keys[SORT_BLOCK];
+
+void compareSwap(uint base, uint k, uint j) {
+    uint t = gl_LocalInvocationIndex;
+    uint i = 2u * j * (t / j) + t % j;
+    uvec2 a = keys[i];
+    uvec2 b = keys[i + j];
+    bool ascending = ((base + i) & k) == 0u;
+    if ((a.x > b.x) == ascending) {
+        keys[i] = b;
+        keys[i + j] = a;
+    }
+}
+
+void main() {
+    // stages past the padded alive count: nothing to merge.
+    if (params.k > counters.sortCount) {
+        return;
+    }
+    uint base = gl_WorkGroupID.x * SORT_BLOCK;
+    uint listBase = params.list * frames[params.slot].capacity;
+    uint alive = counters.aliveCount[params.list];
+    for (uint e = gl_LocalInvocationIndex; e < SORT_BLOCK; e += 512u) {
+        uint g = base + e;
+        keys[e] = params.k != 0u || g < alive ? entries[listBase + g] : uvec2(SORT_SENTINEL, 0u);
+    }
+    barrier();
+
+    if (params.k == 0u) {
+        for (uint k = 2u; k <= SORT_BLOCK; k <<= 1) {
+            for (uint j = k >> 1; j > 0u; j >>= 1) {
+                compareSwap(base, k, j);
+                barrier();
+            }
+        }
+    }
+    else {
+        for (uint j = params.j; j > 0u; j >>= 1) {
+            compareSwap(base, params.k, j);
+            barrier();
+        }
+    }
+
+    for (uint e = gl_LocalInvocationIndex; e < SORT_BLOCK; e += 512u) {
+        entries[listBase + base + e] = keys[e];
+    }
+}
@@ -0,0 +1,102 @@
+#version 450
+#extension GL_KHR_shader_subgroup_basic : enable
+#extension GL_KHR_shader_subgroup_ballot : enable
+
+// Bloom downsample. Four bilinear taps around the destination texel cover a
+// 4x4 source footprint. The first pass reads the HDR scene: it keeps what is
+// brighter than the threshold and bins the luminance of every 2x2 block into
+// the exposure histogram, so the scene is read once for both.
+
+layout(local_size_x = 8, local_size_y = 8) in;
+
+layout(binding = 0) uniform sampler2D src;
+layout(binding = 1) uniform writeonly image2D dst;
+layout(std430, binding = 2) buffer Luminance {
+    float exposure;
+    float averageLuminance;
+    uint pixelCount;
+    uint pad;
+    uint bins[256];
+} luminance;
+
+layout(push_constant) uniform Params {
+    vec2 srcTexel;      // 1 / size of the source level
+    float srcLod;
+    uint prefilter;     // first pass: threshold and histogram
+    float threshold;
+    float knee;
+    float minLogLuminance;
+    float invLogRange;
+} params;
+
+shared uint localBins[256];
+
+uint binOf(float lum) {
+    if (lum < 1e-5) {
+        return 0u;
+    }
+    float t = clamp((log2(lum) - params.minLogLuminance) * params.invLogRange, 0.0, 1.0);
+    return 1u + uint(t * 254.0);
+}
+
+void main() {
+    const uint GROUP_SIZE = gl_WorkGroupSize.x * gl_WorkGroupSize.y;
+    bool histogram = params.prefilter != 0u;
+    if (histogram) {
+        for (uint i = gl_LocalInvocationIndex; i < 256u; i += GROUP_SIZE) {
+            localBins[i] = 0u;
+        }
+        barrier();
+    }
+
+    ivec2 p = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 dstSize = imageSize(dst);
+    bool inside = p.x < dstSize.x && p.y < dstSize.y;
+
+    vec3 color = vec3(0.0);
+    if (inside) {
+        vec2 uv = (vec2(p) + 0.5) / vec2(dstSize);
+        vec2 d = params.srcTexel;
+        color = 0.25 * (
+            textureLod(src, uv + vec2(-d.x, -d.y), params.srcLod).rgb +
+            textureLod(src, uv + vec2( d.x, -d.y), params.srcLod).rgb +
+            textureLod(src, uv + vec2(-d.x,  d.y), params.srcLod).rgb +
+            textureLod(src, uv + vec2( d.x,  d.y), params.srcLod).rgb);
+    }
+
+    if (histogram) {
+        // neighbouring texels mostly share a bin: one shared atomic per
+        // distinct bin in the subgroup instead of one per invocation.
+        if (inside) {
+            uint bin = binOf(dot(color, vec3(0.2126, 0.7152, 0.0722)));
+            for (;;) {
+                uint first = subgroupBroadcastFirst(bin);
+                if (bin == first) {
+                    uint count = subgroupBallotBitCount(subgroupBallot(true));
+                    if (subgroupElect()) {
+                        atomicAdd(localBins[first], count);
+                    }
+                    break;
+                }
+            }
+        }
+        barrier();
+        for (uint i = gl_LocalInvocationIndex; i < 256u; i += GROUP_SIZE) {
+            if (localBins[i] != 0u) {
+                atomicAdd(luminance.bins[i], localBins[i]);
+            }
+        }
+
+        // soft knee: the previous frame's exposure keeps the threshold in
+        // display terms.
+        float exposure = luminance.exposure > 0.0 ? luminance.exposure : 1.0;
+        float brightness = max(color.r, max(color.g, color.b)) * exposure;
+        float soft = clamp(brightness - params.threshold + params.knee, 0.0, 2.0 * params.knee);
+        soft = soft * soft / (4.0 * params.knee + 1e-5);
+        color *= max(soft, brightness - params.threshold) / max(brightness, 1e-5);
+    }
+
+    if (inside) {
+        imageStore(dst, p, vec4(color, 1.0));
+    }
+}
@@ -0,0 +1,42 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// Bloom upsample: the next smaller level through a 3x3 tent of bilinear taps,
+// added to this level's downsampled value and written back over it.
+
+layout(local_size_x = 8, local_size_y = 8) in;
+
+layout(binding = 0) uniform sampler2D chain;
+layout(binding = 1) uniform writeonly image2D dst;
+
+layout(push_constant) uniform Params {
+    vec2 srcTexel;      // 1 / size of level `dstLod + 1`
+    float dstLod;
+    float radius;       // tent spacing in source texels
+} params;
+
+void main() {
+    ivec2 p = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 dstSize = imageSize(dst);
+    if (p.x >= dstSize.x || p.y >= dstSize.y) {
+        return;
+    }
+
+    vec2 uv = (vec2(p) + 0.5) / vec2(dstSize);
+    vec2 d = params.srcTexel * params.radius;
+    float srcLod = params.dstLod + 1.0;
+    vec3 up =
+        textureLod(chain, uv + vec2(-d.x, -d.y), srcLod).rgb +
+        textureLod(chain, uv + vec2( 0.0, -d.y), srcLod).rgb * 2.0 +
+        textureLod(chain, uv + vec2( d.x, -d.y), srcLod).rgb +
+        textureLod(chain, uv + vec2(-d.x,  0.0), srcLod).rgb * 2.0 +
+        textureLod(chain, uv, srcLod).rgb * 4.0 +
+        textureLod(chain, uv + vec2( d.x,  0.0), srcLod).rgb * 2.0 +
+        textureLod(chain, uv + vec2(-d.x,  d.y), srcLod).rgb +
+        textureLod(chain, uv + vec2( 0.0,  d.y), srcLod).rgb * 2.0 +
+        textureLod(chain, uv + vec2( d.x,  d.y), srcLod).rgb;
+
+    // each invocation reads its own texel before overwriting it.
+    vec3 down = texelFetch(chain, p, int(params.dstLod)).rgb;
+    imageStore(dst, p, vec4(down + up / 16.0, 1.0));
+}
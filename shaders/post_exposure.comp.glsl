@@ -0,0 +1,64 @@
+#version 450
+#extension GL_KHR_shader_subgroup_basic : enable
+#extension GL_KHR_shader_subgroup_arithmetic : enable
+
+// Average log luminance from the histogram, one invocation per bin: reduced
+// within subgroups first, then across them through shared memory. Moves the
+// exposure towards the value that maps the average to `key`, and clears the
+// histogram for the next frame.
+
+layout(local_size_x = 256) in;
+
+layout(std430, binding = 0) buffer Luminance {
+    float exposure;
+    float averageLuminance;
+    uint pixelCount;
+    uint pad;
+    uint bins[256];
+} luminance;
+
+layout(push_constant) uniform Params {
+    float minLogLuminance;
+    float logRange;
+    float adaptation;   // fraction of the way to the target per frame
+    float key;
+} params;
+
+shared float partialLog[256];
+shared uint partialCount[256];
+
+void main() {
+    uint bin = gl_LocalInvocationIndex;
+    uint count = luminance.bins[bin];
+    luminance.bins[bin] = 0u;
+
+    // bin 0 holds black pixels, which would drag the average to zero.
+    float logLum = params.minLogLuminance + (float(bin) - 0.5) / 254.0 * params.logRange;
+    float weighted = bin == 0u ? 0.0 : float(count) * logLum;
+    uint counted = bin == 0u ? 0u : count;
+
+    float sumLog = subgroupAdd(weighted);
+    uint sumCount = subgroupAdd(counted);
+    if (subgroupElect()) {
+        partialLog[gl_SubgroupID] = sumLog;
+        partialCount[gl_SubgroupID] = sumCount;
+    }
+    barrier();
+
+    if (bin == 0u) {
+        float totalLog = 0.0;
+        uint total = 0u;
+        for (uint i = 0u; i < gl_NumSubgroups; i++) {
+            totalLog += partialLog[i];
+            total += partialCount[i];
+        }
+        if (total > 0u) {
+            float average = exp2(totalLog / float(total));
+            float target = params.key / max(average, 1e-4);
+            float previous = luminance.exposure;
+            luminance.exposure = previous > 0.0 ? mix(previous, target, params.adaptation) : target;
+            luminance.averageLuminance = average;
+        }
+        luminance.pixelCount = total;
+    }
+}
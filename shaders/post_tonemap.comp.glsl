@@ -0,0 +1,56 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// Adds the bloom, applies the exposure and maps HDR to display range with the
+// ACES filmic fit. Writes the swapchain image directly when it allows storage,
+// otherwise an intermediate image that is blitted into it.
+
+layout(local_size_x = 8, local_size_y = 8) in;
+
+layout(binding = 0) uniform sampler2D scene;
+layout(binding = 1) uniform sampler2D bloom;
+layout(binding = 2) uniform writeonly image2D dst;
+layout(std430, binding = 3) readonly buffer Luminance {
+    float exposure;
+    float averageLuminance;
+    uint pixelCount;
+    uint pad;
+    uint bins[256];
+} luminance;
+
+layout(push_constant) uniform Params {
+    float bloomStrength;
+    uint encodeSrgb;    // the destination is UNORM but displayed as sRGB
+} params;
+
+vec3 aces(vec3 x) {
+    const float a = 2.51;
+    const float b = 0.03;
+    const float c = 2.43;
+    const float d = 0.59;
+    const float e = 0.14;
+    return clamp((x * (a * x + b)) / (x * (c * x + d) + e), 0.0, 1.0);
+}
+
+vec3 encodeSrgb(vec3 c) {
+    vec3 low = c * 12.92;
+    vec3 high = 1.055 * pow(c, vec3(1.0 / 2.4)) - 0.055;
+    return mix(high, low, lessThanEqual(c, vec3(0.0031308)));
+}
+
+void main() {
+    ivec2 p = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 size = imageSize(dst);
+    if (p.x >= size.x || p.y >= size.y) {
+        return;
+    }
+
+    vec2 uv = (vec2(p) + 0.5) / vec2(size);
+    vec3 color = texelFetch(scene, p, 0).rgb + textureLod(bloom, uv, 0.0).rgb * params.bloomStrength;
+    float exposure = luminance.exposure > 0.0 ? luminance.exposure : 1.0;
+    color = aces(color * exposure);
+    if (params.encodeSrgb != 0u) {
+        color = encodeSrgb(color);
+    }
+    imageStore(dst, p, vec4(color, 1.0));
+}
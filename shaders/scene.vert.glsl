@@ -0,0 +1,25 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// Pack meshes drawn from the render queue: one draw per VulkanDrawPacket, its
+// transform in firstInstance. Only the position at the start of each vertex is
+// read; shaded like the meshlets, by meshlet.frag.glsl.
+
+layout(location = 0) in vec3 inPosition;
+
+layout(std430, binding = 0) readonly buffer Transforms {
+    mat4 viewProj;
+    mat4 worlds[];      // VulkanScene::worldMatrices()
+};
+
+out gl_PerVertex {
+    vec4 gl_Position;
+};
+
+layout(location = 0) out vec3 worldPosition;
+
+void main() {
+    vec4 world = worlds[gl_InstanceIndex] * vec4(inPosition, 1.0);
+    gl_Position = viewProj * world;
+    worldPosition = world.xyz;
+}
@@ -1,6 +0,0 @@
-/Users/qilin/Documents/SDK/VulkanSDK/1.2.176.1/macOS/bin/glslangValidator \
-    -V shader.vert.glsl -o shader.vert.spv
-
-/Users/qilin/Documents/SDK/VulkanSDK/1.2.176.1/macOS/bin/glslangValidator \
-    -V shader.frag.glsl -o shader.frag.spv
-    
\ No newline at end of file
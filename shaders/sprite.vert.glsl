@@ -0,0 +1,37 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// one instance per sprite, see VulkanSprite.
+layout(location = 0) in vec4 inAxes;        // x axis, y axis of the unit quad, in pixels
+layout(location = 1) in vec2 inOrigin;      // center, in pixels
+layout(location = 2) in vec4 inUV;          // u0, v0, u1, v1
+layout(location = 3) in vec4 inColor;
+
+layout(push_constant) uniform PushConstants {
+    vec2 scale;     // pixels to NDC
+    vec2 offset;
+} pc;
+
+out gl_PerVertex {
+    vec4 gl_Position;
+};
+
+layout(location = 0) out vec2 fragUV;
+layout(location = 1) out vec4 fragColor;
+
+const vec2 corners[6] = vec2[](
+    vec2(-0.5, -0.5),
+    vec2(0.5, -0.5),
+    vec2(0.5, 0.5),
+    vec2(0.5, 0.5),
+    vec2(-0.5, 0.5),
+    vec2(-0.5, -0.5)
+);
+
+void main() {
+    vec2 corner = corners[gl_VertexIndex];
+    vec2 position = inOrigin + inAxes.xy * corner.x + inAxes.zw * corner.y;
+    gl_Position = vec4(position * pc.scale + pc.offset, 0.0, 1.0);
+    fragUV = mix(inUV.xy, inUV.zw, corner + 0.5);
+    fragColor = inColor;
+}
@@ -0,0 +1,30 @@
+# Usage: cmake -DINPUT=x.spv -DOUTPUT=x.h -DSYMBOL=x_spv -DSOURCE=x.glsl -P spv2h.cmake
+#
+# Embeds a SPIR-V binary as a constexpr uint32_t array. SPIR-V is a stream of
+# little-endian words, so every 4 bytes are swapped into one 0xDDCCBBAA literal.
+
+file(READ "${INPUT}" _HEX HEX)
+string(LENGTH "${_HEX}" _HEX_LENGTH)
+math(EXPR _REMAINDER "${_HEX_LENGTH} % 8")
+if(NOT _REMAINDER EQUAL 0)
+    message(FATAL_ERROR "${INPUT} is not a valid SPIR-V binary.")
+endif()
+
+string(REGEX REPLACE "(..)(..)(..)(..)" "0x\\4\\3\\2\\1," _WORDS "${_HEX}")
+string(REGEX REPLACE "(0x........,0x........,0x........,0x........,0x........,0x........,0x........,0x........,)" "\\1\n    " _WORDS "${_WORDS}")
+
+string(TOUPPER "_${SYMBOL}_H_" _GUARD)
+
+file(WRITE "${OUTPUT}"
+"// generated from ${SOURCE}, do not edit.
+#ifndef ${_GUARD}
+#define ${_GUARD}
+
+#include <cstdint>
+
+constexpr uint32_t ${SYMBOL}[] = {
+    ${_WORDS}
+};
+
+#endif//${_GUARD}
+")